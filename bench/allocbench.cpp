@@ -0,0 +1,121 @@
+/*
+
+    FPLIB: a library providing a fixed-point datatype.
+
+    Allocator benchmark: runs a bisection square-root loop
+    (see tests/main.cpp) with the heap, the size-class pool
+    and a per-iteration arena and reports the time spent.
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include "../src/fplib.h"
+
+using namespace fplib;
+
+enum Mode
+{
+    MODE_HEAP,
+    MODE_POOL,
+    MODE_ARENA
+};
+
+/** one bisection step; l and r are updated in-place so
+    their storage is never taken from an arena. */
+static void bisectionStep(SFix &l, SFix &r, SFix &c, uint32_t fbits)
+{
+    SFix m = r+l;
+    m = m.reinterpret(m.intBits()-1, m.fracBits()+1);   // divide by two
+    m = m.removeLSBs(m.fracBits()-fbits);
+
+    SFix m2 = m*m-c;
+    if (m2.isNegative())
+    {
+        l.copyValueFrom(m);
+    }
+    else
+    {
+        r.copyValueFrom(m);
+    }
+}
+
+static double bisectionSqrt(Mode mode, uint32_t fbits, uint32_t runs, std::string &result, uint64_t &allocations)
+{
+    setAllocatorPolicy((mode == MODE_POOL) ? AllocatorPolicy::Pool : AllocatorPolicy::Heap);
+    resetAllocatorStats();
+
+    auto start = std::chrono::steady_clock::now();
+    for(uint32_t run=0; run<runs; run++)
+    {
+        SFix l(8,fbits);
+        SFix r(8,fbits);
+        SFix c(8,0);
+        r.setInternalValue(fbits/32,2);
+        c.setInternalValue(0,2);
+
+        for(uint32_t i=0; i<fbits; i++)
+        {
+            if (mode == MODE_ARENA)
+            {
+                ArenaScope arena;
+                bisectionStep(l, r, c, fbits);
+            }
+            else
+            {
+                bisectionStep(l, r, c, fbits);
+            }
+        }
+        result = l.toHexString();
+    }
+    auto stop = std::chrono::steady_clock::now();
+
+    allocations = getAllocatorStats().heapAllocations;
+    setAllocatorPolicy(AllocatorPolicy::Heap);
+    releasePoolMemory();
+
+    return std::chrono::duration<double>(stop-start).count();
+}
+
+int main(int argc, char *argv[])
+{
+    uint32_t widths[] = {32, 64, 128, 256, 512, 1024, 2048};
+
+    uint32_t runs = 20;
+    if (argc > 1)
+    {
+        runs = atoi(argv[1]);
+    }
+
+    printf("------------------------------------------------\n");
+    printf(" Allocator benchmark: bisection sqrt(2)\n");
+    printf("------------------------------------------------\n\n");
+    printf("%8s %8s %14s %14s %14s\n", "bits", "mode", "time [ms]", "heap allocs", "speedup");
+
+    for(uint32_t w : widths)
+    {
+        const char *names[] = {"heap", "pool", "arena"};
+        std::string ref;
+        double heapTime = 0.0;
+        for(uint32_t mode=MODE_HEAP; mode<=MODE_ARENA; mode++)
+        {
+            std::string res;
+            uint64_t allocs;
+            double t = bisectionSqrt(static_cast<Mode>(mode), w, runs, res, allocs);
+            if (mode == MODE_HEAP)
+            {
+                heapTime = t;
+                ref = res;
+            }
+            else if (res != ref)
+            {
+                printf("Error: %s result differs from heap result!\n", names[mode]);
+                return 1;
+            }
+            printf("%8d %8s %14.3f %14llu %14.2f\n", w, names[mode], t*1000.0,
+                   static_cast<unsigned long long>(allocs), heapTime / t);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,249 @@
+/*
+
+    FPLIB: a library providing a fixed-point datatype.
+
+    Microbenchmark suite: sweeps the public SFix operations
+    over operand widths and sign combinations and reports
+    ns/op, words/s and allocations/op. The results can be
+    written as JSON so runs can be compared.
+
+    usage: fplib_bench [-o results.json] [-w maxbits] [-t ms] [-f op]
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include "../src/fplib.h"
+#include "../src/fpaccumulator.h"
+
+using namespace fplib;
+
+namespace bench
+{
+
+/** operation under test. returns a value derived from
+    the result so the compiler cannot remove the call. */
+typedef std::function<uint32_t(SFix &a, const SFix &b, uint32_t shift)> OpFunction;
+
+struct Operation
+{
+    const char  *name;
+    bool        binary;     ///< uses operand b
+    OpFunction  fn;
+};
+
+struct Result
+{
+    std::string op;
+    uint32_t    bits;
+    std::string signs;
+    double      nsPerOp;
+    double      wordsPerSecond;
+    double      allocsPerOp;
+    uint64_t    iterations;
+};
+
+std::vector<Operation> operations()
+{
+    std::vector<Operation> ops;
+    ops.push_back({"add", true, [](SFix &a, const SFix &b, uint32_t) { return (a+b).getInternalValue(0); }});
+    ops.push_back({"sub", true, [](SFix &a, const SFix &b, uint32_t) { return (a-b).getInternalValue(0); }});
+    ops.push_back({"mul", true, [](SFix &a, const SFix &b, uint32_t) { return (a*b).getInternalValue(0); }});
+    ops.push_back({"equal", true, [](SFix &a, const SFix &b, uint32_t) { return static_cast<uint32_t>(a == b); }});
+    ops.push_back({"compare", true, [](SFix &a, const SFix &b, uint32_t) { return static_cast<uint32_t>(compare(a, b)); }});
+    ops.push_back({"accumulate", true, [](SFix &a, const SFix &b, uint32_t) { a.accumulate(b); return a.getInternalValue(0); }});
+    std::shared_ptr<CarrySaveAccumulator> acc;
+    ops.push_back({"carrySaveAdd", true, [acc](SFix &, const SFix &b, uint32_t) mutable
+    {
+        if (!acc || (acc->intBits() != b.intBits()) || (acc->fracBits() != b.fracBits()))
+        {
+            acc = std::make_shared<CarrySaveAccumulator>(b.intBits(), b.fracBits());
+        }
+        acc->add(b);
+        return static_cast<uint32_t>(b.getNumberOfWords());
+    }});
+    ops.push_back({"negate", false, [](SFix &a, const SFix &, uint32_t) { return a.negate().getInternalValue(0); }});
+    ops.push_back({"extendLSBs", false, [](SFix &a, const SFix &, uint32_t shift) { return a.extendLSBs(shift).getInternalValue(0); }});
+    ops.push_back({"extendMSBs", false, [](SFix &a, const SFix &, uint32_t shift) { return a.extendMSBs(shift).getInternalValue(0); }});
+    ops.push_back({"removeLSBs", false, [](SFix &a, const SFix &, uint32_t shift) { return a.removeLSBs(shift).getInternalValue(0); }});
+    ops.push_back({"removeMSBs", false, [](SFix &a, const SFix &, uint32_t shift) { return a.removeMSBs(shift).getInternalValue(0); }});
+    ops.push_back({"reinterpret", false, [](SFix &a, const SFix &, uint32_t) { return a.reinterpret(a.intBits()+1, a.fracBits()-1).getInternalValue(0); }});
+    ops.push_back({"copyValueFrom", true, [](SFix &a, const SFix &b, uint32_t) { a.copyValueFrom(b); return a.getInternalValue(0); }});
+    ops.push_back({"toHexString", false, [](SFix &a, const SFix &, uint32_t) { return static_cast<uint32_t>(a.toHexString().size()); }});
+    ops.push_back({"toBinString", false, [](SFix &a, const SFix &, uint32_t) { return static_cast<uint32_t>(a.toBinString().size()); }});
+    ops.push_back({"minimumIntegerBits", false, [](SFix &a, const SFix &, uint32_t) { return static_cast<uint32_t>(a.determineMinimumIntegerBits()); }});
+    ops.push_back({"randomizeValue", false, [](SFix &a, const SFix &, uint32_t) { a.randomizeValue(); return a.getInternalValue(0); }});
+    return ops;
+}
+
+/** create a random number with the requested sign */
+SFix makeOperand(Random &rng, int32_t intBits, int32_t fracBits, bool negative)
+{
+    SFix v(intBits, fracBits);
+    v.randomizeValue(rng);
+    if (v.isNegative() != negative)
+    {
+        v = v.negate();
+    }
+    return v;
+}
+
+Result run(const Operation &op, uint32_t bits, bool negA, bool negB, double minSeconds)
+{
+    // Q(bits/2, bits/2): the fractional point sits inside
+    // a word for all widths. the extend/remove operations
+    // shift by an odd number of bits where possible.
+    const int32_t intBits  = bits/2;
+    const int32_t fracBits = bits - intBits;
+    const uint32_t shift   = std::min(13U, bits/4);
+
+    Random rng(bits);
+    SFix a = makeOperand(rng, intBits, fracBits, negA);
+    SFix b = makeOperand(rng, intBits, fracBits, negB);
+    const SFix a0 = a;
+
+    volatile uint32_t sink = 0;
+    uint64_t iterations = 0;
+    uint64_t batch = 1;
+    double elapsed = 0.0;
+
+    resetAllocatorStats();
+    while(elapsed < minSeconds)
+    {
+        auto start = std::chrono::steady_clock::now();
+        for(uint64_t i=0; i<batch; i++)
+        {
+            sink = sink + op.fn(a, b, shift);
+        }
+        elapsed += std::chrono::duration<double>(std::chrono::steady_clock::now()-start).count();
+        iterations += batch;
+        batch *= 2;
+
+        // operations that modify a in-place must
+        // not run away from the original operand.
+        a.copyValueFrom(a0);
+    }
+    AllocatorStats stats = getAllocatorStats();
+
+    const uint32_t words = a.getNumberOfWords() + (op.binary ? b.getNumberOfWords() : 0);
+
+    Result r;
+    r.op = op.name;
+    r.bits = bits;
+    r.signs = std::string(negA ? "-" : "+") + (op.binary ? (negB ? "-" : "+") : "");
+    r.nsPerOp = elapsed * 1e9 / iterations;
+    r.wordsPerSecond = static_cast<double>(words) * iterations / elapsed;
+    r.allocsPerOp = static_cast<double>(stats.allocations) / iterations;
+    r.iterations = iterations;
+    return r;
+}
+
+bool writeJSON(const char *filename, const std::vector<Result> &results, double minSeconds)
+{
+    FILE *f = fopen(filename, "wt");
+    if (f == nullptr)
+    {
+        return false;
+    }
+
+    fprintf(f, "{\n");
+    fprintf(f, "  \"benchmark\": \"fplib_bench\",\n");
+    fprintf(f, "  \"min_time_s\": %g,\n", minSeconds);
+    fprintf(f, "  \"results\": [\n");
+    for(size_t i=0; i<results.size(); i++)
+    {
+        const Result &r = results[i];
+        fprintf(f, "    {\"op\": \"%s\", \"bits\": %u, \"signs\": \"%s\", \"ns_per_op\": %.3f, "
+                   "\"words_per_s\": %.6g, \"allocs_per_op\": %.3f, \"iterations\": %llu}%s\n",
+                r.op.c_str(), r.bits, r.signs.c_str(), r.nsPerOp, r.wordsPerSecond, r.allocsPerOp,
+                static_cast<unsigned long long>(r.iterations),
+                (i+1 < results.size()) ? "," : "");
+    }
+    fprintf(f, "  ]\n");
+    fprintf(f, "}\n");
+    fclose(f);
+    return true;
+}
+
+} // namespace bench
+
+int main(int argc, char *argv[])
+{
+    const char *jsonFile = nullptr;
+    const char *filter   = nullptr;
+    uint32_t maxBits     = 65536;
+    double minSeconds    = 0.02;
+
+    for(int i=1; i<argc; i++)
+    {
+        if ((strcmp(argv[i], "-o") == 0) && (i+1 < argc))
+        {
+            jsonFile = argv[++i];
+        }
+        else if ((strcmp(argv[i], "-w") == 0) && (i+1 < argc))
+        {
+            maxBits = atoi(argv[++i]);
+        }
+        else if ((strcmp(argv[i], "-t") == 0) && (i+1 < argc))
+        {
+            minSeconds = atof(argv[++i]) / 1000.0;
+        }
+        else if ((strcmp(argv[i], "-f") == 0) && (i+1 < argc))
+        {
+            filter = argv[++i];
+        }
+        else
+        {
+            printf("usage: %s [-o results.json] [-w maxbits] [-t ms] [-f op]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    printf("------------------------------------------------\n");
+    printf(" fplib microbenchmarks\n");
+    printf("------------------------------------------------\n\n");
+    printf("%-20s %8s %6s %14s %14s %12s\n", "operation", "bits", "signs", "ns/op", "words/s", "allocs/op");
+
+    std::vector<bench::Result> results;
+    for(auto const& op : bench::operations())
+    {
+        if ((filter != nullptr) && (strcmp(filter, op.name) != 0))
+        {
+            continue;
+        }
+
+        for(uint32_t bits=8; bits<=maxBits; bits*=2)
+        {
+            // sign combinations: ++, +-, -- for binary
+            // operations, + and - for unary operations.
+            const uint32_t combinations = op.binary ? 3 : 2;
+            for(uint32_t s=0; s<combinations; s++)
+            {
+                const bool negA = op.binary ? (s == 2) : (s == 1);
+                const bool negB = (s >= 1);
+                bench::Result r = bench::run(op, bits, negA, negB, minSeconds);
+                printf("%-20s %8u %6s %14.1f %14.4g %12.2f\n", r.op.c_str(), r.bits, r.signs.c_str(),
+                       r.nsPerOp, r.wordsPerSecond, r.allocsPerOp);
+                fflush(stdout);
+                results.push_back(r);
+            }
+        }
+    }
+
+    if (jsonFile != nullptr)
+    {
+        if (!bench::writeJSON(jsonFile, results, minSeconds))
+        {
+            printf("Error: cannot write %s\n", jsonFile);
+            return 1;
+        }
+        printf("\nresults written to %s\n", jsonFile);
+    }
+    return 0;
+}
@@ -0,0 +1,123 @@
+/*
+
+    FPLIB: a library providing a fixed-point datatype.
+
+    Carry-save accumulator for long addition chains.
+
+    N.A. Moseley 2017
+    License: T.B.D.
+
+*/
+
+#include <algorithm>
+#include <stdexcept>
+#include "fpaccumulator.h"
+
+using namespace fplib;
+
+CarrySaveAccumulator::CarrySaveAccumulator(int32_t intBits, int32_t fracBits)
+    : m_pending(0),
+      m_result(intBits, fracBits)
+{
+    m_lanes.resize(m_result.getNumberOfWords(), 0);
+}
+
+
+void CarrySaveAccumulator::clear()
+{
+    std::fill(m_lanes.begin(), m_lanes.end(), 0);
+    m_pending = 0;
+}
+
+
+void CarrySaveAccumulator::assign(const SFix &v)
+{
+    clear();
+    add(v);
+}
+
+
+void CarrySaveAccumulator::add(const SFix &a, bool subtract)
+{
+    if (a.fracBits() != m_result.fracBits())
+    {
+        throw std::runtime_error("CarrySaveAccumulator::add fractional bits not equalized!");
+    }
+
+    if (m_pending == c_maxPending)
+    {
+        normalize();
+    }
+    m_pending++;
+
+    // words of 'a' beyond the accumulator are ignored,
+    // so the integer bits wrap around.
+    const uint32_t N = m_lanes.size();
+    const uint32_t M = std::min(a.getNumberOfWords(), N);
+    int64_t *lanes = m_lanes.data();
+    if (subtract)
+    {
+        for(uint32_t i=0; i<M; i++)
+        {
+            lanes[i] -= a.getInternalValue(i);
+        }
+    }
+    else
+    {
+        for(uint32_t i=0; i<M; i++)
+        {
+            lanes[i] += a.getInternalValue(i);
+        }
+    }
+
+    // the sign extension of a negative number,
+    // 0xFFFFFFFF in all lanes from M upwards,
+    // equals -2^(32*M).
+    if ((M < N) && a.isNegative())
+    {
+        lanes[M] += subtract ? 1 : -1;
+    }
+}
+
+
+void CarrySaveAccumulator::add(const SFix *a, size_t count)
+{
+    for(size_t i=0; i<count; i++)
+    {
+        add(a[i]);
+    }
+}
+
+
+void CarrySaveAccumulator::normalize()
+{
+    // a lane changes by at most 2^32 per addition,
+    // so neither the lanes nor the carry overflow.
+    int64_t carry = 0;
+    for(auto &lane : m_lanes)
+    {
+        const int64_t v = lane + carry;
+        lane  = v & 0xFFFFFFFF;
+        carry = (v - lane) / (static_cast<int64_t>(1) << 32);
+    }
+    m_pending = 0;
+}
+
+
+const SFix& CarrySaveAccumulator::value()
+{
+    normalize();
+
+    const uint32_t N = m_lanes.size();
+    if (N == 0)
+    {
+        return m_result;
+    }
+    for(uint32_t i=0; i<N; i++)
+    {
+        m_result.setInternalValue(i, static_cast<uint32_t>(m_lanes[i]));
+    }
+
+    m_result.normalizeSignBits();
+    return m_result;
+}
@@ -0,0 +1,96 @@
+/*
+
+    FPLIB: a library providing a fixed-point datatype.
+
+    Carry-save accumulator for long addition chains.
+
+    SFix::accumulate propagates the carries through all the
+    words of the number for every addition. The accumulator
+    defers the carries instead: every 32-bit word of the sum
+    is kept in a signed 64-bit lane, and an addition simply
+    adds the words of the operand to the lanes. The lanes are
+    independent, so the compiler can vectorise the loop. The
+    upper 32 bits of a lane collect the carries, which are
+    only propagated when the value is read, or after 2^30
+    additions, before a lane could overflow.
+
+    The sign extension of an operand with fewer words is
+    not added to every upper lane: it equals -1 in the lane
+    above the operand.
+
+    The accumulator behaves like an SFix that is updated with
+    accumulate: the operands must have the same number of
+    fractional bits and the integer bits wrap around.
+
+    Example:
+        CarrySaveAccumulator acc(8, 40);
+        for(auto &v : terms) acc.add(v);
+        const SFix &sum = acc.value();  // Q(8,40)
+
+    N.A. Moseley 2017
+    License: T.B.D.
+
+*/
+
+#ifndef fpaccumulator_h
+#define fpaccumulator_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+#include "fplib.h"
+
+namespace fplib
+{
+
+class CarrySaveAccumulator
+{
+public:
+    /** create an accumulator holding a Q(intBits, fracBits)
+        number, set to zero. */
+    CarrySaveAccumulator(int32_t intBits, int32_t fracBits);
+
+    int32_t intBits() const
+    {
+        return m_result.intBits();
+    }
+
+    int32_t fracBits() const
+    {
+        return m_result.fracBits();
+    }
+
+    /** set the accumulator to zero */
+    void clear();
+
+    /** set the accumulator to v. the number of fractional bits
+        must match, otherwise a runtime_error is thrown. */
+    void assign(const SFix &v);
+
+    /** add 'a' to (or subtract 'a' from) the accumulator.
+        the number of fractional bits must match, otherwise
+        a runtime_error is thrown. */
+    void add(const SFix &a, bool subtract = false);
+
+    /** add 'count' numbers to the accumulator */
+    void add(const SFix *a, size_t count);
+
+    /** propagate the carries and return the value. the
+        reference is valid until the next call of a
+        non-const member; reading does not allocate. */
+    const SFix& value();
+
+protected:
+    /** propagate the carries so every lane holds one word */
+    void normalize();
+
+    static const uint32_t c_maxPending = 1u << 30;
+
+    std::vector<int64_t> m_lanes;   ///< one word and its deferred carries per lane
+    uint32_t    m_pending;          ///< additions since the last normalisation
+    SFix        m_result;
+};
+
+} // end namespace
+
+#endif
@@ -0,0 +1,331 @@
+/*
+
+    FPLIB: a library providing a fixed-point datatype.
+
+    Word storage allocators for SFix.
+
+    N.A. Moseley 2017
+    License: T.B.D.
+
+*/
+
+#include <stdlib.h>
+#include "fpalloc.h"
+
+using namespace fplib;
+
+namespace
+{
+
+/** every buffer is preceded by a header that records where
+    the buffer came from, so it can be returned correctly
+    regardless of the policy/arena active at the time it
+    is freed. The header is 16 bytes to keep the word data
+    16-byte aligned. */
+struct BlockHeader
+{
+    uint32_t origin;        ///< one of the Origin values
+    uint32_t sizeClass;     ///< pool size class
+    union
+    {
+        BlockHeader *next;  ///< next free block in a pool free list
+        uint64_t     pad;
+    };
+};
+
+static_assert(sizeof(BlockHeader) == 16, "BlockHeader must be 16 bytes");
+
+enum Origin
+{
+    ORIGIN_HEAP  = 0,
+    ORIGIN_POOL  = 1,
+    ORIGIN_ARENA = 2
+};
+
+/** size class c holds buffers of 2^c words */
+const uint32_t c_poolClasses = 21;
+
+/** maximum number of bytes kept in one free list */
+const size_t c_poolMaxBytesPerClass = 16*1024*1024;
+
+/** set once the pool of the thread has been destroyed. a
+    separate, trivially destructible flag is still valid when
+    other thread_local objects free SFix storage after the
+    pool itself is gone. */
+thread_local bool t_wordPoolDestroyed = false;
+
+/** per-thread free lists of word buffers, one per size class */
+struct SizeClassPool
+{
+    SizeClassPool()
+    {
+        for(uint32_t i=0; i<c_poolClasses; i++)
+        {
+            freeList[i] = nullptr;
+            freeCount[i] = 0;
+        }
+    }
+
+    ~SizeClassPool()
+    {
+        release();
+        t_wordPoolDestroyed = true;
+    }
+
+    void release()
+    {
+        for(uint32_t i=0; i<c_poolClasses; i++)
+        {
+            BlockHeader *h = freeList[i];
+            while(h != nullptr)
+            {
+                BlockHeader *next = h->next;
+                free(h);
+                h = next;
+            }
+            freeList[i] = nullptr;
+            freeCount[i] = 0;
+        }
+    }
+
+    BlockHeader *freeList[c_poolClasses];
+    size_t       freeCount[c_poolClasses];
+};
+
+thread_local AllocatorPolicy t_policy = AllocatorPolicy::Heap;
+thread_local ArenaScope     *t_arena  = nullptr;
+thread_local AllocatorStats  t_stats  = {0,0,0,0};
+thread_local SizeClassPool   t_wordPool;
+
+/** determine the pool size class for a number of words */
+inline uint32_t sizeClass(size_t words)
+{
+    uint32_t c = 0;
+    while((static_cast<size_t>(1) << c) < words)
+    {
+        c++;
+    }
+    return c;
+}
+
+inline BlockHeader* heapBlock(size_t bytes)
+{
+    void *p = malloc(sizeof(BlockHeader) + bytes);
+    if (p == nullptr)
+    {
+        throw std::bad_alloc();
+    }
+    t_stats.heapAllocations++;
+    return static_cast<BlockHeader*>(p);
+}
+
+} // end anonymous namespace
+
+
+void fplib::setAllocatorPolicy(AllocatorPolicy policy)
+{
+    t_policy = policy;
+}
+
+
+AllocatorPolicy fplib::getAllocatorPolicy()
+{
+    return t_policy;
+}
+
+
+void fplib::releasePoolMemory()
+{
+    if (!t_wordPoolDestroyed)
+    {
+        t_wordPool.release();
+    }
+}
+
+
+AllocatorStats fplib::getAllocatorStats()
+{
+    return t_stats;
+}
+
+
+void fplib::resetAllocatorStats()
+{
+    t_stats.allocations = 0;
+    t_stats.deallocations = 0;
+    t_stats.heapAllocations = 0;
+    t_stats.arenaAllocations = 0;
+}
+
+
+uint32_t* fplib::detail::allocateWords(size_t words)
+{
+    t_stats.allocations++;
+    BlockHeader *h;
+    if (t_arena != nullptr)
+    {
+        h = static_cast<BlockHeader*>(t_arena->allocate(sizeof(BlockHeader) + words*sizeof(uint32_t)));
+        h->origin = ORIGIN_ARENA;
+        t_stats.arenaAllocations++;
+    }
+    else if ((t_policy == AllocatorPolicy::Pool) && !t_wordPoolDestroyed)
+    {
+        const uint32_t c = sizeClass(words);
+        if (c >= c_poolClasses)
+        {
+            h = heapBlock(words*sizeof(uint32_t));
+            h->origin = ORIGIN_HEAP;
+        }
+        else if (t_wordPool.freeList[c] != nullptr)
+        {
+            h = t_wordPool.freeList[c];
+            t_wordPool.freeList[c] = h->next;
+            t_wordPool.freeCount[c]--;
+        }
+        else
+        {
+            h = heapBlock((static_cast<size_t>(1) << c)*sizeof(uint32_t));
+            h->origin = ORIGIN_POOL;
+            h->sizeClass = c;
+        }
+    }
+    else
+    {
+        h = heapBlock(words*sizeof(uint32_t));
+        h->origin = ORIGIN_HEAP;
+    }
+    return reinterpret_cast<uint32_t*>(h+1);
+}
+
+
+void fplib::detail::deallocateWords(uint32_t *p, size_t words)
+{
+    (void)words;
+    if (p == nullptr)
+    {
+        return;
+    }
+
+    t_stats.deallocations++;
+    BlockHeader *h = reinterpret_cast<BlockHeader*>(p) - 1;
+    switch(h->origin)
+    {
+    case ORIGIN_ARENA:
+        // released in bulk when the arena goes away.
+        break;
+    case ORIGIN_POOL:
+        {
+            // blocks freed by another thread simply
+            // migrate to the pool of this thread.
+            const uint32_t c = h->sizeClass;
+            const size_t blockBytes = (static_cast<size_t>(1) << c)*sizeof(uint32_t);
+            if (t_wordPoolDestroyed || ((t_wordPool.freeCount[c]+1)*blockBytes > c_poolMaxBytesPerClass))
+            {
+                free(h);
+            }
+            else
+            {
+                h->next = t_wordPool.freeList[c];
+                t_wordPool.freeList[c] = h;
+                t_wordPool.freeCount[c]++;
+            }
+        }
+        break;
+    default:
+        free(h);
+        break;
+    }
+}
+
+
+ArenaScope::ArenaScope(size_t chunkBytes)
+    : m_previous(t_arena),
+      m_chunks(nullptr),
+      m_ptr(nullptr),
+      m_end(nullptr),
+      m_chunkBytes(chunkBytes),
+      m_bytesUsed(0)
+{
+    t_arena = this;
+}
+
+
+ArenaScope::~ArenaScope()
+{
+    t_arena = m_previous;
+    while(m_chunks != nullptr)
+    {
+        Chunk *next = m_chunks->next;
+        free(m_chunks);
+        m_chunks = next;
+    }
+}
+
+
+void* ArenaScope::allocate(size_t bytes)
+{
+    // keep every allocation 16-byte aligned
+    bytes = (bytes + 15) & ~static_cast<size_t>(15);
+    m_bytesUsed += bytes;
+
+    if (static_cast<size_t>(m_end - m_ptr) < bytes)
+    {
+        // large requests get a chunk of their own so
+        // the remainder of the current chunk is not wasted.
+        const bool dedicated = (bytes > m_chunkBytes/4);
+        const size_t size = dedicated ? bytes : m_chunkBytes;
+
+        // the chunk header is padded to 16 bytes
+        void *mem = malloc(16 + size);
+        if (mem == nullptr)
+        {
+            throw std::bad_alloc();
+        }
+        t_stats.heapAllocations++;
+
+        Chunk *c = static_cast<Chunk*>(mem);
+        c->next = m_chunks;
+        c->size = size;
+        m_chunks = c;
+
+        uint8_t *data = static_cast<uint8_t*>(mem) + 16;
+        if (dedicated)
+        {
+            return data;
+        }
+        m_ptr = data;
+        m_end = data + size;
+    }
+
+    void *p = m_ptr;
+    m_ptr += bytes;
+    return p;
+}
+
+
+HeapScope::HeapScope()
+    : m_arena(t_arena),
+      m_policy(t_policy)
+{
+    t_arena  = nullptr;
+    t_policy = AllocatorPolicy::Heap;
+}
+
+
+HeapScope::~HeapScope()
+{
+    t_arena  = m_arena;
+    t_policy = m_policy;
+}
+
+
+bool fplib::detail::arenaOpen()
+{
+    return t_arena != nullptr;
+}
+
+
+bool fplib::detail::isArenaStorage(const uint32_t *p)
+{
+    return (p != nullptr) && (reinterpret_cast<const BlockHeader*>(p)[-1].origin == ORIGIN_ARENA);
+}
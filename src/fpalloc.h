@@ -0,0 +1,190 @@
+/*
+
+    FPLIB: a library providing a fixed-point datatype.
+
+    Word storage allocators for SFix. By default all SFix
+    storage comes from the heap. A thread can switch to a
+    size-class pool, or open an ArenaScope under which all
+    SFix storage is bump-allocated and released in bulk.
+
+    N.A. Moseley 2017
+    License: T.B.D.
+
+*/
+
+#ifndef fpalloc_h
+#define fpalloc_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include <new>
+
+namespace fplib
+{
+
+/** allocation policy used for SFix word storage
+    outside of an ArenaScope. The policy is
+    selected per thread. */
+enum class AllocatorPolicy
+{
+    Heap,   ///< every buffer is obtained from / returned to the heap.
+    Pool    ///< buffers are recycled through per-thread size-class free lists.
+};
+
+/** select the allocation policy for the calling thread */
+void setAllocatorPolicy(AllocatorPolicy policy);
+
+/** return the allocation policy of the calling thread */
+AllocatorPolicy getAllocatorPolicy();
+
+/** release all buffers held in the free lists of the
+    calling thread's pool. */
+void releasePoolMemory();
+
+/** allocation counters of the calling thread */
+struct AllocatorStats
+{
+    uint64_t allocations;       ///< number of buffers handed out
+    uint64_t deallocations;     ///< number of buffers returned
+    uint64_t heapAllocations;   ///< number of buffers that needed a heap allocation
+    uint64_t arenaAllocations;  ///< number of buffers taken from an arena
+};
+
+/** return the allocation counters of the calling thread */
+AllocatorStats getAllocatorStats();
+
+/** reset the allocation counters of the calling thread */
+void resetAllocatorStats();
+
+/** While an ArenaScope is alive, all SFix storage allocated
+    by the constructing thread comes from a bump allocator.
+    Freeing such storage is a no-op; the arena memory is
+    released in bulk when the scope is destroyed.
+
+    Scopes can be nested, the innermost scope is used.
+
+    Note: SFix objects holding arena storage must not outlive
+    the scope. Values that must survive the scope should be
+    created outside it. Assigning to them is safe: a number
+    that does not hold arena storage is given heap storage
+    when an assignment needs new storage, and arena storage
+    is copied rather than moved into it. Copy and move
+    construction inside the scope, e.g. push_back into a
+    vector created outside it, do create arena storage.
+*/
+class ArenaScope
+{
+public:
+    /** open an arena scope on the calling thread.
+        @param[in] chunkBytes size of the memory chunks the arena
+                   obtains from the heap.
+    */
+    explicit ArenaScope(size_t chunkBytes = 64*1024);
+    ~ArenaScope();
+
+    /** number of bytes handed out by this arena so far */
+    size_t bytesUsed() const
+    {
+        return m_bytesUsed;
+    }
+
+    /** bump-allocate 'bytes' bytes from the arena. */
+    void* allocate(size_t bytes);
+
+private:
+    ArenaScope(const ArenaScope &);
+    ArenaScope& operator=(const ArenaScope &);
+
+    struct Chunk
+    {
+        Chunk  *next;
+        size_t  size;
+    };
+
+    ArenaScope  *m_previous;    ///< enclosing scope on this thread
+    Chunk       *m_chunks;      ///< list of chunks owned by the arena
+    uint8_t     *m_ptr;         ///< bump pointer into the current chunk
+    uint8_t     *m_end;         ///< end of the current chunk
+    size_t      m_chunkBytes;
+    size_t      m_bytesUsed;
+};
+
+/** While a HeapScope is alive, SFix storage allocated by the
+    constructing thread comes from the heap, bypassing any open
+    ArenaScope and the thread's allocation policy. This is used
+    for values that must outlive an arena, such as cache entries
+    created on behalf of a caller that runs inside an arena.
+*/
+class HeapScope
+{
+public:
+    HeapScope();
+    ~HeapScope();
+
+private:
+    HeapScope(const HeapScope &);
+    HeapScope& operator=(const HeapScope &);
+
+    ArenaScope      *m_arena;   ///< arena suspended by this scope
+    AllocatorPolicy m_policy;   ///< policy replaced by this scope
+};
+
+namespace detail
+{
+    /** allocate storage for 'words' 32-bit words using
+        the current arena or the policy of the calling thread */
+    uint32_t* allocateWords(size_t words);
+
+    /** return storage obtained through allocateWords */
+    void deallocateWords(uint32_t *p, size_t words);
+
+    /** check if an ArenaScope is open on the calling thread */
+    bool arenaOpen();
+
+    /** check if storage obtained through allocateWords
+        comes from an arena. p may be null. */
+    bool isArenaStorage(const uint32_t *p);
+}
+
+/** standard library allocator that routes SFix word storage
+    through the arena / pool machinery. */
+template <class T> class WordAllocator
+{
+public:
+    typedef T value_type;
+
+    WordAllocator() {}
+    template <class U> WordAllocator(const WordAllocator<U> &) {}
+
+    T* allocate(size_t n)
+    {
+        static_assert(sizeof(T) == sizeof(uint32_t), "WordAllocator only supports 32-bit words");
+        return reinterpret_cast<T*>(detail::allocateWords(n));
+    }
+
+    void deallocate(T *p, size_t n)
+    {
+        detail::deallocateWords(reinterpret_cast<uint32_t*>(p), n);
+    }
+
+    template <class U> struct rebind
+    {
+        typedef WordAllocator<U> other;
+    };
+};
+
+template <class T, class U>
+bool operator==(const WordAllocator<T> &, const WordAllocator<U> &)
+{
+    return true;
+}
+
+template <class T, class U>
+bool operator!=(const WordAllocator<T> &, const WordAllocator<U> &)
+{
+    return false;
+}
+
+} // end namespace
+
+#endif
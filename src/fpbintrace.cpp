@@ -0,0 +1,552 @@
+/*
+
+    FPLIB: a library providing a fixed-point datatype.
+
+    Compressed binary traces of SFix sample streams.
+
+    N.A. Moseley 2017
+    License: T.B.D.
+
+*/
+
+#include <string.h>
+#include <algorithm>
+#include <stdexcept>
+#include "fpbintrace.h"
+
+using namespace fplib;
+
+namespace
+{
+
+const char c_traceMagic[] = "FPTRACE1";
+const char c_indexMagic[] = "FPTRIDX1";
+
+const uint64_t c_headerBytes      = 20;
+const uint64_t c_chunkHeaderBytes = 9;
+const uint64_t c_trailerBytes     = 32;
+
+enum ChunkEncoding
+{
+    ENC_DELTA  = 0,
+    ENC_PACKED = 1
+};
+
+uint64_t laneMask(uint32_t bits)
+{
+    return (bits >= 64) ? ~0ULL : ((1ULL << bits) - 1);
+}
+
+/** sign-extend the 'bits' LSBs of v */
+int64_t signExtend(uint64_t v, uint32_t bits)
+{
+    return static_cast<int64_t>(v << (64-bits)) >> (64-bits);
+}
+
+void putU32(uint8_t *p, uint32_t v)
+{
+    for(uint32_t i=0; i<4; i++)
+    {
+        p[i] = static_cast<uint8_t>(v >> (8*i));
+    }
+}
+
+void putU64(uint8_t *p, uint64_t v)
+{
+    for(uint32_t i=0; i<8; i++)
+    {
+        p[i] = static_cast<uint8_t>(v >> (8*i));
+    }
+}
+
+uint32_t getU32(const uint8_t *p)
+{
+    uint32_t v = 0;
+    for(uint32_t i=0; i<4; i++)
+    {
+        v |= static_cast<uint32_t>(p[i]) << (8*i);
+    }
+    return v;
+}
+
+uint64_t getU64(const uint8_t *p)
+{
+    uint64_t v = 0;
+    for(uint32_t i=0; i<8; i++)
+    {
+        v |= static_cast<uint64_t>(p[i]) << (8*i);
+    }
+    return v;
+}
+
+/** writes values of up to 64 bits, LSB first */
+class BitPacker
+{
+public:
+    explicit BitPacker(uint8_t *p) : m_p(p), m_acc(0), m_bits(0) {}
+
+    void put(uint64_t v, uint32_t bits)
+    {
+        m_acc |= (m_bits < 64) ? (v << m_bits) : 0;
+        if (m_bits + bits >= 64)
+        {
+            putU64(m_p, m_acc);
+            m_p += 8;
+            m_acc = (m_bits == 0) ? 0 : (v >> (64 - m_bits));
+            m_bits = m_bits + bits - 64;
+        }
+        else
+        {
+            m_bits += bits;
+        }
+    }
+
+    /** write the remaining bits and return the end */
+    uint8_t* finish()
+    {
+        for(uint32_t i=0; i<m_bits; i+=8)
+        {
+            *m_p++ = static_cast<uint8_t>(m_acc >> i);
+        }
+        return m_p;
+    }
+
+protected:
+    uint8_t     *m_p;
+    uint64_t    m_acc;
+    uint32_t    m_bits;
+};
+
+/** reads values written by BitPacker */
+class BitUnpacker
+{
+public:
+    BitUnpacker(const uint8_t *p, const uint8_t *end) : m_p(p), m_end(end), m_acc(0), m_bits(0) {}
+
+    uint64_t get(uint32_t bits)
+    {
+        uint64_t v = 0;
+        uint32_t got = 0;
+        while(got < bits)
+        {
+            if (m_bits == 0)
+            {
+                if (m_p >= m_end)
+                {
+                    throw std::runtime_error("BinaryTraceReader: corrupt chunk!");
+                }
+                const uint32_t n = std::min(static_cast<ptrdiff_t>(8), m_end - m_p);
+                m_acc = 0;
+                for(uint32_t i=0; i<n; i++)
+                {
+                    m_acc |= static_cast<uint64_t>(m_p[i]) << (8*i);
+                }
+                m_p += n;
+                m_bits = 8*n;
+            }
+            const uint32_t take = std::min(m_bits, bits - got);
+            v |= (m_acc & laneMask(take)) << got;
+            m_acc = (take < 64) ? (m_acc >> take) : 0;
+            m_bits -= take;
+            got += take;
+        }
+        return v;
+    }
+
+protected:
+    const uint8_t   *m_p;
+    const uint8_t   *m_end;
+    uint64_t        m_acc;
+    uint32_t        m_bits;
+};
+
+int seekFile(FILE *f, uint64_t offset, int origin)
+{
+#ifdef _WIN32
+    return _fseeki64(f, static_cast<int64_t>(offset), origin);
+#else
+    return fseeko(f, static_cast<off_t>(offset), origin);
+#endif
+}
+
+uint64_t tellFile(FILE *f)
+{
+#ifdef _WIN32
+    return _ftelli64(f);
+#else
+    return ftello(f);
+#endif
+}
+
+} // end anonymous namespace
+
+
+BinaryTraceWriter::BinaryTraceWriter(const std::string &filename, int32_t intBits, int32_t fracBits,
+                                     uint32_t chunkSamples, bool background)
+    : m_out(filename, 4 << 20, background),
+      m_intBits(intBits),
+      m_fracBits(fracBits),
+      m_chunkSamples(std::max(chunkSamples, 1U)),
+      m_count(0),
+      m_samples(0),
+      m_offset(c_headerBytes),
+      m_closed(false)
+{
+    const int32_t W = intBits + fracBits;
+    if (W <= 0)
+    {
+        throw std::runtime_error("BinaryTraceWriter: the format must have at least one bit!");
+    }
+    m_lanes   = (W + 63) / 64;
+    m_topBits = W - 64*(m_lanes-1);
+    m_values.resize(static_cast<size_t>(m_chunkSamples) * m_lanes);
+
+    uint8_t header[c_headerBytes];
+    memcpy(header, c_traceMagic, 8);
+    putU32(header + 8,  static_cast<uint32_t>(intBits));
+    putU32(header + 12, static_cast<uint32_t>(fracBits));
+    putU32(header + 16, m_chunkSamples);
+    m_out.write(reinterpret_cast<const char*>(header), c_headerBytes);
+}
+
+
+BinaryTraceWriter::~BinaryTraceWriter()
+{
+    try
+    {
+        close();
+    }
+    catch(...)
+    {
+    }
+}
+
+
+void BinaryTraceWriter::write(const SFix &v)
+{
+    if ((v.intBits() != m_intBits) || (v.fracBits() != m_fracBits))
+    {
+        throw std::runtime_error("BinaryTraceWriter: the format of the value does not match!");
+    }
+
+    const uint32_t N = v.getNumberOfWords();
+    uint64_t *lanes = &m_values[static_cast<size_t>(m_count) * m_lanes];
+    for(uint32_t l=0; l<m_lanes; l++)
+    {
+        const uint64_t lo = v.getInternalValue(2*l);
+        const uint64_t hi = (2*l+1 < N) ? v.getInternalValue(2*l+1) : 0;
+        lanes[l] = (lo | (hi << 32)) & laneMask((l == m_lanes-1) ? m_topBits : 64);
+    }
+    m_samples++;
+    if (++m_count == m_chunkSamples)
+    {
+        writeChunk();
+    }
+}
+
+
+void BinaryTraceWriter::write(const SFix *v, size_t count)
+{
+    for(size_t i=0; i<count; i++)
+    {
+        write(v[i]);
+    }
+}
+
+
+void BinaryTraceWriter::writeChunk()
+{
+    if (m_count == 0)
+    {
+        return;
+    }
+
+    // delta encoding, lane by lane
+    m_payload.resize(c_chunkHeaderBytes + static_cast<size_t>(m_count) * m_lanes * 10);
+    uint8_t *begin = &m_payload[c_chunkHeaderBytes];
+    uint8_t *p = begin;
+    for(uint32_t l=0; l<m_lanes; l++)
+    {
+        const uint32_t bits = (l == m_lanes-1) ? m_topBits : 64;
+        const uint64_t mask = laneMask(bits);
+        uint64_t prev = 0;
+        for(uint32_t i=0; i<m_count; i++)
+        {
+            const uint64_t cur = m_values[static_cast<size_t>(i) * m_lanes + l];
+            const int64_t  d   = signExtend((cur - prev) & mask, bits);
+            uint64_t zz = (static_cast<uint64_t>(d) << 1) ^ static_cast<uint64_t>(d >> 63);
+            while(zz >= 0x80)
+            {
+                *p++ = static_cast<uint8_t>(zz | 0x80);
+                zz >>= 7;
+            }
+            *p++ = static_cast<uint8_t>(zz);
+            prev = cur;
+        }
+    }
+
+    uint8_t encoding = ENC_DELTA;
+    const uint64_t W = static_cast<uint64_t>(m_intBits + m_fracBits);
+    const uint64_t packedBytes = (m_count * W + 7) / 8;
+    if (static_cast<uint64_t>(p - begin) > packedBytes)
+    {
+        BitPacker packer(begin);
+        const size_t n = static_cast<size_t>(m_count) * m_lanes;
+        for(size_t i=0; i<n; i++)
+        {
+            packer.put(m_values[i], ((i % m_lanes) == m_lanes-1) ? m_topBits : 64);
+        }
+        p = packer.finish();
+        encoding = ENC_PACKED;
+    }
+
+    const uint64_t bytes = p - begin;
+    if (bytes > 0xFFFFFFFFULL)
+    {
+        throw std::runtime_error("BinaryTraceWriter: the chunk is too large, use fewer samples per chunk!");
+    }
+    putU32(&m_payload[0], m_count);
+    putU32(&m_payload[4], static_cast<uint32_t>(bytes));
+    m_payload[8] = encoding;
+    m_out.write(reinterpret_cast<const char*>(&m_payload[0]), c_chunkHeaderBytes + bytes);
+
+    m_index.push_back(m_samples - m_count);
+    m_index.push_back(m_offset);
+    m_offset += c_chunkHeaderBytes + bytes;
+    m_count = 0;
+}
+
+
+void BinaryTraceWriter::close()
+{
+    if (m_closed)
+    {
+        return;
+    }
+    m_closed = true;
+    writeChunk();
+
+    const uint64_t indexOffset = m_offset;
+    uint8_t buffer[c_trailerBytes];
+    for(auto v : m_index)
+    {
+        putU64(buffer, v);
+        m_out.write(reinterpret_cast<const char*>(buffer), 8);
+    }
+    putU64(buffer,      indexOffset);
+    putU64(buffer + 8,  m_index.size() / 2);
+    putU64(buffer + 16, m_samples);
+    memcpy(buffer + 24, c_indexMagic, 8);
+    m_out.write(reinterpret_cast<const char*>(buffer), c_trailerBytes);
+    m_out.close();
+}
+
+
+BinaryTraceReader::BinaryTraceReader(const std::string &filename)
+    : m_file(nullptr),
+      m_samples(0),
+      m_position(0),
+      m_chunk(static_cast<size_t>(-1)),
+      m_count(0)
+{
+    m_file = fopen(filename.c_str(), "rb");
+    if (m_file == nullptr)
+    {
+        throw std::runtime_error("BinaryTraceReader: cannot open " + filename);
+    }
+
+    uint8_t header[c_headerBytes];
+    if ((fread(header, 1, c_headerBytes, m_file) != c_headerBytes) ||
+        (memcmp(header, c_traceMagic, 8) != 0))
+    {
+        fclose(m_file);
+        throw std::runtime_error("BinaryTraceReader: " + filename + " is not a trace!");
+    }
+    m_intBits  = static_cast<int32_t>(getU32(header + 8));
+    m_fracBits = static_cast<int32_t>(getU32(header + 12));
+    const int32_t W = m_intBits + m_fracBits;
+    if (W <= 0)
+    {
+        fclose(m_file);
+        throw std::runtime_error("BinaryTraceReader: " + filename + " has an invalid format!");
+    }
+    m_lanes   = (W + 63) / 64;
+    m_topBits = W - 64*(m_lanes-1);
+
+    // use the index when the trailer is intact
+    seekFile(m_file, 0, SEEK_END);
+    const uint64_t size = tellFile(m_file);
+    uint8_t trailer[c_trailerBytes];
+    if ((size >= c_headerBytes + c_trailerBytes) &&
+        (seekFile(m_file, size - c_trailerBytes, SEEK_SET) == 0) &&
+        (fread(trailer, 1, c_trailerBytes, m_file) == c_trailerBytes) &&
+        (memcmp(trailer + 24, c_indexMagic, 8) == 0))
+    {
+        const uint64_t indexOffset = getU64(trailer);
+        const uint64_t chunks      = getU64(trailer + 8);
+        if (indexOffset + 16*chunks + c_trailerBytes == size)
+        {
+            std::vector<uint8_t> index(16*chunks);
+            seekFile(m_file, indexOffset, SEEK_SET);
+            if (fread(index.data(), 1, index.size(), m_file) == index.size())
+            {
+                for(uint64_t c=0; c<chunks; c++)
+                {
+                    m_first.push_back(getU64(&index[16*c]));
+                    m_offsets.push_back(getU64(&index[16*c + 8]));
+                }
+                m_samples = getU64(trailer + 16);
+                return;
+            }
+        }
+    }
+    scanChunks(c_headerBytes);
+}
+
+
+BinaryTraceReader::~BinaryTraceReader()
+{
+    if (m_file != nullptr)
+    {
+        fclose(m_file);
+    }
+}
+
+
+void BinaryTraceReader::scanChunks(uint64_t offset)
+{
+    seekFile(m_file, 0, SEEK_END);
+    const uint64_t size = tellFile(m_file);
+
+    m_first.clear();
+    m_offsets.clear();
+    m_samples = 0;
+    uint8_t header[c_chunkHeaderBytes];
+    while(offset + c_chunkHeaderBytes <= size)
+    {
+        seekFile(m_file, offset, SEEK_SET);
+        if (fread(header, 1, c_chunkHeaderBytes, m_file) != c_chunkHeaderBytes)
+        {
+            break;
+        }
+        const uint32_t count = getU32(header);
+        const uint64_t bytes = getU32(header + 4);
+        if ((count == 0) || (header[8] > ENC_PACKED) ||
+            (offset + c_chunkHeaderBytes + bytes > size))
+        {
+            // a chunk that was not completely written
+            break;
+        }
+        m_first.push_back(m_samples);
+        m_offsets.push_back(offset);
+        m_samples += count;
+        offset += c_chunkHeaderBytes + bytes;
+    }
+}
+
+
+void BinaryTraceReader::loadChunk(size_t chunk)
+{
+    uint8_t header[c_chunkHeaderBytes];
+    if ((seekFile(m_file, m_offsets[chunk], SEEK_SET) != 0) ||
+        (fread(header, 1, c_chunkHeaderBytes, m_file) != c_chunkHeaderBytes))
+    {
+        throw std::runtime_error("BinaryTraceReader: cannot read a chunk!");
+    }
+    const uint32_t count = getU32(header);
+    const uint32_t bytes = getU32(header + 4);
+    m_payload.resize(std::max(bytes, 1U));
+    if (fread(m_payload.data(), 1, bytes, m_file) != bytes)
+    {
+        throw std::runtime_error("BinaryTraceReader: cannot read a chunk!");
+    }
+
+    m_values.resize(static_cast<size_t>(count) * m_lanes);
+    const uint8_t *p   = m_payload.data();
+    const uint8_t *end = p + bytes;
+    if (header[8] == ENC_DELTA)
+    {
+        for(uint32_t l=0; l<m_lanes; l++)
+        {
+            const uint64_t mask = laneMask((l == m_lanes-1) ? m_topBits : 64);
+            uint64_t prev = 0;
+            for(uint32_t i=0; i<count; i++)
+            {
+                uint64_t zz = 0;
+                uint32_t shift = 0;
+                while(true)
+                {
+                    if ((p >= end) || (shift > 63))
+                    {
+                        throw std::runtime_error("BinaryTraceReader: corrupt chunk!");
+                    }
+                    const uint8_t b = *p++;
+                    zz |= static_cast<uint64_t>(b & 0x7F) << shift;
+                    shift += 7;
+                    if ((b & 0x80) == 0)
+                    {
+                        break;
+                    }
+                }
+                const uint64_t d = (zz >> 1) ^ (0 - (zz & 1));
+                prev = (prev + d) & mask;
+                m_values[static_cast<size_t>(i) * m_lanes + l] = prev;
+            }
+        }
+    }
+    else
+    {
+        BitUnpacker unpacker(p, end);
+        const size_t n = static_cast<size_t>(count) * m_lanes;
+        for(size_t i=0; i<n; i++)
+        {
+            m_values[i] = unpacker.get(((i % m_lanes) == m_lanes-1) ? m_topBits : 64);
+        }
+    }
+    m_chunk = chunk;
+    m_count = count;
+}
+
+
+void BinaryTraceReader::seek(uint64_t sample)
+{
+    m_position = std::min(sample, m_samples);
+}
+
+
+size_t BinaryTraceReader::read(SFix *out, size_t count)
+{
+    size_t n = 0;
+    while((n < count) && (m_position < m_samples))
+    {
+        SFix &v = out[n];
+        if ((v.intBits() != m_intBits) || (v.fracBits() != m_fracBits))
+        {
+            throw std::runtime_error("BinaryTraceReader: the format of the output does not match!");
+        }
+
+        if ((m_chunk >= m_first.size()) || (m_position < m_first[m_chunk]) ||
+            (m_position >= m_first[m_chunk] + m_count))
+        {
+            const size_t chunk = std::upper_bound(m_first.begin(), m_first.end(), m_position) - m_first.begin() - 1;
+            loadChunk(chunk);
+        }
+
+        const uint64_t *lanes = &m_values[static_cast<size_t>(m_position - m_first[m_chunk]) * m_lanes];
+        const uint32_t N = v.getNumberOfWords();
+        for(uint32_t l=0; l<m_lanes; l++)
+        {
+            // the top lane is sign-extended, so the top
+            // word of the SFix is too.
+            const uint64_t lane = (l == m_lanes-1) ? static_cast<uint64_t>(signExtend(lanes[l], m_topBits)) : lanes[l];
+            v.setInternalValue(2*l, static_cast<uint32_t>(lane));
+            if (2*l+1 < N)
+            {
+                v.setInternalValue(2*l+1, static_cast<uint32_t>(lane >> 32));
+            }
+        }
+        m_position++;
+        n++;
+    }
+    return n;
+}
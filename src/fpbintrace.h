@@ -0,0 +1,182 @@
+/*
+
+    FPLIB: a library providing a fixed-point datatype.
+
+    Compressed binary traces of SFix sample streams.
+
+    A trace stores a sequence of values of one Q format.
+    The samples are stored in chunks of a fixed number of
+    samples. Every value is split into 64-bit lanes; lane k
+    holds the words 2k and 2k+1 and the top lane holds only
+    the bits of the format. A chunk is encoded in one of two
+    ways, whichever is smaller:
+
+      * delta: per lane, the difference to the previous
+        sample (the first sample of a chunk is relative to
+        zero) is taken modulo the lane width, zig-zag encoded
+        and written as a LEB128 varint. slowly changing
+        signals need one or two bytes per sample.
+      * packed: the raw bits of every value, packed to the
+        exact total bit width.
+
+    File layout, all numbers little endian:
+
+        header  : "FPTRACE1", int32 intBits, int32 fracBits,
+                  uint32 samples per chunk
+        chunks  : uint32 samples, uint32 payload bytes,
+                  uint8 encoding (0 = delta, 1 = packed),
+                  payload
+        index   : uint64 first sample, uint64 file offset,
+                  for every chunk
+        trailer : uint64 index offset, uint64 chunks,
+                  uint64 samples, "FPTRIDX1"
+
+    Chunks can be decoded independently, so the reader
+    seeks to any sample using the index. When the trailer
+    is missing, e.g. after a crash of the writer, the reader
+    rebuilds the index by scanning the chunks.
+
+    Example:
+        BinaryTraceWriter w("x.fpt", 1, 15);
+        w.write(&xs[0], xs.size());
+        w.close();
+
+        BinaryTraceReader r("x.fpt");
+        r.seek(1000000);
+        r.read(&block[0], block.size());
+
+    N.A. Moseley 2017
+    License: T.B.D.
+
+*/
+
+#ifndef fpbintrace_h
+#define fpbintrace_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include "fplib.h"
+#include "fptrace.h"
+
+namespace fplib
+{
+
+class BinaryTraceWriter
+{
+public:
+    /** create 'filename' for Q(intBits, fracBits) samples */
+    BinaryTraceWriter(const std::string &filename, int32_t intBits, int32_t fracBits,
+                      uint32_t chunkSamples = 65536, bool background = false);
+
+    /** write the last chunk and the index; errors are
+        ignored, call close() to see them. */
+    ~BinaryTraceWriter();
+
+    /** append one sample. the format must match, otherwise a
+        runtime_error is thrown. */
+    void write(const SFix &v);
+
+    /** append 'count' samples */
+    void write(const SFix *v, size_t count);
+
+    /** return the number of samples written */
+    uint64_t samples() const
+    {
+        return m_samples;
+    }
+
+    /** write the last chunk and the index and close the file */
+    void close();
+
+protected:
+    /** encode and write the buffered samples as a chunk */
+    void writeChunk();
+
+    BufferedWriter          m_out;
+    int32_t                 m_intBits;
+    int32_t                 m_fracBits;
+    uint32_t                m_chunkSamples;
+    uint32_t                m_lanes;        ///< 64-bit lanes per sample
+    uint32_t                m_topBits;      ///< bits in the top lane
+    std::vector<uint64_t>   m_values;       ///< lanes of the buffered samples
+    uint32_t                m_count;        ///< buffered samples
+    uint64_t                m_samples;
+    uint64_t                m_offset;       ///< bytes written
+    std::vector<uint64_t>   m_index;        ///< first sample and offset of every chunk
+    std::vector<uint8_t>    m_payload;
+    bool                    m_closed;
+};
+
+
+class BinaryTraceReader
+{
+public:
+    /** open a trace. throws a runtime_error when the file
+        cannot be opened or is not a trace. */
+    explicit BinaryTraceReader(const std::string &filename);
+
+    ~BinaryTraceReader();
+
+    int32_t intBits() const
+    {
+        return m_intBits;
+    }
+
+    int32_t fracBits() const
+    {
+        return m_fracBits;
+    }
+
+    /** return the number of samples in the trace */
+    uint64_t samples() const
+    {
+        return m_samples;
+    }
+
+    /** return the number of the next sample to read */
+    uint64_t position() const
+    {
+        return m_position;
+    }
+
+    /** continue reading at sample 'sample' */
+    void seek(uint64_t sample);
+
+    /** read up to 'count' samples into 'out', which must have
+        the format of the trace, and return the number read. */
+    size_t read(SFix *out, size_t count);
+
+    /** read one sample; returns false at the end */
+    bool read(SFix &out)
+    {
+        return read(&out, 1) == 1;
+    }
+
+protected:
+    /** build the index by scanning the chunks */
+    void scanChunks(uint64_t offset);
+
+    /** decode chunk 'chunk' into m_values */
+    void loadChunk(size_t chunk);
+
+    FILE                    *m_file;
+    int32_t                 m_intBits;
+    int32_t                 m_fracBits;
+    uint32_t                m_lanes;
+    uint32_t                m_topBits;
+    uint64_t                m_samples;
+    uint64_t                m_position;
+    std::vector<uint64_t>   m_first;        ///< first sample of every chunk
+    std::vector<uint64_t>   m_offsets;      ///< file offset of every chunk
+    size_t                  m_chunk;        ///< decoded chunk
+    uint32_t                m_count;        ///< samples in the decoded chunk
+    std::vector<uint64_t>   m_values;       ///< lanes of the decoded chunk
+    std::vector<uint8_t>    m_payload;
+};
+
+} // end namespace
+
+#endif
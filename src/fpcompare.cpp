@@ -0,0 +1,545 @@
+/*
+
+    FPLIB: a library providing a fixed-point datatype.
+
+    Comparison of golden-vector files.
+
+    N.A. Moseley 2017
+    License: T.B.D.
+
+*/
+
+#include <string.h>
+#include <ctype.h>
+#include <algorithm>
+#include <memory>
+#include <stdexcept>
+#include "fpcompare.h"
+#include "fpthreads.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+using namespace fplib;
+
+namespace
+{
+
+/** values per block; blocks are the unit of work and the
+    granularity of the hex index. */
+const uint64_t c_blockValues = 65536;
+
+/** a read-only memory mapping of a whole file */
+class MappedFile
+{
+public:
+    explicit MappedFile(const std::string &filename)
+        : m_data(nullptr), m_size(0)
+    {
+#ifdef _WIN32
+        m_file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL,
+                             OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+        m_mapping = NULL;
+        LARGE_INTEGER size;
+        if ((m_file == INVALID_HANDLE_VALUE) || !GetFileSizeEx(m_file, &size))
+        {
+            close();
+            throw std::runtime_error("compareVectorFiles: cannot open " + filename);
+        }
+        m_size = static_cast<uint64_t>(size.QuadPart);
+        if (m_size > 0)
+        {
+            m_mapping = CreateFileMappingA(m_file, NULL, PAGE_READONLY, 0, 0, NULL);
+            m_data = (m_mapping != NULL) ?
+                static_cast<const uint8_t*>(MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0)) : nullptr;
+            if (m_data == nullptr)
+            {
+                close();
+                throw std::runtime_error("compareVectorFiles: cannot map " + filename);
+            }
+        }
+#else
+        m_fd = open(filename.c_str(), O_RDONLY);
+        struct stat st;
+        if ((m_fd < 0) || (fstat(m_fd, &st) != 0))
+        {
+            close();
+            throw std::runtime_error("compareVectorFiles: cannot open " + filename);
+        }
+        m_size = static_cast<uint64_t>(st.st_size);
+        if (m_size > 0)
+        {
+            void *p = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, m_fd, 0);
+            if (p == MAP_FAILED)
+            {
+                close();
+                throw std::runtime_error("compareVectorFiles: cannot map " + filename);
+            }
+            m_data = static_cast<const uint8_t*>(p);
+        }
+#endif
+    }
+
+    ~MappedFile()
+    {
+        close();
+    }
+
+    const uint8_t* data() const
+    {
+        return m_data;
+    }
+
+    uint64_t size() const
+    {
+        return m_size;
+    }
+
+protected:
+    void close()
+    {
+#ifdef _WIN32
+        if (m_data != nullptr)
+        {
+            UnmapViewOfFile(m_data);
+        }
+        if (m_mapping != NULL)
+        {
+            CloseHandle(m_mapping);
+        }
+        if (m_file != INVALID_HANDLE_VALUE)
+        {
+            CloseHandle(m_file);
+        }
+        m_mapping = NULL;
+        m_file = INVALID_HANDLE_VALUE;
+#else
+        if (m_data != nullptr)
+        {
+            munmap(const_cast<uint8_t*>(m_data), m_size);
+        }
+        if (m_fd >= 0)
+        {
+            ::close(m_fd);
+        }
+        m_fd = -1;
+#endif
+        m_data = nullptr;
+    }
+
+#ifdef _WIN32
+    HANDLE          m_file;
+    HANDLE          m_mapping;
+#else
+    int             m_fd;
+#endif
+    const uint8_t   *m_data;
+    uint64_t        m_size;
+};
+
+
+inline bool isSpace(uint8_t c)
+{
+    return (c == ' ') || (c == '\t') || (c == '\n') || (c == '\r') || (c == '\f') || (c == '\v');
+}
+
+inline int32_t hexValue(uint8_t c)
+{
+    if ((c >= '0') && (c <= '9'))
+    {
+        return c - '0';
+    }
+    if ((c >= 'a') && (c <= 'f'))
+    {
+        return c - 'a' + 10;
+    }
+    if ((c >= 'A') && (c <= 'F'))
+    {
+        return c - 'A' + 10;
+    }
+    return -1;
+}
+
+/** return the start of the next hex token, or 'end' */
+const uint8_t* nextToken(const uint8_t *p, const uint8_t *end)
+{
+    while(p < end)
+    {
+        if (isSpace(*p))
+        {
+            p++;
+        }
+        else if ((*p == '/') && (p+1 < end) && (p[1] == '/'))
+        {
+            while((p < end) && (*p != '\n'))
+            {
+                p++;
+            }
+        }
+        else
+        {
+            return p;
+        }
+    }
+    return end;
+}
+
+/** return the end of the token starting at p */
+const uint8_t* tokenEnd(const uint8_t *p, const uint8_t *end)
+{
+    while((p < end) && !isSpace(*p))
+    {
+        p++;
+    }
+    return p;
+}
+
+
+/** a memory-mapped file of values of one format */
+class VectorSource
+{
+public:
+    VectorSource(const std::string &filename, VectorFileType type, int32_t width, ThreadPool &pool)
+        : m_file(filename), m_width(width), m_words((width + 31)/32), m_count(0)
+    {
+        if (type == VectorFileType::Auto)
+        {
+            std::string ext;
+            const size_t dot = filename.find_last_of('.');
+            if ((dot != std::string::npos) && (filename.find_first_of("/\\", dot) == std::string::npos))
+            {
+                ext = filename.substr(dot);
+                std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+            }
+            type = ((ext == ".hex") || (ext == ".mem") || (ext == ".txt")) ? VectorFileType::Hex : VectorFileType::Binary;
+        }
+        m_hex = (type == VectorFileType::Hex);
+
+        if (m_hex)
+        {
+            indexHex(pool);
+        }
+        else
+        {
+            m_bytes = (width + 7)/8;
+            if ((m_file.size() % m_bytes) != 0)
+            {
+                throw std::runtime_error("compareVectorFiles: the size of " + filename +
+                                         " is not a multiple of the value size!");
+            }
+            m_count = m_file.size() / m_bytes;
+        }
+    }
+
+    uint64_t count() const
+    {
+        return m_count;
+    }
+
+    uint32_t words() const
+    {
+        return m_words;
+    }
+
+    /** return the bytes per value of a binary file, or 0
+        for a hex file */
+    uint32_t valueBytes() const
+    {
+        return m_hex ? 0 : m_bytes;
+    }
+
+    /** return the first byte of block 'block' */
+    const uint8_t* block(uint64_t block) const
+    {
+        return m_file.data() + (m_hex ? m_blocks[block] : block*c_blockValues*m_bytes);
+    }
+
+    /** decode the value at p into 'words', sign-extended
+        like the words of an SFix, and advance p. */
+    void decode(const uint8_t *&p, uint32_t *words) const
+    {
+        if (m_hex)
+        {
+            memset(words, 0, m_words*sizeof(uint32_t));
+            const uint8_t *end = m_file.data() + m_file.size();
+            p = nextToken(p, end);
+            const uint8_t *last = tokenEnd(p, end);
+            uint32_t k = 0;
+            for(const uint8_t *q=last; q>p; q--)
+            {
+                const int32_t d = hexValue(q[-1]);
+                if (d < 0)
+                {
+                    if (q[-1] == '_')
+                    {
+                        continue;
+                    }
+                    throw std::runtime_error("compareVectorFiles: invalid character in a hex value!");
+                }
+                if (k < 8*m_words)
+                {
+                    words[k/8] |= static_cast<uint32_t>(d) << (4*(k % 8));
+                }
+                else if (d != 0)
+                {
+                    throw std::runtime_error("compareVectorFiles: a hex value is too wide!");
+                }
+                k++;
+            }
+            p = last;
+        }
+        else
+        {
+            // assemble every word in a register; read-modify-
+            // write of the output words stalls store forwarding.
+            for(uint32_t w=0; w<m_words; w++)
+            {
+                uint32_t x = 0;
+                const uint32_t n = std::min(4U, m_bytes - 4*w);
+                for(uint32_t k=0; k<n; k++)
+                {
+                    x |= static_cast<uint32_t>(p[4*w+k]) << (8*k);
+                }
+                words[w] = x;
+            }
+            p += m_bytes;
+        }
+
+        // sign-extend the top word from the width
+        const uint32_t topBits = m_width - 32*(m_words-1);
+        if (topBits < 32)
+        {
+            const uint32_t shift = 32 - topBits;
+            words[m_words-1] = static_cast<uint32_t>(static_cast<int32_t>(words[m_words-1] << shift) >> shift);
+        }
+    }
+
+protected:
+    /** count the values and find the start of every block,
+        in two parallel passes over line-aligned ranges. */
+    void indexHex(ThreadPool &pool)
+    {
+        const uint8_t *data = m_file.data();
+        const uint64_t size = m_file.size();
+        const uint32_t ranges = std::max(1U, std::min(pool.threads()*8, static_cast<uint32_t>(size >> 20) + 1));
+        std::vector<uint64_t> starts(ranges+1, size);
+        starts[0] = 0;
+        for(uint32_t r=1; r<ranges; r++)
+        {
+            uint64_t pos = std::max(starts[r-1], size*r/ranges);
+            while((pos < size) && (pos > 0) && (data[pos-1] != '\n'))
+            {
+                pos++;
+            }
+            starts[r] = pos;
+        }
+
+        std::vector<uint64_t> counts(ranges+1, 0);
+        pool.run(ranges, [&](size_t r)
+        {
+            const uint8_t *end = data + starts[r+1];
+            const uint8_t *p = nextToken(data + starts[r], end);
+            uint64_t n = 0;
+            while(p < end)
+            {
+                if (*p == '@')
+                {
+                    throw std::runtime_error("compareVectorFiles: address markers are not supported!");
+                }
+                n++;
+                p = nextToken(tokenEnd(p, end), end);
+            }
+            counts[r+1] = n;
+        });
+        for(uint32_t r=0; r<ranges; r++)
+        {
+            counts[r+1] += counts[r];
+        }
+        m_count = counts[ranges];
+
+        m_blocks.resize((m_count + c_blockValues - 1) / c_blockValues);
+        pool.run(ranges, [&](size_t r)
+        {
+            const uint8_t *end = data + starts[r+1];
+            const uint8_t *p = nextToken(data + starts[r], end);
+            for(uint64_t idx=counts[r]; p<end; idx++)
+            {
+                if ((idx % c_blockValues) == 0)
+                {
+                    m_blocks[idx / c_blockValues] = p - data;
+                }
+                p = nextToken(tokenEnd(p, end), end);
+            }
+        });
+    }
+
+    MappedFile              m_file;
+    bool                    m_hex;
+    uint32_t                m_width;
+    uint32_t                m_words;
+    uint32_t                m_bytes;
+    uint64_t                m_count;
+    std::vector<uint64_t>   m_blocks;   ///< byte offset of every block of a hex file
+};
+
+
+/** return true when a and b differ by at most 'tolerance'.
+    'd' must hold N+1 words. */
+bool withinTolerance(const uint32_t *a, const uint32_t *b, uint32_t N, uint64_t tolerance, uint32_t *d)
+{
+    if (memcmp(a, b, N*sizeof(uint32_t)) == 0)
+    {
+        return true;
+    }
+    if (tolerance == 0)
+    {
+        return false;
+    }
+
+    // d = a - b, one word wider so it cannot overflow
+    const uint32_t extA = (a[N-1] >> 31) ? 0xFFFFFFFF : 0;
+    const uint32_t extB = (b[N-1] >> 31) ? 0xFFFFFFFF : 0;
+    uint64_t borrow = 0;
+    for(uint32_t i=0; i<=N; i++)
+    {
+        const uint64_t t = static_cast<uint64_t>((i < N) ? a[i] : extA) - ((i < N) ? b[i] : extB) - borrow;
+        d[i] = static_cast<uint32_t>(t);
+        borrow = (t >> 32) ? 1 : 0;
+    }
+
+    // |d|
+    if (d[N] >> 31)
+    {
+        uint64_t carry = 1;
+        for(uint32_t i=0; i<=N; i++)
+        {
+            const uint64_t t = static_cast<uint64_t>(~d[i]) + carry;
+            d[i] = static_cast<uint32_t>(t);
+            carry = t >> 32;
+        }
+    }
+    for(uint32_t i=2; i<=N; i++)
+    {
+        if (d[i] != 0)
+        {
+            return false;
+        }
+    }
+    return ((static_cast<uint64_t>(d[1]) << 32) | d[0]) <= tolerance;
+}
+
+/** return value 'index' of a source as an SFix */
+SFix decodeValue(const VectorSource &src, uint64_t index, int32_t intBits, int32_t fracBits)
+{
+    std::vector<uint32_t> words(src.words());
+    const uint8_t *p = src.block(index / c_blockValues);
+    for(uint64_t i=index - index % c_blockValues; i<=index; i++)
+    {
+        src.decode(p, words.data());
+    }
+    SFix v(intBits, fracBits);
+    for(uint32_t i=0; i<words.size(); i++)
+    {
+        v.setInternalValue(i, words[i]);
+    }
+    return v;
+}
+
+} // end anonymous namespace
+
+
+CompareResult fplib::compareVectorFiles(const std::string &fileA, const std::string &fileB,
+                                        const CompareOptions &options)
+{
+    const int32_t width = options.intBits + options.fracBits;
+    if (width <= 0)
+    {
+        throw std::runtime_error("compareVectorFiles: the format must have at least one bit!");
+    }
+
+    std::unique_ptr<ThreadPool> ownPool;
+    if (options.threads != 0)
+    {
+        ownPool.reset(new ThreadPool(options.threads));
+    }
+    ThreadPool &pool = ownPool ? *ownPool : defaultThreadPool();
+
+    VectorSource a(fileA, options.typeA, width, pool);
+    VectorSource b(fileB, options.typeB, width, pool);
+
+    CompareResult result;
+    result.countA = a.count();
+    result.countB = b.count();
+    result.mismatches = 0;
+
+    struct BlockResult
+    {
+        uint64_t                mismatches;
+        std::vector<uint64_t>   first;
+    };
+
+    const uint64_t common = std::min(a.count(), b.count());
+    const uint64_t blocks = (common + c_blockValues - 1) / c_blockValues;
+    const uint32_t N = a.words();
+    std::vector<BlockResult> blockResults(blocks);
+    pool.run(blocks, [&](size_t blk)
+    {
+        std::vector<uint32_t> wa(N), wb(N), d(N+1);
+        const uint8_t *pa = a.block(blk);
+        const uint8_t *pb = b.block(blk);
+        const uint64_t begin = blk*c_blockValues;
+        const uint64_t end   = std::min(common, begin + c_blockValues);
+        BlockResult &r = blockResults[blk];
+        r.mismatches = 0;
+
+        // binary files of the same format can be compared
+        // byte-wise; values are only decoded when they differ.
+        const uint32_t bytes = (a.valueBytes() == b.valueBytes()) ? a.valueBytes() : 0;
+        if ((bytes != 0) && (memcmp(pa, pb, (end-begin)*bytes) == 0))
+        {
+            return;
+        }
+        for(uint64_t i=begin; i<end; i++)
+        {
+            if ((bytes != 0) && (memcmp(pa, pb, bytes) == 0))
+            {
+                pa += bytes;
+                pb += bytes;
+                continue;
+            }
+            a.decode(pa, wa.data());
+            b.decode(pb, wb.data());
+            if (!withinTolerance(wa.data(), wb.data(), N, options.tolerance, d.data()))
+            {
+                r.mismatches++;
+                if (r.first.size() < options.maxReported)
+                {
+                    r.first.push_back(i);
+                }
+            }
+        }
+    });
+
+    for(auto &r : blockResults)
+    {
+        result.mismatches += r.mismatches;
+        for(auto idx : r.first)
+        {
+            if (result.first.size() < options.maxReported)
+            {
+                CompareMismatch m;
+                m.index = idx;
+                m.a = decodeValue(a, idx, options.intBits, options.fracBits);
+                m.b = decodeValue(b, idx, options.intBits, options.fracBits);
+                result.first.push_back(m);
+            }
+        }
+    }
+    return result;
+}
@@ -0,0 +1,104 @@
+/*
+
+    FPLIB: a library providing a fixed-point datatype.
+
+    Comparison of golden-vector files.
+
+    Both files are memory-mapped and hold a sequence of
+    values of one declared Q(intBits, fracBits) format. Two
+    file types are supported:
+
+      * binary: every value takes (intBits+fracBits+7)/8
+        bytes, little endian, two's complement.
+      * hex: $readmemh text, as written by HexWriter: hex
+        values separated by white space, '_' is ignored and
+        '//' starts a comment. values with fewer digits are
+        zero-extended; address markers are not supported.
+
+    The files are split into blocks of values that are
+    compared on a thread pool, word by word, without
+    creating SFix objects; two binary files are compared
+    byte-wise first and values are only decoded where the
+    bytes differ. For hex files the start of every block is
+    found with a parallel scan first. Values match
+    when they differ by at most 'tolerance' LSBs. The first
+    mismatches are decoded into SFix values for reporting.
+
+    Example:
+        CompareOptions opt(1, 15);
+        opt.tolerance = 1;
+        CompareResult r = compareVectorFiles("model.hex", "rtl.bin", opt);
+        if (!r.equal()) ...
+
+    The fplib_compare tool (tools/compare.cpp) is a command
+    line front-end.
+
+    N.A. Moseley 2017
+    License: T.B.D.
+
+*/
+
+#ifndef fpcompare_h
+#define fpcompare_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+#include <vector>
+#include "fplib.h"
+
+namespace fplib
+{
+
+enum class VectorFileType
+{
+    Auto,       ///< hex for .hex, .mem and .txt files, binary otherwise
+    Binary,
+    Hex
+};
+
+struct CompareOptions
+{
+    CompareOptions(int32_t ib, int32_t fb)
+        : intBits(ib), fracBits(fb), tolerance(0), maxReported(10), threads(0),
+          typeA(VectorFileType::Auto), typeB(VectorFileType::Auto) {}
+
+    int32_t         intBits;
+    int32_t         fracBits;
+    uint64_t        tolerance;      ///< allowed difference in LSBs
+    size_t          maxReported;    ///< number of mismatches to decode
+    uint32_t        threads;        ///< 0 selects the hardware threads
+    VectorFileType  typeA;
+    VectorFileType  typeB;
+};
+
+struct CompareMismatch
+{
+    uint64_t    index;  ///< number of the value in the files
+    SFix        a;      ///< value of the first file
+    SFix        b;      ///< value of the second file
+};
+
+struct CompareResult
+{
+    uint64_t    countA;         ///< values in the first file
+    uint64_t    countB;         ///< values in the second file
+    uint64_t    mismatches;     ///< mismatches in the common values
+    std::vector<CompareMismatch> first;    ///< the first mismatches, in order
+
+    /** true when the files have the same number of values
+        and all values match */
+    bool equal() const
+    {
+        return (countA == countB) && (mismatches == 0);
+    }
+};
+
+/** compare two vector files. throws a runtime_error when a
+    file cannot be read or is not a valid vector file. */
+CompareResult compareVectorFiles(const std::string &fileA, const std::string &fileB,
+                                 const CompareOptions &options);
+
+} // end namespace
+
+#endif
@@ -0,0 +1,287 @@
+/*
+
+    FPLIB: a library providing a fixed-point datatype.
+
+    Complex fixed-point numbers.
+
+    N.A. Moseley 2017
+    License: T.B.D.
+
+*/
+
+#include <memory>
+#include <stdexcept>
+#include "fpcomplex.h"
+#include "fpalloc.h"
+
+using namespace fplib;
+
+namespace
+{
+
+/** scratch registers of the in-place operations, one per
+    use so they keep their format. they are re-created on
+    the heap when the requested format changes, so they
+    survive any arena of the thread. */
+thread_local std::unique_ptr<SFix> t_scratch[4];
+
+SFix& scratch(uint32_t slot, int32_t intBits, int32_t fracBits)
+{
+    std::unique_ptr<SFix> &s = t_scratch[slot];
+    if (!s || (s->intBits() != intBits) || (s->fracBits() != fracBits))
+    {
+        HeapScope heap;
+        s.reset(new SFix(intBits, fracBits));
+    }
+    return *s;
+}
+
+void setZero(SFix &v)
+{
+    const uint32_t N = v.getNumberOfWords();
+    for(uint32_t i=0; i<N; i++)
+    {
+        v.setInternalValue(i, 0);
+    }
+}
+
+/** set v to a + b (or a - b) without changing its precision */
+void assignSum(SFix &v, const SFix &a, const SFix &b, bool subtract)
+{
+    setZero(v);
+    v.accumulate(a);
+    v.accumulate(b, subtract);
+}
+
+/** re + j*im = (ar + j*ai) * (br + j*bi), wrapping around
+    in the format of re and im. */
+void complexProduct(SFix &re, SFix &im, const SFix &ar, const SFix &ai,
+                    const SFix &br, const SFix &bi, bool gauss)
+{
+    if ((ar.fracBits() + br.fracBits()) != re.fracBits())
+    {
+        throw std::runtime_error("SCFix::assignProduct fractional bits do not match!");
+    }
+
+    SFix &t = scratch(2, re.intBits(), re.fracBits());
+    if (!gauss)
+    {
+        re.assignTruncatedProduct(ar, br);
+        t.assignTruncatedProduct(ai, bi);
+        re.accumulate(t, true);
+
+        im.assignTruncatedProduct(ar, bi);
+        t.assignTruncatedProduct(ai, br);
+        im.accumulate(t);
+        return;
+    }
+
+    // k1 = br*(ar + ai), k2 = ar*(bi - br), k3 = ai*(br + bi).
+    // the sums are exact and the products wrap around
+    // in the format of the result, like the final sums.
+    SFix &sa = scratch(0, ar.intBits()+1, ar.fracBits());
+    SFix &sb = scratch(1, br.intBits()+1, br.fracBits());
+
+    assignSum(sa, ar, ai, false);
+    re.assignTruncatedProduct(sa, br);
+    im.copyValueFrom(re);
+
+    assignSum(sb, bi, br, true);
+    t.assignTruncatedProduct(ar, sb);
+    im.accumulate(t);
+
+    assignSum(sb, br, bi, false);
+    t.assignTruncatedProduct(ai, sb);
+    re.accumulate(t, true);
+}
+
+/** result = re^2 + im^2, wrapping around in the format of result */
+void magnitude2(SFix &result, const SFix &re, const SFix &im)
+{
+    if ((2*re.fracBits()) != result.fracBits())
+    {
+        throw std::runtime_error("SCFix::magnitudeSquared fractional bits do not match!");
+    }
+
+    SFix &t = scratch(3, result.intBits(), result.fracBits());
+    result.assignTruncatedProduct(re, re);
+    t.assignTruncatedProduct(im, im);
+    result.accumulate(t);
+}
+
+} // end anonymous namespace
+
+
+SCFix::SCFix(int32_t intBits, int32_t fracBits)
+    : m_re(intBits, fracBits),
+      m_im(intBits, fracBits)
+{
+}
+
+
+SCFix::SCFix(const SFix &re, const SFix &im)
+    : m_re(re),
+      m_im(im)
+{
+    if ((re.intBits() != im.intBits()) || (re.fracBits() != im.fracBits()))
+    {
+        throw std::runtime_error("SCFix: the real and imaginary parts have different formats!");
+    }
+}
+
+
+void SCFix::set(const SFix &re, const SFix &im)
+{
+    m_re.copyValueFrom(re);
+    m_im.copyValueFrom(im);
+}
+
+
+SCFix SCFix::operator+(const SCFix &rhs) const
+{
+    return SCFix(m_re + rhs.m_re, m_im + rhs.m_im);
+}
+
+
+SCFix SCFix::operator-(const SCFix &rhs) const
+{
+    return SCFix(m_re - rhs.m_re, m_im - rhs.m_im);
+}
+
+
+SCFix SCFix::operator*(const SCFix &rhs) const
+{
+    SCFix result(intBits()+rhs.intBits()+1, fracBits()+rhs.fracBits());
+    result.assignProduct(*this, rhs, false);
+    return result;
+}
+
+
+SCFix SCFix::gaussProduct(const SCFix &rhs) const
+{
+    SCFix result(intBits()+rhs.intBits()+1, fracBits()+rhs.fracBits());
+    result.assignProduct(*this, rhs, true);
+    return result;
+}
+
+
+SCFix SCFix::conj() const
+{
+    return SCFix(m_re, m_im.negate());
+}
+
+
+SFix SCFix::magnitudeSquared() const
+{
+    SFix result(2*intBits()+1, 2*fracBits());
+    magnitude2(result, m_re, m_im);
+    return result;
+}
+
+
+void SCFix::magnitudeSquared(SFix &result) const
+{
+    magnitude2(result, m_re, m_im);
+}
+
+
+void SCFix::accumulate(const SCFix &a, bool subtract)
+{
+    m_re.accumulate(a.m_re, subtract);
+    m_im.accumulate(a.m_im, subtract);
+}
+
+
+void SCFix::assignProduct(const SCFix &a, const SCFix &b, bool gauss)
+{
+    complexProduct(m_re, m_im, a.m_re, a.m_im, b.m_re, b.m_im, gauss);
+}
+
+
+void SCFix::conjugate()
+{
+    // negate the imaginary part in place: invert
+    // all bits and add one. like negate(), the most
+    // negative number wraps around.
+    const uint32_t N = m_im.getNumberOfWords();
+    uint32_t carry = 1;
+    for(uint32_t i=0; i<N; i++)
+    {
+        const uint32_t w = ~m_im.getInternalValue(i) + carry;
+        carry = (w == 0) ? carry : 0;
+        m_im.setInternalValue(i, w);
+    }
+    m_im.normalizeSignBits();
+}
+
+
+SCFixBuffer::SCFixBuffer(size_t size, int32_t intBits, int32_t fracBits)
+    : m_re(size, SFix(intBits, fracBits)),
+      m_im(size, SFix(intBits, fracBits)),
+      m_intBits(intBits),
+      m_fracBits(fracBits)
+{
+}
+
+
+void SCFixBuffer::checkSize(const SCFixBuffer &other) const
+{
+    if (other.size() != size())
+    {
+        throw std::runtime_error("SCFixBuffer: the buffers have different sizes!");
+    }
+}
+
+
+SCFix SCFixBuffer::get(size_t idx) const
+{
+    return SCFix(m_re.at(idx), m_im.at(idx));
+}
+
+
+void SCFixBuffer::set(size_t idx, const SCFix &v)
+{
+    m_re.at(idx).copyValueFrom(v.real());
+    m_im.at(idx).copyValueFrom(v.imag());
+}
+
+
+void SCFixBuffer::multiply(const SCFixBuffer &a, const SCFixBuffer &b, bool gauss)
+{
+    checkSize(a);
+    checkSize(b);
+    for(size_t i=0; i<m_re.size(); i++)
+    {
+        complexProduct(m_re[i], m_im[i], a.m_re[i], a.m_im[i], b.m_re[i], b.m_im[i], gauss);
+    }
+}
+
+
+void SCFixBuffer::multiply(const SCFixBuffer &a, const SCFix &b, bool gauss)
+{
+    checkSize(a);
+    for(size_t i=0; i<m_re.size(); i++)
+    {
+        complexProduct(m_re[i], m_im[i], a.m_re[i], a.m_im[i], b.real(), b.imag(), gauss);
+    }
+}
+
+
+void SCFixBuffer::accumulate(const SCFixBuffer &a, bool subtract)
+{
+    checkSize(a);
+    for(size_t i=0; i<m_re.size(); i++)
+    {
+        m_re[i].accumulate(a.m_re[i], subtract);
+        m_im[i].accumulate(a.m_im[i], subtract);
+    }
+}
+
+
+void SCFixBuffer::magnitudeSquared(SFix *result) const
+{
+    for(size_t i=0; i<m_re.size(); i++)
+    {
+        magnitude2(result[i], m_re[i], m_im[i]);
+    }
+}
@@ -0,0 +1,238 @@
+/*
+
+    FPLIB: a library providing a fixed-point datatype.
+
+    Complex fixed-point numbers.
+
+    An SCFix holds a real and an imaginary SFix of the
+    same Q(intBits, fracBits) format. The operators follow
+    the format rules of SFix and are exact:
+
+        a + b, a - b : Q( max(n1,n2)+1, max(m1,m2) )
+        a * b        : Q( n1+n2+1, m1+m2 )
+        |a|^2        : Q( 2*n+1, 2*m )
+
+    The product needs two more integer bits than the SFix
+    product: every partial product can reach 2^(n1+n2-2)
+    when both factors are the most negative value, so both
+    re = ar*br - ai*bi and im = ar*bi + ai*br can reach
+    2^(n1+n2-1).
+
+    The product is calculated with four real multiplications,
+    or with three (Gauss) multiplications and five additions:
+
+        k1 = br*(ar + ai), k2 = ar*(bi - br), k3 = ai*(br + bi)
+        re = k1 - k3,      im = k1 + k2
+
+    Both give the same bits. The three-multiplication form
+    is faster when the multiplications dominate, i.e. for
+    operands of about a thousand bits and more.
+
+    The in-place forms, accumulate and assignProduct, keep
+    the format of the number and wrap around like their SFix
+    counterparts. They multiply with assignTruncatedProduct
+    and use thread-local scratch registers, so they do not
+    allocate once the formats stop changing. The operands
+    of assignProduct must not be the number itself.
+
+    An SCFixBuffer stores the real and imaginary parts in
+    separate arrays (structure of arrays) and applies the
+    in-place operations to all elements.
+
+    Example:
+        SCFix x(1, 15), w(1, 15);
+        SCFix y(3, 30);
+        y.assignProduct(x, w, true);        // Gauss product
+
+    N.A. Moseley 2017
+    License: T.B.D.
+
+*/
+
+#ifndef fpcomplex_h
+#define fpcomplex_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+#include "fplib.h"
+
+namespace fplib
+{
+
+/** signed complex fixed-point datatype class */
+class SCFix
+{
+public:
+    /** create a complex Q(intBits, fracBits) number set to zero */
+    SCFix(int32_t intBits, int32_t fracBits);
+
+    /** create a complex number from its parts. the parts must
+        have the same format, otherwise a runtime_error is thrown. */
+    SCFix(const SFix &re, const SFix &im);
+
+    int32_t intBits() const
+    {
+        return m_re.intBits();
+    }
+
+    int32_t fracBits() const
+    {
+        return m_re.fracBits();
+    }
+
+    const SFix& real() const
+    {
+        return m_re;
+    }
+
+    const SFix& imag() const
+    {
+        return m_im;
+    }
+
+    /** set the value. the parts must have the format of
+        this number, otherwise a runtime_error is thrown. */
+    void set(const SFix &re, const SFix &im);
+
+    /** Addition: Q(n1,m1) + Q(n2,m2) -> Q( max(n1,n2)+1, max(m1,m2) ) */
+    SCFix operator+(const SCFix &rhs) const;
+
+    /** Subtraction: Q(n1,m1) - Q(n2,m2) -> Q( max(n1,n2)+1, max(m1,m2) ) */
+    SCFix operator-(const SCFix &rhs) const;
+
+    /** Multiplication: Q(n1,m1) * Q(n2,m2) -> Q(n1+n2, m1+m2),
+        using four real multiplications. */
+    SCFix operator*(const SCFix &rhs) const;
+
+    /** Multiplication like operator*, using three real
+        multiplications. */
+    SCFix gaussProduct(const SCFix &rhs) const;
+
+    /** return the complex conjugate. like SFix::negate, the
+        format is kept, so the most negative imaginary part
+        wraps around. */
+    SCFix conj() const;
+
+    /** return re^2 + im^2 as a Q(2n+1, 2m) number */
+    SFix magnitudeSquared() const;
+
+    /** set 'result' to re^2 + im^2 without changing its
+        precision; the integer bits wrap around. the number
+        of fractional bits must be 2m, otherwise a
+        runtime_error is thrown. */
+    void magnitudeSquared(SFix &result) const;
+
+    bool operator==(const SCFix &rhs) const
+    {
+        return (m_re == rhs.m_re) && (m_im == rhs.m_im);
+    }
+
+    bool operator!=(const SCFix &rhs) const
+    {
+        return !(*this == rhs);
+    }
+
+    /** In-place accumulation: add 'a' to (or subtract 'a' from)
+        this number without changing its precision, see
+        SFix::accumulate. */
+    void accumulate(const SCFix &a, bool subtract = false);
+
+    /** Set this number to the product a*b without changing its
+        precision; the integer bits wrap around. when gauss is
+        true, three real multiplications are used.
+
+        note: the number of fractional bits must equal
+        a.fracBits() + b.fracBits(), otherwise a runtime_error
+        is thrown.
+    */
+    void assignProduct(const SCFix &a, const SCFix &b, bool gauss = false);
+
+    /** negate the imaginary part in place */
+    void conjugate();
+
+protected:
+    SFix m_re;
+    SFix m_im;
+};
+
+
+/** a buffer of complex numbers of the same format, with
+    the real and imaginary parts in separate arrays. */
+class SCFixBuffer
+{
+public:
+    /** create a buffer of 'size' Q(intBits, fracBits) zeros */
+    SCFixBuffer(size_t size, int32_t intBits, int32_t fracBits);
+
+    size_t size() const
+    {
+        return m_re.size();
+    }
+
+    int32_t intBits() const
+    {
+        return m_intBits;
+    }
+
+    int32_t fracBits() const
+    {
+        return m_fracBits;
+    }
+
+    /** the array of real parts */
+    SFix* real()
+    {
+        return m_re.data();
+    }
+
+    const SFix* real() const
+    {
+        return m_re.data();
+    }
+
+    /** the array of imaginary parts */
+    SFix* imag()
+    {
+        return m_im.data();
+    }
+
+    const SFix* imag() const
+    {
+        return m_im.data();
+    }
+
+    /** return element 'idx' */
+    SCFix get(size_t idx) const;
+
+    /** set element 'idx', using copyValueFrom. the format
+        must match, otherwise a runtime_error is thrown. */
+    void set(size_t idx, const SCFix &v);
+
+    /** set every element to a[i]*b[i], see SCFix::assignProduct */
+    void multiply(const SCFixBuffer &a, const SCFixBuffer &b, bool gauss = false);
+
+    /** set every element to a[i]*b, see SCFix::assignProduct */
+    void multiply(const SCFixBuffer &a, const SCFix &b, bool gauss = false);
+
+    /** add a[i] to (or subtract a[i] from) every element,
+        see SCFix::accumulate */
+    void accumulate(const SCFixBuffer &a, bool subtract = false);
+
+    /** write re^2 + im^2 of every element to 'result', see
+        SCFix::magnitudeSquared(SFix &). */
+    void magnitudeSquared(SFix *result) const;
+
+protected:
+    /** throw a runtime_error when 'other' has a different size */
+    void checkSize(const SCFixBuffer &other) const;
+
+    std::vector<SFix>   m_re;
+    std::vector<SFix>   m_im;
+    int32_t             m_intBits;
+    int32_t             m_fracBits;
+};
+
+} // end namespace
+
+#endif
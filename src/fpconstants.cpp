@@ -0,0 +1,911 @@
+/*
+
+    FPLIB: a library providing a fixed-point datatype.
+
+    Mathematical constants to arbitrary precision.
+
+    N.A. Moseley 2017
+    License: T.B.D.
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <map>
+#include <vector>
+#include <mutex>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include "fpconstants.h"
+#include "fpconvert.h"
+#include "fpinternal.h"
+#include "fpalloc.h"
+
+using namespace fplib;
+using namespace fplib::detail;
+
+namespace
+{
+
+/** number of fractional bits computed beyond the requested
+    precision. more are used when the rounding is not certain. */
+const int32_t c_guardBits = 64;
+
+/** an approximation with W fractional bits is within
+    2^-(W-c_errorBits) of the constant. the approximations
+    are much better than that: this is a safety margin. */
+const int32_t c_errorBits = 32;
+
+/** precisions are rounded up to a multiple of this, so that
+    requests for similar precisions share one computation */
+const int32_t c_precisionStep = 64;
+
+/** remove redundant sign bits. one spare integer bit is kept,
+    so that products of trimmed numbers cannot overflow. */
+SFix trim(const SFix &v)
+{
+    const int32_t intBits = std::max(v.determineMinimumIntegerBits(), 1) + 1;
+    if (intBits < v.intBits())
+    {
+        return v.removeMSBs(v.intBits() - intBits);
+    }
+    return v;
+}
+
+/** return an integer as a Q(n,0) number */
+SFix integer(int64_t x)
+{
+    return trim(fromInt64(x, 65, 0));
+}
+
+/** 1/x for 0.5 <= x < 1 as a Q(3,W) number, using
+    Newton iterations y' = y + y*(1 - x*y) that double
+    the precision every step. */
+SFix reciprocal(const SFix &x, int32_t W)
+{
+    // the double approximation is good to 51 bits
+    int32_t p = 48;
+    SFix y = fromDouble(1.0 / toDouble(x), 3, 60);
+    while(p < W)
+    {
+        p = std::min(2*p - 2, W);
+        const int32_t w = p + 8;
+        const SFix xw = fit(x, 1, w);
+        const SFix yw = fit(y, 3, w);
+        const SFix e  = fit(one(w) - fit(xw*yw, 3, w), 2, w);
+        y = fit(yw + fit(yw*e, 3, w), 3, w);
+    }
+    return fit(y, 3, W);
+}
+
+/** 1/sqrt(x) for x > 0.25 as a Q(2,W) number, using
+    Newton iterations y' = y + y*(1 - x*y^2)/2 */
+SFix inverseSqrt(const SFix &x, int32_t W)
+{
+    int32_t p = 48;
+    SFix y = fromDouble(1.0 / sqrt(toDouble(x)), 2, 60);
+    while(p < W)
+    {
+        p = std::min(2*p - 3, W);
+        // x*y^2 loses the integer bits of x
+        const int32_t w = p + 8 + x.intBits();
+        const SFix xw = fit(x, x.intBits(), w);
+        const SFix yw = fit(y, 2, w);
+        const SFix u  = fit(xw*fit(yw*yw, 2, w), 3, w);
+        const SFix d  = fit(yw*fit(one(w) - u, 2, w), 2, w);
+        y = fit(yw + d.reinterpret(1, w+1), 2, w);
+    }
+    return fit(y, 2, W);
+}
+
+/** sqrt(x) for x >= 1 with W fractional bits */
+SFix squareRoot(const SFix &x, int32_t W)
+{
+    const SFix y = inverseSqrt(x, W + 8 + x.intBits());
+    return fit(x*y, x.intBits()+1, W);
+}
+
+/** num/den for integers num and den > 0, with W fractional bits */
+SFix divide(const SFix &num, const SFix &den, int32_t W)
+{
+    // den = x * 2^L with 0.5 <= x < 1
+    const int32_t L = den.determineMinimumIntegerBits() - 1;
+    const SFix x = fit(den, L+1, 0).reinterpret(1, L);
+    const SFix y = reciprocal(x, W + 16);
+
+    // num * y * 2^-L
+    const int32_t nBits = std::max(num.determineMinimumIntegerBits() + 1, L);
+    const SFix p = fit(num, nBits, 0) * y;
+    const SFix q = p.reinterpret(p.intBits() - L, p.fracBits() + L);
+    return trim(fit(q, q.intBits(), W));
+}
+
+/** a term of a hypergeometric series
+        S = sum_n a(n) * prod_{j=0..n} p(j)/q(j)
+    with integer p(n), q(n) and a(n). */
+typedef void (*SeriesTerm)(uint32_t n, SFix &p, SFix &q, SFix &a);
+
+/** binary splitting: calculate the integers P, Q and T so that
+    sum_{n=n1..n2-1} a(n) * prod_{j=n1..n} p(j)/q(j) = T/Q and
+    prod_{j=n1..n2-1} p(j) = P. */
+void split(SeriesTerm term, uint32_t n1, uint32_t n2, SFix &P, SFix &Q, SFix &T)
+{
+    if ((n2 - n1) == 1)
+    {
+        SFix a;
+        term(n1, P, Q, a);
+        T = trim(a*P);
+        return;
+    }
+
+    const uint32_t m = (n1 + n2) / 2;
+    SFix P1, Q1, T1, P2, Q2, T2;
+    split(term, n1, m, P1, Q1, T1);
+    split(term, m, n2, P2, Q2, T2);
+    P = trim(P1*P2);
+    Q = trim(Q1*Q2);
+    T = trim(T1*Q2 + P1*T2);
+}
+
+/** e = sum_n 1/n! */
+void eTerm(uint32_t n, SFix &p, SFix &q, SFix &a)
+{
+    p = integer(1);
+    q = integer((n == 0) ? 1 : n);
+    a = integer(1);
+}
+
+/** ln(2) = 3/4 * sum_n (-1)^n (n!)^2 / (4^n (2n+1)!) */
+void ln2Term(uint32_t n, SFix &p, SFix &q, SFix &a)
+{
+    p = integer((n == 0) ? 1 : -static_cast<int64_t>(n));
+    q = integer((n == 0) ? 1 : 4*(2*static_cast<int64_t>(n)+1));
+    a = integer(1);
+}
+
+/** Chudnovsky: 1/pi = 12/640320^(3/2) * sum_n (-1)^n (6n)! (13591409 + 545140134 n)
+                                             / ((3n)! (n!)^3 640320^(3n)) */
+void piTerm(uint32_t n, SFix &p, SFix &q, SFix &a)
+{
+    const int64_t k = n;
+    a = trim(integer(13591409) + integer(545140134)*integer(k));
+    if (n == 0)
+    {
+        p = integer(1);
+        q = integer(1);
+        return;
+    }
+    p = trim((integer(6*k-5)*integer(2*k-1)*integer(6*k-1)).negate());
+    q = trim(integer(k)*integer(k)*integer(k)*integer(10939058860032000LL));
+}
+
+/** sum a series with W fractional bits */
+SFix sumSeries(SeriesTerm term, uint32_t terms, int32_t W)
+{
+    SFix P, Q, T;
+    split(term, 0, terms, P, Q, T);
+    return divide(T, Q, W);
+}
+
+SFix computeE(int32_t W)
+{
+    // stop when n! > 2^(W+8)
+    double bits = 0.0;
+    uint32_t terms = 1;
+    while(bits < W + 8)
+    {
+        bits += log2(static_cast<double>(terms));
+        terms++;
+    }
+    return fit(sumSeries(eTerm, terms, W + 8), 3, W);
+}
+
+SFix computeLn2(int32_t W)
+{
+    // every term gains 3 bits
+    const SFix s = sumSeries(ln2Term, W/3 + 4, W + 8);
+    const SFix s3 = s + s + s;
+    return fit(s3.reinterpret(s3.intBits()-2, s3.fracBits()+2), 1, W);
+}
+
+SFix computePi(int32_t W)
+{
+    // every term gains 47 bits. pi = 426880 * sqrt(10005) * Q / T.
+    SFix P, Q, T;
+    split(piTerm, 0, W/47 + 2, P, Q, T);
+    const SFix r = divide(trim(Q*integer(426880)), T, W + 32);
+    const SFix s = squareRoot(integer(10005), W + 32);
+    return fit(r*s, 3, W);
+}
+
+SFix computeInvLn2(int32_t W)
+{
+    return fit(reciprocal(computeLn2(W + 16), W + 8), 2, W);
+}
+
+SFix computeSqrt2(int32_t W)
+{
+    return fit(squareRoot(integer(2), W + 8), 2, W);
+}
+
+SFix computeInvPi(int32_t W)
+{
+    // 1/pi = 1/(pi/4) / 4
+    const SFix pi = constants::pi(W + 16);
+    const SFix y = reciprocal(pi.reinterpret(1, pi.fracBits()+2), W + 8);
+    return fit(y.reinterpret(1, y.fracBits()+2), 1, W);
+}
+
+/** atan(2^-i) or atanh(2^-i) = sum_k (-1)^k 2^-i(2k+1) / (2k+1),
+    where the signs alternate for atan only */
+SFix computeArcTan(uint32_t i, bool hyperbolic, int32_t W)
+{
+    if (i == 0)
+    {
+        // atan(1) = pi/4
+        const SFix pi = constants::pi(W + 8);
+        return fit(pi.reinterpret(1, pi.fracBits()+2), 1, W);
+    }
+
+    const int32_t w = W + 16;
+    SFix sum = fromInt64(0, 2, w);
+    for(uint32_t k=0; static_cast<int64_t>(i)*(2*k+1) <= w; k++)
+    {
+        SFix term = fromInt64(0, 2, w);
+        term.addPowerOfTwo(-static_cast<int32_t>(i*(2*k+1)), false);
+        term = divSmall(term, 2*k+1);
+        sum = fit(((k & 1) && !hyperbolic) ? (sum - term) : (sum + term), 2, w);
+    }
+    return fit(sum, 1, W);
+}
+
+/** the inverse CORDIC gain, 1/sqrt(prod (1 +- 2^-2s)) */
+SFix computeCordicGain(uint32_t iterations, bool hyperbolic, int32_t W)
+{
+    // every iteration truncates the product once
+    const int32_t w = W + 48;
+    SFix p = fromInt64(1, 3, w);
+    for(uint32_t n=0; n<iterations; n++)
+    {
+        const int32_t s = 2*static_cast<int32_t>(constants::cordicShift(n, hyperbolic));
+        if (s > w)
+        {
+            break;
+        }
+        const SFix t = fit(fit(p, 3 + s, w).reinterpret(3, w + s), 3, w);
+        p = fit(hyperbolic ? (p - t) : (p + t), 3, w);
+    }
+    return fit(inverseSqrt(p, W + 8), 2, W);
+}
+
+/** sin(phi) and cos(phi) for 0 <= phi <= pi/4. the argument is
+    divided by 2^r so that the Taylor series converge quickly, then
+    the results are doubled r times with sin(2x) = 2 sin(x) cos(x)
+    and cos(2x) = cos(x)^2 - sin(x)^2. */
+void sinCos(const SFix &phi, int32_t W, SFix &s, SFix &c)
+{
+    const int32_t r = static_cast<int32_t>(sqrt(W / 2.0));
+
+    // every doubling step loses up to 1.5 bits
+    const int32_t w = W + 16 + 2*r;
+    const SFix x = fit(fit(phi, 2 + r, w).reinterpret(2, w + r), 2, w);
+
+    // the terms x^k/k!: odd powers belong to
+    // the sine, even powers to the cosine.
+    SFix term = x;
+    s = x;
+    c = one(w);
+    for(uint32_t k=2; !isZero(term); k++)
+    {
+        term = divSmall(fit(term*x, 2, w), k);
+        switch(k % 4)
+        {
+        case 0:
+            c = fit(c + term, 2, w);
+            break;
+        case 1:
+            s = fit(s + term, 2, w);
+            break;
+        case 2:
+            c = fit(c - term, 2, w);
+            break;
+        case 3:
+            s = fit(s - term, 2, w);
+            break;
+        }
+    }
+
+    for(int32_t i=0; i<r; i++)
+    {
+        const SFix sc = fit(s*c, 2, w);
+        c = fit(c*c - s*s, 2, w);
+        s = fit(sc + sc, 2, w);
+    }
+    s = fit(s, 2, W);
+    c = fit(c, 2, W);
+}
+
+/** an approximation of a constant */
+struct Approximation
+{
+    SFix value;
+    bool exact;     ///< the value equals the constant
+};
+
+/** the real part (cos) or imaginary part (-sin) of the
+    twiddle factor exp(-2*pi*i*k/n), for k < n */
+Approximation computeTwiddle(bool imag, uint32_t k, uint32_t n, int32_t W)
+{
+    // 2*pi*k/n = pi/4 * (octant + f), reduced to
+    // phi = pi/4 * f for even octants and pi/4 * (1-f)
+    // for odd octants, so that 0 <= phi <= pi/4.
+    const uint64_t octant = (8*static_cast<uint64_t>(k)) / n;
+    uint64_t num = (8*static_cast<uint64_t>(k)) % n;
+    if (octant & 1)
+    {
+        num = n - num;
+    }
+
+    // cos uses sin(phi) in octants 1,2,5,6 and is negative
+    // in octants 2..5. sin uses sin(phi) in octants 0,3,4,7
+    // and is negative in octants 4..7.
+    const bool swap = ((octant + 1) & 2) != 0;
+    const bool useSine = imag ? !swap : swap;
+    const bool negative = imag ? ((octant & 4) == 0) : (((octant + 2) & 4) != 0);
+
+    Approximation a;
+    a.exact = false;
+    if (num == 0)
+    {
+        // phi = 0
+        a.value = useSine ? fromInt64(0, 2, W) : one(W);
+        a.exact = true;
+    }
+    else if ((3*num == 2*static_cast<uint64_t>(n)) && useSine)
+    {
+        // phi = pi/6
+        a.value = one(W).reinterpret(1, W+1);
+        a.exact = true;
+    }
+    else
+    {
+        // phi = pi * num / (4n)
+        const SFix pi = constants::pi(W + 16);
+        const SFix p = divSmall(pi*integer(static_cast<int64_t>(num)), n);
+        SFix sine, cosine;
+        sinCos(p.reinterpret(p.intBits()-2, p.fracBits()+2), W, sine, cosine);
+        a.value = useSine ? sine : cosine;
+    }
+
+    if (negative)
+    {
+        a.value = a.value.negate();
+    }
+    a.value = fit(a.value, 2, W);
+    return a;
+}
+
+/** parse the name of a twiddle factor constant, "re:k/n" or "im:k/n" */
+bool parseTwiddle(const std::string &name, bool &imag, uint32_t &k, uint32_t &n)
+{
+    char part[3];
+    char end;
+    if ((sscanf(name.c_str(), "%2[reim]:%u/%u%c", part, &k, &n, &end) != 3) ||
+        (n == 0) || (k >= n))
+    {
+        return false;
+    }
+    imag = (std::string(part) == "im");
+    return imag || (std::string(part) == "re");
+}
+
+/** parse the name of a constant with an index, "kind:i" */
+bool parseIndexed(const std::string &name, std::string &kind, uint32_t &i)
+{
+    char buffer[16];
+    char end;
+    if (sscanf(name.c_str(), "%15[a-z]:%u%c", buffer, &i, &end) != 2)
+    {
+        return false;
+    }
+    kind = buffer;
+    if (kind == "atanh")
+    {
+        return (i >= 1);
+    }
+    return (kind == "atan") || (kind == "cordic") || (kind == "cordich");
+}
+
+/** return the number of integer bits of a constant,
+    or 0 if the name is unknown */
+int32_t intBitsOf(const std::string &name)
+{
+    bool imag;
+    uint32_t k, n;
+    std::string kind;
+    if ((name == "pi") || (name == "e"))
+    {
+        return 3;
+    }
+    if (parseIndexed(name, kind, k))
+    {
+        return ((kind == "atan") || (kind == "atanh")) ? 1 : 2;
+    }
+    if ((name == "ln2") || (name == "invpi"))
+    {
+        return 1;
+    }
+    if ((name == "invln2") || (name == "sqrt2") || parseTwiddle(name, imag, k, n))
+    {
+        return 2;
+    }
+    return 0;
+}
+
+/** approximate a constant with W fractional bits */
+Approximation compute(const std::string &name, int32_t W)
+{
+    bool imag;
+    uint32_t k, n;
+    if (parseTwiddle(name, imag, k, n))
+    {
+        return computeTwiddle(imag, k, n, W);
+    }
+
+    Approximation a;
+    a.exact = false;
+    std::string kind;
+    if (parseIndexed(name, kind, k))
+    {
+        if ((kind == "atan") || (kind == "atanh"))
+        {
+            a.value = computeArcTan(k, kind == "atanh", W);
+        }
+        else if (k == 0)
+        {
+            // no iterations, no gain
+            a.value = one(W);
+            a.exact = true;
+        }
+        else
+        {
+            a.value = computeCordicGain(k, kind == "cordich", W);
+        }
+    }
+    else if (name == "pi")
+    {
+        a.value = computePi(W);
+    }
+    else if (name == "e")
+    {
+        a.value = computeE(W);
+    }
+    else if (name == "ln2")
+    {
+        a.value = computeLn2(W);
+    }
+    else if (name == "invln2")
+    {
+        a.value = computeInvLn2(W);
+    }
+    else if (name == "sqrt2")
+    {
+        a.value = computeSqrt2(W);
+    }
+    else if (name == "invpi")
+    {
+        a.value = computeInvPi(W);
+    }
+    else
+    {
+        throw std::runtime_error("fplib::constants: unknown constant " + name);
+    }
+    return a;
+}
+
+/** check that every number within the error bound of the
+    approximation v rounds to the same value when the lower
+    'guard' bits are removed. the guard bits above the error
+    bound must not be all zeros or all ones. */
+bool isCertain(const SFix &v, int32_t guard)
+{
+    bool zeros = true;
+    bool ones = true;
+    for(int32_t bit=c_errorBits+1; bit<guard; bit++)
+    {
+        const bool b = ((v.getInternalValue(bit/32) >> (bit%32)) & 1) != 0;
+        zeros = zeros && !b;
+        ones = ones && b;
+    }
+    return !zeros && !ones;
+}
+
+/** calculate a constant, rounded towards minus infinity */
+SFix evaluate(const std::string &name, int32_t fracBits)
+{
+    for(int32_t guard=c_guardBits; ; guard*=2)
+    {
+        const Approximation a = compute(name, fracBits + guard);
+        if (a.exact || isCertain(a.value, guard))
+        {
+            return fit(a.value, intBitsOf(name), fracBits);
+        }
+    }
+}
+
+struct Cache
+{
+    std::mutex                      mutex;
+    std::map<std::string, SFix>     values;     ///< highest precision of each constant
+    std::string                     filename;   ///< cache file or empty
+    bool                            dirty;      ///< values not yet in the cache file
+
+    Cache() : dirty(false) {}
+};
+
+void flushAtExit();
+
+Cache& cache()
+{
+    // intentionally leaked, like the instrumentation
+    // registry: constants may be used during static
+    // destruction.
+    static Cache *c = new Cache();
+    static bool registered = (atexit(flushAtExit) == 0);
+    (void)registered;
+    return *c;
+}
+
+/** store a constant if it is more precise than the cached one.
+    the cache must be locked. */
+bool store(Cache &c, const std::string &name, const SFix &v)
+{
+    auto iter = c.values.find(name);
+    if ((iter != c.values.end()) && (iter->second.fracBits() >= v.fracBits()))
+    {
+        return false;
+    }
+
+    // cached values outlive any arena of the calling thread.
+    HeapScope heap;
+    if (iter == c.values.end())
+    {
+        c.values.insert(std::make_pair(name, v));
+    }
+    else
+    {
+        iter->second = v;
+    }
+    return true;
+}
+
+/** write constants to a file */
+void write(const std::map<std::string, SFix> &values, const std::string &filename)
+{
+    // write a temporary file and rename it, so
+    // readers never see a partial file.
+    const std::string tmpname = filename + ".tmp";
+    {
+        std::ofstream file(tmpname.c_str());
+        file << "fplib-constants 1\n";
+        for(auto const& entry : values)
+        {
+            file << entry.first << " " << entry.second.intBits() << " "
+                 << entry.second.fracBits() << " " << entry.second.toHexString() << "\n";
+        }
+        if (!file.good())
+        {
+            throw std::runtime_error("fplib::constants: cannot write cache file " + filename);
+        }
+    }
+    if (rename(tmpname.c_str(), filename.c_str()) != 0)
+    {
+        throw std::runtime_error("fplib::constants: cannot write cache file " + filename);
+    }
+}
+
+/** return a constant from the cache, or calculate it */
+SFix get(const std::string &name, int32_t fracBits)
+{
+    if (fracBits < 0)
+    {
+        throw std::runtime_error("fplib::constants: the number of fractional bits must not be negative!");
+    }
+
+    Cache &c = cache();
+    {
+        std::lock_guard<std::mutex> lock(c.mutex);
+        auto iter = c.values.find(name);
+        if ((iter != c.values.end()) && (iter->second.fracBits() >= fracBits))
+        {
+            // truncating a constant that was rounded towards
+            // minus infinity gives the constant rounded to
+            // the lower precision.
+            return fit(iter->second, iter->second.intBits(), fracBits);
+        }
+    }
+
+    // calculate without holding the lock: constants
+    // depend on other constants.
+    const int32_t bits = ((fracBits + c_precisionStep - 1) / c_precisionStep) * c_precisionStep;
+    const SFix v = evaluate(name, bits);
+
+    {
+        std::lock_guard<std::mutex> lock(c.mutex);
+        if (store(c, name, v) && !c.filename.empty())
+        {
+            c.dirty = true;
+        }
+    }
+    return fit(v, v.intBits(), fracBits);
+}
+
+/** write the new constants to the cache file, if there
+    are any. the file is written without holding the lock. */
+void flush(Cache &c)
+{
+    HeapScope heap;
+    std::map<std::string, SFix> values;
+    std::string filename;
+    {
+        std::lock_guard<std::mutex> lock(c.mutex);
+        if (!c.dirty)
+        {
+            return;
+        }
+        values   = c.values;
+        filename = c.filename;
+        c.dirty  = false;
+    }
+
+    try
+    {
+        write(values, filename);
+    }
+    catch(...)
+    {
+        // keep the constants marked for the next attempt,
+        // unless the cache file was changed meanwhile.
+        std::lock_guard<std::mutex> lock(c.mutex);
+        if (c.filename == filename)
+        {
+            c.dirty = true;
+        }
+        throw;
+    }
+}
+
+void flushAtExit()
+{
+    try
+    {
+        flush(cache());
+    }
+    catch(...)
+    {
+        // a cache that cannot be written only costs time
+        // in the next run.
+    }
+}
+
+} // end anonymous namespace
+
+
+SFix constants::pi(int32_t fracBits)
+{
+    return get("pi", fracBits);
+}
+
+
+SFix constants::e(int32_t fracBits)
+{
+    return get("e", fracBits);
+}
+
+
+SFix constants::ln2(int32_t fracBits)
+{
+    return get("ln2", fracBits);
+}
+
+
+SFix constants::invLn2(int32_t fracBits)
+{
+    return get("invln2", fracBits);
+}
+
+
+SFix constants::sqrt2(int32_t fracBits)
+{
+    return get("sqrt2", fracBits);
+}
+
+
+SFix constants::invPi(int32_t fracBits)
+{
+    return get("invpi", fracBits);
+}
+
+
+SFix constants::atanPow2(uint32_t i, int32_t fracBits)
+{
+    return get("atan:" + std::to_string(i), fracBits);
+}
+
+
+SFix constants::atanhPow2(uint32_t i, int32_t fracBits)
+{
+    if (i == 0)
+    {
+        throw std::runtime_error("fplib::constants::atanhPow2: i must be at least 1!");
+    }
+    return get("atanh:" + std::to_string(i), fracBits);
+}
+
+
+uint32_t constants::cordicShift(uint32_t iteration, bool hyperbolic)
+{
+    if (!hyperbolic)
+    {
+        return iteration;
+    }
+
+    uint32_t shift = 1;
+    uint32_t repeat = 4;
+    bool repeated = false;
+    for(uint32_t n=0; n<iteration; n++)
+    {
+        if ((shift == repeat) && !repeated)
+        {
+            repeated = true;
+            continue;
+        }
+        if (shift == repeat)
+        {
+            repeat = 3*repeat + 1;
+        }
+        repeated = false;
+        shift++;
+    }
+    return shift;
+}
+
+
+SFix constants::cordicInverseGain(uint32_t iterations, bool hyperbolic, int32_t fracBits)
+{
+    return get((hyperbolic ? "cordich:" : "cordic:") + std::to_string(iterations), fracBits);
+}
+
+
+void constants::twiddle(uint32_t k, uint32_t n, int32_t fracBits, SFix &re, SFix &im)
+{
+    if (n == 0)
+    {
+        throw std::runtime_error("fplib::constants::twiddle: n must be non-zero!");
+    }
+
+    // reduce k/n, so that equal angles share a cache entry
+    k %= n;
+    uint32_t a = k;
+    uint32_t b = n;
+    while(a != 0)
+    {
+        const uint32_t t = b % a;
+        b = a;
+        a = t;
+    }
+    std::stringstream ss;
+    ss << ":" << (k/b) << "/" << (n/b);
+    re = get("re" + ss.str(), fracBits);
+    im = get("im" + ss.str(), fracBits);
+}
+
+
+void constants::setCacheFile(const std::string &filename)
+{
+    Cache &c = cache();
+    flushAtExit();
+    {
+        std::lock_guard<std::mutex> lock(c.mutex);
+        if (c.filename != filename)
+        {
+            // the constants cached so far belong in the new file
+            c.filename = filename;
+            c.dirty    = !filename.empty() && !c.values.empty();
+        }
+    }
+
+    if (!filename.empty() && std::ifstream(filename.c_str()).good())
+    {
+        loadCache(filename);
+    }
+}
+
+
+void constants::loadCache(const std::string &filename)
+{
+    std::ifstream file(filename.c_str());
+    std::string header;
+    if (!std::getline(file, header) || (header != "fplib-constants 1"))
+    {
+        throw std::runtime_error("fplib::constants: cannot read cache file " + filename);
+    }
+
+    std::vector<std::pair<std::string, SFix> > entries;
+    std::string line;
+    while(std::getline(file, line))
+    {
+        std::istringstream ls(line);
+        std::string name;
+        std::string hex;
+        int32_t intBits;
+        int32_t fracBits;
+        if (!(ls >> name >> intBits >> fracBits >> hex) || (fracBits < 0))
+        {
+            throw std::runtime_error("fplib::constants: malformed line in cache file " + filename);
+        }
+
+        // skip constants this version does not know
+        if (intBitsOf(name) == 0)
+        {
+            continue;
+        }
+
+        const uint32_t N = (static_cast<uint32_t>(intBits) + fracBits + 31) / 32;
+        if ((intBits != intBitsOf(name)) || (hex.size() != 8*static_cast<size_t>(N)) ||
+            (hex.find_first_not_of("0123456789abcdefABCDEF") != std::string::npos))
+        {
+            throw std::runtime_error("fplib::constants: malformed line in cache file " + filename);
+        }
+        SFix v(intBits, fracBits);
+        for(uint32_t i=0; i<N; i++)
+        {
+            v.setInternalValue(N-i-1, static_cast<uint32_t>(strtoul(hex.substr(8*i, 8).c_str(), nullptr, 16)));
+        }
+
+        // a cheap check against a freshly calculated
+        // constant catches damaged or foreign files.
+        const int32_t checkBits = std::min(fracBits, c_guardBits);
+        if (!v.isOk() || (fit(v, intBits, checkBits) != evaluate(name, checkBits)))
+        {
+            throw std::runtime_error("fplib::constants: wrong value for " + name + " in cache file " + filename);
+        }
+        entries.push_back(std::make_pair(name, v));
+    }
+
+    Cache &c = cache();
+    std::lock_guard<std::mutex> lock(c.mutex);
+    for(auto const& entry : entries)
+    {
+        store(c, entry.first, entry.second);
+    }
+}
+
+
+void constants::saveCache(const std::string &filename)
+{
+    Cache &c = cache();
+    HeapScope heap;
+    std::map<std::string, SFix> values;
+    {
+        std::lock_guard<std::mutex> lock(c.mutex);
+        values = c.values;
+    }
+    write(values, filename);
+}
+
+
+void constants::flushCache()
+{
+    flush(cache());
+}
+
+
+void constants::clearCache()
+{
+    Cache &c = cache();
+    std::lock_guard<std::mutex> lock(c.mutex);
+    c.values.clear();
+}
@@ -0,0 +1,116 @@
+/*
+
+    FPLIB: a library providing a fixed-point datatype.
+
+    Mathematical constants to arbitrary precision: pi, e,
+    ln(2), 1/ln(2), sqrt(2), 1/pi, FFT twiddle factors and
+    the angle tables and gains of CORDIC, see fpcordic.h.
+
+    The constants are computed with SFix arithmetic: the
+    series for pi (Chudnovsky), e and ln(2) are summed by
+    binary splitting, divisions and square roots use
+    Newton iterations and the twiddle factors use Taylor
+    series. Results are rounded towards minus infinity,
+    like SFix::removeLSBs, and are exact: the constant is
+    computed with guard bits until the rounding is certain.
+
+    Computed constants are cached in memory. A request for
+    fewer fractional bits than a cached value has is
+    answered by truncating the cached value, so only the
+    highest precision of each constant is stored. The cache
+    can also be kept in a file, so later runs do not have
+    to compute the constants again:
+
+        constants::setCacheFile("constants.fpc");
+        SFix p = constants::pi(4096);   // Q(3,4096)
+
+    All functions are thread-safe.
+
+    N.A. Moseley 2017
+    License: T.B.D.
+
+*/
+
+#ifndef fpconstants_h
+#define fpconstants_h
+
+#include <stdint.h>
+#include <string>
+#include "fplib.h"
+
+namespace fplib
+{
+
+namespace constants
+{
+
+/** pi as a Q(3, fracBits) number */
+SFix pi(int32_t fracBits);
+
+/** e as a Q(3, fracBits) number */
+SFix e(int32_t fracBits);
+
+/** ln(2) as a Q(1, fracBits) number */
+SFix ln2(int32_t fracBits);
+
+/** 1/ln(2) = log2(e) as a Q(2, fracBits) number */
+SFix invLn2(int32_t fracBits);
+
+/** sqrt(2) as a Q(2, fracBits) number */
+SFix sqrt2(int32_t fracBits);
+
+/** 1/pi as a Q(1, fracBits) number */
+SFix invPi(int32_t fracBits);
+
+/** atan(2^-i) as a Q(1, fracBits) number */
+SFix atanPow2(uint32_t i, int32_t fracBits);
+
+/** atanh(2^-i) as a Q(1, fracBits) number. i must be at least 1. */
+SFix atanhPow2(uint32_t i, int32_t fracBits);
+
+/** return the shift s of CORDIC iteration n (counting from 0),
+    i.e. the iteration uses 2^-s. circular CORDIC uses s = n,
+    hyperbolic CORDIC uses 1,2,3,4,4,5,...,13,13,14,... where
+    the shifts 4, 13, 40, ... (s' = 3s+1) are repeated. */
+uint32_t cordicShift(uint32_t iteration, bool hyperbolic);
+
+/** the inverse of the CORDIC gain after a number of iterations,
+    prod 1/sqrt(1 + 2^-2s) for circular and prod 1/sqrt(1 - 2^-2s)
+    for hyperbolic CORDIC, as a Q(2, fracBits) number. */
+SFix cordicInverseGain(uint32_t iterations, bool hyperbolic, int32_t fracBits);
+
+/** the FFT twiddle factor W = exp(-2*pi*i*k/n) as
+    Q(2, fracBits) numbers: re = cos(2*pi*k/n) and
+    im = -sin(2*pi*k/n). n must be non-zero. */
+void twiddle(uint32_t k, uint32_t n, int32_t fracBits, SFix &re, SFix &im);
+
+/** keep the cache in a file. the constants in the file
+    are loaded; the cached constants, including the ones
+    computed before this call, are written to it by
+    flushCache(), when the file is changed and at exit.
+    an empty name stops using the file. a file that does
+    not exist yet is not an error. looking up a constant
+    never throws because the file cannot be written. */
+void setCacheFile(const std::string &filename);
+
+/** write newly computed constants to the cache file now.
+    a std::runtime_error is thrown when the file cannot
+    be written. */
+void flushCache();
+
+/** add the constants in a cache file to the cache.
+    a std::runtime_error is thrown when the file cannot
+    be read or does not hold the right constants. */
+void loadCache(const std::string &filename);
+
+/** write all cached constants to a file */
+void saveCache(const std::string &filename);
+
+/** remove all constants from the in-memory cache */
+void clearCache();
+
+} // end namespace constants
+
+} // end namespace
+
+#endif
@@ -0,0 +1,456 @@
+/*
+
+    FPLIB: a library providing a fixed-point datatype.
+
+    Conversions between SFix and native numbers.
+
+    N.A. Moseley 2017
+    License: T.B.D.
+
+*/
+
+#include <math.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#include "fpconvert.h"
+
+using namespace fplib;
+
+namespace
+{
+
+/** return word 'idx' of v, sign-extended beyond the top-most
+    word and zero below the LSB. */
+inline uint32_t word(const SFix &v, int64_t idx)
+{
+    if (idx < 0)
+    {
+        return 0;
+    }
+    if (idx >= static_cast<int64_t>(v.getNumberOfWords()))
+    {
+        return v.isNegative() ? 0xFFFFFFFF : 0;
+    }
+    return v.getInternalValue(static_cast<uint32_t>(idx));
+}
+
+/** return the 64 bits of v starting at bit 'offset' */
+uint64_t bitsAt(const SFix &v, int64_t offset)
+{
+    if (offset < 0)
+    {
+        return (offset <= -64) ? 0 : (bitsAt(v, 0) << -offset);
+    }
+    const int64_t k = offset / 32;
+    const uint32_t b = offset % 32;
+    uint64_t bits = word(v, k) | (static_cast<uint64_t>(word(v, k+1)) << 32);
+    if (b != 0)
+    {
+        bits = (bits >> b) | (static_cast<uint64_t>(word(v, k+2)) << (64-b));
+    }
+    return bits;
+}
+
+/** check if any of the bits of v below bit 'pos' are set */
+bool anyBitsBelow(const SFix &v, int64_t pos)
+{
+    const int64_t k = pos / 32;
+    for(int64_t i=0; i<k; i++)
+    {
+        if (word(v, i) != 0)
+        {
+            return true;
+        }
+    }
+    const uint32_t b = pos % 32;
+    return (b != 0) && ((word(v, k) & ((1UL << b) - 1)) != 0);
+}
+
+/** return the number of bits needed to represent x */
+inline uint32_t bitLength(uint64_t x)
+{
+#if defined(_MSC_VER) && defined(_M_X64)
+    unsigned long idx;
+    return _BitScanReverse64(&idx, x) ? static_cast<uint32_t>(idx) + 1 : 0;
+#elif defined(_MSC_VER)
+    unsigned long idx;
+    if (_BitScanReverse(&idx, static_cast<uint32_t>(x >> 32)))
+    {
+        return static_cast<uint32_t>(idx) + 33;
+    }
+    return _BitScanReverse(&idx, static_cast<uint32_t>(x)) ? static_cast<uint32_t>(idx) + 1 : 0;
+#else
+    return (x == 0) ? 0 : 64 - __builtin_clzll(x);
+#endif
+}
+
+/** return the number of leading zero bits of x, which
+    must be non-zero */
+inline uint32_t countLeadingZeros(uint32_t x)
+{
+#if defined(_MSC_VER)
+    unsigned long idx;
+    _BitScanReverse(&idx, x);
+    return 31 - static_cast<uint32_t>(idx);
+#else
+    return __builtin_clz(x);
+#endif
+}
+
+/** set dst to the value (-1)^neg * mag * 2^shift LSBs,
+    rounding when shift is negative. */
+void assignScaled(SFix &dst, bool neg, uint64_t mag, int64_t shift, Rounding rounding)
+{
+    if (shift < 0)
+    {
+        // divide by 2^s, rounding the signed value.
+        const uint64_t s = -shift;
+        uint64_t q;
+        bool half;      // remainder is exactly 1/2
+        bool above;     // remainder is more than 1/2
+        bool nonzero;   // remainder is not zero
+        if (s < 64)
+        {
+            const uint64_t rem = mag & ((static_cast<uint64_t>(1) << s) - 1);
+            const uint64_t h = static_cast<uint64_t>(1) << (s-1);
+            q = mag >> s;
+            half = (rem == h);
+            above = (rem > h);
+            nonzero = (rem != 0);
+        }
+        else
+        {
+            const uint64_t h = static_cast<uint64_t>(1) << 63;
+            q = 0;
+            half = (s == 64) && (mag == h);
+            above = (s == 64) && (mag > h);
+            nonzero = (mag != 0);
+        }
+
+        switch(rounding)
+        {
+        case Rounding::Floor:
+            q += (neg && nonzero) ? 1 : 0;
+            break;
+        case Rounding::Nearest:
+            q += (above || (half && (q & 1))) ? 1 : 0;
+            break;
+        case Rounding::TowardZero:
+            break;
+        }
+        mag = q;
+        shift = 0;
+    }
+
+    // the value must fit: |value| < 2^(n-1), or
+    // value == -2^(n-1).
+    const int64_t n = static_cast<int64_t>(dst.intBits()) + dst.fracBits();
+    const int64_t len = bitLength(mag) + shift;
+    if (mag == 0)
+    {
+        neg = false;
+    }
+    else if ((len > n) || ((len == n) && !(neg && ((mag & (mag-1)) == 0))))
+    {
+        throw std::runtime_error("fplib conversion: value out of range!");
+    }
+
+    const uint32_t N = dst.getNumberOfWords();
+    for(uint32_t i=0; i<N; i++)
+    {
+        dst.setInternalValue(i, 0);
+    }
+
+    if (mag != 0)
+    {
+        // place the magnitude; it spans at most three words.
+        const uint32_t k = static_cast<uint32_t>(shift / 32);
+        const uint32_t b = static_cast<uint32_t>(shift % 32);
+        const uint32_t w[3] = { static_cast<uint32_t>(mag << b),
+                                static_cast<uint32_t>((mag << b) >> 32),
+                                (b != 0) ? static_cast<uint32_t>(mag >> (64-b)) : 0 };
+        for(uint32_t i=0; (i<3) && (k+i<N); i++)
+        {
+            dst.setInternalValue(k+i, w[i]);
+        }
+
+        if (neg)
+        {
+            // two's complement over all words; this also
+            // sign-extends the top-most word.
+            bool carry = true;
+            for(uint32_t i=0; i<N; i++)
+            {
+                const uint32_t x = ~dst.getInternalValue(i) + (carry ? 1 : 0);
+                carry = carry && (x == 0);
+                dst.setInternalValue(i, x);
+            }
+        }
+    }
+}
+
+/** determine the sign, the 64 most significant bits of the magnitude
+    (leading one in bit 63, with bit 0 or-ed with all bits below it),
+    and the weight of bit 0 so |v| ~= m * 2^exp.
+    returns false if v is zero.
+*/
+bool significand(const SFix &v, bool &neg, uint64_t &m, int64_t &exp)
+{
+    neg = v.isNegative();
+    const uint32_t inv = neg ? 0xFFFFFFFF : 0;
+
+    // the top-most word of the magnitude (one's complement
+    // for negative numbers) that is not zero.
+    int64_t t = static_cast<int64_t>(v.getNumberOfWords()) - 1;
+    while((t >= 0) && ((v.getInternalValue(static_cast<uint32_t>(t)) ^ inv) == 0))
+    {
+        t--;
+    }
+    if (t < 0)
+    {
+        if (!neg)
+        {
+            return false;
+        }
+        t = 0;  // v = -1 LSB: the magnitude is created by the carry.
+    }
+
+    // three words of the magnitude, plus one for a carry.
+    // for negative numbers |v| = ~v + 1; the +1 only reaches
+    // the window when all lower bits of v are zero.
+    uint32_t mw[4];
+    for(int64_t j=0; j<3; j++)
+    {
+        const int64_t idx = t-2+j;
+        mw[j] = (idx < 0) ? 0 : (word(v, idx) ^ inv);
+    }
+    mw[3] = 0;
+
+    const bool lowerBits = anyBitsBelow(v, 32*std::max(t-2, static_cast<int64_t>(0)));
+    if (neg && !lowerBits)
+    {
+        uint32_t j = static_cast<uint32_t>(std::max(2-t, static_cast<int64_t>(0)));
+        while(j < 4)
+        {
+            mw[j]++;
+            if (mw[j] != 0)
+            {
+                break;
+            }
+            j++;
+        }
+    }
+
+    bool sticky = lowerBits;
+    uint32_t top = 2;
+    if (mw[3] != 0)
+    {
+        top = 3;
+        sticky = sticky || (mw[0] != 0);
+        t++;
+    }
+
+    const uint32_t w2 = mw[top];
+    const uint32_t w1 = mw[top-1];
+    const uint32_t w0 = mw[top-2];
+    const uint32_t lz = countLeadingZeros(w2);
+    m = ((static_cast<uint64_t>(w2) << 32) | w1) << lz;
+    if (lz != 0)
+    {
+        m |= w0 >> (32-lz);
+        sticky = sticky || ((w0 << lz) != 0);
+    }
+    else
+    {
+        sticky = sticky || (w0 != 0);
+    }
+    if (sticky)
+    {
+        m |= 1;
+    }
+    exp = 32*t - 32 - static_cast<int64_t>(lz) - v.fracBits();
+    return true;
+}
+
+/** return the value of a number of at most 64 bits as int64_t */
+inline int64_t smallValue(const SFix &v)
+{
+    if (v.getNumberOfWords() == 1)
+    {
+        return static_cast<int32_t>(v.getInternalValue(0));
+    }
+    return static_cast<int64_t>((static_cast<uint64_t>(v.getInternalValue(1)) << 32) | v.getInternalValue(0));
+}
+
+} // end anonymous namespace
+
+
+void fplib::assignDouble(SFix &dst, double x, Rounding rounding)
+{
+    if (!isfinite(x))
+    {
+        throw std::runtime_error("fplib::fromDouble: value is not finite!");
+    }
+
+    // x = m * 2^e, with m having 53 significant bits
+    int e;
+    const double m = frexp(fabs(x), &e);
+    const uint64_t mag = static_cast<uint64_t>(ldexp(m, 53));
+    assignScaled(dst, x < 0, mag, static_cast<int64_t>(e) - 53 + dst.fracBits(), rounding);
+}
+
+
+SFix fplib::fromDouble(double x, int32_t intBits, int32_t fracBits, Rounding rounding)
+{
+    SFix result(intBits, fracBits);
+    assignDouble(result, x, rounding);
+    return result;
+}
+
+
+SFix fplib::fromFloat(float x, int32_t intBits, int32_t fracBits, Rounding rounding)
+{
+    // every float is exactly representable as a double
+    return fromDouble(x, intBits, fracBits, rounding);
+}
+
+
+SFix fplib::fromInt64(int64_t x, int32_t intBits, int32_t fracBits, Rounding rounding)
+{
+    SFix result(intBits, fracBits);
+    const bool neg = (x < 0);
+    const uint64_t mag = neg ? static_cast<uint64_t>(-(x+1)) + 1 : static_cast<uint64_t>(x);
+    assignScaled(result, neg, mag, fracBits, rounding);
+    return result;
+}
+
+
+double fplib::toDouble(const SFix &v)
+{
+    if (v.getNumberOfWords() <= 2)
+    {
+        // the int64 -> double conversion is exactly rounded,
+        // scaling by a power of two is exact.
+        return ldexp(static_cast<double>(smallValue(v)), -v.fracBits());
+    }
+
+    bool neg;
+    uint64_t m;
+    int64_t exp;
+    if (!significand(v, neg, m, exp))
+    {
+        return 0.0;
+    }
+
+    // bit 0 of m holds the sticky bit, so the uint64 -> double
+    // conversion rounds exactly as the full number would.
+    const double d = ldexp(static_cast<double>(m), static_cast<int>(std::max<int64_t>(std::min<int64_t>(exp, 4096), -4096)));
+    return neg ? -d : d;
+}
+
+
+float fplib::toFloat(const SFix &v)
+{
+    bool neg;
+    uint64_t m;
+    int64_t exp;
+    if (!significand(v, neg, m, exp))
+    {
+        return 0.0f;
+    }
+
+    // round the 64-bit significand to 24 bits, ties to even
+    uint64_t q = m >> 40;
+    const uint64_t rem = m & ((static_cast<uint64_t>(1) << 40) - 1);
+    const uint64_t half = static_cast<uint64_t>(1) << 39;
+    if ((rem > half) || ((rem == half) && (q & 1)))
+    {
+        q++;
+    }
+    const float f = ldexpf(static_cast<float>(q), static_cast<int>(std::max<int64_t>(std::min<int64_t>(exp+40, 512), -512)));
+    return neg ? -f : f;
+}
+
+
+int64_t fplib::toInt64(const SFix &v, Rounding rounding)
+{
+    const int64_t fracBits = v.fracBits();
+    const int64_t n = static_cast<int64_t>(v.intBits()) + fracBits;
+
+    // all bits from bit 63 of the result upwards
+    // must be sign bits.
+    const int64_t signBits = v.isNegative() ? -1 : 0;
+    for(int64_t pos = fracBits+63; pos < n; pos += 64)
+    {
+        if (static_cast<int64_t>(bitsAt(v, pos)) != signBits)
+        {
+            throw std::runtime_error("fplib::toInt64: value out of range!");
+        }
+    }
+
+    // the integer part, rounded towards minus infinity
+    int64_t result = static_cast<int64_t>(bitsAt(v, fracBits));
+    if (fracBits > 0)
+    {
+        const bool half = (bitsAt(v, fracBits-1) & 1) != 0;
+        const bool sticky = anyBitsBelow(v, fracBits-1);
+        bool up = false;
+        switch(rounding)
+        {
+        case Rounding::Floor:
+            break;
+        case Rounding::Nearest:
+            up = half && (sticky || (result & 1));
+            break;
+        case Rounding::TowardZero:
+            up = (result < 0) && (half || sticky);
+            break;
+        }
+        if (up)
+        {
+            if (result == INT64_MAX)
+            {
+                throw std::runtime_error("fplib::toInt64: value out of range!");
+            }
+            result++;
+        }
+    }
+    return result;
+}
+
+
+void fplib::fromDouble(const double *src, SFix *dst, size_t count, Rounding rounding)
+{
+    for(size_t i=0; i<count; i++)
+    {
+        assignDouble(dst[i], src[i], rounding);
+    }
+}
+
+
+void fplib::fromFloat(const float *src, SFix *dst, size_t count, Rounding rounding)
+{
+    for(size_t i=0; i<count; i++)
+    {
+        assignDouble(dst[i], src[i], rounding);
+    }
+}
+
+
+void fplib::toDouble(const SFix *src, double *dst, size_t count)
+{
+    for(size_t i=0; i<count; i++)
+    {
+        dst[i] = toDouble(src[i]);
+    }
+}
+
+
+void fplib::toFloat(const SFix *src, float *dst, size_t count)
+{
+    for(size_t i=0; i<count; i++)
+    {
+        dst[i] = toFloat(src[i]);
+    }
+}
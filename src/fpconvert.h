@@ -0,0 +1,71 @@
+/*
+
+    FPLIB: a library providing a fixed-point datatype.
+
+    Conversions between SFix and native numbers: double,
+    float and int64_t, for single values and for sample
+    buffers.
+
+    All conversions are exactly rounded: the result is
+    the native number or SFix value that the rounding mode
+    selects from the exact value of the source. Values that
+    do not fit the destination cause a std::runtime_error.
+    Conversions to double / float do not produce denormals:
+    values below the normal range may be rounded twice.
+
+    N.A. Moseley 2017
+    License: T.B.D.
+
+*/
+
+#ifndef fpconvert_h
+#define fpconvert_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include "fplib.h"
+
+namespace fplib
+{
+
+/** rounding modes for conversions that lose bits */
+enum class Rounding
+{
+    Floor,      ///< towards minus infinity, like SFix::removeLSBs
+    Nearest,    ///< to nearest, ties to even
+    TowardZero  ///< towards zero, like a C cast
+};
+
+/** convert a double to a Q(intBits, fracBits) number */
+SFix fromDouble(double x, int32_t intBits, int32_t fracBits, Rounding rounding = Rounding::Nearest);
+
+/** convert a float to a Q(intBits, fracBits) number */
+SFix fromFloat(float x, int32_t intBits, int32_t fracBits, Rounding rounding = Rounding::Nearest);
+
+/** convert an integer to a Q(intBits, fracBits) number */
+SFix fromInt64(int64_t x, int32_t intBits, int32_t fracBits, Rounding rounding = Rounding::Nearest);
+
+/** return the double nearest to the value of v (ties to even) */
+double toDouble(const SFix &v);
+
+/** return the float nearest to the value of v (ties to even) */
+float toFloat(const SFix &v);
+
+/** return the value of v rounded to an integer */
+int64_t toInt64(const SFix &v, Rounding rounding = Rounding::Nearest);
+
+/** Buffer conversions. The fromXXX versions write into existing
+    numbers, which keep their format and storage, so converting
+    a buffer does not allocate. */
+void fromDouble(const double *src, SFix *dst, size_t count, Rounding rounding = Rounding::Nearest);
+void fromFloat(const float *src, SFix *dst, size_t count, Rounding rounding = Rounding::Nearest);
+void toDouble(const SFix *src, double *dst, size_t count);
+void toFloat(const SFix *src, float *dst, size_t count);
+
+/** set the value of an existing number from a double,
+    keeping its format and storage. */
+void assignDouble(SFix &dst, double x, Rounding rounding = Rounding::Nearest);
+
+} // end namespace
+
+#endif
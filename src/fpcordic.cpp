@@ -0,0 +1,317 @@
+/*
+
+    FPLIB: a library providing a fixed-point datatype.
+
+    Bit-true CORDIC engine.
+
+    N.A. Moseley 2017
+    License: T.B.D.
+
+*/
+
+#include <map>
+#include <mutex>
+#include <tuple>
+#include <stdexcept>
+#include "fpcordic.h"
+#include "fpconstants.h"
+#include "fpconvert.h"
+#include "fpinternal.h"
+#include "fpalloc.h"
+
+using namespace fplib;
+
+namespace
+{
+
+/** round v to nearest with 'fracBits' fractional bits, ties
+    upwards. v must have more fractional bits. */
+SFix roundToNearest(SFix v, int32_t intBits, int32_t fracBits)
+{
+    v.addPowerOfTwo(-(fracBits+1), false);
+    return detail::fit(v, intBits, fracBits);
+}
+
+/** dst = src * 2^-bits, truncated like an arithmetic right shift.
+    src and dst must have the same format. */
+void shiftRight(const SFix &src, uint32_t bits, SFix &dst)
+{
+    const uint32_t N = src.getNumberOfWords();
+    const uint32_t words = bits / 32;
+    const uint32_t shift = bits % 32;
+    const uint32_t fill  = src.isNegative() ? 0xFFFFFFFF : 0;
+    for(uint32_t i=0; i<N; i++)
+    {
+        const uint32_t lo = (words < N-i) ? src.getInternalValue(i+words) : fill;
+        if (shift == 0)
+        {
+            dst.setInternalValue(i, lo);
+        }
+        else
+        {
+            const uint32_t hi = (words+1 < N-i) ? src.getInternalValue(i+words+1) : fill;
+            dst.setInternalValue(i, (lo >> shift) | (hi << (32-shift)));
+        }
+    }
+}
+
+typedef std::shared_ptr<const std::vector<SFix> > AngleTable;
+
+struct TableCache
+{
+    std::mutex  mutex;
+    std::map<std::tuple<CordicCoordinates, AngleUnit, int32_t>, AngleTable> tables;
+};
+
+TableCache& tableCache()
+{
+    // intentionally leaked, like the constants cache.
+    static TableCache *c = new TableCache();
+    return *c;
+}
+
+/** return the table of atan(2^-s) or atanh(2^-s) for shifts
+    0..maxShift, as Q(1, fracBits) numbers rounded to nearest.
+    tables are shared by all engines with the same settings and
+    number of fractional bits. */
+AngleTable angleTable(CordicCoordinates coordinates, AngleUnit unit, int32_t fracBits, uint32_t maxShift)
+{
+    TableCache &c = tableCache();
+    std::lock_guard<std::mutex> lock(c.mutex);
+
+    AngleTable &table = c.tables[std::make_tuple(coordinates, unit, fracBits)];
+    if (table && (table->size() > maxShift))
+    {
+        return table;
+    }
+
+    // the table entries outlive any arena of the calling thread.
+    HeapScope heap;
+    std::vector<SFix> *angles = new std::vector<SFix>();
+    AngleTable result(angles);
+    for(uint32_t s=0; s<=maxShift; s++)
+    {
+        if (coordinates == CordicCoordinates::Hyperbolic)
+        {
+            // shift 0 is never used: atanh(1) is infinite.
+            angles->push_back((s == 0) ? SFix(1, fracBits) :
+                              roundToNearest(constants::atanhPow2(s, fracBits+1), 1, fracBits));
+        }
+        else if (unit == AngleUnit::HalfTurns)
+        {
+            const int32_t bits = fracBits + 64;
+            angles->push_back(roundToNearest(constants::atanPow2(s, bits)*constants::invPi(bits), 1, fracBits));
+        }
+        else
+        {
+            angles->push_back(roundToNearest(constants::atanPow2(s, fracBits+1), 1, fracBits));
+        }
+    }
+    table = result;
+    return result;
+}
+
+} // end anonymous namespace
+
+
+Cordic::Cordic(int32_t xyIntBits, int32_t xyFracBits, int32_t zIntBits, int32_t zFracBits,
+               uint32_t iterations, CordicCoordinates coordinates, AngleUnit unit)
+    : m_coordinates(coordinates),
+      m_unit(unit),
+      m_fullRange(false),
+      m_x(xyIntBits, xyFracBits),
+      m_y(xyIntBits, xyFracBits),
+      m_z(zIntBits, zFracBits),
+      m_tx(xyIntBits, xyFracBits),
+      m_ty(xyIntBits, xyFracBits),
+      m_zero(xyIntBits, xyFracBits)
+{
+    const bool hyperbolic = (coordinates == CordicCoordinates::Hyperbolic);
+    if (hyperbolic && (unit == AngleUnit::HalfTurns))
+    {
+        throw std::runtime_error("Cordic: half turns are only supported in circular coordinates!");
+    }
+    if ((xyIntBits < (hyperbolic ? 2 : 1)) || (zIntBits < 1))
+    {
+        throw std::runtime_error("Cordic: the register formats cannot hold the gain or angles!");
+    }
+
+    uint32_t maxShift = 0;
+    for(uint32_t n=0; n<iterations; n++)
+    {
+        m_shifts.push_back(constants::cordicShift(n, hyperbolic));
+        maxShift = std::max(maxShift, m_shifts.back());
+    }
+    m_angles = angleTable(coordinates, unit, zFracBits, maxShift);
+
+    m_inverseGain = roundToNearest(constants::cordicInverseGain(iterations, hyperbolic, xyFracBits+1),
+                                   xyIntBits, xyFracBits);
+
+    if (unit == AngleUnit::HalfTurns)
+    {
+        m_pi = fromInt64(1, 2, zFracBits);
+        m_halfPi = m_pi.reinterpret(1, zFracBits+1).removeLSBs(1);
+    }
+    else
+    {
+        const SFix pi = constants::pi(zFracBits+2);
+        m_pi = roundToNearest(pi, 3, zFracBits);
+        m_halfPi = roundToNearest(pi.reinterpret(2, pi.fracBits()+1), 2, zFracBits);
+    }
+    m_minusHalfPi = m_halfPi.negate();
+}
+
+
+void Cordic::setFullRange(bool enable)
+{
+    if (enable && (m_coordinates != CordicCoordinates::Circular))
+    {
+        throw std::runtime_error("Cordic: full-range operation needs circular coordinates!");
+    }
+    m_fullRange = enable;
+}
+
+
+void Cordic::negate(SFix &r, SFix &tmp)
+{
+    tmp.copyValueFrom(r);
+    r.copyValueFrom(m_zero);
+    r.accumulate(tmp, true);
+}
+
+
+void Cordic::fullRangeCorrection(bool vectoring)
+{
+    if (vectoring)
+    {
+        // atan2(y,x) = atan(y/x) +- pi for x < 0
+        if (m_x.isNegative())
+        {
+            m_z.accumulate(m_pi, m_y.isNegative());
+            negate(m_x, m_tx);
+            negate(m_y, m_ty);
+        }
+    }
+    else
+    {
+        const bool above = (compare(m_z, m_halfPi) > 0);
+        const bool below = (compare(m_z, m_minusHalfPi) < 0);
+        if (above || below)
+        {
+            m_z.accumulate(m_pi, above);
+            negate(m_x, m_tx);
+            negate(m_y, m_ty);
+        }
+    }
+}
+
+
+void Cordic::run(const SFix &x, const SFix &y, const SFix &z, bool vectoring)
+{
+    m_x.copyValueFrom(x);
+    m_y.copyValueFrom(y);
+    m_z.copyValueFrom(z);
+
+    if (m_fullRange)
+    {
+        fullRangeCorrection(vectoring);
+    }
+
+    const bool circular = (m_coordinates == CordicCoordinates::Circular);
+    const std::vector<SFix> &angles = *m_angles;
+    for(auto s : m_shifts)
+    {
+        shiftRight(m_x, s, m_tx);
+        shiftRight(m_y, s, m_ty);
+
+        // d = +1 rotates counter-clockwise:
+        //   circular:   x -= d*y*2^-s
+        //   hyperbolic: x += d*y*2^-s
+        //   y += d*x*2^-s, z -= d*angle
+        const bool positive = vectoring ? m_y.isNegative() : !m_z.isNegative();
+        m_x.accumulate(m_ty, positive == circular);
+        m_y.accumulate(m_tx, !positive);
+        m_z.accumulate(angles[s], positive);
+    }
+}
+
+
+void Cordic::rotate(const SFix &x, const SFix &y, const SFix &z)
+{
+    run(x, y, z, false);
+}
+
+
+void Cordic::vector(const SFix &x, const SFix &y, const SFix &z)
+{
+    run(x, y, z, true);
+}
+
+
+void Cordic::sinCos(const SFix &angle, SFix &sine, SFix &cosine)
+{
+    run(m_inverseGain, m_zero, angle, false);
+    sine = m_y;
+    cosine = m_x;
+}
+
+
+void Cordic::rotate(const SFix *x, const SFix *y, const SFix *z,
+                    SFix *xOut, SFix *yOut, SFix *zOut, size_t count)
+{
+    for(size_t i=0; i<count; i++)
+    {
+        run(x[i], y[i], z[i], false);
+        if (xOut != nullptr)
+        {
+            xOut[i].copyValueFrom(m_x);
+        }
+        if (yOut != nullptr)
+        {
+            yOut[i].copyValueFrom(m_y);
+        }
+        if (zOut != nullptr)
+        {
+            zOut[i].copyValueFrom(m_z);
+        }
+    }
+}
+
+
+void Cordic::vector(const SFix *x, const SFix *y, const SFix *z,
+                    SFix *xOut, SFix *yOut, SFix *zOut, size_t count)
+{
+    for(size_t i=0; i<count; i++)
+    {
+        run(x[i], y[i], z[i], true);
+        if (xOut != nullptr)
+        {
+            xOut[i].copyValueFrom(m_x);
+        }
+        if (yOut != nullptr)
+        {
+            yOut[i].copyValueFrom(m_y);
+        }
+        if (zOut != nullptr)
+        {
+            zOut[i].copyValueFrom(m_z);
+        }
+    }
+}
+
+
+void Cordic::sinCos(const SFix *angle, SFix *sine, SFix *cosine, size_t count)
+{
+    for(size_t i=0; i<count; i++)
+    {
+        run(m_inverseGain, m_zero, angle[i], false);
+        if (sine != nullptr)
+        {
+            sine[i].copyValueFrom(m_y);
+        }
+        if (cosine != nullptr)
+        {
+            cosine[i].copyValueFrom(m_x);
+        }
+    }
+}
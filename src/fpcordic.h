@@ -0,0 +1,175 @@
+/*
+
+    FPLIB: a library providing a fixed-point datatype.
+
+    Bit-true CORDIC engine.
+
+    The engine models a hardware CORDIC with x, y and z
+    registers of fixed SFix formats. Every iteration shifts
+    x and y right (arithmetic shift, i.e. truncation towards
+    minus infinity), adds or subtracts them and adds or
+    subtracts an angle table entry to/from z. All additions
+    wrap around like in hardware.
+
+    Modes:
+        rotation:  z is driven to zero; (x,y) is rotated by z.
+                   circular: x = K*(x0*cos(z0) - y0*sin(z0))
+                             y = K*(y0*cos(z0) + x0*sin(z0))
+                   hyperbolic: cosh / sinh instead of cos / sin.
+        vectoring: y is driven to zero.
+                   circular: x = K*sqrt(x0^2 + y0^2)
+                             z = z0 + atan(y0/x0)
+                   hyperbolic: x = K*sqrt(x0^2 - y0^2)
+                               z = z0 + atanh(y0/x0)
+
+    K is the gain of the iterations, see inverseGain(); it
+    is about 1.65 for circular and 0.83 for hyperbolic
+    CORDIC. The x and y registers must hold the results
+    including the gain, or they wrap around.
+    Circular rotation converges for |z0| < 1.74 radians and
+    vectoring needs x0 > 0, unless full-range operation is
+    enabled. Hyperbolic rotation converges for |z0| < 1.11.
+
+    The angle tables are rounded to nearest and are shared
+    by all engines with the same z format. The iterations
+    run in registers that are allocated once, when the
+    engine is created.
+
+    Example: a numerically controlled oscillator
+        Cordic nco(2, 16, 1, 24, 18, CordicCoordinates::Circular,
+                   AngleUnit::HalfTurns);
+        nco.sinCos(phase, s, c);
+
+    N.A. Moseley 2017
+    License: T.B.D.
+
+*/
+
+#ifndef fpcordic_h
+#define fpcordic_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include <memory>
+#include <vector>
+#include "fplib.h"
+
+namespace fplib
+{
+
+/** coordinate system of the CORDIC iterations */
+enum class CordicCoordinates
+{
+    Circular,       ///< sin, cos, atan, magnitude
+    Hyperbolic      ///< sinh, cosh, atanh
+};
+
+/** unit of the CORDIC z register */
+enum class AngleUnit
+{
+    Radians,
+    HalfTurns       ///< units of pi: the range [-1,1) covers a full turn
+};
+
+class Cordic
+{
+public:
+    /** create a CORDIC engine.
+        @param[in] xyIntBits  integer bits of the x and y registers.
+        @param[in] xyFracBits fractional bits of the x and y registers.
+        @param[in] zIntBits   integer bits of the z register.
+        @param[in] zFracBits  fractional bits of the z register.
+        @param[in] iterations number of iterations.
+        @param[in] coordinates circular or hyperbolic.
+        @param[in] unit       angle unit, half turns are circular only.
+    */
+    Cordic(int32_t xyIntBits, int32_t xyFracBits, int32_t zIntBits, int32_t zFracBits,
+           uint32_t iterations,
+           CordicCoordinates coordinates = CordicCoordinates::Circular,
+           AngleUnit unit = AngleUnit::Radians);
+
+    /** enable or disable full-range operation (circular only).
+        the input is first rotated by pi when the angle is
+        outside [-pi/2, pi/2] (rotation) or when x0 < 0
+        (vectoring). z must be able to hold +-pi, unless the
+        angle unit is half turns, where z wraps around. */
+    void setFullRange(bool enable);
+
+    /** run the rotation mode. the inputs must have the
+        formats of the registers. */
+    void rotate(const SFix &x, const SFix &y, const SFix &z);
+
+    /** run the vectoring mode. the inputs must have the
+        formats of the registers. */
+    void vector(const SFix &x, const SFix &y, const SFix &z);
+
+    /** the registers after the last run */
+    const SFix& x() const
+    {
+        return m_x;
+    }
+
+    const SFix& y() const
+    {
+        return m_y;
+    }
+
+    const SFix& z() const
+    {
+        return m_z;
+    }
+
+    /** 1/K in the format of the x and y registers, rounded
+        to nearest. Rotating (1/K, 0) gives cos and sin. */
+    const SFix& inverseGain() const
+    {
+        return m_inverseGain;
+    }
+
+    /** sine and cosine (or sinh and cosh) of an angle in the
+        z format, by rotating (1/K, 0). the results have the
+        format of the x and y registers. */
+    void sinCos(const SFix &angle, SFix &sine, SFix &cosine);
+
+    /** Batch versions. The inputs and outputs must have the
+        formats of the registers; outputs are written with
+        SFix::copyValueFrom, so they do not allocate. Output
+        pointers may be nullptr when a result is not needed. */
+    void rotate(const SFix *x, const SFix *y, const SFix *z,
+                SFix *xOut, SFix *yOut, SFix *zOut, size_t count);
+    void vector(const SFix *x, const SFix *y, const SFix *z,
+                SFix *xOut, SFix *yOut, SFix *zOut, size_t count);
+    void sinCos(const SFix *angle, SFix *sine, SFix *cosine, size_t count);
+
+protected:
+    /** load the registers and run the iterations */
+    void run(const SFix &x, const SFix &y, const SFix &z, bool vectoring);
+
+    /** rotate (x,y) by pi if needed for full-range operation */
+    void fullRangeCorrection(bool vectoring);
+
+    /** negate a register in place */
+    void negate(SFix &r, SFix &tmp);
+
+    CordicCoordinates   m_coordinates;
+    AngleUnit           m_unit;
+    bool                m_fullRange;
+
+    std::vector<uint32_t>   m_shifts;   ///< shift of every iteration
+    std::shared_ptr<const std::vector<SFix> > m_angles;   ///< angle of every shift
+    SFix                m_inverseGain;
+    SFix                m_pi;           ///< pi with the fractional bits of z
+    SFix                m_halfPi;       ///< pi/2 with the fractional bits of z
+    SFix                m_minusHalfPi;  ///< -pi/2 with the fractional bits of z
+
+    SFix                m_x;
+    SFix                m_y;
+    SFix                m_z;
+    SFix                m_tx;           ///< shifted x
+    SFix                m_ty;           ///< shifted y
+    SFix                m_zero;         ///< zero in the x and y format
+};
+
+} // end namespace
+
+#endif
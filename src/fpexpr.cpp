@@ -0,0 +1,109 @@
+/*
+
+    FPLIB: a library providing a fixed-point datatype.
+
+    Expression templates for SFix: evaluation kernels.
+
+    N.A. Moseley 2017
+    License: T.B.D.
+
+*/
+
+#include "fpexpr.h"
+
+using namespace fplib;
+using namespace fplib::expr;
+
+SFix expr::detail::wrap(const SFix &v, int32_t intBits)
+{
+    if (intBits == v.intBits())
+    {
+        return v;
+    }
+
+    // accumulating into a zero number of the
+    // requested precision wraps or sign-extends
+    // in a single pass.
+    SFix result(intBits, v.fracBits());
+    result.accumulate(v);
+    return result;
+}
+
+
+SFix expr::detail::quantize(const SFix &v, int32_t intBits, int32_t fracBits)
+{
+    if (fracBits < v.fracBits())
+    {
+        return wrap(v.removeLSBs(v.fracBits()-fracBits), intBits);
+    }
+    else if (fracBits > v.fracBits())
+    {
+        // add v to a zero number of the requested
+        // precision: aligns and wraps in a single pass.
+        SFix result(intBits, fracBits);
+        result.assignSum(v, result);
+        return result;
+    }
+    return wrap(v, intBits);
+}
+
+
+SFix expr::detail::sum(std::vector<Operand> &terms, int32_t intBits, int32_t fracBits)
+{
+    SFix acc(intBits, fracBits);
+    for(auto &term : terms)
+    {
+        const SFix &v = term.value();
+        if (v.fracBits() == fracBits)
+        {
+            acc.accumulate(v, term.negative);
+        }
+        else
+        {
+            // the accumulator has the largest number of
+            // fractional bits of all terms; the term is
+            // aligned while it is added.
+            acc.assignSum(acc, v, term.negative);
+        }
+    }
+    return acc;
+}
+
+
+SFix expr::detail::product(std::vector<Operand> &factors, int32_t intBits, int32_t fracBits)
+{
+    // all integer bits of partial products above this
+    // weight cannot influence the result.
+    const int32_t topBit = intBits + fracBits;
+
+    // multiply the two narrowest factors and put
+    // the product back, until one factor remains.
+    while(factors.size() > 1)
+    {
+        std::sort(factors.begin(), factors.end(),
+            [](const Operand &a, const Operand &b)
+            {
+                return a.value().getNumberOfWords() > b.value().getNumberOfWords();
+            });
+
+        Operand &a = factors[factors.size()-1];
+        Operand &b = factors[factors.size()-2];
+        const int32_t pFracBits = a.value().fracBits() + b.value().fracBits();
+        const int32_t pIntBits  = std::min(a.value().intBits() + b.value().intBits() - 1,
+                                           topBit - pFracBits);
+
+        Operand p;
+        p.owned = SFix(pIntBits, pFracBits);
+        p.owned.assignProduct(a.value(), b.value());
+
+        factors.pop_back();
+        factors.back() = std::move(p);
+    }
+
+    const SFix &v = factors[0].value();
+    if ((v.intBits() == intBits) && (factors[0].ptr == nullptr))
+    {
+        return std::move(factors[0].owned);
+    }
+    return wrap(v, intBits);
+}
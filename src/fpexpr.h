@@ -0,0 +1,419 @@
+/*
+
+    FPLIB: a library providing a fixed-point datatype.
+
+    Expression templates for SFix. An expression such as
+
+        x.reinterpret(9,255) - x*x*b
+
+    evaluates one operator at a time, materialising every
+    intermediate result at its full width. Using the lazy
+    layer in this file, the same expression is recorded as
+    a tree and evaluated as a whole:
+
+        using namespace fplib::expr;
+        assign(x, lazy(x.reinterpret(9,255)) - lazy(x)*x*b);
+
+    The final Q format of the tree is inferred using the
+    same rules as the SFix operators. During evaluation:
+
+      * integer bits that cannot influence the destination
+        are never calculated: two's complement addition,
+        subtraction and multiplication wrap around, so
+        every sub-expression is evaluated modulo the
+        destination range (plus the fractional bits of the
+        other factors for multiplications).
+      * chains of additions/subtractions are summed into a
+        single accumulator, in place.
+      * chains of multiplications are evaluated narrowest
+        operands first.
+      * leaves are used in place, without copies.
+
+    Removed fractional bits are truncated, like removeLSBs.
+    Removed integer bits wrap around (two's complement). The
+    result is therefore bit-identical to evaluating the tree
+    with the SFix operators followed by removeLSBs/removeMSBs
+    whenever the value fits the destination format.
+
+    Note: expressions hold references to their SFix leaves
+    and must be evaluated within the lifetime of the leaves,
+    i.e. normally within the same statement.
+
+    N.A. Moseley 2017
+    License: T.B.D.
+
+*/
+
+#ifndef fpexpr_h
+#define fpexpr_h
+
+#include <vector>
+#include "fplib.h"
+
+namespace fplib
+{
+
+namespace expr
+{
+
+/** a term of a flattened addition/subtraction chain,
+    or a factor of a flattened multiplication chain.
+    Leaves are referred to directly, other nodes store
+    their evaluated value. */
+struct Operand
+{
+    Operand() : ptr(nullptr), negative(false) {}
+
+    const SFix& value() const
+    {
+        return (ptr != nullptr) ? *ptr : owned;
+    }
+
+    const SFix  *ptr;       ///< leaf value, or nullptr when owned is used
+    SFix        owned;      ///< evaluated value of a non-leaf node
+    bool        negative;   ///< term is subtracted
+};
+
+namespace detail
+{
+    /** return value 'v' at exactly Q(intBits, v.fracBits()),
+        wrapping or sign-extending the integer bits. */
+    SFix wrap(const SFix &v, int32_t intBits);
+
+    /** return value 'v' at exactly Q(intBits, fracBits),
+        truncating or extending the fractional bits and
+        wrapping or sign-extending the integer bits. */
+    SFix quantize(const SFix &v, int32_t intBits, int32_t fracBits);
+
+    /** sum a flattened addition chain into Q(intBits, fracBits) */
+    SFix sum(std::vector<Operand> &terms, int32_t intBits, int32_t fracBits);
+
+    /** multiply a flattened multiplication chain into
+        Q(intBits, fracBits). The fractional bits must be the
+        sum of the fractional bits of the factors. */
+    SFix product(std::vector<Operand> &factors, int32_t intBits, int32_t fracBits);
+}
+
+/** base class of all expression nodes (CRTP).
+
+    Every node provides:
+      intBits(), fracBits() : the inferred Q format.
+      eval(needed)          : the value at Q(min(intBits(),needed), fracBits()),
+                              wrapped modulo the range of that format.
+      collectTerms()        : flatten addition/subtraction chains.
+      collectFactors()      : flatten multiplication chains.
+*/
+template <class E> class Expr
+{
+public:
+    const E& self() const
+    {
+        return static_cast<const E&>(*this);
+    }
+
+    int32_t intBits() const
+    {
+        return self().intBits();
+    }
+
+    int32_t fracBits() const
+    {
+        return self().fracBits();
+    }
+
+    /** evaluate the expression at its natural precision */
+    SFix eval() const
+    {
+        return self().eval(self().intBits());
+    }
+
+    /** a node that is not an addition or subtraction
+        is a single term. */
+    void collectTerms(std::vector<Operand> &terms, bool negative, int32_t needed) const
+    {
+        terms.push_back(Operand());
+        terms.back().owned = self().eval(needed);
+        terms.back().negative = negative;
+    }
+
+    /** a node that is not a multiplication is a single
+        factor. */
+    void collectFactors(std::vector<Operand> &factors, int32_t needed) const
+    {
+        factors.push_back(Operand());
+        factors.back().owned = self().eval(needed);
+    }
+};
+
+/** leaf node referring to an existing SFix */
+class Leaf : public Expr<Leaf>
+{
+public:
+    explicit Leaf(const SFix &v) : m_v(v) {}
+
+    int32_t intBits() const
+    {
+        return m_v.intBits();
+    }
+
+    int32_t fracBits() const
+    {
+        return m_v.fracBits();
+    }
+
+    SFix eval(int32_t needed) const
+    {
+        return detail::wrap(m_v, std::min(needed, m_v.intBits()));
+    }
+
+    void collectTerms(std::vector<Operand> &terms, bool negative, int32_t needed) const
+    {
+        // the accumulator wraps, so a leaf with too
+        // many integer bits can be used as-is.
+        (void)needed;
+        terms.push_back(Operand());
+        terms.back().ptr = &m_v;
+        terms.back().negative = negative;
+    }
+
+    void collectFactors(std::vector<Operand> &factors, int32_t needed) const
+    {
+        factors.push_back(Operand());
+        if ((needed < m_v.intBits()) && ((needed + m_v.fracBits()) > 0))
+        {
+            SFix w = detail::wrap(m_v, needed);
+            if (w.getNumberOfWords() < m_v.getNumberOfWords())
+            {
+                // narrower operand -> fewer partial products
+                factors.back().owned = std::move(w);
+                return;
+            }
+        }
+        factors.back().ptr = &m_v;
+    }
+
+private:
+    const SFix &m_v;
+};
+
+/** addition node: Q(n1,m1) + Q(n2,m2) -> Q( max(n1,n2)+1, max(m1,m2) ) */
+template <class L, class R> class Add : public Expr< Add<L,R> >
+{
+public:
+    Add(const L &l, const R &r) : m_l(l), m_r(r) {}
+
+    int32_t intBits() const
+    {
+        return std::max(m_l.intBits(), m_r.intBits())+1;
+    }
+
+    int32_t fracBits() const
+    {
+        return std::max(m_l.fracBits(), m_r.fracBits());
+    }
+
+    SFix eval(int32_t needed) const
+    {
+        std::vector<Operand> terms;
+        collectTerms(terms, false, needed);
+        return detail::sum(terms, std::min(needed, intBits()), fracBits());
+    }
+
+    void collectTerms(std::vector<Operand> &terms, bool negative, int32_t needed) const
+    {
+        m_l.collectTerms(terms, negative, needed);
+        m_r.collectTerms(terms, negative, needed);
+    }
+
+private:
+    const L m_l;
+    const R m_r;
+};
+
+/** subtraction node: Q(n1,m1) - Q(n2,m2) -> Q( max(n1,n2)+1, max(m1,m2) ) */
+template <class L, class R> class Sub : public Expr< Sub<L,R> >
+{
+public:
+    Sub(const L &l, const R &r) : m_l(l), m_r(r) {}
+
+    int32_t intBits() const
+    {
+        return std::max(m_l.intBits(), m_r.intBits())+1;
+    }
+
+    int32_t fracBits() const
+    {
+        return std::max(m_l.fracBits(), m_r.fracBits());
+    }
+
+    SFix eval(int32_t needed) const
+    {
+        std::vector<Operand> terms;
+        collectTerms(terms, false, needed);
+        return detail::sum(terms, std::min(needed, intBits()), fracBits());
+    }
+
+    void collectTerms(std::vector<Operand> &terms, bool negative, int32_t needed) const
+    {
+        m_l.collectTerms(terms, negative, needed);
+        m_r.collectTerms(terms, !negative, needed);
+    }
+
+private:
+    const L m_l;
+    const R m_r;
+};
+
+/** multiplication node: Q(n1,m1) * Q(n2,m2) -> Q(n1+n2-1, m1+m2) */
+template <class L, class R> class Mul : public Expr< Mul<L,R> >
+{
+public:
+    Mul(const L &l, const R &r) : m_l(l), m_r(r) {}
+
+    int32_t intBits() const
+    {
+        return m_l.intBits() + m_r.intBits() - 1;
+    }
+
+    int32_t fracBits() const
+    {
+        return m_l.fracBits() + m_r.fracBits();
+    }
+
+    SFix eval(int32_t needed) const
+    {
+        std::vector<Operand> factors;
+        collectFactors(factors, needed);
+        return detail::product(factors, std::min(needed, intBits()), fracBits());
+    }
+
+    /** a factor only needs the integer bits of the product
+        plus the fractional bits of the other factors. */
+    void collectFactors(std::vector<Operand> &factors, int32_t needed) const
+    {
+        m_l.collectFactors(factors, needed + m_r.fracBits());
+        m_r.collectFactors(factors, needed + m_l.fracBits());
+    }
+
+private:
+    const L m_l;
+    const R m_r;
+};
+
+/** quantization node: truncate/extend to Q(intBits, fracBits).
+    Removed fractional bits are truncated (rounded towards -inf),
+    removed integer bits wrap around. */
+template <class E> class Quantize : public Expr< Quantize<E> >
+{
+public:
+    Quantize(const E &e, int32_t intBits, int32_t fracBits)
+        : m_e(e), m_intBits(intBits), m_fracBits(fracBits) {}
+
+    int32_t intBits() const
+    {
+        return m_intBits;
+    }
+
+    int32_t fracBits() const
+    {
+        return m_fracBits;
+    }
+
+    SFix eval(int32_t needed) const
+    {
+        const int32_t bits = std::min(needed, m_intBits);
+        return detail::quantize(m_e.eval(bits), bits, m_fracBits);
+    }
+
+private:
+    const E         m_e;
+    const int32_t   m_intBits;
+    const int32_t   m_fracBits;
+};
+
+/** start a lazy expression from an SFix */
+inline Leaf lazy(const SFix &v)
+{
+    return Leaf(v);
+}
+
+template <class L, class R>
+Add<L,R> operator+(const Expr<L> &l, const Expr<R> &r)
+{
+    return Add<L,R>(l.self(), r.self());
+}
+
+template <class L>
+Add<L,Leaf> operator+(const Expr<L> &l, const SFix &r)
+{
+    return Add<L,Leaf>(l.self(), Leaf(r));
+}
+
+template <class R>
+Add<Leaf,R> operator+(const SFix &l, const Expr<R> &r)
+{
+    return Add<Leaf,R>(Leaf(l), r.self());
+}
+
+template <class L, class R>
+Sub<L,R> operator-(const Expr<L> &l, const Expr<R> &r)
+{
+    return Sub<L,R>(l.self(), r.self());
+}
+
+template <class L>
+Sub<L,Leaf> operator-(const Expr<L> &l, const SFix &r)
+{
+    return Sub<L,Leaf>(l.self(), Leaf(r));
+}
+
+template <class R>
+Sub<Leaf,R> operator-(const SFix &l, const Expr<R> &r)
+{
+    return Sub<Leaf,R>(Leaf(l), r.self());
+}
+
+template <class L, class R>
+Mul<L,R> operator*(const Expr<L> &l, const Expr<R> &r)
+{
+    return Mul<L,R>(l.self(), r.self());
+}
+
+template <class L>
+Mul<L,Leaf> operator*(const Expr<L> &l, const SFix &r)
+{
+    return Mul<L,Leaf>(l.self(), Leaf(r));
+}
+
+template <class R>
+Mul<Leaf,R> operator*(const SFix &l, const Expr<R> &r)
+{
+    return Mul<Leaf,R>(Leaf(l), r.self());
+}
+
+/** truncate/extend an expression to Q(intBits, fracBits) */
+template <class E>
+Quantize<E> quantize(const Expr<E> &e, int32_t intBits, int32_t fracBits)
+{
+    return Quantize<E>(e.self(), intBits, fracBits);
+}
+
+/** evaluate an expression into the format of 'dst', truncating
+    the fractional bits and wrapping the integer bits. Only the
+    bits needed for the format of 'dst' are calculated.
+    'dst' may appear in the expression itself.
+*/
+template <class E>
+void assign(SFix &dst, const Expr<E> &e)
+{
+    const int32_t intBits  = dst.intBits();
+    const int32_t fracBits = dst.fracBits();
+    const int32_t bits = std::min(intBits, e.intBits());
+    dst = detail::quantize(e.self().eval(bits), intBits, fracBits);
+}
+
+} // end namespace expr
+
+} // end namespace
+
+#endif
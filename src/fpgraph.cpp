@@ -0,0 +1,358 @@
+/*
+
+    FPLIB: a library providing a fixed-point datatype.
+
+    Dataflow graphs of bit-true DSP models.
+
+    N.A. Moseley 2017
+    License: T.B.D.
+
+*/
+
+#include <algorithm>
+#include <stdexcept>
+#include "fpgraph.h"
+
+using namespace fplib;
+
+namespace
+{
+
+/** return the 32 bits of v starting at bit 'pos', which
+    can be negative; bits below the LSB are zero and bits
+    above the MSB are sign bits. */
+uint32_t bitsAt(const SFix &v, int64_t pos)
+{
+    const int64_t N = v.getNumberOfWords();
+    const uint32_t ext = v.isNegative() ? 0xFFFFFFFF : 0;
+    const int64_t k = (pos >= 0) ? (pos / 32) : -((31 - pos) / 32);
+    const uint32_t s = static_cast<uint32_t>(pos - 32*k);
+
+    const uint32_t lo = (k < 0) ? 0 : ((k < N) ? v.getInternalValue(k) : ext);
+    if (s == 0)
+    {
+        return lo;
+    }
+    const uint32_t hi = (k+1 < 0) ? 0 : ((k+1 < N) ? v.getInternalValue(k+1) : ext);
+    return (lo >> s) | (hi << (32-s));
+}
+
+/** dst = src in the format of dst: fractional bits are
+    truncated or extended, integer bits wrap around or
+    are sign-extended. */
+void quantizeInto(const SFix &src, SFix &dst)
+{
+    const uint32_t N = dst.getNumberOfWords();
+    if (N == 0)
+    {
+        return;
+    }
+
+    const int64_t shift = static_cast<int64_t>(src.fracBits()) - dst.fracBits();
+    for(uint32_t i=0; i<N; i++)
+    {
+        dst.setInternalValue(i, bitsAt(src, 32*static_cast<int64_t>(i) + shift));
+    }
+
+    dst.normalizeSignBits();
+}
+
+} // end anonymous namespace
+
+
+Graph::Graph()
+    : m_compiled(false)
+{
+}
+
+
+NodeId Graph::addNode(Op op, NodeId a, NodeId b, const SFix &value)
+{
+    Node n;
+    n.op = op;
+    n.a = a;
+    n.b = b;
+    n.connected = (op != Op::Delay);
+    n.value = value;
+    m_nodes.push_back(std::move(n));
+    m_compiled = false;
+    return static_cast<NodeId>(m_nodes.size() - 1);
+}
+
+
+void Graph::checkNode(NodeId a) const
+{
+    if (a >= m_nodes.size())
+    {
+        throw std::runtime_error("Graph: the node does not exist!");
+    }
+}
+
+
+NodeId Graph::input(int32_t intBits, int32_t fracBits)
+{
+    const NodeId id = addNode(Op::Input, 0, 0, SFix(intBits, fracBits));
+    m_inputs.push_back(id);
+    return id;
+}
+
+
+NodeId Graph::constant(const SFix &v)
+{
+    return addNode(Op::Constant, 0, 0, v);
+}
+
+
+NodeId Graph::add(NodeId a, NodeId b)
+{
+    checkNode(a);
+    checkNode(b);
+    const SFix &va = m_nodes[a].value;
+    const SFix &vb = m_nodes[b].value;
+    return addNode(Op::Add, a, b, SFix(std::max(va.intBits(), vb.intBits())+1,
+                                       std::max(va.fracBits(), vb.fracBits())));
+}
+
+
+NodeId Graph::sub(NodeId a, NodeId b)
+{
+    checkNode(a);
+    checkNode(b);
+    const SFix &va = m_nodes[a].value;
+    const SFix &vb = m_nodes[b].value;
+    return addNode(Op::Sub, a, b, SFix(std::max(va.intBits(), vb.intBits())+1,
+                                       std::max(va.fracBits(), vb.fracBits())));
+}
+
+
+NodeId Graph::mul(NodeId a, NodeId b)
+{
+    checkNode(a);
+    checkNode(b);
+    const SFix &va = m_nodes[a].value;
+    const SFix &vb = m_nodes[b].value;
+    return addNode(Op::Mul, a, b, SFix(va.intBits()+vb.intBits()-1, va.fracBits()+vb.fracBits()));
+}
+
+
+NodeId Graph::quantize(NodeId a, int32_t intBits, int32_t fracBits)
+{
+    checkNode(a);
+    return addNode(Op::Quantize, a, 0, SFix(intBits, fracBits));
+}
+
+
+NodeId Graph::delay(NodeId a, uint32_t samples)
+{
+    checkNode(a);
+    for(uint32_t i=0; i<samples; i++)
+    {
+        const SFix &v = m_nodes[a].value;
+        const NodeId d = addNode(Op::Delay, a, 0, SFix(v.intBits(), v.fracBits()));
+        m_nodes[d].connected = true;
+        a = d;
+    }
+    return a;
+}
+
+
+NodeId Graph::feedback(int32_t intBits, int32_t fracBits)
+{
+    return addNode(Op::Delay, 0, 0, SFix(intBits, fracBits));
+}
+
+
+void Graph::connect(NodeId delay, NodeId source)
+{
+    checkNode(delay);
+    checkNode(source);
+    Node &d = m_nodes[delay];
+    const SFix &v = m_nodes[source].value;
+    if ((d.op != Op::Delay) || d.connected)
+    {
+        throw std::runtime_error("Graph: only an unconnected feedback delay can be connected!");
+    }
+    if ((v.intBits() != d.value.intBits()) || (v.fracBits() != d.value.fracBits()))
+    {
+        throw std::runtime_error("Graph: the source of a feedback delay must have its format!");
+    }
+    d.a = source;
+    d.connected = true;
+    m_compiled = false;
+}
+
+
+void Graph::output(NodeId a)
+{
+    checkNode(a);
+    m_outputs.push_back(a);
+    m_compiled = false;
+}
+
+
+int32_t Graph::intBits(NodeId a) const
+{
+    checkNode(a);
+    return m_nodes[a].value.intBits();
+}
+
+
+int32_t Graph::fracBits(NodeId a) const
+{
+    checkNode(a);
+    return m_nodes[a].value.fracBits();
+}
+
+
+const SFix& Graph::value(NodeId a) const
+{
+    checkNode(a);
+    return m_nodes[a].value;
+}
+
+
+void Graph::compile()
+{
+    // only nodes that drive an output or a delay are
+    // evaluated. operands are always created before the
+    // nodes that use them, so creation order is a valid
+    // evaluation order; delays break all loops.
+    std::vector<bool> live(m_nodes.size(), false);
+    std::vector<NodeId> stack(m_outputs);
+    m_delays.clear();
+    while(!stack.empty())
+    {
+        const NodeId id = stack.back();
+        stack.pop_back();
+        if (live[id])
+        {
+            continue;
+        }
+        live[id] = true;
+
+        const Node &n = m_nodes[id];
+        switch(n.op)
+        {
+        case Op::Add:
+        case Op::Sub:
+        case Op::Mul:
+            stack.push_back(n.a);
+            stack.push_back(n.b);
+            break;
+        case Op::Quantize:
+            stack.push_back(n.a);
+            break;
+        case Op::Delay:
+            if (!n.connected)
+            {
+                throw std::runtime_error("Graph: a feedback delay is not connected!");
+            }
+            m_delays.push_back(id);
+            stack.push_back(n.a);
+            break;
+        default:
+            break;
+        }
+    }
+
+    m_schedule.clear();
+    for(NodeId id=0; id<m_nodes.size(); id++)
+    {
+        const Op op = m_nodes[id].op;
+        if (live[id] && (op != Op::Input) && (op != Op::Constant) && (op != Op::Delay))
+        {
+            m_schedule.push_back(id);
+        }
+    }
+
+    for(auto id : m_delays)
+    {
+        Node &d = m_nodes[id];
+        d.next = SFix(d.value.intBits(), d.value.fracBits());
+    }
+    m_compiled = true;
+}
+
+
+void Graph::reset()
+{
+    for(auto &n : m_nodes)
+    {
+        if (n.op == Op::Delay)
+        {
+            const uint32_t N = n.value.getNumberOfWords();
+            for(uint32_t i=0; i<N; i++)
+            {
+                n.value.setInternalValue(i, 0);
+            }
+        }
+    }
+}
+
+
+void Graph::evaluate(Node &n)
+{
+    const SFix &a = m_nodes[n.a].value;
+    switch(n.op)
+    {
+    case Op::Add:
+        n.value.assignSum(a, m_nodes[n.b].value);
+        break;
+    case Op::Sub:
+        n.value.assignSum(a, m_nodes[n.b].value, true);
+        break;
+    case Op::Mul:
+        n.value.assignTruncatedProduct(a, m_nodes[n.b].value);
+        break;
+    case Op::Quantize:
+        quantizeInto(a, n.value);
+        break;
+    default:
+        break;
+    }
+}
+
+
+void Graph::run(const std::vector<const SFix*> &inputs,
+                const std::vector<SFix*> &outputs, size_t samples)
+{
+    if (!m_compiled)
+    {
+        compile();
+    }
+    if ((inputs.size() != m_inputs.size()) || (outputs.size() != m_outputs.size()))
+    {
+        throw std::runtime_error("Graph: the number of inputs or outputs does not match!");
+    }
+
+    for(size_t s=0; s<samples; s++)
+    {
+        for(size_t k=0; k<inputs.size(); k++)
+        {
+            m_nodes[m_inputs[k]].value.copyValueFrom(inputs[k][s]);
+        }
+
+        for(auto id : m_schedule)
+        {
+            evaluate(m_nodes[id]);
+        }
+
+        for(size_t k=0; k<outputs.size(); k++)
+        {
+            outputs[k][s].copyValueFrom(m_nodes[m_outputs[k]].value);
+        }
+
+        // two-phase update, so a delay that follows
+        // another one sees its old state.
+        for(auto id : m_delays)
+        {
+            Node &d = m_nodes[id];
+            d.next.copyValueFrom(m_nodes[d.a].value);
+        }
+        for(auto id : m_delays)
+        {
+            Node &d = m_nodes[id];
+            std::swap(d.value, d.next);
+        }
+    }
+}
@@ -0,0 +1,161 @@
+/*
+
+    FPLIB: a library providing a fixed-point datatype.
+
+    Dataflow graphs of bit-true DSP models.
+
+    A Graph is built from nodes: inputs, constants, additions,
+    subtractions, multiplications, quantizers and delays. The
+    Q format of every node is fixed when it is created, using
+    the rules of the SFix operators:
+
+        add, sub : Q( max(n1,n2)+1, max(m1,m2) )
+        mul      : Q( n1+n2-1, m1+m2 )
+        quantize : any format; fractional bits are truncated
+                   like removeLSBs, integer bits wrap around.
+
+    A delay outputs the value of its input one sample earlier,
+    starting with zero. Delays are the only way to build loops:
+    a feedback delay is created with a format and connected to
+    its source later; the source must have the same format.
+
+    Every node owns a register of its format. Operands are
+    created before the nodes that use them, so a loop without
+    a delay cannot be built. compile() checks the graph and
+    makes the list of nodes that drive an output or a delay,
+    in creation order. run() then processes blocks of samples:
+    it evaluates the listed nodes in order, in place, and
+    updates all delays at the end of every sample. Running a
+    compiled graph does not allocate.
+
+    Example: y[n] = x[n] + a*y[n-1]
+        Graph g;
+        NodeId x  = g.input(1, 15);
+        NodeId yd = g.feedback(2, 15);
+        NodeId y  = g.quantize(g.add(x, g.mul(g.constant(a), yd)), 2, 15);
+        g.connect(yd, y);
+        g.output(y);
+        g.compile();
+        g.run({&xs[0]}, {&ys[0]}, xs.size());
+
+    N.A. Moseley 2017
+    License: T.B.D.
+
+*/
+
+#ifndef fpgraph_h
+#define fpgraph_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+#include "fplib.h"
+
+namespace fplib
+{
+
+typedef uint32_t NodeId;
+
+class Graph
+{
+public:
+    Graph();
+
+    /** add an input of format Q(intBits, fracBits). inputs are
+        numbered in the order they are created. */
+    NodeId input(int32_t intBits, int32_t fracBits);
+
+    /** add a constant */
+    NodeId constant(const SFix &v);
+
+    /** add a node a + b */
+    NodeId add(NodeId a, NodeId b);
+
+    /** add a node a - b */
+    NodeId sub(NodeId a, NodeId b);
+
+    /** add a node a * b */
+    NodeId mul(NodeId a, NodeId b);
+
+    /** add a node converting a to Q(intBits, fracBits) */
+    NodeId quantize(NodeId a, int32_t intBits, int32_t fracBits);
+
+    /** add a chain of 'samples' delays of a. returns a when
+        samples is 0. */
+    NodeId delay(NodeId a, uint32_t samples = 1);
+
+    /** add a delay of format Q(intBits, fracBits) whose input
+        is connected later, see connect(). */
+    NodeId feedback(int32_t intBits, int32_t fracBits);
+
+    /** connect the input of a feedback delay to 'source'.
+        throws a std::runtime_error when 'source' has another
+        format or the delay is already connected. */
+    void connect(NodeId delay, NodeId source);
+
+    /** mark a node as output. outputs are numbered in the
+        order they are marked. */
+    void output(NodeId a);
+
+    int32_t intBits(NodeId a) const;
+    int32_t fracBits(NodeId a) const;
+
+    /** check the graph and make the evaluation order. throws
+        a std::runtime_error when a feedback delay that is used
+        is not connected. */
+    void compile();
+
+    /** process 'samples' samples. inputs[k] points to the
+        samples of input k and outputs[k] to the results of
+        output k, which must have the format of the output
+        node. the graph is compiled first if needed. */
+    void run(const std::vector<const SFix*> &inputs,
+             const std::vector<SFix*> &outputs, size_t samples);
+
+    /** set all delays to zero */
+    void reset();
+
+    /** return the value of a node in the last sample */
+    const SFix& value(NodeId a) const;
+
+protected:
+    enum class Op
+    {
+        Input,
+        Constant,
+        Add,
+        Sub,
+        Mul,
+        Quantize,
+        Delay
+    };
+
+    struct Node
+    {
+        Op      op;
+        NodeId  a;          ///< first operand, or the input of a delay
+        NodeId  b;          ///< second operand
+        bool    connected;  ///< a delay has an input
+        SFix    value;      ///< register, or the state of a delay
+        SFix    next;       ///< next state of a delay
+    };
+
+    NodeId addNode(Op op, NodeId a, NodeId b, const SFix &value);
+
+    /** throw a std::runtime_error for a node id that does not exist */
+    void checkNode(NodeId a) const;
+
+    /** evaluate node n for the current sample */
+    void evaluate(Node &n);
+
+    std::vector<Node>   m_nodes;
+    std::vector<NodeId> m_inputs;
+    std::vector<NodeId> m_outputs;
+    std::vector<NodeId> m_delays;
+    std::vector<NodeId> m_schedule;     ///< non-delay nodes in evaluation order
+    bool                m_compiled;
+};
+
+} // end namespace
+
+#endif
@@ -0,0 +1,268 @@
+/*
+
+    FPLIB: a library providing a fixed-point datatype.
+
+    Optional hot-path instrumentation.
+
+    N.A. Moseley 2017
+    License: T.B.D.
+
+*/
+
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include <algorithm>
+#include <chrono>
+#include <string.h>
+#include "fpalloc.h"
+#include "fpinstrument.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+using namespace fplib;
+using namespace fplib::instrument;
+
+namespace
+{
+
+const uint32_t c_fields = 4;   // calls, words, allocations, cycles
+
+/** Counters of one thread. They are written by their own thread
+    only, using relaxed loads and stores, so updating them needs
+    no locked instructions; other threads may read them at any
+    time. */
+struct ThreadCounters
+{
+    ThreadCounters();
+    ~ThreadCounters();
+
+    void add(uint32_t op, uint32_t bucket, const uint64_t values[c_fields])
+    {
+        std::atomic<uint64_t> *c = m_counters[op][bucket];
+        for(uint32_t i=0; i<c_fields; i++)
+        {
+            c[i].store(c[i].load(std::memory_order_relaxed) + values[i], std::memory_order_relaxed);
+        }
+    }
+
+    void mergeInto(Report &r) const
+    {
+        for(uint32_t op=0; op<OP_COUNT; op++)
+        {
+            for(uint32_t b=0; b<c_widthBuckets; b++)
+            {
+                const std::atomic<uint64_t> *c = m_counters[op][b];
+                Counters &dst = r.counters[op][b];
+                dst.calls       += c[0].load(std::memory_order_relaxed);
+                dst.words       += c[1].load(std::memory_order_relaxed);
+                dst.allocations += c[2].load(std::memory_order_relaxed);
+                dst.cycles      += c[3].load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    void clear()
+    {
+        for(uint32_t op=0; op<OP_COUNT; op++)
+        {
+            for(uint32_t b=0; b<c_widthBuckets; b++)
+            {
+                for(uint32_t i=0; i<c_fields; i++)
+                {
+                    m_counters[op][b][i].store(0, std::memory_order_relaxed);
+                }
+            }
+        }
+    }
+
+    std::atomic<uint64_t> m_counters[OP_COUNT][c_widthBuckets][c_fields];
+};
+
+/** registry of the counters of the running threads and
+    the totals of the threads that have exited. the mutex
+    is only taken when a thread starts or exits and when
+    the counters are merged. */
+struct Registry
+{
+    Registry()
+    {
+        memset(&retired, 0, sizeof(retired));
+    }
+
+    std::mutex                      mutex;
+    std::vector<ThreadCounters*>    threads;
+    Report                          retired;
+};
+
+Registry& registry()
+{
+    // intentionally leaked: threads may exit
+    // after static destruction has started.
+    static Registry *r = new Registry();
+    return *r;
+}
+
+ThreadCounters::ThreadCounters()
+{
+    clear();
+    Registry &r = registry();
+    std::lock_guard<std::mutex> lock(r.mutex);
+    r.threads.push_back(this);
+}
+
+ThreadCounters::~ThreadCounters()
+{
+    Registry &r = registry();
+    std::lock_guard<std::mutex> lock(r.mutex);
+    mergeInto(r.retired);
+    r.threads.erase(std::remove(r.threads.begin(), r.threads.end(), this), r.threads.end());
+}
+
+thread_local ThreadCounters t_counters;
+
+inline uint64_t readCycleCounter()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    // no cycle counter available: use nanoseconds.
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+} // end anonymous namespace
+
+
+bool instrument::isEnabled()
+{
+#ifdef FPLIB_INSTRUMENT
+    return true;
+#else
+    return false;
+#endif
+}
+
+
+const char* instrument::operationName(Operation op)
+{
+    static const char *names[OP_COUNT] =
+    {
+        "add", "sub", "mul", "negate",
+        "extendLSBs", "extendMSBs", "removeLSBs", "removeMSBs",
+        "accumulate", "assignProduct", "assignTruncatedProduct", "assignSum",
+        "toString"
+    };
+    return (op < OP_COUNT) ? names[op] : "unknown";
+}
+
+
+uint32_t instrument::widthBucket(uint32_t bits)
+{
+    uint32_t bucket = 0;
+    while((bucket < c_widthBuckets-1) && (bucketWidth(bucket) < bits))
+    {
+        bucket++;
+    }
+    return bucket;
+}
+
+
+uint32_t instrument::bucketWidth(uint32_t bucket)
+{
+    return 8U << bucket;
+}
+
+
+Report instrument::getReport()
+{
+    Registry &r = registry();
+    std::lock_guard<std::mutex> lock(r.mutex);
+
+    Report report = r.retired;
+    for(auto const* t : r.threads)
+    {
+        t->mergeInto(report);
+    }
+    return report;
+}
+
+
+void instrument::reset()
+{
+    Registry &r = registry();
+    std::lock_guard<std::mutex> lock(r.mutex);
+
+    memset(&r.retired, 0, sizeof(r.retired));
+    for(auto *t : r.threads)
+    {
+        t->clear();
+    }
+}
+
+
+void instrument::dump(FILE *f)
+{
+    if (!isEnabled())
+    {
+        fprintf(f, "fplib instrumentation is disabled; build with FPLIB_INSTRUMENT.\n");
+        return;
+    }
+
+    const Report report = getReport();
+    fprintf(f, "%-14s %10s %12s %14s %12s %16s %12s\n",
+            "operation", "bits", "calls", "words", "allocs", "cycles", "cycles/call");
+
+    for(uint32_t op=0; op<OP_COUNT; op++)
+    {
+        for(uint32_t b=0; b<c_widthBuckets; b++)
+        {
+            const Counters &c = report.counters[op][b];
+            if (c.calls == 0)
+            {
+                continue;
+            }
+            char bits[16];
+            if (b == c_widthBuckets-1)
+            {
+                snprintf(bits, sizeof(bits), ">%u", bucketWidth(b-1));
+            }
+            else
+            {
+                snprintf(bits, sizeof(bits), "<=%u", bucketWidth(b));
+            }
+            fprintf(f, "%-14s %10s %12llu %14llu %12llu %16llu %12.1f\n",
+                    operationName(static_cast<Operation>(op)), bits,
+                    static_cast<unsigned long long>(c.calls),
+                    static_cast<unsigned long long>(c.words),
+                    static_cast<unsigned long long>(c.allocations),
+                    static_cast<unsigned long long>(c.cycles),
+                    static_cast<double>(c.cycles) / c.calls);
+        }
+    }
+}
+
+
+Scope::Scope(Operation op, uint32_t bits, uint32_t words)
+    : m_op(op), m_bits(bits), m_words(words)
+{
+    m_allocations = getAllocatorStats().allocations;
+    m_cycles = readCycleCounter();
+}
+
+
+Scope::~Scope()
+{
+    const uint64_t cycles = readCycleCounter() - m_cycles;
+    const uint64_t values[c_fields] =
+    {
+        1,
+        m_words,
+        getAllocatorStats().allocations - m_allocations,
+        cycles
+    };
+    t_counters.add(m_op, widthBucket(m_bits), values);
+}
@@ -0,0 +1,132 @@
+/*
+
+    FPLIB: a library providing a fixed-point datatype.
+
+    Optional hot-path instrumentation. When the library is
+    built with FPLIB_INSTRUMENT defined (cmake -DFPLIB_INSTRUMENT=ON)
+    every SFix operation counts its calls, the number of words
+    it produces, the word allocations it makes and the CPU
+    cycles it takes, bucketed by operand width.
+
+    Counters are kept per thread and are only written by
+    their own thread; getReport() merges them. Without
+    FPLIB_INSTRUMENT the instrumentation macros expand to
+    nothing and the operations are not affected.
+
+    Note: the counts are inclusive; an operation that uses
+    another operation internally, such as an addition of two
+    numbers with different fractional bits, is counted for both.
+
+    N.A. Moseley 2017
+    License: T.B.D.
+
+*/
+
+#ifndef fpinstrument_h
+#define fpinstrument_h
+
+#include <stdint.h>
+#include <stdio.h>
+
+namespace fplib
+{
+
+namespace instrument
+{
+
+/** instrumented operations */
+enum Operation
+{
+    OP_ADD,
+    OP_SUB,
+    OP_MUL,
+    OP_NEGATE,
+    OP_EXTENDLSBS,
+    OP_EXTENDMSBS,
+    OP_REMOVELSBS,
+    OP_REMOVEMSBS,
+    OP_ACCUMULATE,
+    OP_ASSIGNPRODUCT,
+    OP_ASSIGNTRUNCATEDPRODUCT,
+    OP_ASSIGNSUM,
+    OP_TOSTRING,
+    OP_COUNT
+};
+
+/** number of width buckets. bucket 0 holds operations
+    on numbers up to 8 bits, bucket k those on numbers of
+    up to 8*2^k bits. the last bucket holds all wider ones. */
+const uint32_t c_widthBuckets = 18;
+
+/** counters of one operation / width bucket */
+struct Counters
+{
+    uint64_t calls;         ///< number of calls
+    uint64_t words;         ///< number of result words produced
+    uint64_t allocations;   ///< number of word buffers allocated
+    uint64_t cycles;        ///< CPU cycles spent
+};
+
+/** merged counters of all threads */
+struct Report
+{
+    Counters counters[OP_COUNT][c_widthBuckets];
+};
+
+/** returns true if the library was built with FPLIB_INSTRUMENT */
+bool isEnabled();
+
+/** return the name of an operation */
+const char* operationName(Operation op);
+
+/** return the width bucket for a number of bits */
+uint32_t widthBucket(uint32_t bits);
+
+/** return the largest width (in bits) held by a bucket */
+uint32_t bucketWidth(uint32_t bucket);
+
+/** merge the counters of all threads, including
+    those that have already exited. */
+Report getReport();
+
+/** reset the counters of all threads. this should
+    not be called while instrumented operations are
+    running on other threads. */
+void reset();
+
+/** write the non-zero counters as a table */
+void dump(FILE *f);
+
+/** Measures one operation from construction to destruction.
+    Use the FPLIB_INSTRUMENT_SCOPE macro instead of
+    creating a Scope directly.
+*/
+class Scope
+{
+public:
+    Scope(Operation op, uint32_t bits, uint32_t words);
+    ~Scope();
+
+private:
+    Scope(const Scope &);
+    Scope& operator=(const Scope &);
+
+    Operation   m_op;
+    uint32_t    m_bits;
+    uint32_t    m_words;
+    uint64_t    m_allocations;  ///< allocation count at construction
+    uint64_t    m_cycles;       ///< cycle counter at construction
+};
+
+} // end namespace instrument
+
+} // end namespace
+
+#ifdef FPLIB_INSTRUMENT
+#define FPLIB_INSTRUMENT_SCOPE(op, bits, words) \
+    fplib::instrument::Scope fplib_instrument_scope(fplib::instrument::op, bits, words)
+#else
+#define FPLIB_INSTRUMENT_SCOPE(op, bits, words) do {} while(0)
+#endif
+
+#endif
@@ -0,0 +1,72 @@
+/*
+
+    FPLIB: a library providing a fixed-point datatype.
+
+    Small helpers shared by the implementation of the
+    library.
+
+    N.A. Moseley 2017
+    License: T.B.D.
+
+*/
+
+#include "fpinternal.h"
+#include "fpconvert.h"
+
+using namespace fplib;
+
+SFix fplib::detail::fit(const SFix &v, int32_t intBits, int32_t fracBits)
+{
+    SFix result = v;
+    if (result.fracBits() > fracBits)
+    {
+        result = result.removeLSBs(result.fracBits() - fracBits);
+    }
+    else if (result.fracBits() < fracBits)
+    {
+        result = result.extendLSBs(fracBits - result.fracBits());
+    }
+
+    if (result.intBits() > intBits)
+    {
+        result = result.removeMSBs(result.intBits() - intBits);
+    }
+    else if (result.intBits() < intBits)
+    {
+        result = result.extendMSBs(intBits - result.intBits());
+    }
+    return result;
+}
+
+
+SFix fplib::detail::one(int32_t fracBits)
+{
+    return fromInt64(1, 2, fracBits);
+}
+
+
+bool fplib::detail::isZero(const SFix &v)
+{
+    for(uint32_t i=0; i<v.getNumberOfWords(); i++)
+    {
+        if (v.getInternalValue(i) != 0)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+
+SFix fplib::detail::divSmall(const SFix &v, uint32_t d)
+{
+    SFix result(v.intBits(), v.fracBits());
+    uint64_t rem = 0;
+    for(uint32_t i=v.getNumberOfWords(); i>0; i--)
+    {
+        rem = (rem << 32) | v.getInternalValue(i-1);
+        result.setInternalValue(i-1, static_cast<uint32_t>(rem / d));
+        rem %= d;
+    }
+    return result;
+}
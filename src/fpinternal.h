@@ -0,0 +1,42 @@
+/*
+
+    FPLIB: a library providing a fixed-point datatype.
+
+    Small helpers shared by the implementation of the
+    library. They are not part of the public interface.
+
+    N.A. Moseley 2017
+    License: T.B.D.
+
+*/
+
+#ifndef fpinternal_h
+#define fpinternal_h
+
+#include <stdint.h>
+#include "fplib.h"
+
+namespace fplib
+{
+
+namespace detail
+{
+    /** change the format of a number. fractional bits are
+        truncated or added first, then integer bits are
+        removed or sign-extended; the value must fit the
+        integer bits. */
+    SFix fit(const SFix &v, int32_t intBits, int32_t fracBits);
+
+    /** return 1 as a Q(2,fracBits) number */
+    SFix one(int32_t fracBits);
+
+    /** check if all bits of v are zero */
+    bool isZero(const SFix &v);
+
+    /** v/d for a non-negative v, rounded towards zero */
+    SFix divSmall(const SFix &v, uint32_t d);
+}
+
+} // end namespace
+
+#endif
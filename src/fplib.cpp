@@ -4,10 +4,12 @@
 
 */
 
+#include <memory>
 #include <sstream>
 #include <iostream>
 #include <iomanip>
 #include "fplib.h"
+#include "fpthreads.h"
 
 #ifdef _MSC_VER
 #include <intrin.h>
@@ -17,6 +19,101 @@
 
 using namespace fplib;
 
+namespace
+{
+
+/** scratch buffers of SFix::internal_truncatedMul: the
+    magnitudes of the operands and the product words.
+    they are re-used, so truncated products do not
+    allocate once the buffers have grown. */
+thread_local std::vector<uint32_t> t_magnitudeA;
+thread_local std::vector<uint32_t> t_magnitudeB;
+thread_local std::vector<uint32_t> t_productWords;
+
+/** copy the magnitude of a two's complement number */
+void magnitude(const uint32_t *words, uint32_t N, bool negative, std::vector<uint32_t> &result)
+{
+    result.resize(N);
+    bool carry = negative;
+    for(uint32_t i=0; i<N; i++)
+    {
+        const uint32_t w = negative ? ~words[i] : words[i];
+        result[i] = w + (carry ? 1 : 0);
+        carry = carry && (result[i] == 0);
+    }
+}
+
+/** r[0..L) += x * b[0..N2), where carries beyond r[L-1] are lost */
+void mulAddRow(uint32_t x, const uint32_t *b, uint32_t N2, uint32_t *r, uint32_t L)
+{
+    const uint32_t n = std::min(N2, L);
+    uint64_t carry = 0;
+    for(uint32_t j=0; j<n; j++)
+    {
+        const uint64_t t = static_cast<uint64_t>(x)*b[j] + r[j] + carry;
+        r[j]  = static_cast<uint32_t>(t);
+        carry = t >> 32;
+    }
+    for(uint32_t j=n; (carry != 0) && (j<L); j++)
+    {
+        const uint64_t t = static_cast<uint64_t>(r[j]) + carry;
+        r[j]  = static_cast<uint32_t>(t);
+        carry = t >> 32;
+    }
+}
+
+/** r[0..N3) += a*b, unsigned. the rows of partial products
+    are split into blocks that are calculated on the pool,
+    each in its own buffer, and then summed in order. */
+void parallelMultiply(const uint32_t *a, uint32_t N1, const uint32_t *b, uint32_t N2,
+                      uint32_t *r, uint32_t N3, ThreadPool &pool)
+{
+    // several blocks per thread to balance the load, as
+    // blocks above the result words have less work.
+    const uint32_t blocks = std::max(1U, std::min(4*pool.threads(), N1/64));
+    const uint32_t rows = (N1 + blocks - 1) / blocks;
+
+    std::vector<std::vector<uint32_t> > partial(blocks);
+    pool.run(blocks, [&](size_t k)
+    {
+        const uint32_t i0 = k*rows;
+        const uint32_t i1 = std::min(N1, i0 + rows);
+        if ((i0 >= i1) || (i0 >= N3))
+        {
+            return;
+        }
+        const uint32_t L = std::min(N3 - i0, (i1 - i0) + N2);
+        std::vector<uint32_t> &buffer = partial[k];
+        buffer.assign(L, 0);
+        for(uint32_t i=i0; (i<i1) && (i-i0<L); i++)
+        {
+            mulAddRow(a[i], b, N2, &buffer[i-i0], L-(i-i0));
+        }
+    });
+
+    for(uint32_t k=0; k<blocks; k++)
+    {
+        const std::vector<uint32_t> &buffer = partial[k];
+        const uint32_t i0 = k*rows;
+        uint64_t carry = 0;
+        uint32_t idx = i0;
+        for(uint32_t j=0; j<buffer.size(); j++, idx++)
+        {
+            const uint64_t t = static_cast<uint64_t>(r[idx]) + buffer[j] + carry;
+            r[idx] = static_cast<uint32_t>(t);
+            carry  = t >> 32;
+        }
+        for(; (carry != 0) && (idx<N3); idx++)
+        {
+            const uint64_t t = static_cast<uint64_t>(r[idx]) + carry;
+            r[idx] = static_cast<uint32_t>(t);
+            carry  = t >> 32;
+        }
+    }
+}
+
+} // end anonymous namespace
+
 bool SFix::addUWords(uint32_t a, uint32_t b, bool carry_in, uint32_t &result) const
 {
 #if 0
@@ -51,8 +148,55 @@ bool SFix::addUWords(uint32_t a, uint32_t b, bool carry_in, uint32_t &result) co
 }
 
 
+bool SFix::subUWords(uint32_t a, uint32_t b, bool borrow_in, uint32_t &result) const
+{
+    return _subborrow_u32(borrow_in ? 1:0, a, b, &result) != 0;
+}
+
+
+SFix& SFix::operator=(const SFix &v)
+{
+    if ((m_data.capacity() < v.m_data.size()) && detail::arenaOpen() &&
+        !detail::isArenaStorage(m_data.data()))
+    {
+        // this number may outlive the arena.
+        HeapScope heap;
+        m_data = v.m_data;
+    }
+    else
+    {
+        m_data = v.m_data;
+    }
+    m_intBits  = v.m_intBits;
+    m_fracBits = v.m_fracBits;
+    return *this;
+}
+
+
+SFix& SFix::operator=(SFix &&v)
+{
+    if (this == &v)
+    {
+        return *this;
+    }
+    if (detail::isArenaStorage(v.m_data.data()) && !detail::isArenaStorage(m_data.data()))
+    {
+        // this number may outlive the arena, which may also
+        // be suspended by a HeapScope.
+        HeapScope heap;
+        return *this = static_cast<const SFix&>(v);
+    }
+    m_data     = std::move(v.m_data);
+    m_intBits  = v.m_intBits;
+    m_fracBits = v.m_fracBits;
+    return *this;
+}
+
+
 SFix SFix::extendLSBs(uint32_t bits) const
 {
+    FPLIB_INSTRUMENT_SCOPE(OP_EXTENDLSBS, m_intBits+m_fracBits+bits, (m_intBits+m_fracBits+bits+31)/32);
+
     SFix result(m_intBits, m_fracBits+bits);
 
     uint32_t addWords  = bits / 32;
@@ -65,18 +209,23 @@ SFix SFix::extendLSBs(uint32_t bits) const
     {
         result.m_data[idx] |= m_data[i] << shiftBits;
         idx++;
-        if (idx < N2)
+        if ((idx < N2) && (shiftBits != 0))
         {
             result.m_data[idx] = (m_data[i] >> (32-shiftBits));
         }
     }
 
+    // the bits shifted into the top-most word
+    // are not necessarily sign bits.
+    result.internal_fixSignBits();
     return result;
 }
 
 
 SFix SFix::extendMSBs(uint32_t bits) const
 {
+    FPLIB_INSTRUMENT_SCOPE(OP_EXTENDMSBS, m_intBits+m_fracBits+bits, (m_intBits+m_fracBits+bits+31)/32);
+
     SFix result(m_intBits+bits, m_fracBits);
     uint32_t N=result.m_data.size();
 
@@ -119,6 +268,8 @@ SFix SFix::extendMSBs(uint32_t bits) const
 
 SFix SFix::removeLSBs(uint32_t bits) const
 {
+    FPLIB_INSTRUMENT_SCOPE(OP_REMOVELSBS, m_intBits+m_fracBits-bits, (m_intBits+m_fracBits-bits+31)/32);
+
     SFix result(m_intBits, m_fracBits-bits);
 
     uint32_t idx = bits / 32;   // index of first word to copy
@@ -158,6 +309,8 @@ SFix SFix::removeLSBs(uint32_t bits) const
 
 SFix SFix::removeMSBs(uint32_t bits) const
 {
+    FPLIB_INSTRUMENT_SCOPE(OP_REMOVEMSBS, m_intBits+m_fracBits-bits, (m_intBits+m_fracBits-bits+31)/32);
+
     SFix result(m_intBits-bits, m_fracBits);
 
     uint32_t N=result.m_data.size();
@@ -186,6 +339,8 @@ SFix SFix::removeMSBs(uint32_t bits) const
 
 SFix SFix::negate() const
 {
+    FPLIB_INSTRUMENT_SCOPE(OP_NEGATE, m_intBits+m_fracBits, m_data.size());
+
     SFix result(m_intBits, m_fracBits);
     uint32_t N=result.m_data.size();
 
@@ -229,47 +384,61 @@ bool SFix::addPowerOfTwo(int32_t power, bool negative)
 
 void SFix::randomizeValue()
 {
-    const uint32_t N=m_data.size();
-    for(uint32_t i=0; i<N; i++)
+    randomizeValue(threadRandom());
+}
+
+
+void SFix::randomizeValue(Random &rng)
+{
+    if (m_data.empty())
     {
-        // the max returned by rand()
-        // is implementation dependent
-        // but guaranteerd to be greater
-        // than 32767.
-        if (RAND_MAX >= 65536)
-        {
-            m_data[i] = (rand() & 0xFFFF);
-            m_data[i] |= (rand() & 0xFFFF)<<16;
-        }
-        else
-        {
-            m_data[i]  = (uint32_t)(rand() & 0xFF);
-            m_data[i] |= (uint32_t)(rand() & 0xFF) << 8;
-            m_data[i] |= (uint32_t)(rand() & 0xFF) << 16;
-            m_data[i] |= (uint32_t)(rand() & 0xFF) << 24;
-        }
+        return;
     }
 
-    // force the upper MSB to conform to the
-    // correct sign
-    uint32_t signBitIndex = (m_fracBits+m_intBits-1) % 32;
-    if (isNegative())
+    rng.fill(&m_data[0], m_data.size());
+
+    // force the bits above the sign bit
+    // to conform to the sign.
+    internal_fixSignBits();
+}
+
+
+uint64_t SFix::hash() const
+{
+    // multiply-rotate mixing, two words per step,
+    // followed by the murmur3 finalizer.
+    const uint64_t k1 = 0x9e3779b97f4a7c15ULL;
+    const uint64_t k2 = 0xc2b2ae3d27d4eb4fULL;
+    uint64_t h = ((static_cast<uint64_t>(static_cast<uint32_t>(m_intBits)) << 32) |
+                   static_cast<uint32_t>(m_fracBits)) * k1;
+
+    const uint32_t N = m_data.size();
+    uint32_t i = 0;
+    for(; i+1 < N; i+=2)
     {
-        // clear top bits
-        uint32_t mask = (1UL << signBitIndex) - 1;
-        m_data[N-1] &= mask;
+        const uint64_t w = (static_cast<uint64_t>(m_data[i+1]) << 32) | m_data[i];
+        h ^= w * k2;
+        h = ((h << 31) | (h >> 33)) * k1;
     }
-    else
+    if (i < N)
     {
-        // set top bits
-        uint32_t mask = (1UL << signBitIndex) - 1;
-        m_data[N-1] |= ~mask;
+        h ^= static_cast<uint64_t>(m_data[i]) * k2;
+        h = ((h << 31) | (h >> 33)) * k1;
     }
+
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb93fe53ec53bULL;
+    h ^= h >> 33;
+    return h;
 }
 
 
 std::string SFix::toHexString() const
 {
+    FPLIB_INSTRUMENT_SCOPE(OP_TOSTRING, m_intBits+m_fracBits, m_data.size());
+
     std::stringstream stream;
     const uint32_t N=m_data.size();
     stream << std::hex << std::setfill ('0');
@@ -285,6 +454,8 @@ std::string SFix::toHexString() const
 
 std::string SFix::toBinString() const
 {
+    FPLIB_INSTRUMENT_SCOPE(OP_TOSTRING, m_intBits+m_fracBits, m_data.size());
+
     std::string v;
     //const uint32_t N=m_data.size();         // number of 32-bit words
 
@@ -324,56 +495,24 @@ void SFix::internal_add(const SFix &a, const SFix &b, SFix &result) const
         //throw std::runtime_error(ss.str());
     }
 
-    uint32_t N  = std::min(a.m_data.size(), b.m_data.size());   // #words in smallest operand
-    uint32_t N2 = std::max(a.m_data.size(), b.m_data.size());   // #words in largest operand
+    const uint32_t Na = a.m_data.size();
+    const uint32_t Nb = b.m_data.size();
+    const uint32_t N3 = result.m_data.size();
 
-    // add 32-bit words together until we run out of
-    // words on one of the two operands a or b.
-    // then continue sign-extending the operand
-    // that has run out of bits...
-    uint32_t idx = 0;
+    // add 32-bit words together, sign-extending
+    // the operand(s) that have run out of bits,
+    // until the result is complete.
+    const uint32_t extA = a.isNegative() ? 0xFFFFFFFF : 0;
+    const uint32_t extB = b.isNegative() ? 0xFFFFFFFF : 0;
     bool carry = false;
-    while(idx < N)
-    {
-        carry = addUWords(a.m_data[idx], b.m_data[idx], carry, result.m_data[idx]);
-        idx++;
-    }
-
-    // were, one of the two operands might have run out of bits
-    // check which one, if any
-    if (a.m_data.size() == N)
+    for(uint32_t idx=0; idx<N3; idx++)
     {
-        uint32_t extended = a.isNegative() ? 0xFFFFFFFF : 0;
-        // operand a is smaller, and should be sign extended
-        while(idx < N2)
-        {
-            carry = addUWords(extended, b.m_data[idx], carry, result.m_data[idx]);
-            idx++;
-        }
+        const uint32_t wa = (idx < Na) ? a.m_data[idx] : extA;
+        const uint32_t wb = (idx < Nb) ? b.m_data[idx] : extB;
+        carry = addUWords(wa, wb, carry, result.m_data[idx]);
     }
-    else if (b.m_data.size() == N)
-    {
-        uint32_t extended = b.isNegative() ? 0xFFFFFFFF : 0;
-        // operand a is smaller, and should be sign extended
-        while(idx < N2)
-        {
-            carry = addUWords(a.m_data[idx], extended, carry, result.m_data[idx]);
-            idx++;
-        }
-    }
-
-    //finally, propagate carry to final output word
-    if ((carry) && (idx < result.m_data.size()))
-    {
-        result.m_data[N]++;
 
-        // check sign bit and extend if necessary
-        if (result.isNegative())
-        {
-            uint32_t topBits  = (m_intBits + m_fracBits - 1)/32;
-            result.m_data[N] |= (0xFFFFFFFFUL << topBits);
-        }
-    }
+    result.internal_fixSignBits();
 }
 
 
@@ -452,20 +591,154 @@ void SFix::internal_sub(const SFix &a, const SFix &b, SFix &result) const
         throw std::runtime_error(ss.str());
     }
 
-    SFix tmp = b.negate();
-    internal_add(a,tmp,result);
+    // subtract the words with a borrow chain, so b
+    // is never negated and the most negative value of b,
+    // which has no positive counterpart in its own format,
+    // is handled correctly.
+    const uint32_t Na = a.m_data.size();
+    const uint32_t Nb = b.m_data.size();
+    const uint32_t N3 = result.m_data.size();
+    const uint32_t extA = a.isNegative() ? 0xFFFFFFFF : 0;
+    const uint32_t extB = b.isNegative() ? 0xFFFFFFFF : 0;
+    bool borrow = false;
+    for(uint32_t idx=0; idx<N3; idx++)
+    {
+        const uint32_t wa = (idx < Na) ? a.m_data[idx] : extA;
+        const uint32_t wb = (idx < Nb) ? b.m_data[idx] : extB;
+        borrow = subUWords(wa, wb, borrow, result.m_data[idx]);
+    }
+
+    result.internal_fixSignBits();
+}
+
+
+namespace
+{
+
+/** reads the words of a number shifted left by a number
+    of bits, one after the other, starting with the least
+    significant word. beyond the number, the words are
+    sign-extended. */
+class AlignedWordReader
+{
+public:
+    AlignedWordReader(const uint32_t *words, uint32_t N, bool negative, uint32_t shift)
+        : m_words(words),
+          m_N(N),
+          m_ext(negative ? 0xFFFFFFFF : 0),
+          m_zeroWords(shift / 32),
+          m_bitShift(shift % 32),
+          m_idx(0),
+          m_previous(0)
+    {
+    }
+
+    uint32_t next()
+    {
+        if (m_zeroWords > 0)
+        {
+            m_zeroWords--;
+            return 0;
+        }
+
+        const uint32_t w = (m_idx < m_N) ? m_words[m_idx] : m_ext;
+        m_idx++;
+        if (m_bitShift == 0)
+        {
+            return w;
+        }
+        const uint32_t result = (w << m_bitShift) | (m_previous >> (32-m_bitShift));
+        m_previous = w;
+        return result;
+    }
+
+protected:
+    const uint32_t *m_words;
+    uint32_t m_N;
+    uint32_t m_ext;
+    uint32_t m_zeroWords;
+    uint32_t m_bitShift;
+    uint32_t m_idx;
+    uint32_t m_previous;
+};
+
+} // end anonymous namespace
+
+
+void SFix::internal_addAligned(const SFix &a, uint32_t shiftA, const SFix &b, uint32_t shiftB,
+                               bool subtract, SFix &result) const
+{
+    // sanity check:
+    if (((a.m_fracBits + static_cast<int32_t>(shiftA)) != result.m_fracBits) ||
+        ((b.m_fracBits + static_cast<int32_t>(shiftB)) != result.m_fracBits))
+    {
+        std::stringstream ss;
+        ss << "SFix::internal_addAligned fractional bits not equalized!";
+        throw std::runtime_error(ss.str());
+    }
+
+    // the operands are aligned while their words are
+    // read, so no shifted copies are made.
+    AlignedWordReader ra(a.m_data.data(), a.m_data.size(), a.isNegative(), shiftA);
+    AlignedWordReader rb(b.m_data.data(), b.m_data.size(), b.isNegative(), shiftB);
+    const uint32_t N3 = result.m_data.size();
+    bool carry = false;
+    if (subtract)
+    {
+        for(uint32_t idx=0; idx<N3; idx++)
+        {
+            carry = subUWords(ra.next(), rb.next(), carry, result.m_data[idx]);
+        }
+    }
+    else
+    {
+        for(uint32_t idx=0; idx<N3; idx++)
+        {
+            carry = addUWords(ra.next(), rb.next(), carry, result.m_data[idx]);
+        }
+    }
+
+    result.internal_fixSignBits();
 }
 
 
-void SFix::internal_umul(const SFix &a, const SFix &b, bool invA, bool invB, SFix &result)
+void SFix::internal_umul(const SFix &a, const SFix &b, bool invA, bool invB, SFix &result) const
 {
     const uint32_t N1 = a.m_data.size();
     const uint32_t N2 = b.m_data.size();
     const uint32_t N3 = result.m_data.size();
 
+    // large products are split across threads, see fpthreads.h
+    const uint32_t threshold = getParallelMultiplyThreshold();
+    if (!invA && !invB && (N1 >= threshold) && (N2 >= threshold))
+    {
+        std::shared_ptr<ThreadPool> pool = detail::multiplyPool();
+        if (pool)
+        {
+            parallelMultiply(a.m_data.data(), N1, b.m_data.data(), N2, result.m_data.data(), N3, *pool);
+            return;
+        }
+    }
+
+    if (!invB)
+    {
+        // one row of partial products at a time, skipping
+        // the rows that fall outside of the result.
+        const uint32_t rows = std::min(N1, N3);
+        for(uint32_t i=0; i<rows; i++)
+        {
+            const uint32_t x = invA ? ~a.m_data[i] : a.m_data[i];
+            mulAddRow(x, b.m_data.data(), N2, &result.m_data[i], N3-i);
+        }
+        return;
+    }
+
     for(uint32_t i=0; i<N1; i++)
     {
-        for(uint32_t j=0; j<N2; j++)
+        // skip partial products that fall outside
+        // of the result.
+        const uint32_t N2max = (i < N3) ? std::min(N2, N3-i) : 0;
+        for(uint32_t j=0; j<N2max; j++)
         {
             uint32_t op1,op2;
             if (invA)
@@ -506,27 +779,294 @@ void SFix::internal_umul(const SFix &a, const SFix &b, bool invA, bool invB, SFi
     }
 }
 
-void SFix::internal_mul(const SFix &a, const SFix &b, SFix &result)
+void SFix::internal_mul(const SFix &a, const SFix &b, SFix &result) const
 {
     bool finalNegate = false;
-    SFix op1 = a;
-    SFix op2 = b;
 
-    if (op1.isNegative())
+    // only make copies of the operands that
+    // need to be negated.
+    std::unique_ptr<SFix> negA, negB;
+    const SFix *op1 = &a;
+    const SFix *op2 = &b;
+
+    if (a.isNegative())
     {
-        op1 = op1.negate();
+        negA.reset(new SFix(a.negate()));
+        op1 = negA.get();
         finalNegate = !finalNegate;
     }
-    if (op2.isNegative())
+    if (b.isNegative())
     {
-        op2 = op2.negate();
+        negB.reset(new SFix(b.negate()));
+        op2 = negB.get();
         finalNegate = !finalNegate;
     }
 
-    internal_umul(op1,op2,false,false,result);
+    internal_umul(*op1,*op2,false,false,result);
     if (finalNegate)
     {
-        result = result.negate();
+        internal_invert(result);
+        internal_increment(result);
+    }
+}
+
+
+void SFix::internal_fixSignBits()
+{
+    const uint32_t N = m_data.size();
+    if (N == 0)
+    {
+        return;
+    }
+
+    const uint32_t signBitIndex = (m_intBits + m_fracBits - 1) % 32;
+    const uint32_t mask = genSignMask(signBitIndex);
+    if ((m_data[N-1] >> signBitIndex) & 1)
+    {
+        m_data[N-1] |= mask;
+    }
+    else
+    {
+        m_data[N-1] &= ~mask;
+    }
+}
+
+
+uint32_t SFix::internal_alignedWord(uint32_t shift, uint32_t idx) const
+{
+    const uint32_t wordShift = shift / 32;
+    const uint32_t bitShift  = shift % 32;
+    if (idx < wordShift)
+    {
+        return 0;
+    }
+
+    // words beyond the top-most one are sign bits
+    const uint32_t N = m_data.size();
+    const uint32_t ext = isNegative() ? 0xFFFFFFFF : 0;
+    const uint32_t k = idx - wordShift;
+    uint32_t w = (k < N) ? m_data[k] : ext;
+    if (bitShift == 0)
+    {
+        return w;
+    }
+
+    w <<= bitShift;
+    if (k > 0)
+    {
+        w |= ((k-1 < N) ? m_data[k-1] : ext) >> (32-bitShift);
+    }
+    return w;
+}
+
+
+int32_t fplib::compare(const SFix &a, const SFix &b)
+{
+    // numbers of different sign are decided by the sign
+    const bool negA = a.isNegative();
+    if (negA != b.isNegative())
+    {
+        return negA ? -1 : 1;
+    }
+
+    // align both numbers to the largest number of
+    // fractional bits, without creating temporaries.
+    const int32_t fracBits = std::max(a.m_fracBits, b.m_fracBits);
+    const uint32_t shiftA = fracBits - a.m_fracBits;
+    const uint32_t shiftB = fracBits - b.m_fracBits;
+    const uint32_t Na = (std::max(a.m_intBits + a.m_fracBits, 0) + shiftA + 31) / 32;
+    const uint32_t Nb = (std::max(b.m_intBits + b.m_fracBits, 0) + shiftB + 31) / 32;
+
+    // with equal signs, the two's complement words
+    // can be compared as unsigned numbers, starting
+    // with the most significant word.
+    uint32_t idx = std::max(Na, Nb);
+    while(idx > 0)
+    {
+        idx--;
+        const uint32_t wa = a.internal_alignedWord(shiftA, idx);
+        const uint32_t wb = b.internal_alignedWord(shiftB, idx);
+        if (wa != wb)
+        {
+            return (wa < wb) ? -1 : 1;
+        }
+    }
+    return 0;
+}
+
+
+void SFix::accumulate(const SFix &a, bool subtract)
+{
+    FPLIB_INSTRUMENT_SCOPE(OP_ACCUMULATE, m_intBits+m_fracBits, m_data.size());
+
+    if (a.m_fracBits != m_fracBits)
+    {
+        throw std::runtime_error("SFix::accumulate fractional bits not equalized!");
+    }
+
+    const uint32_t N  = std::min(a.m_data.size(), m_data.size());
+    const uint32_t N2 = m_data.size();
+    const uint32_t inv = subtract ? 0xFFFFFFFF : 0;
+
+    // subtraction is performed by adding the
+    // inverted operand with a carry input of one.
+    bool carry = subtract;
+    uint32_t idx = 0;
+    while(idx < N)
+    {
+        carry = addUWords(a.m_data[idx] ^ inv, m_data[idx], carry, m_data[idx]);
+        idx++;
+    }
+
+    const uint32_t extended = (a.isNegative() ? 0xFFFFFFFF : 0) ^ inv;
+    while(idx < N2)
+    {
+        carry = addUWords(extended, m_data[idx], carry, m_data[idx]);
+        idx++;
+    }
+
+    internal_fixSignBits();
+}
+
+
+void SFix::assignProduct(const SFix &a, const SFix &b)
+{
+    FPLIB_INSTRUMENT_SCOPE(OP_ASSIGNPRODUCT, m_intBits+m_fracBits, m_data.size());
+
+    if ((a.m_fracBits + b.m_fracBits) != m_fracBits)
+    {
+        throw std::runtime_error("SFix::assignProduct fractional bits do not match!");
+    }
+
+    std::fill(m_data.begin(), m_data.end(), 0);
+    internal_mul(a, b, *this);
+    internal_fixSignBits();
+}
+
+
+void SFix::assignSum(const SFix &a, const SFix &b, bool subtract)
+{
+    FPLIB_INSTRUMENT_SCOPE(OP_ASSIGNSUM, m_intBits+m_fracBits, m_data.size());
+
+    if ((a.m_fracBits > m_fracBits) || (b.m_fracBits > m_fracBits))
+    {
+        throw std::runtime_error("SFix::assignSum has fewer fractional bits than the operands!");
+    }
+    internal_addAligned(a, m_fracBits - a.m_fracBits, b, m_fracBits - b.m_fracBits, subtract, *this);
+}
+
+
+void SFix::assignTruncatedProduct(const SFix &a, const SFix &b)
+{
+    FPLIB_INSTRUMENT_SCOPE(OP_ASSIGNTRUNCATEDPRODUCT, m_intBits+m_fracBits, m_data.size());
+
+    const int32_t shift = a.m_fracBits + b.m_fracBits - m_fracBits;
+    if (shift < 0)
+    {
+        throw std::runtime_error("SFix::assignTruncatedProduct has more fractional bits than the product!");
+    }
+
+    if (!internal_truncatedMul(a, b, static_cast<uint32_t>(shift), true))
+    {
+        internal_truncatedMul(a, b, static_cast<uint32_t>(shift), false);
     }
+    internal_fixSignBits();
 }
 
+
+bool SFix::internal_truncatedMul(const SFix &a, const SFix &b, uint32_t shift, bool skipLow)
+{
+    const uint32_t Na = a.m_data.size();
+    const uint32_t Nb = b.m_data.size();
+    const uint32_t N3 = m_data.size();
+    const bool negative = (a.isNegative() != b.isNegative());
+
+    std::vector<uint32_t> &magA = t_magnitudeA;
+    std::vector<uint32_t> &magB = t_magnitudeB;
+    magnitude(&a.m_data[0], Na, a.isNegative(), magA);
+    magnitude(&b.m_data[0], Nb, b.isNegative(), magB);
+
+    // product words first..last are calculated. result
+    // bit 0 is in word 'wordShift'. two words below it
+    // are kept, so the skipped partial products change
+    // the calculated words by less than (Nmin+1) * 2^32.
+    const uint32_t wordShift = shift / 32;
+    const uint32_t first = (skipLow && (wordShift > 2)) ? wordShift - 2 : 0;
+    const uint32_t last  = wordShift + N3;
+    const uint32_t M = last - first + 1;
+
+    std::vector<uint32_t> &acc = t_productWords;
+    acc.assign(M, 0);
+    for(uint32_t i=0; i<Na; i++)
+    {
+        if ((magA[i] == 0) || (i > last))
+        {
+            continue;
+        }
+        const uint32_t jmin = (first > i) ? (first - i) : 0;
+        const uint32_t jmax = std::min(Nb, last - i + 1);
+        for(uint32_t j=jmin; j<jmax; j++)
+        {
+            const uint64_t m = (uint64_t)magA[i]*magB[j];
+            uint32_t idx = i+j-first;
+            bool carry = addUWords(static_cast<uint32_t>(m), acc[idx], false, acc[idx]);
+            idx++;
+            if (idx < M)
+            {
+                carry = addUWords(static_cast<uint32_t>(m>>32), acc[idx], carry, acc[idx]);
+                idx++;
+            }
+            while(carry && (idx < M))
+            {
+                carry = addUWords(0, acc[idx], carry, acc[idx]);
+                idx++;
+            }
+        }
+    }
+
+    // the bits below result bit 0
+    const uint32_t lowBits = shift - 32*first;
+    const uint32_t lowWords = lowBits / 32;
+    const uint32_t bitShift = lowBits % 32;
+    const uint32_t lowMask = (1U << bitShift) - 1;
+    bool remainder = ((acc[lowWords] & lowMask) != 0);
+    for(uint32_t i=0; i<lowWords; i++)
+    {
+        remainder = remainder || (acc[i] != 0);
+    }
+
+    if (first > 0)
+    {
+        // lowBits = 64 + bitShift. the skipped products
+        // must not carry into result bit 0, and negative
+        // results need to know if the remainder is zero.
+        const uint64_t bound = (static_cast<uint64_t>(std::min(Na, Nb)) + 1) << 32;
+        const uint64_t low = (static_cast<uint64_t>(acc[1]) << 32) | acc[0];
+        if (((acc[2] & lowMask) == lowMask) && (low > ~bound))
+        {
+            return false;
+        }
+        if (negative && !remainder)
+        {
+            return false;
+        }
+        remainder = true;
+    }
+
+    // floor(-q) = -ceil(q) = ~q when there is a remainder
+    for(uint32_t r=0; r<N3; r++)
+    {
+        const uint32_t k = lowWords + r;
+        uint32_t w = acc[k];
+        if (bitShift != 0)
+        {
+            w = (w >> bitShift) | (acc[k+1] << (32-bitShift));
+        }
+        m_data[r] = negative ? ~w : w;
+    }
+    if (negative && !remainder)
+    {
+        internal_increment(*this);
+    }
+    return true;
+}
@@ -11,9 +11,15 @@
 #define fplib_h
 
 #include <stdint.h>
+#include <functional>
 #include <algorithm>
 #include <vector>
+#include <string>
+#include <stdexcept>
 #include <assert.h>
+#include "fpalloc.h"
+#include "fprandom.h"
+#include "fpinstrument.h"
 
 namespace fplib
 {
@@ -47,6 +53,17 @@ public:
         setSize(intBits, fracBits);
     }
 
+    SFix(const SFix &v) = default;
+    SFix(SFix &&v) = default;
+
+    /** assignment. a number that does not hold arena storage
+        never receives arena storage, see ArenaScope. */
+    SFix& operator=(const SFix &v);
+
+    /** move assignment. arena storage is copied, not moved,
+        into a number that does not hold arena storage. */
+    SFix& operator=(SFix &&v);
+
     /** return the number of integer bits */
     int32_t intBits() const
     {
@@ -106,8 +123,10 @@ public:
     }
 
     /** Multiplication: Q(n1,m1) * Q(n2,m2) -> Q(n1+n2-1, m1+m2) */
-    SFix operator*(const SFix& rhs)
+    SFix operator*(const SFix& rhs) const
     {
+        FPLIB_INSTRUMENT_SCOPE(OP_MUL, m_intBits+rhs.m_intBits-1+m_fracBits+rhs.m_fracBits,
+                               (m_intBits+rhs.m_intBits+m_fracBits+rhs.m_fracBits+30)/32);
         SFix tmp(m_intBits+rhs.m_intBits-1, m_fracBits+rhs.m_fracBits);
         internal_mul(*this, rhs, tmp);
 
@@ -116,23 +135,18 @@ public:
     }
 
     /** Addition: Q(n1,m1) + Q(n2,m2) -> Q( max(n1,n2)+1, max(m1,m2) ) */
-    SFix operator+(const SFix& rhs)
+    SFix operator+(const SFix& rhs) const
     {
         int32_t intBits  = std::max(m_intBits, rhs.intBits())+1;
         int32_t fracBits = std::max(m_fracBits, rhs.fracBits());
+        FPLIB_INSTRUMENT_SCOPE(OP_ADD, intBits+fracBits, (intBits+fracBits+31)/32);
 
         SFix result(intBits, fracBits);
 
-        // equalise the LSBs
-        if (m_fracBits > rhs.m_fracBits)
-        {
-            SFix tmp = rhs.extendLSBs(m_fracBits-rhs.m_fracBits);
-            internal_add(tmp, *this, result);
-        }
-        else if (m_fracBits < rhs.m_fracBits)
+        // equalise the LSBs while adding
+        if (m_fracBits != rhs.m_fracBits)
         {
-            SFix tmp = extendLSBs(rhs.m_fracBits-m_fracBits);
-            internal_add(tmp, rhs, result);
+            internal_addAligned(*this, fracBits-m_fracBits, rhs, fracBits-rhs.m_fracBits, false, result);
         }
         else
         {
@@ -145,22 +159,17 @@ public:
     }
 
     /** Subtraction: Q(n1,m1) - Q(n2,m2) -> Q( max(n1,n2)+1, max(m1,m2) ) */
-    SFix operator-(const SFix& rhs)
+    SFix operator-(const SFix& rhs) const
     {
         int32_t intBits  = std::max(m_intBits, rhs.intBits())+1;
         int32_t fracBits = std::max(m_fracBits, rhs.fracBits());
+        FPLIB_INSTRUMENT_SCOPE(OP_SUB, intBits+fracBits, (intBits+fracBits+31)/32);
         SFix result(intBits, fracBits);
 
-        // equalise the LSBs
-        if (m_fracBits > rhs.m_fracBits)
-        {
-            SFix tmp = rhs.extendLSBs(m_fracBits-rhs.m_fracBits);
-            internal_sub(*this, tmp, result);
-        }
-        else if (m_fracBits < rhs.m_fracBits)
+        // equalise the LSBs while subtracting
+        if (m_fracBits != rhs.m_fracBits)
         {
-            SFix tmp = extendLSBs(rhs.m_fracBits-m_fracBits);
-            internal_sub(tmp, rhs, result);
+            internal_addAligned(*this, fracBits-m_fracBits, rhs, fracBits-rhs.m_fracBits, true, result);
         }
         else
         {
@@ -203,6 +212,40 @@ public:
         return !(*this == rhs);
     }
 
+    /** Ordering comparisons. Unlike == and !=, these compare
+        the values and accept numbers of different formats,
+        see compare(). */
+    bool operator <(const SFix &rhs) const
+    {
+        return compare(*this, rhs) < 0;
+    }
+
+    bool operator <=(const SFix &rhs) const
+    {
+        return compare(*this, rhs) <= 0;
+    }
+
+    bool operator >(const SFix &rhs) const
+    {
+        return compare(*this, rhs) > 0;
+    }
+
+    bool operator >=(const SFix &rhs) const
+    {
+        return compare(*this, rhs) >= 0;
+    }
+
+    /** Three-way comparison of the values of two numbers of
+        any format. Returns -1 if a < b, 0 if a == b and
+        1 if a > b.
+
+        The numbers are aligned on the fly and compared from
+        the most significant word down, stopping at the first
+        difference, so no temporaries are created and numbers
+        of different sign are decided by the sign bits alone.
+    */
+    friend int32_t compare(const SFix &a, const SFix &b);
+
     /** Return the negated number */
     SFix negate() const;
 
@@ -218,6 +261,10 @@ public:
     /** Remove MSBs / integer bits */
     SFix removeMSBs(uint32_t bits) const;
 
+    /** return a hash of the number, including its format.
+        numbers that compare equal with == have equal hashes. */
+    uint64_t hash() const;
+
     /** convert the fixed point number to a binary string */
     std::string toBinString() const;
 
@@ -242,7 +289,7 @@ public:
 
     /** Change the Q(intBits,fracBits) qualifier to cheaply
         shift the factional point */
-    SFix reinterpret(int32_t intBits, int32_t fracBits)
+    SFix reinterpret(int32_t intBits, int32_t fracBits) const
     {
         SFix result(intBits, fracBits);
         int32_t N = intBits + fracBits;
@@ -258,6 +305,12 @@ public:
         return result;
     }
 
+    /** return the number of internal 32-bit values */
+    uint32_t getNumberOfWords() const
+    {
+        return static_cast<uint32_t>(m_data.size());
+    }
+
     /** set one of the N internal 32-bit values.
         used for debugging. */
     void setInternalValue(uint32_t idx, uint32_t v)
@@ -272,6 +325,61 @@ public:
         return m_data[idx];
     }
 
+    /** make the bits above the sign bit in the top-most
+        32-bit word equal to the sign bit. call this after
+        writing the words with setInternalValue. */
+    void normalizeSignBits()
+    {
+        internal_fixSignBits();
+    }
+
+    /** In-place accumulation: add 'a' to (or subtract 'a' from)
+        this number without changing its precision. The result
+        wraps around when it does not fit, i.e. the integer bits
+        of 'a' beyond the ones of this number are ignored.
+
+        note: the number of fractional bits must match, otherwise
+        a runtime_error is thrown.
+    */
+    void accumulate(const SFix &a, bool subtract = false);
+
+    /** Set this number to the product a*b without changing its
+        precision. Only the words needed for this precision are
+        calculated; the integer bits of the product wrap around.
+
+        note: the number of fractional bits must equal
+        a.fracBits() + b.fracBits(), otherwise a runtime_error
+        is thrown.
+    */
+    void assignProduct(const SFix &a, const SFix &b);
+
+    /** Set this number to the product a*b, truncated to the
+        precision of this number: the fractional bits beyond
+        the ones of this number are removed like removeLSBs
+        and the integer bits wrap around like assignProduct.
+
+        The partial products below the result are skipped;
+        they are only calculated when their carries could
+        change the result, so the result always equals the
+        one of the full product.
+
+        note: this number must not have more fractional bits
+        than a.fracBits() + b.fracBits(), otherwise a
+        runtime_error is thrown.
+    */
+    void assignTruncatedProduct(const SFix &a, const SFix &b);
+
+    /** Set this number to a+b (or a-b) without changing its
+        precision. The operands are aligned while they are
+        added, so no temporaries are made; the integer bits
+        wrap around like accumulate. a or b may be this number,
+        e.g. x.assignSum(x, y) accumulates y with alignment.
+
+        note: this number must have at least as many fractional
+        bits as a and b, otherwise a runtime_error is thrown.
+    */
+    void assignSum(const SFix &a, const SFix &b, bool subtract = false);
+
     /** Add (or subtract) a power of two without affecting
         the precision of the number. This function is needed
         to support Canonical Signed Digit formats.
@@ -282,9 +390,15 @@ public:
     */
     bool addPowerOfTwo(int32_t power, bool negative);
 
-    /** set to random value - used for fuzzing */
+    /** set to random value - used for fuzzing.
+        uses the generator of the calling thread,
+        see threadRandom(). */
     void randomizeValue();
 
+    /** set to a random value from the given generator,
+        uniformly distributed over the range of the format. */
+    void randomizeValue(Random &rng);
+
     /** Return the number of integer bits necessary to represent the
         current value. This assumes the fractional bits all necessary.
         note: this function is primarily used to determine precision
@@ -326,6 +440,10 @@ protected:
         also return a carry value */
     bool addUWords(uint32_t a, uint32_t b, bool carry_in, uint32_t &result) const;
 
+    /** subtract two 32-bit words with borrow input and produce a result.
+        also return a borrow value */
+    bool subUWords(uint32_t a, uint32_t b, bool borrow_in, uint32_t &result) const;
+
     /** add a to b producing a result. */
     void internal_add(const SFix &a, const SFix &b, SFix &result) const;
 
@@ -335,6 +453,12 @@ protected:
     /** subtract b from a producing a result. */
     void internal_sub(const SFix &a, const SFix &b, SFix &result) const;
 
+    /** add b to (or subtract b from) a producing a result,
+        where a and b are shifted left by shiftA and shiftB
+        bits on the fly to align their fractional bits. */
+    void internal_addAligned(const SFix &a, uint32_t shiftA, const SFix &b, uint32_t shiftB,
+                             bool subtract, SFix &result) const;
+
     /** add a to b producing a result. Note: this will only
         handle unsigned a and b correctly! post processing
         is required to compensate for negative numbers.
@@ -342,10 +466,16 @@ protected:
         when invA is true, 'a' is inverted.
         when invB is true, 'b' is inverted.
     */
-    void internal_umul(const SFix &a, const SFix &b, bool invA, bool invB, SFix &result);
+    void internal_umul(const SFix &a, const SFix &b, bool invA, bool invB, SFix &result) const;
 
     /** uses internal_umul with compensation to handle signed numbers */
-    void internal_mul(const SFix &a, const SFix &b, SFix &result);
+    void internal_mul(const SFix &a, const SFix &b, SFix &result) const;
+
+    /** set this number to a*b * 2^-shift, rounded towards minus
+        infinity. when skipLow is true, the partial products of
+        the lowest words are skipped and false is returned if
+        their carries could change the result. */
+    bool internal_truncatedMul(const SFix &a, const SFix &b, uint32_t shift, bool skipLow);
 
     /** increment by one */
     void internal_increment(SFix &result) const;
@@ -353,6 +483,15 @@ protected:
     /** invert bits */
     void internal_invert(SFix &result) const;
 
+    /** make the bits above the sign bit in the top-most
+        32-bit word equal to the sign bit. */
+    void internal_fixSignBits();
+
+    /** return 32-bit word 'idx' of the number shifted
+        left by 'shift' bits and sign-extended to any
+        number of words. */
+    uint32_t internal_alignedWord(uint32_t shift, uint32_t idx) const;
+
     /** get the value of a bit in the internal representation,
         given it's offset w.r.t. the LSB. */
     bool getBitValue(uint32_t offset) const
@@ -388,9 +527,28 @@ protected:
     int32_t m_intBits;      ///< number of integer bits
     int32_t m_fracBits;     ///< number of fractional bits
 
-    std::vector<uint32_t>   m_data; ///< fixed-point value represented by 32-bit words.
+    /** storage type of the 32-bit words, see fpalloc.h */
+    typedef std::vector<uint32_t, WordAllocator<uint32_t> > WordVector;
+
+    WordVector  m_data;     ///< fixed-point value represented by 32-bit words.
 };
 
+int32_t compare(const SFix &a, const SFix &b);
+
 } // end namespace
 
+namespace std
+{
+
+/** allows SFix to be used as a key in unordered containers */
+template<> struct hash<fplib::SFix>
+{
+    size_t operator()(const fplib::SFix &v) const
+    {
+        return static_cast<size_t>(v.hash());
+    }
+};
+
+} // end namespace std
+
 #endif
@@ -0,0 +1,629 @@
+/*
+
+    FPLIB: a library providing a fixed-point datatype.
+
+    Exponential and logarithm functions.
+
+    N.A. Moseley 2017
+    License: T.B.D.
+
+*/
+
+#include <math.h>
+#include <string>
+#include <stdexcept>
+#include "fpmath.h"
+#include "fpconstants.h"
+#include "fpconvert.h"
+#include "fpinternal.h"
+
+using namespace fplib;
+using namespace fplib::detail;
+
+namespace
+{
+
+/** number of bits computed beyond the requested precision.
+    more are used when the rounding is not certain. */
+const int32_t c_guardBits = 64;
+
+/** an approximation with W fractional bits is within
+    2^-(W-c_errorBits) of the result. */
+const int32_t c_errorBits = 32;
+
+/** error bound of the 64-bit fast path, in units of
+    the last bit of its Q(2,62) numbers */
+const int64_t c_fastError = 256;
+
+/** 1 as a Q(2,62) number */
+const uint64_t c_one = 1ULL << 62;
+
+/** change the format of a result, throwing when it does not fit */
+SFix fitResult(const SFix &v, int32_t intBits, int32_t fracBits, const char *name)
+{
+    if (v.determineMinimumIntegerBits() > intBits)
+    {
+        throw std::runtime_error(std::string("fplib::") + name + ": the result does not fit the integer bits!");
+    }
+    return fit(v, intBits, fracBits);
+}
+
+/** v * 2^n, without losing bits */
+SFix scale(const SFix &v, int32_t n)
+{
+    if (n < 0)
+    {
+        return v.extendMSBs(-n).reinterpret(v.intBits(), v.fracBits() - n);
+    }
+    const SFix w = (v.fracBits() < n) ? v.extendLSBs(n - v.fracBits()) : v;
+    return w.reinterpret(w.intBits() + n, w.fracBits() - n);
+}
+
+/** 32 bits of the two's complement representation of v,
+    starting at bit 'lo' (bit 0 is the LSB). bits below
+    the LSB are zero, bits above the MSB are sign bits. */
+uint32_t rawWord(const SFix &v, int32_t lo)
+{
+    if (lo <= -32)
+    {
+        return 0;
+    }
+    if (lo < 0)
+    {
+        return rawWord(v, 0) << (-lo);
+    }
+
+    const uint32_t N = v.getNumberOfWords();
+    const uint32_t fill = v.isNegative() ? 0xFFFFFFFF : 0;
+    const uint32_t idx = static_cast<uint32_t>(lo) / 32;
+    const uint32_t shift = static_cast<uint32_t>(lo) % 32;
+    const uint32_t w0 = (idx < N) ? v.getInternalValue(idx) : fill;
+    if (shift == 0)
+    {
+        return w0;
+    }
+    const uint32_t w1 = (idx+1 < N) ? v.getInternalValue(idx+1) : fill;
+    return (w0 >> shift) | (w1 << (32-shift));
+}
+
+/** 64 bits of v starting at bit 'lo', see rawWord */
+uint64_t rawBits(const SFix &v, int32_t lo)
+{
+    return static_cast<uint64_t>(rawWord(v, lo)) |
+           (static_cast<uint64_t>(rawWord(v, lo+32)) << 32);
+}
+
+/** return a Q(intBits, fracBits) number with the given
+    two's complement representation. the value must fit. */
+SFix fromRaw(int64_t raw, int32_t intBits, int32_t fracBits)
+{
+    SFix result(intBits, fracBits);
+    const uint32_t fill = (raw < 0) ? 0xFFFFFFFF : 0;
+    for(uint32_t i=0; i<result.getNumberOfWords(); i++)
+    {
+        uint32_t w = fill;
+        if (i < 2)
+        {
+            w = static_cast<uint32_t>(static_cast<uint64_t>(raw) >> (32*i));
+        }
+        result.setInternalValue(i, w);
+    }
+    return result;
+}
+
+/** index of the most significant set bit of a positive v */
+int32_t topBit(const SFix &v)
+{
+    for(uint32_t i=v.getNumberOfWords(); i>0; i--)
+    {
+        const uint32_t w = v.getInternalValue(i-1);
+        if (w != 0)
+        {
+            int32_t bit = 31;
+            while(((w >> bit) & 1) == 0)
+            {
+                bit--;
+            }
+            return static_cast<int32_t>(32*(i-1)) + bit;
+        }
+    }
+    return -1;
+}
+
+/** check if the fractional bits of v are all zero */
+bool isInteger(const SFix &v)
+{
+    for(int32_t bit=0; bit<v.fracBits(); bit+=32)
+    {
+        uint32_t w = rawWord(v, bit);
+        if ((v.fracBits() - bit) < 32)
+        {
+            w &= (1U << (v.fracBits() - bit)) - 1;
+        }
+        if (w != 0)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+/** check if a positive v is a power of two */
+bool isPowerOfTwo(const SFix &v)
+{
+    uint32_t bits = 0;
+    for(uint32_t i=0; i<v.getNumberOfWords(); i++)
+    {
+        uint32_t w = v.getInternalValue(i);
+        while(w != 0)
+        {
+            w &= w - 1;
+            bits++;
+        }
+    }
+    return (bits == 1);
+}
+
+/** floor(v / 2^shift), for any sign of v */
+int64_t floorShift(int64_t v, uint32_t shift)
+{
+    return (v >= 0) ? (v >> shift) : ~((~v) >> shift);
+}
+
+/** the 128-bit product of a and b */
+void mul64(uint64_t a, uint64_t b, uint64_t &hi, uint64_t &lo)
+{
+#if defined(__SIZEOF_INT128__)
+    const unsigned __int128 p = static_cast<unsigned __int128>(a) * b;
+    hi = static_cast<uint64_t>(p >> 64);
+    lo = static_cast<uint64_t>(p);
+#else
+    const uint64_t a0 = a & 0xFFFFFFFF;
+    const uint64_t a1 = a >> 32;
+    const uint64_t b0 = b & 0xFFFFFFFF;
+    const uint64_t b1 = b >> 32;
+    const uint64_t p00 = a0*b0;
+    const uint64_t p01 = a0*b1;
+    const uint64_t p10 = a1*b0;
+    const uint64_t mid = (p00 >> 32) + (p01 & 0xFFFFFFFF) + (p10 & 0xFFFFFFFF);
+    lo = (mid << 32) | (p00 & 0xFFFFFFFF);
+    hi = a1*b1 + (p01 >> 32) + (p10 >> 32) + (mid >> 32);
+#endif
+}
+
+/** a*b for Q(2,62) numbers, rounded towards minus infinity */
+uint64_t mul62(uint64_t a, uint64_t b)
+{
+    uint64_t hi, lo;
+    mul64(a, b, hi, lo);
+    return (hi << 2) | (lo >> 62);
+}
+
+/** e^u for |u| < 1 as a Q(3,W) number. the argument is
+    divided by 2^r so that the Taylor series converges
+    quickly, then the result is squared r times. */
+SFix expSeries(const SFix &u, int32_t W)
+{
+    const int32_t r = static_cast<int32_t>(sqrt(W / 2.0));
+
+    // every squaring doubles the relative error
+    const int32_t w = W + 16 + r;
+    const bool negative = u.isNegative();
+    const SFix a = negative ? u.negate() : u;
+    const SFix y = fit(fit(a, 2 + r, w).reinterpret(2, w + r), 2, w);
+
+    // the terms y^k/k! alternate in sign for negative u
+    SFix term = y;
+    SFix sum = fit(negative ? (one(w) - y) : (one(w) + y), 3, w);
+    for(uint32_t k=2; !isZero(term); k++)
+    {
+        term = divSmall(fit(term*y, 2, w), k);
+        sum = fit((negative && (k & 1)) ? (sum - term) : (sum + term), 3, w);
+    }
+
+    for(int32_t i=0; i<r; i++)
+    {
+        sum = fit(sum*sum, 3, w);
+    }
+    return fit(sum, 3, W);
+}
+
+/** ln(m) for 1 <= m < 2 as a Q(2,W) number, using
+    Newton iterations y' = y + m*e^-y - 1 that double
+    the precision every step. */
+SFix logarithm(const SFix &m, int32_t W)
+{
+    // the double approximation is good to 50 bits
+    int32_t p = 48;
+    SFix y = fromDouble(::log(toDouble(m)), 2, 60);
+    while(p < W)
+    {
+        p = std::min(2*p - 4, W);
+        const int32_t w = p + 8;
+        const SFix yw = fit(y, 2, w);
+        const SFix e  = expSeries(yw.negate(), w);
+        const SFix me = fit(fit(m, 2, w)*e, 3, w);
+        y = fit(yw + me - one(w), 2, w);
+    }
+    return fit(y, 2, W);
+}
+
+/** check that every number within the error bound of the
+    approximation v rounds to the same value when the lower
+    'guard' bits are removed. the guard bits above the error
+    bound must not be all zeros or all ones. */
+bool isCertain(const SFix &v, int32_t guard)
+{
+    bool zeros = true;
+    bool ones = true;
+    for(int32_t bit=c_errorBits+1; bit<guard; bit++)
+    {
+        const bool b = ((v.getInternalValue(bit/32) >> (bit%32)) & 1) != 0;
+        zeros = zeros && !b;
+        ones = ones && b;
+    }
+    return !zeros && !ones;
+}
+
+/** 2^t where t = x for exp2 and t = x*log2(e) for exp,
+    with 'nMax' an upper bound of floor(t). */
+SFix slowExp(const SFix &x, bool natural, int32_t nMax, int32_t intBits, int32_t fracBits)
+{
+    const char *name = natural ? "exp" : "exp2";
+    for(int32_t guard=c_guardBits; ; guard*=2)
+    {
+        const int32_t P = fracBits + std::max(nMax, 0) + guard + 16;
+        SFix t = x;
+        if (natural)
+        {
+            const SFix c = constants::invLn2(P + std::max(x.intBits(), 0));
+            t = fit(x*c, x.intBits() + 2, P);
+        }
+
+        // 2^t = 2^n * 2^f with 0 <= f < 1
+        const int64_t n = toInt64(t, Rounding::Floor);
+        if (n < -static_cast<int64_t>(fracBits) - 1)
+        {
+            return SFix(intBits, fracBits);
+        }
+        const SFix f = fit(t - fromInt64(n, 64, 0), 2, P);
+        if (!natural && isZero(f))
+        {
+            SFix result(intBits, fracBits);
+            result.addPowerOfTwo(static_cast<int32_t>(n), false);
+            return result;
+        }
+
+        // 2^f = e^(f*ln(2)) with fracBits + n + guard bits,
+        // so that 2^t has fracBits + guard bits.
+        const int32_t W = fracBits + static_cast<int32_t>(n) + guard;
+        const SFix u = fit(fit(f, 2, W + 8)*constants::ln2(W + 8), 2, W + 8);
+        const SFix m = expSeries(u, W);
+        if (isCertain(m, guard))
+        {
+            return fitResult(scale(m, static_cast<int32_t>(n)).removeLSBs(guard), intBits, fracBits, name);
+        }
+    }
+}
+
+/** log2(x) or ln(x) for a positive x whose most
+    significant bit is bit 'top' */
+SFix slowLog(const SFix &x, int32_t top, bool natural, int32_t intBits, int32_t fracBits)
+{
+    const char *name = natural ? "ln" : "log2";
+
+    // x = 2^e * m with 1 <= m < 2
+    const int32_t e = top - x.fracBits();
+    const SFix m = fit(scale(x, -e), 2, x.intBits() + x.fracBits());
+    const SFix eFix = fromInt64(e, 33, 0);
+
+    if (isPowerOfTwo(x))
+    {
+        // log2(2^e) = e, ln(1) = 0
+        if (!natural)
+        {
+            return fitResult(eFix, intBits, fracBits, name);
+        }
+        if (e == 0)
+        {
+            return SFix(intBits, fracBits);
+        }
+    }
+
+    for(int32_t guard=c_guardBits; ; guard*=2)
+    {
+        const int32_t W = fracBits + guard;
+        const SFix y = logarithm(fit(m, 2, W + 16), W + 8);
+        SFix v;
+        if (natural)
+        {
+            // ln(x) = e*ln(2) + ln(m)
+            const SFix eLn2 = eFix*constants::ln2(W + 40);
+            v = fit(eLn2 + y, eLn2.intBits() + 1, W);
+        }
+        else
+        {
+            // log2(x) = e + ln(m)/ln(2)
+            const SFix l = fit(y*constants::invLn2(W + 8), 2, W + 8);
+            v = fit(eFix + l, 35, W);
+        }
+        if (isCertain(v, guard))
+        {
+            return fitResult(v.removeLSBs(guard), intBits, fracBits, name);
+        }
+    }
+}
+
+/** tables and constants of the fast path, as Q(2,62) numbers */
+struct FastTables
+{
+    uint64_t exp2Table[256];    ///< 2^(i/256)
+    uint64_t recip[256];        ///< 1/(1+i/256), rounded up
+    uint64_t log2Recip[256];    ///< -log2(recip[i])
+    uint64_t lnRecip[256];      ///< -ln(recip[i])
+    uint64_t lnCoeff[9];        ///< 1/k for ln(1+z)
+    uint64_t ln2;               ///< ln(2)
+    uint64_t invLn2;            ///< 1/ln(2)
+    uint64_t ln2x64;            ///< ln(2) as a Q(0,64) number
+    uint64_t invLn2x63;         ///< 1/ln(2) as a Q(1,63) number
+
+    FastTables()
+    {
+        // the tables are exact results of the slow path
+        for(uint32_t i=0; i<256; i++)
+        {
+            exp2Table[i] = rawBits(slowExp(fromRaw(i, 2, 8), false, 1, 2, 62), 0);
+
+            // ceil(2^70 / (256+i))
+            const uint64_t d = 256 + i;
+            const uint64_t q = c_one / d;
+            const uint64_t r = ((c_one % d) << 8);
+            recip[i] = (q << 8) + r / d + (((r % d) != 0) ? 1 : 0);
+
+            const SFix rc = fromRaw(static_cast<int64_t>(recip[i]), 2, 62);
+            const int32_t top = topBit(rc);
+            log2Recip[i] = static_cast<uint64_t>(-static_cast<int64_t>(rawBits(slowLog(rc, top, false, 2, 62), 0)));
+            lnRecip[i] = static_cast<uint64_t>(-static_cast<int64_t>(rawBits(slowLog(rc, top, true, 2, 62), 0)));
+        }
+        for(uint32_t k=1; k<9; k++)
+        {
+            lnCoeff[k] = c_one / k;
+        }
+        lnCoeff[0] = 0;
+        ln2 = rawBits(constants::ln2(62), 0);
+        invLn2 = rawBits(constants::invLn2(62), 0);
+        ln2x64 = rawBits(constants::ln2(64), 0);
+        invLn2x63 = rawBits(constants::invLn2(63), 0);
+    }
+};
+
+const FastTables& fastTables()
+{
+    // intentionally leaked, like the constants cache.
+    static const FastTables *t = new FastTables();
+    return *t;
+}
+
+/** 2^(n + f*2^-64) using 64-bit arithmetic, as the two's
+    complement representation of a Q(intBits, fracBits) number.
+    returns false when the rounding is not certain or the result
+    does not fit; the slow path then decides. */
+bool fastExp2(int64_t n, uint64_t f, int32_t intBits, int32_t fracBits, int64_t &result)
+{
+    // the Q(2,62) approximation loses 'drop' bits
+    const int64_t drop = 62 - n - fracBits;
+    if ((drop < 1) || (drop > 62))
+    {
+        return false;
+    }
+
+    // 2^f = 2^(i/256) * e^(r*ln(2)) with r < 2^-8
+    const FastTables &t = fastTables();
+    const uint32_t i = static_cast<uint32_t>(f >> 56);
+    const uint64_t u = mul62((f & 0x00FFFFFFFFFFFFFFULL) >> 2, t.ln2);
+    uint64_t q = c_one;
+    for(uint32_t k=6; k>0; k--)
+    {
+        q = c_one + mul62(u, q) / k;
+    }
+    const uint64_t a = mul62(t.exp2Table[i], q);
+
+    const uint32_t s = static_cast<uint32_t>(drop);
+    const uint64_t raw = (a - c_fastError) >> s;
+    if (raw != ((a + c_fastError) >> s))
+    {
+        return false;
+    }
+    const int64_t bits = static_cast<int64_t>(intBits) - 1 + fracBits;
+    if ((bits < 63) && (raw >= (1ULL << bits)))
+    {
+        return false;
+    }
+    result = static_cast<int64_t>(raw);
+    return true;
+}
+
+/** log2(x) or ln(x) using 64-bit arithmetic, for a positive
+    x whose most significant bit is bit 'top', like fastExp2. */
+bool fastLog(const SFix &x, int32_t top, bool natural, int32_t intBits, int32_t fracBits, int64_t &result)
+{
+    // x = 2^e * m with 1 <= m < 2. the result is calculated
+    // with G fractional bits, so that e fits 64 bits.
+    const int64_t e = static_cast<int64_t>(top) - x.fracBits();
+    const uint64_t absE = static_cast<uint64_t>((e < 0) ? -e : e);
+    int32_t G = 62;
+    while((absE >> (62 - G)) != 0)
+    {
+        G--;
+    }
+    const int32_t drop = G - fracBits;
+    if (drop < 1)
+    {
+        return false;
+    }
+
+    // m * recip[i] = 1 + z with 0 <= z < 2^-8
+    const FastTables &t = fastTables();
+    const uint64_t m = rawBits(x, top - 62);
+    const uint32_t i = static_cast<uint32_t>(m >> 54) & 0xFF;
+    const uint64_t z = mul62(m, t.recip[i]) - c_one;
+
+    // ln(1+z) = z*(1 - z*(1/2 - z*(1/3 - ...)))
+    uint64_t q = t.lnCoeff[8];
+    for(uint32_t k=7; k>0; k--)
+    {
+        q = t.lnCoeff[k] - mul62(z, q);
+    }
+    const uint64_t ln1z = mul62(z, q);
+
+    int64_t sum;
+    if (natural)
+    {
+        // ln(x) = e*ln(2) - ln(recip[i]) + ln(1+z)
+        const uint64_t l = (ln1z + t.lnRecip[i]) >> (62 - G);
+        uint64_t hi, lo;
+        mul64(absE, t.ln2x64, hi, lo);
+        const int64_t eLn2 = static_cast<int64_t>((hi << G) | (lo >> (64 - G)));
+        sum = static_cast<int64_t>(l) + ((e < 0) ? -eLn2 : eLn2);
+    }
+    else
+    {
+        // log2(x) = e - log2(recip[i]) + ln(1+z)/ln(2)
+        const uint64_t l = (mul62(ln1z, t.invLn2) + t.log2Recip[i]) >> (62 - G);
+        sum = static_cast<int64_t>(l) + e*(static_cast<int64_t>(1) << G);
+    }
+
+    const int64_t raw = floorShift(sum - c_fastError, drop);
+    if (raw != floorShift(sum + c_fastError, drop))
+    {
+        return false;
+    }
+    const int64_t bits = static_cast<int64_t>(intBits) - 1 + fracBits;
+    if ((bits < 63) && ((raw >= (1LL << bits)) || (raw < -(1LL << bits))))
+    {
+        return false;
+    }
+    result = raw;
+    return true;
+}
+
+/** check the argument of a logarithm and return its most significant bit */
+int32_t logArgument(const SFix &x, const char *name)
+{
+    if (x.isNegative() || isZero(x))
+    {
+        throw std::runtime_error(std::string("fplib::") + name + ": the argument must be positive!");
+    }
+    return topBit(x);
+}
+
+} // end anonymous namespace
+
+
+SFix fplib::exp2(const SFix &x, int32_t intBits, int32_t fracBits)
+{
+    // n = floor(x), exactly when x is small enough
+    int64_t n;
+    if ((x.intBits() <= 40) || (x.determineMinimumIntegerBits() <= 40))
+    {
+        n = static_cast<int64_t>(rawBits(x, x.fracBits()));
+    }
+    else
+    {
+        n = x.isNegative() ? INT64_MIN : INT64_MAX;
+    }
+
+    if (n >= static_cast<int64_t>(intBits) - 1)
+    {
+        throw std::runtime_error("fplib::exp2: the result does not fit the integer bits!");
+    }
+    if (n < -static_cast<int64_t>(fracBits))
+    {
+        // 2^x < 2^-fracBits
+        return SFix(intBits, fracBits);
+    }
+
+    if (isInteger(x))
+    {
+        SFix result(intBits, fracBits);
+        result.addPowerOfTwo(static_cast<int32_t>(n), false);
+        return result;
+    }
+
+    int64_t raw;
+    if (fastExp2(n, rawBits(x, x.fracBits() - 64), intBits, fracBits, raw))
+    {
+        return fromRaw(raw, intBits, fracBits);
+    }
+    return slowExp(x, false, static_cast<int32_t>(n), intBits, fracBits);
+}
+
+
+SFix fplib::exp(const SFix &x, int32_t intBits, int32_t fracBits)
+{
+    if (isZero(x))
+    {
+        return fitResult(fromInt64(1, 2, 0), intBits, fracBits, "exp");
+    }
+
+    const double xd = toDouble(x);
+    if (xd >= intBits*0.6931471805599453 + 1.0)
+    {
+        throw std::runtime_error("fplib::exp: the result does not fit the integer bits!");
+    }
+    if (xd < -(fracBits + 2)*0.6931471805599453)
+    {
+        // e^x < 2^-(fracBits+2)
+        return SFix(intBits, fracBits);
+    }
+
+    if (fabs(xd) < 63.0)
+    {
+        // x*log2(e) from x as a Q(7,57) number
+        const FastTables &t = fastTables();
+        const int64_t xr = static_cast<int64_t>(rawBits(x, x.fracBits() - 57));
+        uint64_t hi, lo;
+        mul64(static_cast<uint64_t>((xr < 0) ? -xr : xr), t.invLn2x63, hi, lo);
+        if (xr < 0)
+        {
+            lo = ~lo + 1;
+            hi = ~hi + ((lo == 0) ? 1 : 0);
+        }
+
+        // the product has 120 fractional bits
+        const int64_t n = floorShift(static_cast<int64_t>(hi), 56);
+        const uint64_t f = (hi << 8) | (lo >> 56);
+        int64_t raw;
+        if (fastExp2(n, f, intBits, fracBits, raw))
+        {
+            return fromRaw(raw, intBits, fracBits);
+        }
+    }
+
+    const int32_t nMax = static_cast<int32_t>(floor(xd*1.4426950408889634)) + 2;
+    return slowExp(x, true, nMax, intBits, fracBits);
+}
+
+
+SFix fplib::log2(const SFix &x, int32_t intBits, int32_t fracBits)
+{
+    const int32_t top = logArgument(x, "log2");
+    int64_t raw;
+    if (!isPowerOfTwo(x) && fastLog(x, top, false, intBits, fracBits, raw))
+    {
+        return fromRaw(raw, intBits, fracBits);
+    }
+    return slowLog(x, top, false, intBits, fracBits);
+}
+
+
+SFix fplib::ln(const SFix &x, int32_t intBits, int32_t fracBits)
+{
+    const int32_t top = logArgument(x, "ln");
+    int64_t raw;
+    if (!isPowerOfTwo(x) && fastLog(x, top, true, intBits, fracBits, raw))
+    {
+        return fromRaw(raw, intBits, fracBits);
+    }
+    return slowLog(x, top, true, intBits, fracBits);
+}
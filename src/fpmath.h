@@ -0,0 +1,56 @@
+/*
+
+    FPLIB: a library providing a fixed-point datatype.
+
+    Exponential and logarithm functions: 2^x, e^x, log2(x)
+    and ln(x) of SFix numbers, to any precision.
+
+    The caller chooses the format of the result. Results are
+    rounded towards minus infinity, like SFix::removeLSBs,
+    and are exact: the function is evaluated with guard bits
+    until the rounding is certain, like the constants in
+    fpconstants.h.
+
+    Results with up to about 50 significant bits are
+    computed with 64-bit integer arithmetic and tables of
+    2^(i/256) and log2(1 + i/256), which are calculated once.
+    Longer results use argument reduction, a Taylor series
+    for e^x and Newton iterations for ln(x), with a working
+    precision that follows the number of requested bits.
+
+        SFix g = exp2(gainDb*c, 4, 28);     // Q(4,28)
+        SFix l = log2(power, 8, 24);        // Q(8,24)
+
+    A std::runtime_error is thrown when the result does not
+    fit the requested format, or when the logarithm of a
+    number <= 0 is requested.
+
+    N.A. Moseley 2017
+    License: T.B.D.
+
+*/
+
+#ifndef fpmath_h
+#define fpmath_h
+
+#include <stdint.h>
+#include "fplib.h"
+
+namespace fplib
+{
+
+/** 2^x as a Q(intBits, fracBits) number */
+SFix exp2(const SFix &x, int32_t intBits, int32_t fracBits);
+
+/** e^x as a Q(intBits, fracBits) number */
+SFix exp(const SFix &x, int32_t intBits, int32_t fracBits);
+
+/** log2(x) for x > 0 as a Q(intBits, fracBits) number */
+SFix log2(const SFix &x, int32_t intBits, int32_t fracBits);
+
+/** ln(x) for x > 0 as a Q(intBits, fracBits) number */
+SFix ln(const SFix &x, int32_t intBits, int32_t fracBits);
+
+} // end namespace
+
+#endif
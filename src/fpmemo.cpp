@@ -0,0 +1,172 @@
+/*
+
+    FPLIB: a library providing a fixed-point datatype.
+
+    Memoisation of expensive SFix results.
+
+    N.A. Moseley 2017
+    License: T.B.D.
+
+*/
+
+#include <iterator>
+#include "fpmemo.h"
+
+using namespace fplib;
+
+MemoCache::MemoCache(size_t capacity, uint32_t shards)
+    : m_capacity(capacity), m_hits(0), m_misses(0), m_evictions(0)
+{
+    if ((capacity == 0) || (shards == 0))
+    {
+        throw std::runtime_error("MemoCache: capacity and number of shards must be non-zero!");
+    }
+
+    // every shard holds at least one entry; the remainder
+    // of the division goes to the first shards, so the
+    // shard capacities add up to the capacity.
+    shards = static_cast<uint32_t>(std::min(static_cast<size_t>(shards), capacity));
+    for(uint32_t i=0; i<shards; i++)
+    {
+        m_shards.push_back(std::unique_ptr<Shard>(new Shard()));
+        m_shards.back()->capacity = capacity / shards + ((i < capacity % shards) ? 1 : 0);
+    }
+}
+
+
+uint64_t MemoCache::keyHash(uint32_t functionId, const SFix &a, const SFix *b)
+{
+    uint64_t h = a.hash() ^ (static_cast<uint64_t>(functionId) * 0x9e3779b97f4a7c15ULL);
+    if (b != nullptr)
+    {
+        h = ((h << 17) | (h >> 47)) ^ (b->hash() * 0xc2b2ae3d27d4eb4fULL);
+    }
+    return h;
+}
+
+
+MemoCache::EntryList::iterator MemoCache::find(Shard &s, uint64_t hash, uint32_t functionId,
+                                               const SFix &a, const SFix *b)
+{
+    auto range = s.index.equal_range(hash);
+    for(auto iter = range.first; iter != range.second; ++iter)
+    {
+        const Entry &e = *iter->second;
+        if ((e.functionId == functionId) && (e.binary == (b != nullptr)) &&
+            (e.a == a) && ((b == nullptr) || (e.b == *b)))
+        {
+            return iter->second;
+        }
+    }
+    return s.lru.end();
+}
+
+
+MemoCache::Result MemoCache::lookup(uint64_t hash, uint32_t functionId, const SFix &a, const SFix *b)
+{
+    Shard &s = shard(hash);
+    std::lock_guard<std::mutex> lock(s.mutex);
+
+    auto iter = find(s, hash, functionId, a, b);
+    if (iter == s.lru.end())
+    {
+        m_misses.fetch_add(1, std::memory_order_relaxed);
+        return Result();
+    }
+
+    // move to the front of the LRU list; this
+    // relinks the node without allocating.
+    s.lru.splice(s.lru.begin(), s.lru, iter);
+    m_hits.fetch_add(1, std::memory_order_relaxed);
+    return iter->result;
+}
+
+
+MemoCache::Result MemoCache::insert(uint64_t hash, uint32_t functionId, const SFix &a, const SFix *b,
+                                    const SFix &result)
+{
+    // the result is computed outside of the lock,
+    // so build the entry before taking the lock too.
+    // the copies must not come from an arena of the
+    // calling thread.
+    HeapScope heap;
+    EntryList entry;
+    entry.push_back(Entry{hash, functionId, (b != nullptr), a,
+                          (b != nullptr) ? *b : SFix(),
+                          std::make_shared<const SFix>(result)});
+
+    EntryList evicted;
+    Result r;
+    {
+        Shard &s = shard(hash);
+        std::lock_guard<std::mutex> lock(s.mutex);
+
+        // another thread may have computed the same
+        // result in the meantime; keep the first one.
+        auto iter = find(s, hash, functionId, a, b);
+        if (iter != s.lru.end())
+        {
+            s.lru.splice(s.lru.begin(), s.lru, iter);
+            return iter->result;
+        }
+
+        s.lru.splice(s.lru.begin(), entry);
+        s.index.insert(std::make_pair(hash, s.lru.begin()));
+        r = s.lru.front().result;
+
+        while(s.lru.size() > s.capacity)
+        {
+            auto last = std::prev(s.lru.end());
+            auto range = s.index.equal_range(last->hash);
+            for(auto i = range.first; i != range.second; ++i)
+            {
+                if (i->second == last)
+                {
+                    s.index.erase(i);
+                    break;
+                }
+            }
+            // the evicted entries are destroyed
+            // after the lock has been released.
+            evicted.splice(evicted.begin(), s.lru, last);
+            m_evictions.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+    return r;
+}
+
+
+void MemoCache::clear()
+{
+    for(auto &s : m_shards)
+    {
+        EntryList entries;
+        {
+            std::lock_guard<std::mutex> lock(s->mutex);
+            s->index.clear();
+            entries.swap(s->lru);
+        }
+    }
+}
+
+
+size_t MemoCache::size() const
+{
+    size_t n = 0;
+    for(auto const& s : m_shards)
+    {
+        std::lock_guard<std::mutex> lock(s->mutex);
+        n += s->lru.size();
+    }
+    return n;
+}
+
+
+MemoCache::Stats MemoCache::getStats() const
+{
+    Stats stats;
+    stats.hits      = m_hits.load(std::memory_order_relaxed);
+    stats.misses    = m_misses.load(std::memory_order_relaxed);
+    stats.evictions = m_evictions.load(std::memory_order_relaxed);
+    return stats;
+}
@@ -0,0 +1,164 @@
+/*
+
+    FPLIB: a library providing a fixed-point datatype.
+
+    Memoisation of expensive SFix results, such as
+    reciprocals, square roots and coefficient products.
+
+    A MemoCache holds the results of unary and binary
+    functions, keyed on a function id and the operands
+    (value and format). It is bounded: the least recently
+    used entries are evicted once the capacity is reached.
+    It is thread-safe and split into shards with their own
+    lock, so threads working on different keys rarely
+    contend.
+
+    A cache hit returns a shared pointer to the stored
+    result: it does not compute, copy or allocate an SFix.
+    Results stay valid for as long as the caller holds the
+    pointer, even when the entry is evicted.
+
+    Example:
+        MemoCache cache(4096);
+        auto r = cache.get(FN_RECIPROCAL, x,
+                           [](const SFix &v) { return reciprocal(v); });
+
+    The cache stores its entries on the heap, even when it
+    is used inside an ArenaScope.
+
+    N.A. Moseley 2017
+    License: T.B.D.
+
+*/
+
+#ifndef fpmemo_h
+#define fpmemo_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include <memory>
+#include <mutex>
+#include <list>
+#include <vector>
+#include <atomic>
+#include <unordered_map>
+#include "fplib.h"
+
+namespace fplib
+{
+
+class MemoCache
+{
+public:
+    typedef std::shared_ptr<const SFix> Result;
+
+    /** create a cache.
+        @param[in] capacity maximum number of entries.
+        @param[in] shards number of independently locked parts.
+
+        the capacity is divided over the shards and every
+        shard evicts on its own, so a shard can evict before
+        the whole cache is full.
+    */
+    explicit MemoCache(size_t capacity = 1024, uint32_t shards = 16);
+
+    /** return the cached result of the unary function 'functionId'
+        for operand a. if it is not cached, fn(a) is called to
+        compute it. the function id identifies the function, it
+        must be unique within a cache. */
+    template <class F> Result get(uint32_t functionId, const SFix &a, F fn)
+    {
+        const uint64_t h = keyHash(functionId, a, nullptr);
+        Result r = lookup(h, functionId, a, nullptr);
+        if (r)
+        {
+            return r;
+        }
+        return insert(h, functionId, a, nullptr, fn(a));
+    }
+
+    /** return the cached result of the binary function 'functionId'
+        for operands a and b. if it is not cached, fn(a,b) is called
+        to compute it. */
+    template <class F> Result get(uint32_t functionId, const SFix &a, const SFix &b, F fn)
+    {
+        const uint64_t h = keyHash(functionId, a, &b);
+        Result r = lookup(h, functionId, a, &b);
+        if (r)
+        {
+            return r;
+        }
+        return insert(h, functionId, a, &b, fn(a, b));
+    }
+
+    /** remove all entries */
+    void clear();
+
+    /** return the number of entries */
+    size_t size() const;
+
+    /** return the maximum number of entries */
+    size_t capacity() const
+    {
+        return m_capacity;
+    }
+
+    struct Stats
+    {
+        uint64_t hits;
+        uint64_t misses;
+        uint64_t evictions;
+    };
+
+    /** return the hit / miss / eviction counters */
+    Stats getStats() const;
+
+protected:
+    struct Entry
+    {
+        uint64_t    hash;
+        uint32_t    functionId;
+        bool        binary;
+        SFix        a;
+        SFix        b;
+        Result      result;
+    };
+
+    typedef std::list<Entry> EntryList;
+
+    struct Shard
+    {
+        std::mutex  mutex;
+        EntryList   lru;        ///< most recently used entry first
+        std::unordered_multimap<uint64_t, EntryList::iterator> index;
+        size_t      capacity;   ///< maximum number of entries of this shard
+    };
+
+    static uint64_t keyHash(uint32_t functionId, const SFix &a, const SFix *b);
+
+    Shard& shard(uint64_t hash)
+    {
+        return *m_shards[(hash >> 32) % m_shards.size()];
+    }
+
+    /** find an entry in the index of a shard. the shard must be locked. */
+    static EntryList::iterator find(Shard &s, uint64_t hash, uint32_t functionId,
+                                    const SFix &a, const SFix *b);
+
+    /** return the cached result or an empty pointer */
+    Result lookup(uint64_t hash, uint32_t functionId, const SFix &a, const SFix *b);
+
+    /** add a computed result and return the cached result */
+    Result insert(uint64_t hash, uint32_t functionId, const SFix &a, const SFix *b,
+                  const SFix &result);
+
+    std::vector<std::unique_ptr<Shard> > m_shards;
+    size_t                  m_capacity;
+    std::atomic<uint64_t>   m_hits;
+    std::atomic<uint64_t>   m_misses;
+    std::atomic<uint64_t>   m_evictions;
+};
+
+} // end namespace
+
+#endif
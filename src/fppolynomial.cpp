@@ -0,0 +1,95 @@
+/*
+
+    FPLIB: a library providing a fixed-point datatype.
+
+    Polynomial evaluation using Horner's scheme.
+
+    N.A. Moseley 2017
+    License: T.B.D.
+
+*/
+
+#include <sstream>
+#include <stdexcept>
+#include "fppolynomial.h"
+#include "fpinternal.h"
+
+using namespace fplib;
+
+Polynomial::Polynomial(const std::vector<SFix> &coefficients,
+                       int32_t xIntBits, int32_t xFracBits,
+                       int32_t intBits, int32_t fracBits)
+    : m_original(coefficients),
+      m_xIntBits(xIntBits),
+      m_xFracBits(xFracBits),
+      m_checked(false)
+{
+    if (coefficients.empty())
+    {
+        throw std::runtime_error("Polynomial: no coefficients!");
+    }
+
+    for(size_t k=0; k<coefficients.size(); k++)
+    {
+        m_coefficients.push_back(detail::fit(coefficients[k], intBits, fracBits));
+        m_acc.push_back(SFix(intBits, fracBits));
+    }
+}
+
+
+void Polynomial::setStepFormat(uint32_t power, int32_t intBits, int32_t fracBits)
+{
+    if (power >= m_coefficients.size())
+    {
+        throw std::runtime_error("Polynomial: there is no step for this power!");
+    }
+    m_coefficients[power] = detail::fit(m_original[power], intBits, fracBits);
+    m_acc[power] = SFix(intBits, fracBits);
+    m_checked = false;
+}
+
+
+void Polynomial::checkFormats()
+{
+    for(size_t k=0; k+1<m_acc.size(); k++)
+    {
+        if (m_acc[k].fracBits() > (m_acc[k+1].fracBits() + m_xFracBits))
+        {
+            std::stringstream ss;
+            ss << "Polynomial: step " << k << " has more fractional bits than the product!";
+            throw std::runtime_error(ss.str());
+        }
+    }
+    m_checked = true;
+}
+
+
+const SFix& Polynomial::evaluate(const SFix &x)
+{
+    if ((x.intBits() != m_xIntBits) || (x.fracBits() != m_xFracBits))
+    {
+        throw std::runtime_error("Polynomial: x does not have the format of the polynomial!");
+    }
+    if (!m_checked)
+    {
+        checkFormats();
+    }
+
+    const size_t n = m_acc.size() - 1;
+    m_acc[n].copyValueFrom(m_coefficients[n]);
+    for(size_t k=n; k>0; k--)
+    {
+        m_acc[k-1].assignTruncatedProduct(m_acc[k], x);
+        m_acc[k-1].accumulate(m_coefficients[k-1]);
+    }
+    return m_acc[0];
+}
+
+
+void Polynomial::evaluate(const SFix *x, SFix *result, size_t count)
+{
+    for(size_t i=0; i<count; i++)
+    {
+        result[i].copyValueFrom(evaluate(x[i]));
+    }
+}
@@ -0,0 +1,101 @@
+/*
+
+    FPLIB: a library providing a fixed-point datatype.
+
+    Polynomial evaluation using Horner's scheme.
+
+    p(x) = c[0] + c[1]*x + ... + c[n]*x^n is evaluated as
+
+        acc = c[n]
+        acc = acc*x + c[k]      for k = n-1 down to 0
+
+    Every step has its own accumulator format, like the
+    registers of a hardware implementation. The product
+    acc*x is truncated to the format of the step with
+    SFix::assignTruncatedProduct, which skips most of the
+    partial products below the kept bits, and the
+    coefficient is added in place. The integer bits wrap
+    around. The result is bit-exact: it equals a full
+    multiplication followed by removeLSBs.
+
+    The accumulators are allocated once, so evaluating
+    does not allocate.
+
+    Example: a degree-3 polynomial with a Q(1,24) input
+        Polynomial p(coefficients, 1, 24, 4, 28);
+        p.setStepFormat(2, 3, 20);
+        const SFix &y = p.evaluate(x);     // Q(4,28)
+
+    N.A. Moseley 2017
+    License: T.B.D.
+
+*/
+
+#ifndef fppolynomial_h
+#define fppolynomial_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+#include "fplib.h"
+
+namespace fplib
+{
+
+class Polynomial
+{
+public:
+    /** create a polynomial.
+        @param[in] coefficients c[0] .. c[n], at least one.
+        @param[in] xIntBits   integer bits of x.
+        @param[in] xFracBits  fractional bits of x.
+        @param[in] intBits    integer bits of the accumulator of every step.
+        @param[in] fracBits   fractional bits of the accumulator of every step.
+    */
+    Polynomial(const std::vector<SFix> &coefficients,
+               int32_t xIntBits, int32_t xFracBits,
+               int32_t intBits, int32_t fracBits);
+
+    /** set the accumulator format of the step that adds c[power].
+        the coefficient is converted to this format with
+        removeLSBs / removeMSBs / extend*. a step cannot have
+        more fractional bits than the previous step plus x. */
+    void setStepFormat(uint32_t power, int32_t intBits, int32_t fracBits);
+
+    /** return the degree n */
+    uint32_t degree() const
+    {
+        return static_cast<uint32_t>(m_coefficients.size()) - 1;
+    }
+
+    /** return coefficient c[power] in the format of its step */
+    const SFix& coefficient(uint32_t power) const
+    {
+        return m_coefficients.at(power);
+    }
+
+    /** evaluate p(x). x must have the format given to the
+        constructor. the result has the format of step 0 and
+        is valid until the next evaluation. */
+    const SFix& evaluate(const SFix &x);
+
+    /** evaluate p(x) for 'count' values. the results must have
+        the format of step 0; they are written with copyValueFrom,
+        so they do not allocate. */
+    void evaluate(const SFix *x, SFix *result, size_t count);
+
+protected:
+    /** check the step formats, throws a std::runtime_error */
+    void checkFormats();
+
+    std::vector<SFix>   m_original;     ///< coefficients as given
+    std::vector<SFix>   m_coefficients; ///< coefficients in the format of their step
+    std::vector<SFix>   m_acc;          ///< accumulator of every step
+    int32_t             m_xIntBits;
+    int32_t             m_xFracBits;
+    bool                m_checked;      ///< the step formats have been checked
+};
+
+} // end namespace
+
+#endif
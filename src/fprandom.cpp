@@ -0,0 +1,176 @@
+/*
+
+    FPLIB: a library providing a fixed-point datatype.
+
+    Fast, seedable random number generation.
+
+    N.A. Moseley 2017
+    License: T.B.D.
+
+*/
+
+#include <atomic>
+#include <string.h>
+#include "fplib.h"
+#include "fprandom.h"
+
+using namespace fplib;
+
+namespace
+{
+
+/** splitmix64, used to expand a 64-bit seed
+    into the generator state. */
+uint64_t splitmix64(uint64_t &x)
+{
+    uint64_t z = (x += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+std::atomic<uint64_t> g_seed(0);
+std::atomic<uint64_t> g_threadCount(0);
+
+} // end anonymous namespace
+
+
+Random::Random(uint64_t seed)
+{
+    this->seed(seed);
+}
+
+
+void Random::seed(uint64_t seed)
+{
+    for(uint32_t i=0; i<4; i++)
+    {
+        m_s[i] = splitmix64(seed);
+    }
+}
+
+
+void Random::jump()
+{
+    static const uint64_t JUMP[] = { 0x180ec6d33cfd0abaULL, 0xd5a61266f0c9392cULL,
+                                     0xa9582618e03fc9aaULL, 0x39abdc4529b1661cULL };
+
+    uint64_t s[4] = {0,0,0,0};
+    for(uint32_t i=0; i<4; i++)
+    {
+        for(uint32_t b=0; b<64; b++)
+        {
+            if (JUMP[i] & (1ULL << b))
+            {
+                s[0] ^= m_s[0];
+                s[1] ^= m_s[1];
+                s[2] ^= m_s[2];
+                s[3] ^= m_s[3];
+            }
+            next();
+        }
+    }
+    memcpy(m_s, s, sizeof(m_s));
+}
+
+
+void Random::fill(uint32_t *words, size_t count)
+{
+    // keep the state in registers; this loop
+    // generates two words per step.
+    uint64_t s0 = m_s[0];
+    uint64_t s1 = m_s[1];
+    uint64_t s2 = m_s[2];
+    uint64_t s3 = m_s[3];
+
+    size_t i = 0;
+    while(i < count)
+    {
+        const uint64_t r = rotl(s1 * 5, 7) * 9;
+        const uint64_t t = s1 << 17;
+        s2 ^= s0;
+        s3 ^= s1;
+        s1 ^= s2;
+        s0 ^= s3;
+        s2 ^= t;
+        s3 = rotl(s3, 45);
+
+        words[i++] = static_cast<uint32_t>(r);
+        if (i < count)
+        {
+            words[i++] = static_cast<uint32_t>(r >> 32);
+        }
+    }
+
+    m_s[0] = s0;
+    m_s[1] = s1;
+    m_s[2] = s2;
+    m_s[3] = s3;
+}
+
+
+void Random::randomize(SFix &v)
+{
+    v.randomizeValue(*this);
+}
+
+
+void Random::randomize(SFix *values, size_t count)
+{
+    for(size_t i=0; i<count; i++)
+    {
+        values[i].randomizeValue(*this);
+    }
+}
+
+
+void Random::randomize(std::vector<SFix> &values)
+{
+    if (!values.empty())
+    {
+        randomize(&values[0], values.size());
+    }
+}
+
+
+namespace
+{
+
+/** return generator 'index' of 'seed': the generator
+    seeded with 'seed', jumped 'index' times. */
+Random streamRandom(uint64_t seed, uint64_t index)
+{
+    Random r(seed);
+    for(uint64_t i=0; i<index; i++)
+    {
+        r.jump();
+    }
+    return r;
+}
+
+} // end anonymous namespace
+
+
+Random& fplib::threadRandom()
+{
+    // threads that did not select a stream get the
+    // next free one, in the order of first use.
+    thread_local Random t_random(streamRandom(g_seed.load(), g_threadCount.fetch_add(1)));
+    return t_random;
+}
+
+
+void fplib::setRandomSeed(uint64_t seed)
+{
+    // the calling thread uses stream 0, so the next
+    // thread starts at stream 1.
+    g_seed = seed;
+    g_threadCount = 1;
+    threadRandom() = streamRandom(seed, 0);
+}
+
+
+void fplib::setThreadRandomStream(uint64_t index)
+{
+    threadRandom() = streamRandom(g_seed.load(), index);
+}
@@ -0,0 +1,115 @@
+/*
+
+    FPLIB: a library providing a fixed-point datatype.
+
+    Fast, seedable random number generation for fuzzing
+    and simulation, based on xoshiro256** by D. Blackman
+    and S. Vigna. Every generator is an independent object,
+    so there is no shared state between threads. Each thread
+    also has its own generator, returned by threadRandom(),
+    which is used by SFix::randomizeValue().
+
+    N.A. Moseley 2017
+    License: T.B.D.
+
+*/
+
+#ifndef fprandom_h
+#define fprandom_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+
+namespace fplib
+{
+
+class SFix;
+
+/** xoshiro256** pseudo random number generator */
+class Random
+{
+public:
+    /** create a generator. generators created with
+        the same seed produce the same stream. */
+    explicit Random(uint64_t seed = 0);
+
+    /** restart the generator with a new seed */
+    void seed(uint64_t seed);
+
+    /** advance the generator by 2^128 steps. this is used
+        to create non-overlapping streams from one seed. */
+    void jump();
+
+    /** return the next 64-bit random value */
+    uint64_t next()
+    {
+        const uint64_t result = rotl(m_s[1] * 5, 7) * 9;
+        const uint64_t t = m_s[1] << 17;
+
+        m_s[2] ^= m_s[0];
+        m_s[3] ^= m_s[1];
+        m_s[1] ^= m_s[2];
+        m_s[0] ^= m_s[3];
+        m_s[2] ^= t;
+        m_s[3] = rotl(m_s[3], 45);
+
+        return result;
+    }
+
+    /** return the next 32-bit random value */
+    uint32_t next32()
+    {
+        return static_cast<uint32_t>(next() >> 32);
+    }
+
+    /** return a uniformly distributed value in [0, range) */
+    uint32_t nextBelow(uint32_t range)
+    {
+        return static_cast<uint32_t>((static_cast<uint64_t>(next32()) * range) >> 32);
+    }
+
+    /** fill an array of 32-bit words with random values */
+    void fill(uint32_t *words, size_t count);
+
+    /** set a number to a random value, uniformly
+        distributed over the range of its format. */
+    void randomize(SFix &v);
+
+    /** set an array of numbers to random values */
+    void randomize(SFix *values, size_t count);
+
+    /** set an array of numbers to random values */
+    void randomize(std::vector<SFix> &values);
+
+protected:
+    static uint64_t rotl(const uint64_t x, int k)
+    {
+        return (x << k) | (x >> (64 - k));
+    }
+
+    uint64_t m_s[4];    ///< generator state
+};
+
+/** return the generator of the calling thread. stream k of
+    a seed is the generator of that seed jumped k times, so
+    streams never overlap. a thread that did not select a
+    stream with setThreadRandomStream() gets the next free
+    stream when it first uses its generator, which depends
+    on the order in which threads start. */
+Random& threadRandom();
+
+/** set the seed of the thread generators. the calling thread
+    is restarted on stream 0 of the seed; threads that have
+    not used their generator yet take streams 1, 2, ... */
+void setRandomSeed(uint64_t seed);
+
+/** restart the generator of the calling thread on stream
+    'index' of the current seed. threads that select their
+    stream by a fixed index, e.g. their worker number, get
+    the same values in every run. */
+void setThreadRandomStream(uint64_t index);
+
+} // end namespace
+
+#endif
@@ -0,0 +1,279 @@
+/*
+
+    FPLIB: a library providing a fixed-point datatype.
+
+    Static bit-growth / range analysis.
+
+    N.A. Moseley 2017
+    License: T.B.D.
+
+*/
+
+#include "fprange.h"
+#include "fpinternal.h"
+
+using namespace fplib;
+
+namespace
+{
+
+/** return the product of two bounds. one extra integer bit
+    is added because Q(n1,m1)*Q(n2,m2) -> Q(n1+n2-1, m1+m2)
+    cannot represent the product of the two most negative
+    values. */
+SFix boundProduct(const SFix &a, const SFix &b)
+{
+    return a.extendMSBs(1) * b;
+}
+
+} // end anonymous namespace
+
+
+RangeAnalysis::NodeId RangeAnalysis::addNode(Node &n)
+{
+    // the minimum number of integer bits needed for an interval
+    // is the largest of the ones needed for the end points.
+    n.minIntBits = std::max(n.lo.determineMinimumIntegerBits(),
+                            n.hi.determineMinimumIntegerBits());
+
+    // keep the bounds at the minimum precision so they
+    // don't grow along with the computation.
+    n.lo = detail::fit(n.lo, n.minIntBits, n.fracBits);
+    n.hi = detail::fit(n.hi, n.minIntBits, n.fracBits);
+
+    m_nodes.push_back(n);
+    return static_cast<NodeId>(m_nodes.size()-1);
+}
+
+
+RangeAnalysis::NodeId RangeAnalysis::input(int32_t intBits, int32_t fracBits)
+{
+    // lo = -2^(intBits-1): only the sign bits set
+    // hi = 2^(intBits-1) - 2^-fracBits: all bits set except the sign bits
+    SFix lo(intBits, fracBits);
+    SFix hi(intBits, fracBits);
+    const uint32_t N = lo.getNumberOfWords();
+    const uint32_t signMask = 0xFFFFFFFFUL << ((intBits + fracBits - 1) % 32);
+    for(uint32_t i=0; i<N-1; i++)
+    {
+        hi.setInternalValue(i, 0xFFFFFFFF);
+    }
+    lo.setInternalValue(N-1, signMask);
+    hi.setInternalValue(N-1, ~signMask);
+    return input(lo, hi);
+}
+
+
+RangeAnalysis::NodeId RangeAnalysis::input(const SFix &lo, const SFix &hi)
+{
+    if ((lo.intBits() != hi.intBits()) || (lo.fracBits() != hi.fracBits()))
+    {
+        throw std::runtime_error("RangeAnalysis::input bounds must have the same format!");
+    }
+    if (hi < lo)
+    {
+        throw std::runtime_error("RangeAnalysis::input lower bound exceeds upper bound!");
+    }
+
+    Node n;
+    n.op = OP_INPUT;
+    n.a = n.b = 0;
+    n.param = 0;
+    n.naturalIntBits = lo.intBits();
+    n.fracBits = lo.fracBits();
+    n.lo = lo;
+    n.hi = hi;
+    return addNode(n);
+}
+
+
+RangeAnalysis::NodeId RangeAnalysis::constant(const SFix &v)
+{
+    Node n;
+    n.op = OP_CONSTANT;
+    n.a = n.b = 0;
+    n.param = 0;
+    n.naturalIntBits = v.intBits();
+    n.fracBits = v.fracBits();
+    n.lo = v;
+    n.hi = v;
+    return addNode(n);
+}
+
+
+RangeAnalysis::NodeId RangeAnalysis::add(NodeId a, NodeId b)
+{
+    const Node &na = node(a);
+    const Node &nb = node(b);
+
+    Node n;
+    n.op = OP_ADD;
+    n.a = a;
+    n.b = b;
+    n.param = 0;
+    n.naturalIntBits = std::max(na.naturalIntBits, nb.naturalIntBits)+1;
+    n.fracBits = std::max(na.fracBits, nb.fracBits);
+    n.lo = na.lo + nb.lo;
+    n.hi = na.hi + nb.hi;
+    return addNode(n);
+}
+
+
+RangeAnalysis::NodeId RangeAnalysis::sub(NodeId a, NodeId b)
+{
+    const Node &na = node(a);
+    const Node &nb = node(b);
+
+    Node n;
+    n.op = OP_SUB;
+    n.a = a;
+    n.b = b;
+    n.param = 0;
+    n.naturalIntBits = std::max(na.naturalIntBits, nb.naturalIntBits)+1;
+    n.fracBits = std::max(na.fracBits, nb.fracBits);
+    n.lo = na.lo - nb.hi;
+    n.hi = na.hi - nb.lo;
+    return addNode(n);
+}
+
+
+RangeAnalysis::NodeId RangeAnalysis::mul(NodeId a, NodeId b)
+{
+    const Node &na = node(a);
+    const Node &nb = node(b);
+
+    // the extremes of a product of two intervals
+    // are found among the products of the end points.
+    SFix p[4] = { boundProduct(na.lo, nb.lo),
+                  boundProduct(na.lo, nb.hi),
+                  boundProduct(na.hi, nb.lo),
+                  boundProduct(na.hi, nb.hi) };
+
+    uint32_t minIdx = 0;
+    uint32_t maxIdx = 0;
+    for(uint32_t i=1; i<4; i++)
+    {
+        if (p[i] < p[minIdx]) minIdx = i;
+        if (p[maxIdx] < p[i]) maxIdx = i;
+    }
+
+    Node n;
+    n.op = OP_MUL;
+    n.a = a;
+    n.b = b;
+    n.param = 0;
+    n.naturalIntBits = na.naturalIntBits + nb.naturalIntBits - 1;
+    n.fracBits = na.fracBits + nb.fracBits;
+    n.lo = p[minIdx];
+    n.hi = p[maxIdx];
+    return addNode(n);
+}
+
+
+RangeAnalysis::NodeId RangeAnalysis::negate(NodeId a)
+{
+    const Node &na = node(a);
+
+    Node n;
+    n.op = OP_NEGATE;
+    n.a = a;
+    n.b = 0;
+    n.param = 0;
+    n.naturalIntBits = na.naturalIntBits;
+    n.fracBits = na.fracBits;
+    // extend first: the most negative value has no
+    // positive counterpart in the same format.
+    n.lo = na.hi.extendMSBs(1).negate();
+    n.hi = na.lo.extendMSBs(1).negate();
+    return addNode(n);
+}
+
+
+RangeAnalysis::NodeId RangeAnalysis::removeLSBs(NodeId a, uint32_t bits)
+{
+    const Node &na = node(a);
+
+    // truncation is monotonic, so the bounds
+    // can be truncated directly.
+    Node n;
+    n.op = OP_REMOVELSBS;
+    n.a = a;
+    n.b = 0;
+    n.param = static_cast<int32_t>(bits);
+    n.naturalIntBits = na.naturalIntBits;
+    n.fracBits = na.fracBits - static_cast<int32_t>(bits);
+    n.lo = na.lo.removeLSBs(bits);
+    n.hi = na.hi.removeLSBs(bits);
+    return addNode(n);
+}
+
+
+RangeAnalysis::NodeId RangeAnalysis::shift(NodeId a, int32_t bits)
+{
+    const Node &na = node(a);
+
+    Node n;
+    n.op = OP_SHIFT;
+    n.a = a;
+    n.b = 0;
+    n.param = bits;
+    n.naturalIntBits = na.naturalIntBits + bits;
+    n.fracBits = na.fracBits - bits;
+    n.lo = na.lo.reinterpret(na.lo.intBits()+bits, na.lo.fracBits()-bits);
+    n.hi = na.hi.reinterpret(na.hi.intBits()+bits, na.hi.fracBits()-bits);
+    return addNode(n);
+}
+
+
+std::vector<SFix> RangeAnalysis::evaluate(const std::vector<SFix> &inputs) const
+{
+    std::vector<SFix> values;
+    values.reserve(m_nodes.size());
+
+    uint32_t inputIdx = 0;
+    for(auto const& n : m_nodes)
+    {
+        SFix v;
+        switch(n.op)
+        {
+        case OP_INPUT:
+            if (inputIdx >= inputs.size())
+            {
+                throw std::runtime_error("RangeAnalysis::evaluate not enough inputs!");
+            }
+            v = detail::fit(inputs[inputIdx], inputs[inputIdx].intBits(), n.fracBits);
+            inputIdx++;
+            if ((v < n.lo) || (n.hi < v))
+            {
+                throw std::runtime_error("RangeAnalysis::evaluate input outside of its declared range!");
+            }
+            break;
+        case OP_CONSTANT:
+            v = n.lo;
+            break;
+        case OP_ADD:
+            v = values[n.a] + values[n.b];
+            break;
+        case OP_SUB:
+            v = values[n.a] - values[n.b];
+            break;
+        case OP_MUL:
+            v = values[n.a].extendMSBs(1) * values[n.b];
+            break;
+        case OP_NEGATE:
+            v = values[n.a].extendMSBs(1).negate();
+            break;
+        case OP_REMOVELSBS:
+            v = values[n.a].removeLSBs(n.param);
+            break;
+        case OP_SHIFT:
+            v = values[n.a].reinterpret(values[n.a].intBits()+n.param, values[n.a].fracBits()-n.param);
+            break;
+        }
+
+        // the value is proven to fit the minimum
+        // number of integer bits.
+        values.push_back(detail::fit(v, n.minIntBits, v.fracBits()));
+    }
+    return values;
+}
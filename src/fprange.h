@@ -0,0 +1,172 @@
+/*
+
+    FPLIB: a library providing a fixed-point datatype.
+
+    Static bit-growth / range analysis.
+
+    The SFix width rules are conservative: every addition
+    adds an integer bit, so long computation chains grow
+    without bound. The RangeAnalysis class records a
+    computation and propagates exact value intervals
+    through it, using SFix arithmetic for the interval
+    bounds. Because the bounds are calculated exactly
+    (no rounding), the resulting integer bit counts are
+    proven to be sufficient for every input within the
+    declared input ranges, not just for observed values.
+
+    The recorded computation can then be evaluated with
+    every node trimmed to its minimum number of integer
+    bits, which uses fewer words.
+
+    Example:
+        RangeAnalysis ra;
+        auto x = ra.input(lo, hi);
+        auto s = ra.add(ra.mul(x,x), x);
+        int32_t bits = ra.minimumIntBits(s);
+
+    N.A. Moseley 2017
+    License: T.B.D.
+
+*/
+
+#ifndef fprange_h
+#define fprange_h
+
+#include <vector>
+#include "fplib.h"
+
+namespace fplib
+{
+
+class RangeAnalysis
+{
+public:
+    typedef uint32_t NodeId;
+
+    /** add an input that may take any value of
+        the Q(intBits, fracBits) format */
+    NodeId input(int32_t intBits, int32_t fracBits);
+
+    /** add an input with a declared value range [lo, hi].
+        lo and hi must have the same format, which is the
+        format of the input. */
+    NodeId input(const SFix &lo, const SFix &hi);
+
+    /** add a constant */
+    NodeId constant(const SFix &v);
+
+    /** add the node a+b */
+    NodeId add(NodeId a, NodeId b);
+
+    /** add the node a-b */
+    NodeId sub(NodeId a, NodeId b);
+
+    /** add the node a*b */
+    NodeId mul(NodeId a, NodeId b);
+
+    /** add the node -a */
+    NodeId negate(NodeId a);
+
+    /** add the node a.removeLSBs(bits), i.e. truncation */
+    NodeId removeLSBs(NodeId a, uint32_t bits);
+
+    /** add the node a*2^bits, i.e. a reinterpret of the
+        fractional point. bits may be negative. */
+    NodeId shift(NodeId a, int32_t bits);
+
+    /** return the number of nodes */
+    uint32_t size() const
+    {
+        return static_cast<uint32_t>(m_nodes.size());
+    }
+
+    /** return the proven lower bound of a node */
+    const SFix& lowerBound(NodeId n) const
+    {
+        return node(n).lo;
+    }
+
+    /** return the proven upper bound of a node */
+    const SFix& upperBound(NodeId n) const
+    {
+        return node(n).hi;
+    }
+
+    /** return the number of fractional bits of a node */
+    int32_t fracBits(NodeId n) const
+    {
+        return node(n).fracBits;
+    }
+
+    /** return the number of integer bits of a node
+        according to the SFix width rules */
+    int32_t naturalIntBits(NodeId n) const
+    {
+        return node(n).naturalIntBits;
+    }
+
+    /** return the smallest number of integer bits that
+        can represent every value the node can attain */
+    int32_t minimumIntBits(NodeId n) const
+    {
+        return node(n).minIntBits;
+    }
+
+    /** evaluate the recorded computation with every node
+        trimmed to its minimum number of integer bits.
+
+        @param[in] inputs values of the input nodes, in the
+                   order the inputs were added.
+        @return the values of all nodes.
+
+        A runtime_error is thrown when an input is outside
+        its declared range, as the bounds would no longer
+        be valid.
+    */
+    std::vector<SFix> evaluate(const std::vector<SFix> &inputs) const;
+
+protected:
+    enum Operation
+    {
+        OP_INPUT,
+        OP_CONSTANT,
+        OP_ADD,
+        OP_SUB,
+        OP_MUL,
+        OP_NEGATE,
+        OP_REMOVELSBS,
+        OP_SHIFT
+    };
+
+    struct Node
+    {
+        Operation   op;
+        NodeId      a;
+        NodeId      b;
+        int32_t     param;          ///< bits for removeLSBs / shift
+        int32_t     naturalIntBits;
+        int32_t     fracBits;
+        int32_t     minIntBits;
+        SFix        lo;             ///< proven lower bound
+        SFix        hi;             ///< proven upper bound
+    };
+
+    const Node& node(NodeId n) const
+    {
+        if (n >= m_nodes.size())
+        {
+            throw std::runtime_error("RangeAnalysis: invalid node id!");
+        }
+        return m_nodes[n];
+    }
+
+    /** set the minimum integer bits of a node from its bounds
+        and trim the bounds to that precision, then add it. */
+    NodeId addNode(Node &n);
+
+    std::vector<Node> m_nodes;
+};
+
+} // end namespace
+
+#endif
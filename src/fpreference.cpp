@@ -11,6 +11,7 @@
 
 */
 
+#include <stdio.h>
 #include <stdexcept>
 #include <algorithm>
 #include "fpreference.h"
@@ -222,9 +223,9 @@ void SFixRef::internal_add(const SFixRef &a, const SFixRef &b, SFixRef &result)
         }
     }
 
-    //finally, propagate carry to final output word
-    //if there is room
-    if ((carry) && (idx < N3))
+    //finally, fill the remaining result bits with the
+    //sum of the sign extensions and the carry.
+    while(idx < N3)
     {
         result.m_bits[idx] = (s_exta != s_extb) != carry;
         carry = (s_exta && s_extb) || (carry && (s_exta || s_extb));
@@ -241,8 +242,22 @@ void SFixRef::internal_sub(const SFixRef &a, const SFixRef &b, SFixRef &result)
         // internal error!
     }
 
-    SFixRef tmp = b.negate();
-    internal_add(a,tmp,result);
+    // a - b = a + ~b + 1, inverting b on the fly so
+    // the most negative value of b is handled correctly.
+    const uint32_t Na = a.m_bits.size();
+    const uint32_t Nb = b.m_bits.size();
+    const uint32_t N3 = result.m_bits.size();
+    const bool s_exta = a.isNegative();
+    const bool s_extb = b.isNegative();
+
+    bool carry = true;
+    for(uint32_t idx=0; idx<N3; idx++)
+    {
+        bool aa = (idx < Na) ? a.m_bits[idx] : s_exta;
+        bool bb = !((idx < Nb) ? b.m_bits[idx] : s_extb);
+        result.m_bits[idx] = (aa != bb) != carry;
+        carry = (aa && bb) || (carry && (aa || bb));
+    }
 }
 
 /** negate a number */
@@ -0,0 +1,148 @@
+/*
+
+    FPLIB: a library providing a fixed-point datatype.
+
+    Reference implementation based on native 128-bit integers.
+
+    N.A. Moseley 2017
+    License: T.B.D.
+
+*/
+
+#include <stdexcept>
+#include <algorithm>
+#include "fpreference128.h"
+
+#ifdef FPLIB_HAVE_INT128
+
+using namespace fplib;
+
+const int32_t SFixRef128::c_maxBits;
+
+SFixRef128::SFixRef128(int32_t intBits, int32_t fracBits)
+    : m_value(0), m_intBits(intBits), m_fracBits(fracBits)
+{
+    if ((intBits + fracBits < 1) || (intBits + fracBits > c_maxBits))
+    {
+        throw std::runtime_error("SFixRef128: number of bits out of range!");
+    }
+}
+
+
+SFixRef128 SFixRef128::operator*(const SFixRef128 &rhs) const
+{
+    SFixRef128 result(m_intBits+rhs.m_intBits-1, m_fracBits+rhs.m_fracBits);
+
+    // the product needs at most 126 bits,
+    // so it cannot overflow.
+    result.setValue(m_value * rhs.m_value);
+    return result;
+}
+
+
+SFixRef128 SFixRef128::operator+(const SFixRef128 &rhs) const
+{
+    const int32_t fracBits = std::max(m_fracBits, rhs.m_fracBits);
+    SFixRef128 result(std::max(m_intBits, rhs.m_intBits)+1, fracBits);
+    result.setValue(shiftLeft(m_value, fracBits - m_fracBits) + shiftLeft(rhs.m_value, fracBits - rhs.m_fracBits));
+    return result;
+}
+
+
+SFixRef128 SFixRef128::operator-(const SFixRef128 &rhs) const
+{
+    const int32_t fracBits = std::max(m_fracBits, rhs.m_fracBits);
+    SFixRef128 result(std::max(m_intBits, rhs.m_intBits)+1, fracBits);
+    result.setValue(shiftLeft(m_value, fracBits - m_fracBits) - shiftLeft(rhs.m_value, fracBits - rhs.m_fracBits));
+    return result;
+}
+
+
+SFixRef128 SFixRef128::negate() const
+{
+    SFixRef128 result(m_intBits, m_fracBits);
+    result.setValue(-m_value);
+    return result;
+}
+
+
+SFixRef128 SFixRef128::extendLSBs(uint32_t bits) const
+{
+    SFixRef128 result(m_intBits, m_fracBits+bits);
+    result.setValue(shiftLeft(m_value, bits));
+    return result;
+}
+
+
+SFixRef128 SFixRef128::extendMSBs(uint32_t bits) const
+{
+    SFixRef128 result(m_intBits+bits, m_fracBits);
+    result.m_value = m_value;
+    return result;
+}
+
+
+SFixRef128 SFixRef128::removeLSBs(uint32_t bits) const
+{
+    SFixRef128 result(m_intBits, m_fracBits-bits);
+    result.m_value = m_value >> bits;
+    return result;
+}
+
+
+SFixRef128 SFixRef128::removeMSBs(uint32_t bits) const
+{
+    SFixRef128 result(m_intBits-bits, m_fracBits);
+
+    // keep the lower bits and force the
+    // sign bit to the original sign.
+    const int32_t N = result.totalBits();
+    const int128_t signBit = static_cast<int128_t>(1) << (N-1);
+    int128_t v = m_value & (signBit-1);
+    if (isNegative())
+    {
+        v |= signBit;
+    }
+    result.setValue(v);
+    return result;
+}
+
+
+SFixRef128 SFixRef128::reinterpret(int32_t intBits, int32_t fracBits) const
+{
+    if (intBits + fracBits != totalBits())
+    {
+        throw std::runtime_error("SFixRef128::reinterpret number of bits does not match!");
+    }
+    SFixRef128 result(intBits, fracBits);
+    result.m_value = m_value;
+    return result;
+}
+
+
+void SFixRef128::fromBinString(const std::string &bin)
+{
+    int128_t v = 0;
+    for(auto c : bin)
+    {
+        v = shiftLeft(v, 1) | ((c == '1') ? 1 : 0);
+    }
+    setValue(v);
+}
+
+
+std::string SFixRef128::toBinString() const
+{
+    const int32_t N = totalBits();
+    std::string bin(N, '0');
+    for(int32_t i=0; i<N; i++)
+    {
+        if ((m_value >> i) & 1)
+        {
+            bin[N-1-i] = '1';
+        }
+    }
+    return bin;
+}
+
+#endif
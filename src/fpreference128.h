@@ -0,0 +1,151 @@
+/*
+
+    FPLIB: a library providing a fixed-point datatype.
+
+    Reference implementation based on native 128-bit
+    integers, for formats of up to 126 bits. It implements
+    the same operations and format rules as SFix but is
+    simple enough to be obviously correct, and is much
+    faster than the bit-serial SFixRef. This is just for
+    checking the fplib library results.
+
+    Only available on compilers that support __int128;
+    FPLIB_HAVE_INT128 is defined when it is.
+
+    N.A. Moseley 2017
+    License: T.B.D.
+
+*/
+
+#ifndef fpreference128_h
+#define fpreference128_h
+
+#include <stdint.h>
+#include <string>
+
+#if defined(__SIZEOF_INT128__)
+#define FPLIB_HAVE_INT128
+
+namespace fplib
+{
+
+/** Reference implementation for formats of up to 126 bits.
+    The value is held as a sign-extended 128-bit integer,
+    scaled by 2^fracBits. Operations whose result does not
+    fit in 126 bits throw a std::runtime_error.
+*/
+class SFixRef128
+{
+public:
+    typedef __int128 int128_t;
+
+    /** maximum number of bits of a number or result */
+    static const int32_t c_maxBits = 126;
+
+    SFixRef128(int32_t intBits, int32_t fracBits);
+
+    /** return the number of integer bits */
+    int32_t intBits() const
+    {
+        return m_intBits;
+    }
+
+    /** return the number of fractional bits */
+    int32_t fracBits() const
+    {
+        return m_fracBits;
+    }
+
+    /** return the total number of bits */
+    int32_t totalBits() const
+    {
+        return m_intBits + m_fracBits;
+    }
+
+    /** return the scaled value, i.e. value * 2^fracBits */
+    int128_t value() const
+    {
+        return m_value;
+    }
+
+    /** set the scaled value. it is wrapped to the format. */
+    void setValue(int128_t v)
+    {
+        m_value = wrap(v, totalBits());
+    }
+
+    /** return 32-bit word 'idx' of the sign-extended value,
+        in the layout used by SFix::getInternalValue. */
+    uint32_t getWord(uint32_t idx) const
+    {
+        if (idx >= 4)
+        {
+            return isNegative() ? 0xFFFFFFFF : 0;
+        }
+        return static_cast<uint32_t>(static_cast<unsigned __int128>(m_value) >> (32*idx));
+    }
+
+    /** multiplication: Q(n1,m1) * Q(n2,m2) -> Q(n1+n2-1, m1+m2) */
+    SFixRef128 operator*(const SFixRef128 &rhs) const;
+
+    /** addition: Q(n1,m1) + Q(n2,m2) -> Q( max(n1,n2)+1, max(m1,m2) ) */
+    SFixRef128 operator+(const SFixRef128 &rhs) const;
+
+    /** subtraction: Q(n1,m1) - Q(n2,m2) -> Q( max(n1,n2)+1, max(m1,m2) ) */
+    SFixRef128 operator-(const SFixRef128 &rhs) const;
+
+    /** negate a number. the most negative value wraps to itself. */
+    SFixRef128 negate() const;
+
+    /** extend LSBs / fractional bits */
+    SFixRef128 extendLSBs(uint32_t bits) const;
+
+    /** extend MSBs / integer bits */
+    SFixRef128 extendMSBs(uint32_t bits) const;
+
+    /** remove LSBs / fractional bits, rounding towards minus infinity */
+    SFixRef128 removeLSBs(uint32_t bits) const;
+
+    /** remove MSBs / integer bits. like SFix, the sign of
+        the original number is kept. */
+    SFixRef128 removeMSBs(uint32_t bits) const;
+
+    /** change the Q(intBits,fracBits) qualifier */
+    SFixRef128 reinterpret(int32_t intBits, int32_t fracBits) const;
+
+    /** check the sign bit */
+    bool isNegative() const
+    {
+        return m_value < 0;
+    }
+
+    /** load number from a binary string, MSB first */
+    void fromBinString(const std::string &bin);
+
+    /** convert to a binary string, MSB first */
+    std::string toBinString() const;
+
+protected:
+    /** sign-extend the lower 'bits' bits of v */
+    static int128_t wrap(int128_t v, int32_t bits)
+    {
+        const uint32_t shift = 128 - bits;
+        return static_cast<int128_t>(static_cast<unsigned __int128>(v) << shift) >> shift;
+    }
+
+    /** v * 2^bits, without relying on left shifts of negative values */
+    static int128_t shiftLeft(int128_t v, int32_t bits)
+    {
+        return static_cast<int128_t>(static_cast<unsigned __int128>(v) << bits);
+    }
+
+    int128_t    m_value;
+    int32_t     m_intBits;
+    int32_t     m_fracBits;
+};
+
+} // namespace
+
+#endif
+
+#endif
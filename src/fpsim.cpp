@@ -0,0 +1,194 @@
+/*
+
+    FPLIB: a library providing a fixed-point datatype.
+
+    Cycle-based simulation kernel for RTL-equivalent models.
+
+    N.A. Moseley 2017
+    License: T.B.D.
+
+*/
+
+#include <stdexcept>
+#include "fpsim.h"
+
+using namespace fplib;
+
+Simulator::Simulator()
+    : m_cycle(0), m_maxDeltas(1000), m_initialized(false)
+{
+}
+
+
+SignalId Simulator::signal(int32_t intBits, int32_t fracBits)
+{
+    return signal(SFix(intBits, fracBits));
+}
+
+
+SignalId Simulator::signal(const SFix &init)
+{
+    Signal s;
+    s.current = init;
+    s.next    = init;
+    s.written = false;
+    m_signals.push_back(std::move(s));
+    return static_cast<SignalId>(m_signals.size() - 1);
+}
+
+
+void Simulator::write(SignalId s, const SFix &v)
+{
+    checkSignal(s);
+    Signal &sig = m_signals[s];
+    sig.next.copyValueFrom(v);
+    if (!sig.written)
+    {
+        sig.written = true;
+        m_written.push_back(s);
+    }
+}
+
+
+SFix& Simulator::modify(SignalId s)
+{
+    checkSignal(s);
+    Signal &sig = m_signals[s];
+    if (!sig.written)
+    {
+        sig.next.copyValueFrom(sig.current);
+        sig.written = true;
+        m_written.push_back(s);
+    }
+    return sig.next;
+}
+
+
+void Simulator::process(const std::function<void()> &fn, const std::vector<SignalId> &sensitivity)
+{
+    const uint32_t id = static_cast<uint32_t>(m_processes.size());
+    for(auto s : sensitivity)
+    {
+        checkSignal(s);
+    }
+    for(auto s : sensitivity)
+    {
+        m_signals[s].fanout.push_back(id);
+    }
+    Process p;
+    p.fn = fn;
+    p.queued = false;
+    m_processes.push_back(std::move(p));
+    m_initialized = false;
+}
+
+
+void Simulator::clocked(const std::function<void()> &fn)
+{
+    m_clocked.push_back(fn);
+}
+
+
+void Simulator::addRegister(SignalId d, SignalId q)
+{
+    checkSignal(d);
+    checkSignal(q);
+    const SFix &vd = m_signals[d].current;
+    const SFix &vq = m_signals[q].current;
+    if ((vd.intBits() != vq.intBits()) || (vd.fracBits() != vq.fracBits()))
+    {
+        throw std::runtime_error("Simulator: the signals of a register must have the same format!");
+    }
+    m_registers.push_back(std::make_pair(d, q));
+}
+
+
+void Simulator::update()
+{
+    for(auto s : m_written)
+    {
+        Signal &sig = m_signals[s];
+        sig.written = false;
+        if (sig.next == sig.current)
+        {
+            continue;
+        }
+        std::swap(sig.current, sig.next);
+        for(auto p : sig.fanout)
+        {
+            if (!m_processes[p].queued)
+            {
+                m_processes[p].queued = true;
+                m_queue.push_back(p);
+            }
+        }
+    }
+    m_written.clear();
+}
+
+
+void Simulator::settle()
+{
+    if (!m_initialized)
+    {
+        // like an HDL simulator, every process runs once
+        // at the start, so outputs match the inputs.
+        for(uint32_t p=0; p<m_processes.size(); p++)
+        {
+            if (!m_processes[p].queued)
+            {
+                m_processes[p].queued = true;
+                m_queue.push_back(p);
+            }
+        }
+        m_initialized = true;
+    }
+
+    update();
+    uint32_t deltas = 0;
+    while(!m_queue.empty())
+    {
+        if (++deltas > m_maxDeltas)
+        {
+            throw std::runtime_error("Simulator: the combinational logic does not settle!");
+        }
+
+        m_running.swap(m_queue);
+        for(auto p : m_running)
+        {
+            m_processes[p].queued = false;
+            m_processes[p].fn();
+        }
+        m_running.clear();
+        update();
+    }
+}
+
+
+void Simulator::step()
+{
+    settle();
+
+    // clock edge: everything reads the values
+    // from before the edge.
+    for(auto &r : m_registers)
+    {
+        write(r.second, m_signals[r.first].current);
+    }
+    for(auto &fn : m_clocked)
+    {
+        fn();
+    }
+
+    settle();
+    m_cycle++;
+}
+
+
+void Simulator::run(uint64_t cycles)
+{
+    for(uint64_t i=0; i<cycles; i++)
+    {
+        step();
+    }
+}
@@ -0,0 +1,176 @@
+/*
+
+    FPLIB: a library providing a fixed-point datatype.
+
+    Cycle-based simulation kernel for RTL-equivalent models.
+
+    A Simulator holds signals and processes. Every signal
+    carries an SFix of a fixed format and has two values:
+    the current value, which processes read, and the next
+    value, which processes write. Writes become visible in
+    the update phase, so processes can run in any order.
+
+    There are three kinds of processes:
+
+      * combinational processes run when one of the signals
+        in their sensitivity list changed value.
+      * clocked processes run once per clock cycle.
+      * registers copy a signal to another signal once per
+        clock cycle, without a callback.
+
+    step() simulates one clock cycle:
+
+        1. writes made since the last step are applied and
+           the combinational logic settles.
+        2. the clock edge: registers and clocked processes
+           read the current values and write next values.
+        3. the writes are applied and the combinational
+           logic settles.
+
+    Settling repeats update and evaluation (delta cycles)
+    until no signal changes. A signal that is written with
+    its current value does not trigger anything, so only
+    processes whose inputs changed are evaluated. All
+    combinational processes run once in the first step.
+
+    Example: a two-stage pipeline computing (a*b) + c
+        Simulator sim;
+        SignalId a = sim.signal(1, 15), b = sim.signal(1, 15);
+        SignalId c = sim.signal(2, 30);
+        SignalId p = sim.signal(1, 30), pq = sim.signal(1, 30);
+        SignalId cq = sim.signal(2, 30), y = sim.signal(3, 30);
+        sim.process([&] { sim.modify(p).assignTruncatedProduct(sim.read(a), sim.read(b)); }, {a, b});
+        sim.addRegister(p, pq);
+        sim.addRegister(c, cq);
+        sim.clocked([&] { sim.write(y, sim.read(pq) + sim.read(cq)); });
+
+    Running the kernel does not allocate; processes that
+    want the same should use the in-place SFix operations
+    on modify().
+
+    N.A. Moseley 2017
+    License: T.B.D.
+
+*/
+
+#ifndef fpsim_h
+#define fpsim_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+#include <functional>
+#include <stdexcept>
+#include "fplib.h"
+
+namespace fplib
+{
+
+typedef uint32_t SignalId;
+
+class Simulator
+{
+public:
+    Simulator();
+
+    /** add a Q(intBits, fracBits) signal set to zero */
+    SignalId signal(int32_t intBits, int32_t fracBits);
+
+    /** add a signal with the format and value of 'init' */
+    SignalId signal(const SFix &init);
+
+    /** return the current value of a signal */
+    const SFix& read(SignalId s) const
+    {
+        checkSignal(s);
+        return m_signals[s].current;
+    }
+
+    /** set the next value of a signal. the format must
+        match, otherwise a runtime_error is thrown. */
+    void write(SignalId s, const SFix &v);
+
+    /** return the next value of a signal for in-place
+        operations. on the first call in a delta cycle it is
+        set to the current value. */
+    SFix& modify(SignalId s);
+
+    /** add a process that runs when one of the signals
+        in 'sensitivity' changes */
+    void process(const std::function<void()> &fn, const std::vector<SignalId> &sensitivity);
+
+    /** add a process that runs at every clock edge */
+    void clocked(const std::function<void()> &fn);
+
+    /** add a register: q takes the value of d at every
+        clock edge. the formats must match, otherwise a
+        runtime_error is thrown. */
+    void addRegister(SignalId d, SignalId q);
+
+    /** simulate one clock cycle. throws a runtime_error
+        when the combinational logic does not settle within
+        the maximum number of delta cycles. */
+    void step();
+
+    /** simulate 'cycles' clock cycles */
+    void run(uint64_t cycles);
+
+    /** return the number of simulated clock cycles */
+    uint64_t cycle() const
+    {
+        return m_cycle;
+    }
+
+    /** set the maximum number of delta cycles per settle.
+        the default is 1000. */
+    void setMaxDeltaCycles(uint32_t deltas)
+    {
+        m_maxDeltas = deltas;
+    }
+
+protected:
+    struct Signal
+    {
+        SFix    current;
+        SFix    next;
+        bool    written;                ///< next is pending
+        std::vector<uint32_t> fanout;   ///< sensitive processes
+    };
+
+    struct Process
+    {
+        std::function<void()> fn;
+        bool    queued;
+    };
+
+    /** throw a runtime_error for a signal id that does not exist */
+    void checkSignal(SignalId s) const
+    {
+        if (s >= m_signals.size())
+        {
+            throw std::runtime_error("Simulator: the signal does not exist!");
+        }
+    }
+
+    /** apply the pending writes and queue the processes
+        sensitive to the signals that changed */
+    void update();
+
+    /** repeat update and evaluation until no signal changes */
+    void settle();
+
+    std::vector<Signal>     m_signals;
+    std::vector<Process>    m_processes;
+    std::vector<std::function<void()> > m_clocked;
+    std::vector<std::pair<SignalId, SignalId> > m_registers;
+    std::vector<SignalId>   m_written;      ///< signals with a pending write
+    std::vector<uint32_t>   m_queue;        ///< processes to run in the next delta cycle
+    std::vector<uint32_t>   m_running;
+    uint64_t                m_cycle;
+    uint32_t                m_maxDeltas;
+    bool                    m_initialized;  ///< all processes ran once
+};
+
+} // end namespace
+
+#endif
@@ -0,0 +1,344 @@
+/*
+
+    FPLIB: a library providing a fixed-point datatype.
+
+    Work-stealing thread pool, parallel batch evaluation and
+    the settings of the multi-threaded multiplication.
+
+    N.A. Moseley 2017
+    License: T.B.D.
+
+*/
+
+#include <atomic>
+#include <algorithm>
+#include <exception>
+#include "fpthreads.h"
+
+using namespace fplib;
+
+namespace
+{
+
+/** the indices [lo, hi) a thread has not started yet */
+struct alignas(64) StealRange
+{
+    std::mutex  mutex;
+    size_t      lo;
+    size_t      hi;
+};
+
+uint32_t hardwareThreads(uint32_t threads)
+{
+    if (threads == 0)
+    {
+        threads = std::max(1U, std::thread::hardware_concurrency());
+    }
+    return threads;
+}
+
+struct MultiplySettings
+{
+    MultiplySettings() : threads(1), threshold(1024) {}
+
+    std::mutex                  mutex;
+    uint32_t                    threads;
+    std::atomic<uint32_t>       threshold;
+    std::shared_ptr<ThreadPool> pool;
+};
+
+MultiplySettings& multiplySettings()
+{
+    // intentionally leaked, like the constants cache.
+    static MultiplySettings *s = new MultiplySettings();
+    return *s;
+}
+
+} // end anonymous namespace
+
+
+struct ThreadPool::Job
+{
+    Job(size_t n, size_t g, uint32_t threads, const std::function<void(size_t, size_t)> &f)
+        : fn(f), grain(g), ranges(threads), unclaimed(n), remaining(n), nextSlot(0)
+    {
+        // split the indices evenly over the threads
+        for(uint32_t t=0; t<threads; t++)
+        {
+            ranges[t].lo = n*t/threads;
+            ranges[t].hi = n*(t+1)/threads;
+        }
+    }
+
+    const std::function<void(size_t, size_t)> &fn;
+    const size_t        grain;
+    std::vector<StealRange> ranges;     ///< one range per thread
+    std::atomic<size_t> unclaimed;      ///< indices not taken by a thread
+    std::atomic<size_t> remaining;      ///< indices not finished
+    std::atomic<uint32_t> nextSlot;     ///< range of the next thread that joins
+    std::mutex          mutex;
+    std::condition_variable finished;
+    std::exception_ptr  error;          ///< first exception thrown by fn
+};
+
+
+
+ThreadPool::ThreadPool(uint32_t threads)
+    : m_stop(false)
+{
+    threads = hardwareThreads(threads);
+    for(uint32_t i=1; i<threads; i++)
+    {
+        m_workers.push_back(std::thread(&ThreadPool::workerLoop, this));
+    }
+}
+
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_wakeup.notify_all();
+    for(auto &t : m_workers)
+    {
+        t.join();
+    }
+}
+
+
+void ThreadPool::work(Job &job)
+{
+    // threads that join after every range has an owner
+    // have no range of their own; they steal one chunk
+    // at a time.
+    const uint32_t N = job.ranges.size();
+    const uint32_t slot = job.nextSlot.fetch_add(1);
+    StealRange *own = (slot < N) ? &job.ranges[slot] : nullptr;
+    while(true)
+    {
+        // take a chunk from the front of the own range
+        size_t begin = 0;
+        size_t end = 0;
+        if (own != nullptr)
+        {
+            std::lock_guard<std::mutex> lock(own->mutex);
+            if (own->lo < own->hi)
+            {
+                begin   = own->lo;
+                end     = std::min(own->hi, own->lo + job.grain);
+                own->lo = end;
+            }
+        }
+
+        if (begin == end)
+        {
+            // steal the upper half of another range
+            bool stolen = false;
+            for(uint32_t k=1; (k<=N) && !stolen; k++)
+            {
+                StealRange &victim = job.ranges[(slot+k) % N];
+                if (&victim == own)
+                {
+                    continue;
+                }
+                std::lock_guard<std::mutex> lock(victim.mutex);
+                if (victim.lo >= victim.hi)
+                {
+                    continue;
+                }
+                begin = victim.lo;
+                end   = victim.hi;
+                if (own == nullptr)
+                {
+                    begin = (end - begin > job.grain) ? end - job.grain : begin;
+                }
+                else if ((end - begin) > job.grain)
+                {
+                    begin = begin + (end - begin)/2;
+                }
+                victim.hi = begin;
+                stolen = true;
+            }
+            if (!stolen)
+            {
+                return;
+            }
+
+            if (own != nullptr)
+            {
+                std::lock_guard<std::mutex> lock(own->mutex);
+                own->lo = begin;
+                own->hi = end;
+                continue;
+            }
+        }
+
+        job.unclaimed -= (end - begin);
+        try
+        {
+            job.fn(begin, end);
+        }
+        catch(...)
+        {
+            std::lock_guard<std::mutex> lock(job.mutex);
+            if (!job.error)
+            {
+                job.error = std::current_exception();
+            }
+        }
+
+        if (job.remaining.fetch_sub(end - begin) == (end - begin))
+        {
+            std::lock_guard<std::mutex> lock(job.mutex);
+            job.finished.notify_all();
+        }
+    }
+}
+
+
+void ThreadPool::workerLoop()
+{
+    // every worker recycles SFix storage through its own
+    // free lists, so workers do not contend for the heap.
+    setAllocatorPolicy(AllocatorPolicy::Pool);
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while(true)
+    {
+        m_wakeup.wait(lock, [this] { return m_stop || !m_jobs.empty(); });
+        if (m_stop)
+        {
+            return;
+        }
+
+        // jobs without work left are removed by the
+        // first thread that finds them.
+        std::shared_ptr<Job> job = m_jobs.front();
+        if (job->unclaimed == 0)
+        {
+            m_jobs.pop_front();
+            continue;
+        }
+
+        lock.unlock();
+        work(*job);
+        lock.lock();
+    }
+}
+
+
+void ThreadPool::parallelFor(size_t count, size_t grain, const std::function<void(size_t, size_t)> &fn)
+{
+    if (grain == 0)
+    {
+        grain = std::max(static_cast<size_t>(1), count / (8*threads()));
+    }
+
+    if ((count <= grain) || m_workers.empty())
+    {
+        for(size_t begin=0; begin<count; begin+=grain)
+        {
+            fn(begin, std::min(count, begin+grain));
+        }
+        return;
+    }
+
+    std::shared_ptr<Job> job = std::make_shared<Job>(count, grain, threads(), fn);
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_jobs.push_back(job);
+    }
+    m_wakeup.notify_all();
+
+    work(*job);
+    {
+        std::unique_lock<std::mutex> lock(job->mutex);
+        job->finished.wait(lock, [&job] { return job->remaining == 0; });
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto iter = std::find(m_jobs.begin(), m_jobs.end(), job);
+        if (iter != m_jobs.end())
+        {
+            m_jobs.erase(iter);
+        }
+    }
+
+    if (job->error)
+    {
+        std::rethrow_exception(job->error);
+    }
+}
+
+
+void ThreadPool::run(size_t count, const std::function<void(size_t)> &fn)
+{
+    parallelFor(count, 1, [&fn](size_t begin, size_t end)
+    {
+        for(size_t i=begin; i<end; i++)
+        {
+            fn(i);
+        }
+    });
+}
+
+
+ThreadPool& fplib::defaultThreadPool()
+{
+    // intentionally leaked, like the constants cache.
+    static ThreadPool *p = new ThreadPool(0);
+    return *p;
+}
+
+
+void fplib::setMultiplyThreads(uint32_t threads)
+{
+    MultiplySettings &s = multiplySettings();
+    std::lock_guard<std::mutex> lock(s.mutex);
+    threads = hardwareThreads(threads);
+    if (threads != s.threads)
+    {
+        // multiplications in progress keep the old pool alive.
+        s.threads = threads;
+        s.pool.reset();
+    }
+}
+
+
+uint32_t fplib::getMultiplyThreads()
+{
+    MultiplySettings &s = multiplySettings();
+    std::lock_guard<std::mutex> lock(s.mutex);
+    return s.threads;
+}
+
+
+void fplib::setParallelMultiplyThreshold(uint32_t words)
+{
+    multiplySettings().threshold = std::max(1U, words);
+}
+
+
+uint32_t fplib::getParallelMultiplyThreshold()
+{
+    return multiplySettings().threshold;
+}
+
+
+std::shared_ptr<ThreadPool> fplib::detail::multiplyPool()
+{
+    MultiplySettings &s = multiplySettings();
+    std::lock_guard<std::mutex> lock(s.mutex);
+    if (s.threads <= 1)
+    {
+        return std::shared_ptr<ThreadPool>();
+    }
+    if (!s.pool)
+    {
+        s.pool = std::make_shared<ThreadPool>(s.threads);
+    }
+    return s.pool;
+}
@@ -0,0 +1,208 @@
+/*
+
+    FPLIB: a library providing a fixed-point datatype.
+
+    Work-stealing thread pool, parallel batch evaluation and
+    the settings of the multi-threaded multiplication.
+
+    ThreadPool::parallelFor splits a range of indices evenly
+    over the threads of the pool. Every thread takes chunks
+    of 'grain' indices from the front of its own range; a
+    thread that runs out steals the upper half of the range
+    of another thread. The calling thread takes part, so a
+    pool can be used from one of its own jobs without
+    deadlocking: the caller finishes the job when all
+    workers are busy.
+
+    parallel_for and transform run on a shared pool with one
+    thread per hardware thread:
+
+        parallel_for(n, [&](size_t i) { y[i] = model(x[i]); });
+        transform(x, y, n, [](const SFix &v) { return v*v; });
+
+    transform evaluates every chunk of indices inside an
+    ArenaScope of the executing thread, so the temporaries
+    of the function are bump-allocated per thread and
+    released in bulk; the threads do not contend for the
+    heap. The results are stored with copyValueFrom, so the
+    outputs must be created with the format of the results.
+    The worker threads use the Pool allocation policy.
+
+    SFix multiplications where both operands have at least
+    the threshold number of words are split into blocks of
+    partial-product rows, which are calculated on a pool of
+    their own. The blocks are summed afterwards, so the
+    result does not depend on the number of threads.
+
+        setMultiplyThreads(8);
+        setParallelMultiplyThreshold(1024);    // 32k bits
+
+    N.A. Moseley 2017
+    License: T.B.D.
+
+*/
+
+#ifndef fpthreads_h
+#define fpthreads_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <vector>
+#include <thread>
+#include <functional>
+#include "fplib.h"
+#include "fpalloc.h"
+
+namespace fplib
+{
+
+class ThreadPool
+{
+public:
+    /** create a pool with 'threads' threads, including the
+        calling thread, so threads-1 workers are started.
+        0 selects the number of hardware threads. */
+    explicit ThreadPool(uint32_t threads = 0);
+
+    ~ThreadPool();
+
+    /** return the number of threads, including the caller */
+    uint32_t threads() const
+    {
+        return static_cast<uint32_t>(m_workers.size()) + 1;
+    }
+
+    /** call fn(begin, end) for chunks of at most 'grain'
+        indices that together cover [0, count), and wait until
+        all calls are done. a grain of 0 selects about eight
+        chunks per thread. the first exception thrown by fn is
+        re-thrown once all calls have finished. */
+    void parallelFor(size_t count, size_t grain, const std::function<void(size_t, size_t)> &fn);
+
+    /** call fn(i) for i = 0 .. count-1, one index per chunk,
+        and wait until all calls are done. */
+    void run(size_t count, const std::function<void(size_t)> &fn);
+
+protected:
+    struct Job;
+
+    /** execute chunks of a job until no thread has work left */
+    static void work(Job &job);
+
+    void workerLoop();
+
+    std::vector<std::thread>        m_workers;
+    std::mutex                      m_mutex;
+    std::condition_variable         m_wakeup;
+    std::deque<std::shared_ptr<Job> > m_jobs;
+    bool                            m_stop;
+};
+
+/** return the pool of parallel_for and transform, which has
+    one thread per hardware thread. */
+ThreadPool& defaultThreadPool();
+
+/** call fn(i) for i = 0 .. count-1 on a pool */
+template <class F> void parallel_for(ThreadPool &pool, size_t count, F fn, size_t grain = 0)
+{
+    pool.parallelFor(count, grain, [&fn](size_t begin, size_t end)
+    {
+        for(size_t i=begin; i<end; i++)
+        {
+            fn(i);
+        }
+    });
+}
+
+/** call fn(i) for i = 0 .. count-1 on the default pool */
+template <class F> void parallel_for(size_t count, F fn, size_t grain = 0)
+{
+    parallel_for(defaultThreadPool(), count, fn, grain);
+}
+
+namespace detail
+{
+    inline void assignResult(SFix &dst, const SFix &v)
+    {
+        dst.copyValueFrom(v);
+    }
+
+    template <class U, class V> void assignResult(U &dst, const V &v)
+    {
+        dst = v;
+    }
+}
+
+/** out[i] = fn(in[i]) for i = 0 .. count-1 on a pool.
+    'in' and 'out' can be SFix or sample arrays. */
+template <class T, class U, class F> void transform(ThreadPool &pool, const T *in, U *out,
+                                                    size_t count, F fn, size_t grain = 0)
+{
+    pool.parallelFor(count, grain, [&](size_t begin, size_t end)
+    {
+        ArenaScope scratch;
+        for(size_t i=begin; i<end; i++)
+        {
+            detail::assignResult(out[i], fn(in[i]));
+        }
+    });
+}
+
+/** out[i] = fn(a[i], b[i]) for i = 0 .. count-1 on a pool */
+template <class T1, class T2, class U, class F> void transform(ThreadPool &pool, const T1 *a, const T2 *b,
+                                                              U *out, size_t count, F fn, size_t grain = 0)
+{
+    pool.parallelFor(count, grain, [&](size_t begin, size_t end)
+    {
+        ArenaScope scratch;
+        for(size_t i=begin; i<end; i++)
+        {
+            detail::assignResult(out[i], fn(a[i], b[i]));
+        }
+    });
+}
+
+/** out[i] = fn(in[i]) for i = 0 .. count-1 on the default pool */
+template <class T, class U, class F> void transform(const T *in, U *out, size_t count,
+                                                    F fn, size_t grain = 0)
+{
+    transform(defaultThreadPool(), in, out, count, fn, grain);
+}
+
+/** out[i] = fn(a[i], b[i]) for i = 0 .. count-1 on the default pool */
+template <class T1, class T2, class U, class F> void transform(const T1 *a, const T2 *b, U *out,
+                                                              size_t count, F fn, size_t grain = 0)
+{
+    transform(defaultThreadPool(), a, b, out, count, fn, grain);
+}
+
+/** set the number of threads used by large multiplications.
+    0 selects the number of hardware threads, 1 disables
+    multi-threading. the default is 1. */
+void setMultiplyThreads(uint32_t threads);
+
+/** return the number of threads used by large multiplications */
+uint32_t getMultiplyThreads();
+
+/** set the minimum number of 32-bit words both operands
+    must have for a multi-threaded multiplication. */
+void setParallelMultiplyThreshold(uint32_t words);
+
+/** return the minimum number of words of a multi-threaded
+    multiplication */
+uint32_t getParallelMultiplyThreshold();
+
+namespace detail
+{
+    /** return the pool of the multi-threaded multiplication,
+        or nullptr when multiplications are single-threaded */
+    std::shared_ptr<ThreadPool> multiplyPool();
+}
+
+} // end namespace
+
+#endif
@@ -0,0 +1,422 @@
+/*
+
+    FPLIB: a library providing a fixed-point datatype.
+
+    Trace writers for comparing SFix signals with HDL
+    simulators.
+
+    N.A. Moseley 2017
+    License: T.B.D.
+
+*/
+
+#include <string.h>
+#include <algorithm>
+#include <stdexcept>
+#include "fptrace.h"
+
+using namespace fplib;
+
+namespace
+{
+
+const char c_nibbleBits[16][4] =
+{
+    {'0','0','0','0'}, {'0','0','0','1'}, {'0','0','1','0'}, {'0','0','1','1'},
+    {'0','1','0','0'}, {'0','1','0','1'}, {'0','1','1','0'}, {'0','1','1','1'},
+    {'1','0','0','0'}, {'1','0','0','1'}, {'1','0','1','0'}, {'1','0','1','1'},
+    {'1','1','0','0'}, {'1','1','0','1'}, {'1','1','1','0'}, {'1','1','1','1'}
+};
+
+const char c_hexDigits[] = "0123456789abcdef";
+
+/** write the 'width' LSBs of v, MSB first, and return
+    the end of the written characters. */
+char* putBits(char *p, const SFix &v, uint32_t width)
+{
+    const uint32_t N = (width + 31) / 32;
+    for(uint32_t w=N; w>0; w--)
+    {
+        const uint32_t word = v.getInternalValue(w-1);
+        uint32_t b = (w == N) ? width - 32*(N-1) : 32;
+        while((b % 4) != 0)
+        {
+            b--;
+            *p++ = '0' + ((word >> b) & 1);
+        }
+        while(b > 0)
+        {
+            b -= 4;
+            memcpy(p, c_nibbleBits[(word >> b) & 15], 4);
+            p += 4;
+        }
+    }
+    return p;
+}
+
+/** write the 'width' LSBs of v as (width+3)/4 hex digits
+    and return the end of the written characters. */
+char* putHex(char *p, const SFix &v, uint32_t width)
+{
+    const uint32_t D = (width + 3) / 4;
+    for(uint32_t k=D; k>0; k--)
+    {
+        uint32_t nibble = (v.getInternalValue((k-1) / 8) >> (4*((k-1) % 8))) & 15;
+        if ((k == D) && ((width % 4) != 0))
+        {
+            nibble &= (1u << (width % 4)) - 1;
+        }
+        *p++ = c_hexDigits[nibble];
+    }
+    return p;
+}
+
+/** return the VCD identifier code of signal 'idx' */
+std::string vcdIdentifier(uint32_t idx)
+{
+    // printable characters '!' to '~'
+    std::string id;
+    do
+    {
+        id += static_cast<char>('!' + (idx % 94));
+        idx /= 94;
+    } while(idx > 0);
+    return id;
+}
+
+} // end anonymous namespace
+
+
+BufferedWriter::BufferedWriter(const std::string &filename, size_t bufferSize, bool background)
+    : m_file(nullptr),
+      m_buffer(std::max(bufferSize, static_cast<size_t>(1))),
+      m_used(0),
+      m_pendingUsed(0),
+      m_busy(false),
+      m_stop(false),
+      m_error(false),
+      m_background(background)
+{
+    m_file = fopen(filename.c_str(), "wb");
+    if (m_file == nullptr)
+    {
+        throw std::runtime_error("BufferedWriter: cannot create " + filename);
+    }
+    if (m_background)
+    {
+        m_pending.resize(m_buffer.size());
+        m_thread = std::thread(&BufferedWriter::writerLoop, this);
+    }
+}
+
+
+BufferedWriter::~BufferedWriter()
+{
+    try
+    {
+        close();
+    }
+    catch(...)
+    {
+    }
+}
+
+
+void BufferedWriter::write(const char *data, size_t bytes)
+{
+    while(bytes > 0)
+    {
+        if (m_used == m_buffer.size())
+        {
+            swapBuffers();
+        }
+        const size_t n = std::min(bytes, m_buffer.size() - m_used);
+        memcpy(&m_buffer[m_used], data, n);
+        m_used += n;
+        data  += n;
+        bytes -= n;
+    }
+}
+
+
+void BufferedWriter::makeRoom(size_t bytes)
+{
+    swapBuffers();
+    if (bytes > m_buffer.size())
+    {
+        m_buffer.resize(bytes);
+    }
+}
+
+
+void BufferedWriter::writeFile(const char *data, size_t bytes)
+{
+    if ((bytes > 0) && (fwrite(data, 1, bytes, m_file) != bytes))
+    {
+        m_error = true;
+    }
+}
+
+
+void BufferedWriter::swapBuffers()
+{
+    if (m_used == 0)
+    {
+        return;
+    }
+    if (!m_background)
+    {
+        writeFile(&m_buffer[0], m_used);
+        m_used = 0;
+        return;
+    }
+
+    // wait for the writer thread to finish the
+    // previous buffer, then hand over this one.
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_done.wait(lock, [this] { return !m_busy; });
+        std::swap(m_buffer, m_pending);
+        m_pendingUsed = m_used;
+        m_busy = true;
+    }
+    m_wakeup.notify_one();
+    m_used = 0;
+    if (m_buffer.size() < m_pending.size())
+    {
+        m_buffer.resize(m_pending.size());
+    }
+}
+
+
+void BufferedWriter::writerLoop()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while(true)
+    {
+        m_wakeup.wait(lock, [this] { return m_stop || m_busy; });
+        if (m_busy)
+        {
+            lock.unlock();
+            writeFile(&m_pending[0], m_pendingUsed);
+            lock.lock();
+            m_busy = false;
+            m_done.notify_all();
+            continue;
+        }
+        return;
+    }
+}
+
+
+void BufferedWriter::flush()
+{
+    if (m_file == nullptr)
+    {
+        return;
+    }
+    swapBuffers();
+    if (m_background)
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_done.wait(lock, [this] { return !m_busy; });
+    }
+    if (fflush(m_file) != 0)
+    {
+        m_error = true;
+    }
+}
+
+
+void BufferedWriter::close()
+{
+    if (m_file == nullptr)
+    {
+        return;
+    }
+    flush();
+    if (m_background)
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stop = true;
+        }
+        m_wakeup.notify_one();
+        m_thread.join();
+    }
+    if (fclose(m_file) != 0)
+    {
+        m_error = true;
+    }
+    m_file = nullptr;
+    if (m_error)
+    {
+        throw std::runtime_error("BufferedWriter: writing the file failed!");
+    }
+}
+
+
+VcdWriter::VcdWriter(const std::string &filename, const std::string &timescale, bool background)
+    : m_out(filename, 4 << 20, background),
+      m_timescale(timescale),
+      m_time(0),
+      m_started(false),
+      m_timeWritten(false)
+{
+}
+
+
+uint32_t VcdWriter::addSignal(const std::string &name, int32_t intBits, int32_t fracBits)
+{
+    if (m_started)
+    {
+        throw std::runtime_error("VcdWriter: signals must be added before the first time step!");
+    }
+    Signal s;
+    s.name      = name;
+    s.id        = vcdIdentifier(m_signals.size());
+    s.intBits   = intBits;
+    s.fracBits  = fracBits;
+    s.last.resize(SFix(intBits, fracBits).getNumberOfWords());
+    s.written   = false;
+    m_signals.push_back(s);
+    return static_cast<uint32_t>(m_signals.size() - 1);
+}
+
+
+void VcdWriter::writeHeader()
+{
+    std::string h = "$timescale " + m_timescale + " $end\n";
+    h += "$scope module fplib $end\n";
+    for(auto &s : m_signals)
+    {
+        h += "$var wire " + std::to_string(s.intBits + s.fracBits) + " " + s.id + " " + s.name + " $end\n";
+    }
+    h += "$upscope $end\n";
+    h += "$enddefinitions $end\n";
+    m_out.write(h);
+    m_started = true;
+}
+
+
+void VcdWriter::setTime(uint64_t t)
+{
+    if (!m_started)
+    {
+        writeHeader();
+    }
+    else if (t < m_time)
+    {
+        throw std::runtime_error("VcdWriter: the time must not decrease!");
+    }
+    if (t != m_time)
+    {
+        m_timeWritten = false;
+    }
+    m_time = t;
+}
+
+
+void VcdWriter::change(uint32_t signal, const SFix &v)
+{
+    if (signal >= m_signals.size())
+    {
+        throw std::runtime_error("VcdWriter: the signal does not exist!");
+    }
+    Signal &s = m_signals[signal];
+    if ((v.intBits() != s.intBits) || (v.fracBits() != s.fracBits))
+    {
+        throw std::runtime_error("VcdWriter: the format of the value does not match the signal!");
+    }
+    if (!m_started)
+    {
+        writeHeader();
+    }
+
+    const uint32_t N = s.last.size();
+    bool same = s.written;
+    for(uint32_t i=0; i<N; i++)
+    {
+        const uint32_t w = v.getInternalValue(i);
+        same = same && (s.last[i] == w);
+        s.last[i] = w;
+    }
+    if (same)
+    {
+        return;
+    }
+    s.written = true;
+
+    if (!m_timeWritten)
+    {
+        char *p = m_out.reserve(24);
+        const int n = sprintf(p, "#%llu\n", static_cast<unsigned long long>(m_time));
+        m_out.commit(n);
+        m_timeWritten = true;
+    }
+
+    const uint32_t width = s.intBits + s.fracBits;
+    char *start = m_out.reserve(width + s.id.size() + 3);
+    char *p = start;
+    if (width == 1)
+    {
+        *p++ = '0' + (v.getInternalValue(0) & 1);
+    }
+    else
+    {
+        *p++ = 'b';
+        p = putBits(p, v, width);
+        *p++ = ' ';
+    }
+    memcpy(p, s.id.data(), s.id.size());
+    p += s.id.size();
+    *p++ = '\n';
+    m_out.commit(p - start);
+}
+
+
+void VcdWriter::close()
+{
+    if (!m_started)
+    {
+        writeHeader();
+    }
+    m_out.close();
+}
+
+
+HexWriter::HexWriter(const std::string &filename, int32_t intBits, int32_t fracBits, bool background)
+    : m_out(filename, 4 << 20, background),
+      m_intBits(intBits),
+      m_fracBits(fracBits)
+{
+}
+
+
+void HexWriter::write(const SFix &v)
+{
+    if ((v.intBits() != m_intBits) || (v.fracBits() != m_fracBits))
+    {
+        throw std::runtime_error("HexWriter: the format of the value does not match!");
+    }
+    const uint32_t width = m_intBits + m_fracBits;
+    char *start = m_out.reserve((width + 3)/4 + 1);
+    char *p = putHex(start, v, width);
+    *p++ = '\n';
+    m_out.commit(p - start);
+}
+
+
+void HexWriter::write(const SFix *v, size_t count)
+{
+    for(size_t i=0; i<count; i++)
+    {
+        write(v[i]);
+    }
+}
+
+
+void HexWriter::close()
+{
+    m_out.close();
+}
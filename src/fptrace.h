@@ -0,0 +1,205 @@
+/*
+
+    FPLIB: a library providing a fixed-point datatype.
+
+    Trace writers for comparing SFix signals with HDL
+    simulators.
+
+    VcdWriter writes a value change dump: signals are
+    declared first, then the values of every time step are
+    reported and only values that differ from the previous
+    ones are written. HexWriter writes one value per line in
+    the format of $readmemh, using just enough hex digits
+    for the width of the value; negative values are written
+    in two's complement of that width.
+
+    Both format the 32-bit words of an SFix directly with
+    lookup tables, without toBinString or toHexString, and
+    write through a BufferedWriter. With 'background' set,
+    a full buffer is handed to a writer thread and filling
+    continues in a second buffer, so formatting and file
+    I/O overlap.
+
+    Example:
+        VcdWriter vcd("trace.vcd", "1ns");
+        uint32_t x = vcd.addSignal("x", 1, 15);
+        for(uint64_t t=0; t<N; t++)
+        {
+            vcd.setTime(t);
+            vcd.change(x, xs[t]);
+        }
+
+    N.A. Moseley 2017
+    License: T.B.D.
+
+*/
+
+#ifndef fptrace_h
+#define fptrace_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include "fplib.h"
+
+namespace fplib
+{
+
+/** buffered file writer with an optional writer thread */
+class BufferedWriter
+{
+public:
+    /** open 'filename' for writing. throws a runtime_error
+        when the file cannot be created. */
+    BufferedWriter(const std::string &filename, size_t bufferSize = 4 << 20, bool background = false);
+
+    /** flush and close the file; errors are ignored, call
+        close() to see them. */
+    ~BufferedWriter();
+
+    /** return a pointer to at least 'bytes' free bytes in the
+        buffer. the buffer grows when it is too small. */
+    char* reserve(size_t bytes)
+    {
+        if (m_used + bytes > m_buffer.size())
+        {
+            makeRoom(bytes);
+        }
+        return &m_buffer[m_used];
+    }
+
+    /** mark 'bytes' of the reserved space as written */
+    void commit(size_t bytes)
+    {
+        m_used += bytes;
+    }
+
+    /** append 'bytes' bytes */
+    void write(const char *data, size_t bytes);
+
+    /** append a string */
+    void write(const std::string &s)
+    {
+        write(s.data(), s.size());
+    }
+
+    /** return the size of the buffer */
+    size_t bufferSize() const
+    {
+        return m_buffer.size();
+    }
+
+    /** write all buffered data to the file */
+    void flush();
+
+    /** flush and close the file. throws a runtime_error
+        when a write failed. */
+    void close();
+
+protected:
+    /** swap buffers and grow the buffer to at least 'bytes' */
+    void makeRoom(size_t bytes);
+
+    /** hand the filled buffer to the file and continue
+        with an empty one */
+    void swapBuffers();
+
+    /** write a buffer to the file, remembering errors */
+    void writeFile(const char *data, size_t bytes);
+
+    void writerLoop();
+
+    FILE                *m_file;
+    std::vector<char>   m_buffer;       ///< buffer being filled
+    size_t              m_used;
+    std::vector<char>   m_pending;      ///< buffer of the writer thread
+    size_t              m_pendingUsed;
+    bool                m_busy;         ///< the writer thread has a pending buffer
+    bool                m_stop;
+    bool                m_error;
+    bool                m_background;
+    std::mutex          m_mutex;
+    std::condition_variable m_wakeup;
+    std::condition_variable m_done;
+    std::thread         m_thread;
+};
+
+
+/** value change dump writer */
+class VcdWriter
+{
+public:
+    /** create 'filename' with the given time unit, e.g. "1ns" */
+    VcdWriter(const std::string &filename, const std::string &timescale = "1ns",
+              bool background = false);
+
+    /** declare a Q(intBits, fracBits) signal. signals must be
+        declared before the first setTime. */
+    uint32_t addSignal(const std::string &name, int32_t intBits, int32_t fracBits);
+
+    /** start time step 't'. the time must not decrease. */
+    void setTime(uint64_t t);
+
+    /** report the value of a signal at the current time. it is
+        written only when it differs from the last value. the
+        format must match the declaration, otherwise a
+        runtime_error is thrown. */
+    void change(uint32_t signal, const SFix &v);
+
+    /** flush and close the file */
+    void close();
+
+protected:
+    struct Signal
+    {
+        std::string name;
+        std::string id;             ///< VCD identifier code
+        int32_t     intBits;
+        int32_t     fracBits;
+        std::vector<uint32_t> last; ///< last written words
+        bool        written;        ///< a value was written
+    };
+
+    void writeHeader();
+
+    BufferedWriter      m_out;
+    std::string         m_timescale;
+    std::vector<Signal> m_signals;
+    uint64_t            m_time;
+    bool                m_started;      ///< the header was written
+    bool                m_timeWritten;  ///< the current time stamp was written
+};
+
+
+/** $readmemh vector writer */
+class HexWriter
+{
+public:
+    /** create 'filename' for Q(intBits, fracBits) values */
+    HexWriter(const std::string &filename, int32_t intBits, int32_t fracBits,
+              bool background = false);
+
+    /** write one value. the format must match, otherwise a
+        runtime_error is thrown. */
+    void write(const SFix &v);
+
+    /** write 'count' values */
+    void write(const SFix *v, size_t count);
+
+    /** flush and close the file */
+    void close();
+
+protected:
+    BufferedWriter  m_out;
+    int32_t         m_intBits;
+    int32_t         m_fracBits;
+};
+
+} // end namespace
+
+#endif
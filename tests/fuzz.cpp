@@ -0,0 +1,917 @@
+/*
+
+    FPLIB: a library providing a fixed-point datatype.
+
+    Differential fuzzing of SFix against the SFixRef
+    reference model. Random formats and values are
+    generated on all cores, every SFix operation is
+    checked against the reference, and failing cases
+    are shrunk to a minimal reproducer.
+
+    With -r int128 the much faster SFixRef128 is used as
+    the reference; the formats are then limited so all
+    results fit in 126 bits.
+
+    With -x bits, every value (pair) of every operand width
+    up to 'bits' bits (max. 12) is checked against
+    SFixRef128 for every operation instead: all fractional
+    point alignments for add/sub, and all shift amounts up
+    to 40 bits for the extend/remove operations.
+
+    usage: fplib_fuzz [-n checks] [-t threads] [-s seed] [-w maxbits]
+                      [-r bits|int128] [-x bits]
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include "../src/fplib.h"
+#include "../src/fpreference.h"
+#include "../src/fpreference128.h"
+
+using namespace fplib;
+
+namespace fuzz
+{
+
+enum Operation
+{
+    OP_ADD = 0,
+    OP_SUB,
+    OP_MUL,
+    OP_NEGATE,
+    OP_EXTENDLSBS,
+    OP_EXTENDMSBS,
+    OP_REMOVELSBS,
+    OP_REMOVEMSBS,
+    OP_LAST
+};
+
+const char *c_opNames[OP_LAST] =
+{
+    "add", "sub", "mul", "negate",
+    "extendLSBs", "extendMSBs", "removeLSBs", "removeMSBs"
+};
+
+/** reference implementation used for random cases */
+enum Reference
+{
+    REF_BITS,       ///< SFixRef, bit-serial
+    REF_INT128      ///< SFixRef128, native 128-bit integers
+};
+
+/** selected reference, set before the workers start */
+Reference g_reference = REF_BITS;
+
+/** a single test case. values are kept as binary
+    strings so they can be loaded into both SFix
+    and SFixRef, and easily shrunk. */
+struct Case
+{
+    Operation   op;
+    int32_t     aInt, aFrac;
+    int32_t     bInt, bFrac;
+    std::string a;          ///< binary value of a, MSB first
+    std::string b;          ///< binary value of b, MSB first
+    uint32_t    param;      ///< number of bits for extend/remove
+};
+
+/** load an SFix from a binary string */
+SFix sfixFromBin(const std::string &bin, int32_t intBits, int32_t fracBits)
+{
+    SFix v(intBits, fracBits);
+    const uint32_t N = bin.size();
+    std::vector<uint32_t> words(v.getNumberOfWords(), 0);
+    for(uint32_t i=0; i<N; i++)
+    {
+        if (bin[N-1-i] == '1')
+        {
+            words[i/32] |= (1UL << (i%32));
+        }
+    }
+
+    // sign-extend the top-most word
+    if ((N > 0) && (bin[0] == '1'))
+    {
+        words.back() |= (0xFFFFFFFFUL << ((N-1)%32));
+    }
+
+    for(uint32_t i=0; i<words.size(); i++)
+    {
+        v.setInternalValue(i, words[i]);
+    }
+    return v;
+}
+
+/** check if a binary string holds the most negative value */
+bool isMostNegative(const std::string &bin)
+{
+    if (bin.empty() || (bin[0] != '1'))
+    {
+        return false;
+    }
+    return bin.find('1', 1) == std::string::npos;
+}
+
+/** check if the top 'bits' bits of a binary string are
+    all equal to its sign bit, i.e. can be removed
+    without changing the value. */
+bool hasRedundantSignBits(const std::string &bin, uint32_t bits)
+{
+    for(uint32_t i=1; i<=bits; i++)
+    {
+        if (bin[i] != bin[0])
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+/** return the number of bits of the result of a case */
+int32_t resultBits(const Case &c)
+{
+    const int32_t aBits = c.aInt + c.aFrac;
+    const int32_t bBits = c.bInt + c.bFrac;
+    switch(c.op)
+    {
+    case OP_ADD:
+    case OP_SUB:
+        return std::max(c.aInt, c.bInt) + 1 + std::max(c.aFrac, c.bFrac);
+    case OP_MUL:
+        return aBits + bBits - 1;
+    case OP_EXTENDLSBS:
+    case OP_EXTENDMSBS:
+        return aBits + static_cast<int32_t>(c.param);
+    default:
+        return aBits;
+    }
+}
+
+/** check whether a case is within the specification of
+    the operation. cases outside of it are skipped. */
+bool isValid(const Case &c)
+{
+    const int32_t aBits = c.aInt + c.aFrac;
+    const int32_t bBits = c.bInt + c.bFrac;
+    if ((aBits < 1) || (aBits != static_cast<int32_t>(c.a.size())))
+    {
+        return false;
+    }
+
+#ifdef FPLIB_HAVE_INT128
+    if ((g_reference == REF_INT128) && (resultBits(c) > SFixRef128::c_maxBits))
+    {
+        return false;
+    }
+#endif
+
+    switch(c.op)
+    {
+    case OP_ADD:
+    case OP_SUB:
+        return (bBits >= 1) && (bBits == static_cast<int32_t>(c.b.size()));
+    case OP_MUL:
+        // Q(n1,m1)*Q(n2,m2) -> Q(n1+n2-1,m1+m2) cannot hold the
+        // product of the two most negative values.
+        if ((bBits < 1) || (bBits != static_cast<int32_t>(c.b.size())))
+        {
+            return false;
+        }
+        return !(isMostNegative(c.a) && isMostNegative(c.b));
+    case OP_NEGATE:
+        // the most negative value has no positive counterpart
+        return !isMostNegative(c.a);
+    case OP_REMOVELSBS:
+        return static_cast<int32_t>(c.param) < aBits;
+    case OP_REMOVEMSBS:
+        // removeMSBs is only defined for redundant sign bits
+        return (static_cast<int32_t>(c.param) < aBits) && hasRedundantSignBits(c.a, c.param);
+    default:
+        return true;
+    }
+}
+
+/** run a case on SFix and a reference implementation.
+    @return true if the results match.
+*/
+template <class Ref> bool check(const Case &c, std::string &got, std::string &wanted)
+{
+    SFix a = sfixFromBin(c.a, c.aInt, c.aFrac);
+    Ref ra(c.aInt, c.aFrac);
+    ra.fromBinString(c.a);
+
+    SFix r;
+    Ref rr = ra;
+
+    switch(c.op)
+    {
+    case OP_ADD:
+    case OP_SUB:
+    case OP_MUL:
+        {
+            SFix b = sfixFromBin(c.b, c.bInt, c.bFrac);
+            Ref rb(c.bInt, c.bFrac);
+            rb.fromBinString(c.b);
+            if (c.op == OP_ADD)
+            {
+                r = a + b;
+                rr = ra + rb;
+            }
+            else if (c.op == OP_SUB)
+            {
+                r = a - b;
+                rr = ra - rb;
+            }
+            else
+            {
+                r = a * b;
+                rr = ra * rb;
+            }
+        }
+        break;
+    case OP_NEGATE:
+        r = a.negate();
+        rr = ra.negate();
+        break;
+    case OP_EXTENDLSBS:
+        r = a.extendLSBs(c.param);
+        rr = ra.extendLSBs(c.param);
+        break;
+    case OP_EXTENDMSBS:
+        r = a.extendMSBs(c.param);
+        rr = ra.extendMSBs(c.param);
+        break;
+    case OP_REMOVELSBS:
+        r = a.removeLSBs(c.param);
+        rr = ra.removeLSBs(c.param);
+        break;
+    case OP_REMOVEMSBS:
+        r = a.removeMSBs(c.param);
+        rr = ra.removeMSBs(c.param);
+        break;
+    default:
+        break;
+    }
+
+    got = r.toBinString();
+    wanted = rr.toBinString();
+
+    if ((r.intBits() != rr.intBits()) || (r.fracBits() != rr.fracBits()))
+    {
+        got += " (wrong format)";
+        return false;
+    }
+    if (!r.isOk())
+    {
+        got += " (sign bits not extended)";
+        return false;
+    }
+    return got == wanted;
+}
+
+/** run a case on SFix and the selected reference.
+    @return true if the results match.
+*/
+bool check(const Case &c, std::string &got, std::string &wanted)
+{
+#ifdef FPLIB_HAVE_INT128
+    if (g_reference == REF_INT128)
+    {
+        return check<SFixRef128>(c, got, wanted);
+    }
+#endif
+    return check<SFixRef>(c, got, wanted);
+}
+
+/** check a case, returning true if it fails */
+bool fails(const Case &c)
+{
+    if (!isValid(c))
+    {
+        return false;
+    }
+    std::string got, wanted;
+    return !check(c, got, wanted);
+}
+
+/** try to make a failing case smaller while it keeps failing */
+Case shrink(Case c)
+{
+    bool progress = true;
+    while(progress)
+    {
+        progress = false;
+        std::vector<Case> candidates;
+
+        // fewer bits: drop an MSB or an LSB of an operand
+        for(uint32_t operand=0; operand<2; operand++)
+        {
+            std::string &v = (operand == 0) ? c.a : c.b;
+            if (v.size() < 2)
+            {
+                continue;
+            }
+            Case lsb = c;
+            Case msb = c;
+            if (operand == 0)
+            {
+                lsb.a.erase(lsb.a.size()-1);
+                lsb.aFrac--;
+                msb.a.erase(0,1);
+                msb.aInt--;
+            }
+            else
+            {
+                lsb.b.erase(lsb.b.size()-1);
+                lsb.bFrac--;
+                msb.b.erase(0,1);
+                msb.bInt--;
+            }
+            candidates.push_back(lsb);
+            candidates.push_back(msb);
+        }
+
+        // smaller parameter
+        if (c.param > 0)
+        {
+            Case p = c;
+            p.param--;
+            candidates.push_back(p);
+        }
+
+        // simpler values: clear one bit at a time
+        for(uint32_t i=0; i<c.a.size(); i++)
+        {
+            if (c.a[i] == '1')
+            {
+                Case v = c;
+                v.a[i] = '0';
+                candidates.push_back(v);
+            }
+        }
+        for(uint32_t i=0; i<c.b.size(); i++)
+        {
+            if (c.b[i] == '1')
+            {
+                Case v = c;
+                v.b[i] = '0';
+                candidates.push_back(v);
+            }
+        }
+
+        for(auto const& candidate : candidates)
+        {
+            if (fails(candidate))
+            {
+                c = candidate;
+                progress = true;
+                break;
+            }
+        }
+    }
+    return c;
+}
+
+/** generate a random binary string */
+std::string randomBin(Random &rng, uint32_t bits)
+{
+    std::string s(bits, '0');
+    uint64_t r = 0;
+    for(uint32_t i=0; i<bits; i++)
+    {
+        if ((i % 64) == 0)
+        {
+            r = rng.next();
+        }
+        s[i] = (r & 1) ? '1' : '0';
+        r >>= 1;
+    }
+    return s;
+}
+
+/** generate a random format with a total number of bits
+    between 1 and maxBits. */
+void randomFormat(Random &rng, uint32_t maxBits, int32_t &intBits, int32_t &fracBits)
+{
+    // favour small widths and widths around word boundaries
+    int32_t bits;
+    switch(rng.nextBelow(4))
+    {
+    case 0:
+        bits = 1 + rng.nextBelow(8);
+        break;
+    case 1:
+        bits = 32*(1+rng.nextBelow(1+maxBits/32)) + static_cast<int32_t>(rng.nextBelow(5)) - 2;
+        break;
+    default:
+        bits = 1 + rng.nextBelow(maxBits);
+        break;
+    }
+    bits = std::max(1, std::min(bits, static_cast<int32_t>(maxBits)));
+
+    // the integer bits may be negative or exceed the total
+    intBits  = static_cast<int32_t>(rng.nextBelow(bits+9)) - 4;
+    fracBits = bits - intBits;
+}
+
+Case randomCase(Random &rng, uint32_t maxBits)
+{
+    Case c;
+    c.op = static_cast<Operation>(rng.nextBelow(OP_LAST));
+    randomFormat(rng, maxBits, c.aInt, c.aFrac);
+    randomFormat(rng, maxBits, c.bInt, c.bFrac);
+    c.a = randomBin(rng, c.aInt + c.aFrac);
+    c.b = randomBin(rng, c.bInt + c.bFrac);
+    c.param = rng.nextBelow(maxBits);
+
+    const uint32_t aBits = c.a.size();
+    if ((c.op == OP_REMOVELSBS) || (c.op == OP_REMOVEMSBS))
+    {
+        c.param = (aBits > 1) ? rng.nextBelow(aBits) : 0;
+    }
+
+    if (c.op == OP_REMOVEMSBS)
+    {
+        // make the removed bits redundant sign bits
+        for(uint32_t i=1; i<=c.param; i++)
+        {
+            c.a[i] = c.a[0];
+        }
+    }
+    return c;
+}
+
+void printCase(FILE *f, const Case &c)
+{
+    std::string got, wanted;
+    check(c, got, wanted);
+    fprintf(f, "  %s: a = Q(%d,%d) %s\n", c_opNames[c.op], c.aInt, c.aFrac, c.a.c_str());
+    if (c.op <= OP_MUL)
+    {
+        fprintf(f, "  %*s  b = Q(%d,%d) %s\n", static_cast<int>(strlen(c_opNames[c.op])), "", c.bInt, c.bFrac, c.b.c_str());
+    }
+    else
+    {
+        fprintf(f, "  %*s  bits = %d\n", static_cast<int>(strlen(c_opNames[c.op])), "", c.param);
+    }
+    fprintf(f, "  got    %s\n", got.c_str());
+    fprintf(f, "  wanted %s\n", wanted.c_str());
+}
+
+struct Shared
+{
+    Shared() : checks(0), failures(0), running(0), stop(false)
+    {
+        for(uint32_t i=0; i<OP_LAST; i++)
+        {
+            reported[i] = 0;
+        }
+    }
+
+    std::atomic<uint64_t>   checks;
+    std::atomic<uint64_t>   failures;
+    std::atomic<uint32_t>   running;    ///< number of workers still running
+    std::atomic<bool>       stop;
+    std::mutex              mutex;
+    uint32_t                reported[OP_LAST];
+};
+
+/** maximum number of shrunk failures reported per operation */
+const uint32_t c_maxReports = 3;
+
+/** count a failing case and report it, shrunk, if the
+    operation has not been reported too often yet. */
+void reportFailure(Shared &shared, const Case &c)
+{
+    shared.failures++;
+    bool report;
+    {
+        std::lock_guard<std::mutex> lock(shared.mutex);
+        report = (shared.reported[c.op] < c_maxReports);
+        if (report)
+        {
+            shared.reported[c.op]++;
+        }
+    }
+    if (report)
+    {
+        Case s = shrink(c);
+        std::lock_guard<std::mutex> lock(shared.mutex);
+        printf("\nFAIL (shrunk from Q(%d,%d) / Q(%d,%d)):\n", c.aInt, c.aFrac, c.bInt, c.bFrac);
+        printCase(stdout, s);
+        fflush(stdout);
+    }
+}
+
+void worker(Shared &shared, uint64_t seed, uint32_t threadIdx, uint64_t checks, uint32_t maxBits)
+{
+    Random rng(seed);
+    for(uint32_t i=0; i<threadIdx; i++)
+    {
+        rng.jump();
+    }
+
+    const uint64_t batch = 256;
+    uint64_t done = 0;
+    while((done < checks) && !shared.stop)
+    {
+        const uint64_t n = std::min(batch, checks-done);
+        for(uint64_t i=0; i<n; i++)
+        {
+            Case c = randomCase(rng, maxBits);
+            while(!isValid(c))
+            {
+                c = randomCase(rng, maxBits);
+            }
+
+            std::string got, wanted;
+            if (!check(c, got, wanted))
+            {
+                reportFailure(shared, c);
+            }
+        }
+        done += n;
+        shared.checks += n;
+    }
+    shared.running--;
+}
+
+#ifdef FPLIB_HAVE_INT128
+
+/** largest width supported by the exhaustive mode */
+const uint32_t c_maxExhaustiveBits = 12;
+
+/** largest extend / remove amount checked by the exhaustive mode */
+const uint32_t c_maxExhaustiveShift = 40;
+
+/** a block of exhaustive checks: all values of operand
+    widths na (and nb) for one operation and one alignment. */
+struct Job
+{
+    Operation   op;
+    int32_t     na, nb;
+    int32_t     d;          ///< fracB - fracA for add / sub
+};
+
+std::vector<Job> exhaustiveJobs(uint32_t maxBits)
+{
+    std::vector<Job> jobs;
+    for(uint32_t op=0; op<OP_LAST; op++)
+    {
+        for(int32_t na=1; na<=static_cast<int32_t>(maxBits); na++)
+        {
+            if (op > OP_MUL)
+            {
+                jobs.push_back({static_cast<Operation>(op), na, 0, 0});
+                continue;
+            }
+            for(int32_t nb=1; nb<=static_cast<int32_t>(maxBits); nb++)
+            {
+                if (op == OP_MUL)
+                {
+                    // the alignment does not affect the bits of a product
+                    jobs.push_back({OP_MUL, na, nb, 0});
+                    continue;
+                }
+                // all alignments where the operands overlap,
+                // plus one beyond at either side.
+                for(int32_t d=-nb; d<=na; d++)
+                {
+                    jobs.push_back({static_cast<Operation>(op), na, nb, d});
+                }
+            }
+        }
+    }
+    return jobs;
+}
+
+/** create an SFix from a sign-extended scaled value */
+SFix sfixFromInt(int64_t v, int32_t intBits, int32_t fracBits)
+{
+    SFix x(intBits, fracBits);
+    const uint32_t N = x.getNumberOfWords();
+    for(uint32_t i=0; i<N; i++)
+    {
+        const int64_t w = (i < 2) ? (v >> (32*i)) : (v >> 63);
+        x.setInternalValue(i, static_cast<uint32_t>(w));
+    }
+    return x;
+}
+
+/** convert a value to a binary string of 'bits' bits, MSB first */
+std::string intToBin(int64_t v, int32_t bits)
+{
+    std::string s(bits, '0');
+    for(int32_t i=0; i<bits; i++)
+    {
+        if ((v >> i) & 1)
+        {
+            s[bits-1-i] = '1';
+        }
+    }
+    return s;
+}
+
+/** compare an SFix result against the SFixRef128 result word by word */
+bool matches(const SFix &r, const SFixRef128 &rr)
+{
+    if ((r.intBits() != rr.intBits()) || (r.fracBits() != rr.fracBits()) || !r.isOk())
+    {
+        return false;
+    }
+    const uint32_t N = r.getNumberOfWords();
+    for(uint32_t i=0; i<N; i++)
+    {
+        if (r.getInternalValue(i) != rr.getWord(i))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+/** run all checks of one job, returns the number of checks */
+uint64_t runJob(Shared &shared, const Job &job)
+{
+    const int32_t aFrac = job.na/2;
+    const int32_t aInt  = job.na - aFrac;
+    const int32_t bFrac = (job.op == OP_MUL) ? job.nb/2 : aFrac + job.d;
+    const int32_t bInt  = job.nb - bFrac;
+
+    const int64_t aMin = -(static_cast<int64_t>(1) << (job.na-1));
+    const int64_t aMax = -aMin;
+    const int64_t bMin = (job.nb > 0) ? -(static_cast<int64_t>(1) << (job.nb-1)) : 0;
+    const int64_t bMax = -bMin;
+
+    uint64_t checks = 0;
+    for(int64_t va=aMin; (va<aMax) && !shared.stop; va++)
+    {
+        const SFix a = sfixFromInt(va, aInt, aFrac);
+        SFixRef128 ra(aInt, aFrac);
+        ra.setValue(va);
+
+        Case c;
+        c.op = job.op;
+        c.aInt = aInt;
+        c.aFrac = aFrac;
+        c.bInt = bInt;
+        c.bFrac = bFrac;
+        c.param = 0;
+
+        if (job.op <= OP_MUL)
+        {
+            for(int64_t vb=bMin; vb<bMax; vb++)
+            {
+                if ((job.op == OP_MUL) && (va == aMin) && (vb == bMin))
+                {
+                    continue;   // see isValid
+                }
+                const SFix b = sfixFromInt(vb, bInt, bFrac);
+                SFixRef128 rb(bInt, bFrac);
+                rb.setValue(vb);
+
+                bool ok;
+                switch(job.op)
+                {
+                case OP_ADD:
+                    ok = matches(a+b, ra+rb);
+                    break;
+                case OP_SUB:
+                    ok = matches(a-b, ra-rb);
+                    break;
+                default:
+                    ok = matches(a*b, ra*rb);
+                    break;
+                }
+                checks++;
+
+                if (!ok)
+                {
+                    c.a = intToBin(va, job.na);
+                    c.b = intToBin(vb, job.nb);
+                    reportFailure(shared, c);
+                }
+            }
+            continue;
+        }
+
+        uint32_t maxParam = c_maxExhaustiveShift;
+        if ((job.op == OP_REMOVELSBS) || (job.op == OP_REMOVEMSBS))
+        {
+            maxParam = job.na-1;
+        }
+        else if (job.op == OP_NEGATE)
+        {
+            maxParam = 0;
+        }
+
+        for(uint32_t p=0; p<=maxParam; p++)
+        {
+            bool ok = true;
+            switch(job.op)
+            {
+            case OP_NEGATE:
+                if (va == aMin)
+                {
+                    continue;   // see isValid
+                }
+                ok = matches(a.negate(), ra.negate());
+                break;
+            case OP_EXTENDLSBS:
+                ok = matches(a.extendLSBs(p), ra.extendLSBs(p));
+                break;
+            case OP_EXTENDMSBS:
+                ok = matches(a.extendMSBs(p), ra.extendMSBs(p));
+                break;
+            case OP_REMOVELSBS:
+                ok = matches(a.removeLSBs(p), ra.removeLSBs(p));
+                break;
+            case OP_REMOVEMSBS:
+                {
+                    // only defined when the removed bits are sign bits
+                    const int64_t lim = static_cast<int64_t>(1) << (job.na-1-p);
+                    if ((va < -lim) || (va >= lim))
+                    {
+                        continue;
+                    }
+                    ok = matches(a.removeMSBs(p), ra.removeMSBs(p));
+                }
+                break;
+            default:
+                break;
+            }
+            checks++;
+
+            if (!ok)
+            {
+                c.a = intToBin(va, job.na);
+                c.param = p;
+                reportFailure(shared, c);
+            }
+        }
+    }
+    return checks;
+}
+
+void exhaustiveWorker(Shared &shared, const std::vector<Job> &jobs, std::atomic<size_t> &nextJob)
+{
+    size_t idx;
+    while(((idx = nextJob++) < jobs.size()) && !shared.stop)
+    {
+        shared.checks += runJob(shared, jobs[idx]);
+    }
+    shared.running--;
+}
+
+#endif
+
+} // namespace fuzz
+
+int main(int argc, char *argv[])
+{
+    uint64_t checks   = 1000000;
+    uint32_t threads  = std::max(1U, std::thread::hardware_concurrency());
+    uint64_t seed     = 1;
+    uint32_t maxBits  = 300;
+    uint32_t exhaustiveBits = 0;
+    bool     maxBitsSet = false;
+
+    for(int i=1; i<argc; i++)
+    {
+        if ((strcmp(argv[i], "-n") == 0) && (i+1 < argc))
+        {
+            checks = strtoull(argv[++i], nullptr, 10);
+        }
+        else if ((strcmp(argv[i], "-t") == 0) && (i+1 < argc))
+        {
+            threads = std::max(1, atoi(argv[++i]));
+        }
+        else if ((strcmp(argv[i], "-s") == 0) && (i+1 < argc))
+        {
+            seed = strtoull(argv[++i], nullptr, 10);
+        }
+        else if ((strcmp(argv[i], "-w") == 0) && (i+1 < argc))
+        {
+            maxBits = std::max(1, atoi(argv[++i]));
+            maxBitsSet = true;
+        }
+        else if ((strcmp(argv[i], "-r") == 0) && (i+1 < argc) && (strcmp(argv[i+1], "bits") == 0))
+        {
+            fuzz::g_reference = fuzz::REF_BITS;
+            i++;
+        }
+        else if ((strcmp(argv[i], "-r") == 0) && (i+1 < argc) && (strcmp(argv[i+1], "int128") == 0))
+        {
+            fuzz::g_reference = fuzz::REF_INT128;
+            i++;
+        }
+        else if ((strcmp(argv[i], "-x") == 0) && (i+1 < argc))
+        {
+            exhaustiveBits = std::max(1, atoi(argv[++i]));
+            fuzz::g_reference = fuzz::REF_INT128;
+        }
+        else
+        {
+            printf("usage: %s [-n checks] [-t threads] [-s seed] [-w maxbits] [-r bits|int128] [-x bits]\n", argv[0]);
+            return 1;
+        }
+    }
+
+#ifndef FPLIB_HAVE_INT128
+    if (fuzz::g_reference == fuzz::REF_INT128)
+    {
+        printf("Error: the int128 reference is not supported by this compiler\n");
+        return 1;
+    }
+#endif
+
+    // keep the random operands small enough for
+    // most results to fit the 128-bit reference.
+    if ((fuzz::g_reference == fuzz::REF_INT128) && !maxBitsSet)
+    {
+        maxBits = 60;
+    }
+
+    printf("------------------------------------------------\n");
+    printf(" SFix vs %s differential fuzzing\n", (fuzz::g_reference == fuzz::REF_INT128) ? "SFixRef128" : "SFixRef");
+    printf("------------------------------------------------\n\n");
+
+    fuzz::Shared shared;
+    std::vector<std::thread> pool;
+    shared.running = threads;
+    auto start = std::chrono::steady_clock::now();
+
+#ifdef FPLIB_HAVE_INT128
+    std::vector<fuzz::Job> jobs;
+    std::atomic<size_t> nextJob(0);
+#endif
+    if (exhaustiveBits > 0)
+    {
+#ifdef FPLIB_HAVE_INT128
+        if (exhaustiveBits > fuzz::c_maxExhaustiveBits)
+        {
+            printf("Error: the exhaustive mode supports up to %u bits\n", fuzz::c_maxExhaustiveBits);
+            return 1;
+        }
+        jobs = fuzz::exhaustiveJobs(exhaustiveBits);
+        printf("exhaustive, widths 1..%u: %u jobs, threads: %u\n",
+               exhaustiveBits, static_cast<uint32_t>(jobs.size()), threads);
+        for(uint32_t t=0; t<threads; t++)
+        {
+            pool.push_back(std::thread(fuzz::exhaustiveWorker, std::ref(shared), std::cref(jobs), std::ref(nextJob)));
+        }
+#endif
+    }
+    else
+    {
+        printf("checks: %llu, threads: %u, seed: %llu, max bits: %u\n",
+               static_cast<unsigned long long>(checks), threads,
+               static_cast<unsigned long long>(seed), maxBits);
+        for(uint32_t t=0; t<threads; t++)
+        {
+            uint64_t n = checks / threads + ((t < (checks % threads)) ? 1 : 0);
+            pool.push_back(std::thread(fuzz::worker, std::ref(shared), seed, t, n, maxBits));
+        }
+    }
+
+    // progress report
+    uint64_t lastChecks = 0;
+    auto last = start;
+    while(shared.running > 0)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        auto now = std::chrono::steady_clock::now();
+        double dt = std::chrono::duration<double>(now-last).count();
+        if (dt >= 10.0)
+        {
+            uint64_t c = shared.checks;
+            printf("%llu checks, %.0f checks/s, %llu failures\n",
+                   static_cast<unsigned long long>(c), (c-lastChecks)/dt,
+                   static_cast<unsigned long long>(shared.failures.load()));
+            fflush(stdout);
+            lastChecks = c;
+            last = now;
+        }
+    }
+
+    for(auto &t : pool)
+    {
+        t.join();
+    }
+
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now()-start).count();
+    printf("\n%llu checks in %.2f s: %.0f checks/s, %llu failures\n",
+           static_cast<unsigned long long>(shared.checks.load()), elapsed,
+           shared.checks / elapsed,
+           static_cast<unsigned long long>(shared.failures.load()));
+
+    return (shared.failures == 0) ? 0 : 1;
+}
@@ -1,6 +1,30 @@
 
+#include <stdio.h>
+#include <string.h>
+#include <unordered_set>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <math.h>
 #include "reftest.h"
 #include "../src/fplib.h"
+#include "../src/fpaccumulator.h"
+#include "../src/fpbintrace.h"
+#include "../src/fpcompare.h"
+#include "../src/fpcomplex.h"
+#include "../src/fpexpr.h"
+#include "../src/fpgraph.h"
+#include "../src/fprange.h"
+#include "../src/fpconstants.h"
+#include "../src/fpconvert.h"
+#include "../src/fpcordic.h"
+#include "../src/fpmath.h"
+#include "../src/fpmemo.h"
+#include "../src/fppolynomial.h"
+#include "../src/fpreference128.h"
+#include "../src/fpsim.h"
+#include "../src/fpthreads.h"
+#include "../src/fptrace.h"
 
 using namespace fplib;
 
@@ -310,6 +334,22 @@ bool testMul()
         return false;
     }    
 
+    // only negative operands are copied
+    SFix pa = fromInt64(3, 8, 8);
+    SFix pb = fromInt64(5, 8, 8);
+    resetAllocatorStats();
+    const SFix pp = pa*pb;
+    const uint64_t positive = getAllocatorStats().allocations;
+    resetAllocatorStats();
+    const SFix pn = pa*pb.negate();
+    const uint64_t negative = getAllocatorStats().allocations;
+    if ((positive != 1) || (negative != 3) || (toInt64(pp) != 15) || (toInt64(pn) != -15))
+    {
+        printf("a positive, b positive or negative\n");
+        printf("Error: products allocated %d and %d buffers\n", (int)positive, (int)negative);
+        return false;
+    }
+
     return true;
 }
 
@@ -356,6 +396,37 @@ bool testAdd()
         return false;
     }
 
+    // mixed formats must equal the sum and difference
+    // of the explicitly aligned operands, and only
+    // allocate the result.
+    Random rng(3);
+    for(uint32_t i=0; i<2000; i++)
+    {
+        SFix c(1 + rng.nextBelow(100), rng.nextBelow(100));
+        SFix d(1 + rng.nextBelow(100), rng.nextBelow(100));
+        c.randomizeValue(rng);
+        d.randomizeValue(rng);
+        const int32_t fracBits = std::max(c.fracBits(), d.fracBits());
+        const SFix ce = c.extendLSBs(fracBits - c.fracBits());
+        const SFix de = d.extendLSBs(fracBits - d.fracBits());
+
+        resetAllocatorStats();
+        const SFix sum = c+d;
+        const SFix difference = c-d;
+        if (getAllocatorStats().allocations != 2)
+        {
+            printf("test 3\n");
+            printf("Error: mixed-format add/sub allocated %d buffers\n", (int)getAllocatorStats().allocations);
+            return false;
+        }
+        if ((sum != ce+de) || (difference != ce-de))
+        {
+            printf("test 4\n");
+            printf("Error: Q(%d,%d) +- Q(%d,%d) is wrong\n", c.intBits(), c.fracBits(), d.intBits(), d.fracBits());
+            return false;
+        }
+    }
+
     return true;
 }
 
@@ -499,184 +570,2525 @@ bool powerCheck()
     return true;
 }
 
-void oneDivXTest()
+bool testExpressions()
 {
-    // iterate using:
-    //
-    // x = x*(2-b*x)
-    //
-    // where 1/b is the desired quotient.
-    // Note that the starting x _must_ be
-    // larger than 1 and that b*x
-    // must be smaller than x
+    // compare the lazy expression evaluation with
+    // the operator-by-operator result.
+    for(uint32_t i=0; i<100; i++)
+    {
+        SFix a(3,40);
+        SFix b(5,17);
+        SFix c(2,70);
+        a.randomizeValue();
+        b.randomizeValue();
+        c.randomizeValue();
+
+        SFix r1 = a*b - c*a + b;
+        SFix r2(r1.intBits(), r1.fracBits());
+        expr::assign(r2, expr::lazy(a)*b - expr::lazy(c)*a + b);
+        if (r1 != r2)
+        {
+            printf("test 1\n");
+            printf("Error: got    %s\n", r2.toHexString().c_str());
+            printf("       wanted %s\n", r1.toHexString().c_str());
+            return false;
+        }
+    }
 
+    // 1/14 iteration, see oneDivXTest()
     SFix b(8,0);
-    b.setInternalValue(0,14);   // 14.0
-
-    const uint32_t intbits = 8;
-    const uint32_t precision = 256;
-
-    printf("\n");
-    printf("------------------------------------------------\n");
-    printf(" Calculate 1/%d using an iterative method\n", 14);
-    printf("------------------------------------------------\n");
+    b.setInternalValue(0,14);
 
-    SFix x(intbits,precision);
-    x.setInternalValue((precision/32)-1,0x000010000);    // ?
+    SFix x1(8,256);
+    x1.setInternalValue(7,0x000010000);
+    SFix x2 = x1;
     for(uint32_t i=0; i<30; i++)
     {
-        //x = x*(two-b*x);
-        x = x.reinterpret(x.intBits()+1, x.fracBits()-1) - x*x*b;
+        x1 = x1.reinterpret(x1.intBits()+1, x1.fracBits()-1) - x1*x1*b;
+        x1 = x1.removeMSBs(x1.intBits()-8);
+        x1 = x1.removeLSBs(x1.fracBits()-256);
 
-        //std::string s = x.toHexString();
-        //printf("x1 -> %s\n", s.c_str());
-        x = x.removeMSBs(x.intBits()-intbits);
+        expr::assign(x2, expr::lazy(x2.reinterpret(9,255)) - expr::lazy(x2)*x2*b);
+    }
 
-        //s = x.toHexString();
-        //printf("x2 -> %s\n", s.c_str());
-        x = x.removeLSBs(x.fracBits()-precision);
+    if (x1 != x2)
+    {
+        printf("test 2\n");
+        printf("Error: got    %s\n", x2.toHexString().c_str());
+        printf("       wanted %s\n", x1.toHexString().c_str());
+        return false;
+    }
 
-        std::string s = x.toHexString();
-        printf("x -> %s\n", s.c_str());
+    // terms with fewer fractional bits are aligned while
+    // they are added, without temporaries
+    SFix s1(3,70);
+    SFix s2(5,17);
+    SFix s3(2,70);
+    s1.randomizeValue();
+    s2.randomizeValue();
+    s3.randomizeValue();
+    const SFix s2e = s2.extendLSBs(53);
+    SFix mixed(7,70);
+    SFix same(7,70);
+    resetAllocatorStats();
+    expr::assign(same, expr::lazy(s1) + s2e - s3);
+    const uint64_t sameAllocations = getAllocatorStats().allocations;
+    resetAllocatorStats();
+    expr::assign(mixed, expr::lazy(s1) + s2 - s3);
+    const uint64_t mixedAllocations = getAllocatorStats().allocations;
+    if ((mixed != same) || (same != s1+s2-s3) || (mixedAllocations != sameAllocations))
+    {
+        printf("test 3\n");
+        printf("Error: mixed-format sum made %d allocations, wanted %d\n",
+               (int)mixedAllocations, (int)sameAllocations);
+        return false;
     }
 
-    printf("result = 0.");
-    displayNumber(x);
+    return true;
 }
 
-void bisectionSqrt()
+bool testRangeAnalysis()
 {
-    //
-    // calculate sqrt(rootOf) using the
-    // bisection method.
-    // https://en.wikipedia.org/wiki/Bisection_method
-    //
+    // sum of eight inputs in the range [-0.5, 0.5).
+    // the SFix width rules grow this to Q(8,15)
+    // but three integer bits are sufficient.
+    SFix lo(1,15);
+    SFix hi(1,15);
+    lo.setInternalValue(0,0xFFFFC000);  // -0.5
+    hi.setInternalValue(0,0x00003FFF);  //  0.5 - 2^-15
+
+    RangeAnalysis ra;
+    std::vector<RangeAnalysis::NodeId> inputs;
+    for(uint32_t i=0; i<8; i++)
+    {
+        inputs.push_back(ra.input(lo, hi));
+    }
 
-    const uint32_t fbits = 2048;
-    SFix l(8,fbits);   // left point of the interval
-    SFix r(8,fbits);   // right point of the interval
-    SFix c(8,0);    // root to be found
+    RangeAnalysis::NodeId s = inputs[0];
+    for(uint32_t i=1; i<8; i++)
+    {
+        s = ra.add(s, inputs[i]);
+    }
 
-    uint32_t rootOf = 2;
-    r.setInternalValue(fbits/32,rootOf);
-    c.setInternalValue(0,rootOf);
+    if ((ra.naturalIntBits(s) != 8) || (ra.minimumIntBits(s) != 3))
+    {
+        printf("test 1\n");
+        printf("Error: got    Q(%d) / Q(%d)\n", ra.naturalIntBits(s), ra.minimumIntBits(s));
+        printf("       wanted Q(8) / Q(3)\n");
+        return false;
+    }
 
-    for(uint32_t i=0; i<fbits; i++)
+    // x*x - x with x in Q(1,15) full range:
+    // the product of the two most negative values
+    // needs an extra integer bit.
+    RangeAnalysis ra2;
+    RangeAnalysis::NodeId x = ra2.input(1,15);
+    RangeAnalysis::NodeId x2 = ra2.mul(x,x);
+    RangeAnalysis::NodeId y = ra2.sub(x2,x);
+    if ((ra2.minimumIntBits(x2) != 2) || (ra2.minimumIntBits(y) != 3))
     {
-        // create a new middle point
-        SFix m = r+l;
-        m = m.reinterpret(m.intBits()-1, m.fracBits()+1);   // divide by two
-        m = m.removeLSBs(m.fracBits()-fbits);
+        printf("test 2\n");
+        printf("Error: got    Q(%d) / Q(%d)\n", ra2.minimumIntBits(x2), ra2.minimumIntBits(y));
+        printf("       wanted Q(2) / Q(3)\n");
+        return false;
+    }
 
-        SFix m2 = m*m-c;
+    // evaluate the trimmed computation and compare
+    // with the full-width result.
+    for(uint32_t i=0; i<100; i++)
+    {
+        std::vector<SFix> in;
+        SFix sum;
+        for(uint32_t j=0; j<8; j++)
+        {
+            SFix v(0,15);
+            v.randomizeValue();
+            in.push_back(v.extendMSBs(1));
+            sum = (j == 0) ? in[0] : (sum + in[j]);
+        }
 
-        if (m2.isNegative())
+        std::vector<SFix> values = ra.evaluate(in);
+        SFix r = values[s].extendMSBs(sum.intBits()-values[s].intBits());
+        if (r != sum)
         {
-            // if m is negative, m is below the root
-            // so we can move the left point to m
-            l = m;
+            printf("test 3\n");
+            printf("Error: got    %s\n", r.toHexString().c_str());
+            printf("       wanted %s\n", sum.toHexString().c_str());
+            return false;
         }
-        else
+    }
+
+    return true;
+}
+
+bool testRandom()
+{
+    // generators with the same seed must produce the same stream
+    Random r1(1234);
+    Random r2(1234);
+    std::vector<SFix> v1(16, SFix(3,100));
+    std::vector<SFix> v2(16, SFix(3,100));
+    r1.randomize(v1);
+    r2.randomize(v2);
+    for(uint32_t i=0; i<v1.size(); i++)
+    {
+        if (v1[i] != v2[i])
         {
-            // if m is negative, m is above the root
-            // so we can move the right point to m
-            r = m;
+            printf("test 1\n");
+            printf("Error: streams with the same seed differ\n");
+            return false;
         }
     }
-    std::string s1 = l.toHexString();
-    std::string s2 = r.toHexString();
 
-    printf("\n");
-    printf("------------------------------------------------\n");
-    printf(" Square root calculation using bisection method\n");
-    printf("------------------------------------------------\n\n");
-    //printf("Sqrt(%d):\n", rootOf);
-    //printf("l -> %s / 2^%d\n", s1.c_str(), fbits);
-    //printf("r -> %s / 2^%d\n", s2.c_str(), fbits);
+    // a jumped generator must produce a different stream
+    r2.jump();
+    if (r1.next() == r2.next())
+    {
+        printf("test 2\n");
+        printf("Error: jumped stream equals original stream\n");
+        return false;
+    }
 
-    printf("Sqrt(2) is approximately 1.");
-    displayNumber(l);
+    // the sign bits must be correct and both
+    // signs must occur
+    uint32_t negatives = 0;
+    for(uint32_t i=0; i<1000; i++)
+    {
+        SFix a(1,40);
+        a.randomizeValue(r1);
+        if (!a.isOk())
+        {
+            printf("test 3\n");
+            printf("Error: sign bits not correct: %s\n", a.toHexString().c_str());
+            return false;
+        }
+        if (a.isNegative())
+        {
+            negatives++;
+        }
+    }
+
+    if ((negatives < 400) || (negatives > 600))
+    {
+        printf("test 4\n");
+        printf("Error: got %d negative values out of 1000\n", negatives);
+        return false;
+    }
+
+    // the caller of setRandomSeed and a new thread get
+    // different streams
+    setRandomSeed(99);
+    const uint64_t callerValue = threadRandom().next();
+    uint64_t threadValue = callerValue;
+    std::thread([&] { threadValue = threadRandom().next(); }).join();
+    if (threadValue == callerValue)
+    {
+        printf("test 5\n");
+        printf("Error: a new thread repeats the stream of the caller\n");
+        return false;
+    }
+
+    // threads that select a stream get the same values in
+    // every run, whatever order they start in
+    Random expected(99);
+    expected.jump();
+    const uint64_t stream1 = expected.next();
+    for(uint32_t run=0; run<2; run++)
+    {
+        uint64_t values[2] = {0, 0};
+        std::thread t2([&] { setThreadRandomStream(2); values[1] = threadRandom().next(); });
+        std::thread t1([&] { setThreadRandomStream(1); values[0] = threadRandom().next(); });
+        t1.join();
+        t2.join();
+        if ((values[0] != stream1) || (values[1] == values[0]))
+        {
+            printf("test 6\n");
+            printf("Error: thread streams are not reproducible\n");
+            return false;
+        }
+    }
+
+    return true;
 }
 
-int main()
+bool testCompare()
 {
-    printf("------------------------------------------------\n");
-    printf(" Slow reference library tests\n");
-    printf("------------------------------------------------\n\n");
-    if (tests::doTests())
+    // compare against the sign of the full subtraction
+    Random rng(7);
+    for(uint32_t i=0; i<2000; i++)
     {
-        printf("Reference tests passed\n");
+        const int32_t aBits = 1+rng.nextBelow(100);
+        const int32_t bBits = 1+rng.nextBelow(100);
+        const int32_t aInt = static_cast<int32_t>(rng.nextBelow(aBits+4)) - 2;
+        const int32_t bInt = static_cast<int32_t>(rng.nextBelow(bBits+4)) - 2;
+        SFix a(aInt, aBits-aInt);
+        SFix b(bInt, bBits-bInt);
+        a.randomizeValue(rng);
+        b.randomizeValue(rng);
+        if ((i % 4) == 0)
+        {
+            // equal values in different formats
+            b = a.extendLSBs(rng.nextBelow(40)).extendMSBs(rng.nextBelow(40));
+        }
+
+        const SFix d = a - b;
+        const bool zero = (d == SFix(d.intBits(), d.fracBits()));
+        const int32_t wanted = d.isNegative() ? -1 : (zero ? 0 : 1);
+        const int32_t got = compare(a, b);
+        if ((got != wanted) || ((a < b) != (wanted < 0)) || ((a >= b) != (wanted >= 0)) ||
+            ((a > b) != (wanted > 0)) || ((a <= b) != (wanted <= 0)))
+        {
+            printf("test 1\n");
+            printf("Error: got %d wanted %d for a=%s b=%s\n", got, wanted,
+                   a.toBinString().c_str(), b.toBinString().c_str());
+            return false;
+        }
     }
-    else
+    return true;
+}
+
+bool testConversion()
+{
+    // exact round trips
+    Random rng(99);
+    for(uint32_t i=0; i<1000; i++)
     {
-        printf("Reference tests failed\n");
+        const double x = ldexp(static_cast<double>(static_cast<int64_t>(rng.next())), -54);
+        const float f = static_cast<float>(x);
+        if ((toDouble(fromDouble(x, 12, 80)) != x) || (toFloat(fromFloat(f, 12, 150)) != f))
+        {
+            printf("test 1\n");
+            printf("Error: round trip of %.17g failed\n", x);
+            return false;
+        }
     }
 
-    printf("\n\n------------------------------------------------\n");
-    printf(" Fast 32-bit library tests\n");
-    printf("------------------------------------------------\n\n");
+    // rounding of ties and negative numbers
+    const double values[] = {2.5, 3.5, -2.5, -2.25, 2.75};
+    const int64_t floor[] = {2, 3, -3, -3, 2};
+    const int64_t nearest[] = {2, 4, -2, -2, 3};
+    const int64_t towardZero[] = {2, 3, -2, -2, 2};
+    for(uint32_t i=0; i<5; i++)
+    {
+        const SFix v = fromDouble(values[i], 8, 4);
+        if ((toInt64(fromDouble(values[i], 8, 0, Rounding::Floor)) != floor[i]) ||
+            (toInt64(fromDouble(values[i], 8, 0, Rounding::Nearest)) != nearest[i]) ||
+            (toInt64(fromDouble(values[i], 8, 0, Rounding::TowardZero)) != towardZero[i]) ||
+            (toInt64(v, Rounding::Floor) != floor[i]) ||
+            (toInt64(v, Rounding::Nearest) != nearest[i]) ||
+            (toInt64(v, Rounding::TowardZero) != towardZero[i]))
+        {
+            printf("test 2\n");
+            printf("Error: wrong rounding of %g\n", values[i]);
+            return false;
+        }
+    }
 
-    if (testAdd())
+    // toDouble of wide numbers: 1 + 2^-53 is a tie and rounds
+    // to 1, any lower bit set makes it round up.
+    SFix w(2,100);
+    w.addPowerOfTwo(0, false);
+    w.addPowerOfTwo(-53, false);
+    const double d1 = toDouble(w);
+    const double d2 = toDouble(w.negate());
+    w.addPowerOfTwo(-100, false);
+    const double d3 = toDouble(w);
+    const double d4 = toDouble(w.negate());
+    if ((d1 != 1.0) || (d2 != -1.0) || (d3 != 1.0 + ldexp(1.0, -52)) || (d4 != -d3))
     {
-        printf("Add test passed\n");
+        printf("test 3\n");
+        printf("Error: got %.17g %.17g %.17g %.17g\n", d1, d2, d3, d4);
+        return false;
     }
-    else
+
+    // range
+    bool thrown = false;
+    try
     {
-        printf("Add test failed\n");
+        fromDouble(128.0, 8, 0);
+    }
+    catch(std::runtime_error &)
+    {
+        thrown = true;
+    }
+    // 2^127 - 2^-72: all bits above the integer part are
+    // set, but the value is positive.
+    SFix huge(128, 72);
+    for(uint32_t i=0; i<huge.getNumberOfWords(); i++)
+    {
+        huge.setInternalValue(i, 0xFFFFFFFF);
+    }
+    huge.setInternalValue(huge.getNumberOfWords()-1, 0x7F);
+    bool hugeThrown = false;
+    try
+    {
+        toInt64(huge);
+    }
+    catch(std::runtime_error &)
+    {
+        hugeThrown = true;
+    }
+    const SFix minimum = fromInt64(INT64_MIN, 64, 0);
+    if (!thrown || !hugeThrown || (toDouble(fromDouble(-128.0, 8, 0)) != -128.0) || (toInt64(minimum) != INT64_MIN) ||
+        (toInt64(fromInt64(-12345, 20, 33)) != -12345))
+    {
+        printf("test 4\n");
+        printf("Error: range check failed\n");
+        return false;
     }
 
-    if (testSubtract())
+    // buffers
+    std::vector<double> src(256);
+    std::vector<double> dst(256);
+    std::vector<SFix> buffer(256, SFix(4,60));
+    for(auto &x : src)
     {
-        printf("Subtract test passed\n");
+        x = ldexp(static_cast<double>(static_cast<int32_t>(rng.next32())), -31);
     }
-    else
+    fromDouble(&src[0], &buffer[0], src.size());
+    toDouble(&buffer[0], &dst[0], dst.size());
+    for(uint32_t i=0; i<src.size(); i++)
     {
-        printf("Subtract test failed\n");
+        if (src[i] != dst[i])
+        {
+            printf("test 5\n");
+            printf("Error: got %.17g wanted %.17g\n", dst[i], src[i]);
+            return false;
+        }
+    }
+    return true;
+}
+
+bool testMemo()
+{
+    // the hash includes the format
+    SFix a(8,8);
+    a.setInternalValue(0, 0x1234);
+    SFix b = a.reinterpret(4,12);
+    std::unordered_set<SFix> set;
+    set.insert(a);
+    set.insert(b);
+    set.insert(a);
+    if ((set.size() != 2) || (a.hash() == b.hash()))
+    {
+        printf("test 1\n");
+        printf("Error: got %d entries, wanted 2\n", (int)set.size());
+        return false;
     }
 
-    if (testMul())
+    // cached results are returned without recomputation
+    MemoCache cache(4, 1);
+    uint32_t calls = 0;
+    auto square = [&calls](const SFix &v) { calls++; return v*v; };
+    MemoCache::Result r1 = cache.get(1, a, square);
+    MemoCache::Result r2 = cache.get(1, a, square);
+    MemoCache::Result r3 = cache.get(1, b, square);
+    if ((calls != 2) || (r1 != r2) || (*r1 != a*a) || (*r3 != b*b))
     {
-        printf("Mul test passed\n");
+        printf("test 2\n");
+        printf("Error: got %d calls, wanted 2\n", calls);
+        return false;
     }
-    else
+
+    // binary functions and function ids are part of the key
+    MemoCache::Result r4 = cache.get(2, a, b, [&calls](const SFix &x, const SFix &y) { calls++; return x+y; });
+    MemoCache::Result r5 = cache.get(2, a, b, [&calls](const SFix &x, const SFix &y) { calls++; return x+y; });
+    if ((calls != 3) || (r4 != r5) || (*r4 != a+b))
     {
-        printf("Mul test failed\n");
+        printf("test 3\n");
+        printf("Error: got %d calls, wanted 3\n", calls);
+        return false;
     }
 
-    if (testExtend())
+    // the least recently used entry is evicted:
+    // a is used last, so b is evicted.
+    cache.get(1, a, square);
+    for(uint32_t i=0; i<2; i++)
     {
-        printf("Extend test passed\n");
+        SFix v(16,0);
+        v.setInternalValue(0, i);
+        cache.get(3, v, square);
     }
-    else
+    const uint32_t before = calls;
+    cache.get(1, a, square);
+    cache.get(1, b, square);
+    if ((cache.size() != 4) || (calls != before+1) || (*r3 != b*b))
     {
-        printf("Extend test failed\n");
+        printf("test 4\n");
+        printf("Error: got %d entries and %d calls, wanted 4 and %d\n", (int)cache.size(), calls-before, 1);
+        return false;
     }
 
-    if (testRemove())
+    // the shard capacities add up to the capacity
+    MemoCache sharded(1000, 16);
+    for(uint32_t i=0; i<5000; i++)
     {
-        printf("Remove test passed\n");
+        SFix v(32,0);
+        v.setInternalValue(0, i);
+        sharded.get(1, v, square);
     }
-    else
+    if ((sharded.capacity() != 1000) || (sharded.size() != 1000))
     {
-        printf("Remove test failed\n");
+        printf("test 5\n");
+        printf("Error: got capacity %d and %d entries, wanted 1000\n", (int)sharded.capacity(), (int)sharded.size());
+        return false;
     }
+    return true;
+}
 
-    if (powerCheck())
+bool testConstants()
+{
+    // the first 200 fractional bits of each constant
+    const char *expected[] =
     {
-        printf("powerCheck test passed\n");
+        "000003243f6a8885a308d313198a2e03707344a4093822299f31d008",
+        "000002b7e151628aed2a6abf7158809cf4f3c762e7160f38b4da56a7",
+        "000000b17217f7d1cf79abc9e3b39803f2f6af40f343267298b62d8a",
+        "00000171547652b82fe1777d0ffda0d23a7d11d6aef551bad2b4b116",
+        "0000016a09e667f3bcc908b2fb1366ea957d3e3adec17512775099da"
+    };
+    constants::clearCache();
+    const SFix values[] = {constants::pi(200), constants::e(200), constants::ln2(200),
+                           constants::invLn2(200), constants::sqrt2(200)};
+    for(uint32_t i=0; i<5; i++)
+    {
+        if (values[i].toHexString() != expected[i])
+        {
+            printf("test 1\n");
+            printf("Error: got %s, wanted %s\n", values[i].toHexString().c_str(), expected[i]);
+            return false;
+        }
     }
-    else
+
+    // lower precisions are truncated from the cached
+    // value and equal a fresh calculation.
+    const SFix high = constants::pi(1000);
+    const SFix low = constants::pi(77);
+    constants::clearCache();
+    if ((low != high.removeLSBs(1000-77)) || (low != constants::pi(77)) ||
+        (low.intBits() != 3) || (low.fracBits() != 77))
     {
-        printf("powerCheck test failed\n");
+        printf("test 2\n");
+        printf("Error: got %s\n", low.toHexString().c_str());
+        return false;
     }
 
-    if (checkMinimumIntegerBits())
+    // twiddle factors, including the exact ones
+    SFix re, im;
+    constants::twiddle(3, 12, 40, re, im);
+    const bool quarter = (toDouble(re) == 0.0) && (toDouble(im) == -1.0);
+    constants::twiddle(13, 6, 40, re, im);
+    const bool sixth = (toDouble(re) == 0.5) && (fabs(toDouble(im) + sqrt(3.0)/2.0) < 1e-11);
+    constants::twiddle(5, 7, 100, re, im);
+    const double angle = 8.0*atan(1.0)*5.0/7.0;
+    if (!quarter || !sixth || (fabs(toDouble(re) - cos(angle)) > 1e-15) ||
+        (fabs(toDouble(im) + sin(angle)) > 1e-15))
     {
-        printf("checkMinimumIntegerBits test passed\n");
+        printf("test 3\n");
+        printf("Error: wrong twiddle factors\n");
+        return false;
     }
-    else
+
+    // the cache file holds the computed constants
+    const char *filename = "fplib_constants_test.fpc";
+    constants::clearCache();
+    constants::setCacheFile(filename);
+    const SFix cached = constants::e(300);
+    constants::setCacheFile("");
+    constants::clearCache();
+    constants::loadCache(filename);
+    bool loaded = (constants::e(300) == cached);
+
+    // e was calculated with 320 fractional bits
+    FILE *f = fopen(filename, "r");
+    char line[256];
+    bool found = false;
+    while((f != nullptr) && (fgets(line, sizeof(line), f) != nullptr))
     {
-        printf("checkMinimumIntegerBits test failed\n");
+        found = found || (strncmp(line, "e 3 320 ", 8) == 0);
+    }
+    loaded = loaded && found;
+    if (f != nullptr)
+    {
+        fclose(f);
+    }
+
+    // a damaged file is rejected
+    f = fopen(filename, "w");
+    fprintf(f, "fplib-constants 1\ne 3 64 00000002b7e151628aed2a6b\n");
+    fclose(f);
+    bool thrown = false;
+    try
+    {
+        constants::loadCache(filename);
+    }
+    catch(std::runtime_error &)
+    {
+        thrown = true;
+    }
+    remove(filename);
+    if (!loaded || !thrown)
+    {
+        printf("test 4\n");
+        printf("Error: cache file not loaded or not checked\n");
+        return false;
+    }
+
+    // a cache file that cannot be written does not
+    // break lookups, only an explicit flush throws
+    constants::clearCache();
+    constants::setCacheFile("fplib_no_such_dir/constants.fpc");
+    bool lookup = true;
+    try
+    {
+        lookup = (constants::ln2(200) == constants::ln2(200));
+    }
+    catch(std::runtime_error &)
+    {
+        lookup = false;
+    }
+    bool flushThrown = false;
+    try
+    {
+        constants::flushCache();
+    }
+    catch(std::runtime_error &)
+    {
+        flushThrown = true;
+    }
+    constants::setCacheFile("");
+    constants::clearCache();
+    if (!lookup || !flushThrown)
+    {
+        printf("test 5\n");
+        printf("Error: unwritable cache file not handled\n");
+        return false;
+    }
+
+    // constants computed before the file is set are saved
+    remove(filename);
+    constants::ln2(200);
+    constants::setCacheFile(filename);
+    constants::setCacheFile("");
+    constants::clearCache();
+    bool saved = false;
+    f = fopen(filename, "r");
+    while((f != nullptr) && (fgets(line, sizeof(line), f) != nullptr))
+    {
+        saved = saved || (strncmp(line, "ln2 ", 4) == 0);
+    }
+    if (f != nullptr)
+    {
+        fclose(f);
+    }
+    remove(filename);
+    if (!saved)
+    {
+        printf("test 6\n");
+        printf("Error: constants cached before setCacheFile were not saved\n");
+        return false;
+    }
+    return true;
+}
+
+bool testCordic()
+{
+    const double pi = 4.0*atan(1.0);
+
+    // sine and cosine over the full circle, in radians
+    Cordic c(2, 30, 3, 30, 32);
+    c.setFullRange(true);
+    for(int32_t i=-100; i<=100; i++)
+    {
+        const double angle = i*(pi/100.0)*0.999;
+        SFix s, co;
+        c.sinCos(fromDouble(angle, 3, 30), s, co);
+        if ((fabs(toDouble(s) - sin(angle)) > 1e-7) || (fabs(toDouble(co) - cos(angle)) > 1e-7))
+        {
+            printf("test 1\n");
+            printf("Error: sinCos(%f) = %f, %f\n", angle, toDouble(s), toDouble(co));
+            return false;
+        }
+    }
+
+    // an oscillator with the phase in half turns: the
+    // phase accumulator wraps around at +-1.
+    Cordic nco(2, 24, 1, 24, 26, CordicCoordinates::Circular, AngleUnit::HalfTurns);
+    nco.setFullRange(true);
+    SFix phase(1, 24);
+    const SFix step = fromDouble(0.0123, 1, 24);
+    for(uint32_t i=0; i<400; i++)
+    {
+        SFix s, co;
+        nco.sinCos(phase, s, co);
+        const double angle = toDouble(phase)*pi;
+        if ((fabs(toDouble(s) - sin(angle)) > 1e-5) || (fabs(toDouble(co) - cos(angle)) > 1e-5))
+        {
+            printf("test 2\n");
+            printf("Error: half-turn sinCos(%f) = %f, %f\n", toDouble(phase), toDouble(s), toDouble(co));
+            return false;
+        }
+        phase.accumulate(step);
+    }
+
+    // vectoring: magnitude and atan2 in all quadrants.
+    // K*|(x,y)| must stay below 2.
+    Random rng(5);
+    for(uint32_t i=0; i<200; i++)
+    {
+        const double x = (rng.nextBelow(2000)/1000.0 - 1.0)*0.8;
+        const double y = (rng.nextBelow(2000)/1000.0 - 1.0)*0.8;
+        c.vector(fromDouble(x, 2, 30), fromDouble(y, 2, 30), SFix(3, 30));
+        const double mag = toDouble(c.x()*c.inverseGain());
+        if ((fabs(mag - sqrt(x*x+y*y)) > 1e-7) ||
+            ((x*x+y*y > 1e-4) && (fabs(toDouble(c.z()) - atan2(y, x)) > 1e-6)))
+        {
+            printf("test 3\n");
+            printf("Error: vector(%f, %f) = %f, %f\n", x, y, mag, toDouble(c.z()));
+            return false;
+        }
+    }
+
+    // hyperbolic rotation gives cosh and sinh
+    Cordic h(3, 30, 2, 30, 32, CordicCoordinates::Hyperbolic);
+    for(int32_t i=-10; i<=10; i++)
+    {
+        const double t = i*0.1;
+        SFix s, co;
+        h.sinCos(fromDouble(t, 2, 30), s, co);
+        if ((fabs(toDouble(s) - sinh(t)) > 1e-7) || (fabs(toDouble(co) - cosh(t)) > 1e-7))
+        {
+            printf("test 4\n");
+            printf("Error: hyperbolic sinCos(%f) = %f, %f\n", t, toDouble(s), toDouble(co));
+            return false;
+        }
+    }
+
+    // batch runs do not allocate
+    std::vector<SFix> angles(64, SFix(3, 30));
+    std::vector<SFix> sines(64, SFix(2, 30));
+    std::vector<SFix> cosines(64, SFix(2, 30));
+    for(size_t i=0; i<angles.size(); i++)
+    {
+        angles[i] = fromDouble(i*0.05 - 1.6, 3, 30);
+    }
+    resetAllocatorStats();
+    c.sinCos(&angles[0], &sines[0], &cosines[0], angles.size());
+    if (getAllocatorStats().allocations != 0)
+    {
+        printf("test 5\n");
+        printf("Error: batch sinCos allocated %d buffers\n", (int)getAllocatorStats().allocations);
+        return false;
+    }
+    if (fabs(toDouble(sines[10]) - sin(10*0.05 - 1.6)) > 1e-7)
+    {
+        printf("test 6\n");
+        printf("Error: batch sinCos differs\n");
+        return false;
+    }
+
+    // half turns need circular coordinates
+    try
+    {
+        Cordic bad(3, 16, 1, 16, 16, CordicCoordinates::Hyperbolic, AngleUnit::HalfTurns);
+        printf("test 7\n");
+        printf("Error: hyperbolic half turns accepted\n");
+        return false;
+    }
+    catch(std::runtime_error &)
+    {
+    }
+    return true;
+}
+
+bool testMath()
+{
+    // the results are exact, so they must equal the constants
+    if ((exp(fromInt64(1, 2, 0), 3, 200) != constants::e(200)) ||
+        (ln(fromInt64(2, 3, 0), 1, 300) != constants::ln2(300)) ||
+        (exp2(fromDouble(0.5, 1, 1), 2, 300) != constants::sqrt2(300)))
+    {
+        printf("test 1\n");
+        printf("Error: exp(1), ln(2) or exp2(1/2) differ from the constants\n");
+        return false;
+    }
+
+    // exact cases
+    if ((exp2(fromInt64(3, 4, 8), 5, 16) != fromInt64(8, 5, 16)) ||
+        (log2(fromDouble(0.125, 1, 20), 4, 40) != fromInt64(-3, 4, 40)) ||
+        (exp(SFix(4, 10), 2, 64) != fromInt64(1, 2, 64)) ||
+        (ln(fromInt64(1, 2, 30), 2, 64) != SFix(2, 64)))
+    {
+        printf("test 2\n");
+        printf("Error: exact results are wrong\n");
+        return false;
+    }
+
+    // the fast path for short results must agree with
+    // the truncated long results.
+    Random rng(11);
+    for(uint32_t i=0; i<400; i++)
+    {
+        SFix x(4, 1+rng.nextBelow(60));
+        x.randomizeValue(rng);
+        const SFix ax = (x.isNegative() || (x == SFix(1, 0))) ? x.negate() + fromInt64(1, 2, 0) : x;
+        const SFix r[4] = {exp2(x, 10, 32), exp(x, 24, 32), log2(ax, 6, 32), ln(ax, 6, 32)};
+        const SFix l[4] = {exp2(x, 10, 200), exp(x, 24, 200), log2(ax, 6, 200), ln(ax, 6, 200)};
+        for(uint32_t k=0; k<4; k++)
+        {
+            if (r[k] != l[k].removeLSBs(168))
+            {
+                printf("test 3\n");
+                printf("Error: function %d of %s: %s != %s\n", k, x.toBinString().c_str(),
+                       r[k].toBinString().c_str(), l[k].toBinString().c_str());
+                return false;
+            }
+        }
+        if ((fabs(toDouble(r[1]) - ::exp(toDouble(x))) > 1e-9*::exp(toDouble(x)) + 1e-9) ||
+            (fabs(toDouble(r[2]) - ::log2(toDouble(ax))) > 1e-9))
+        {
+            printf("test 4\n");
+            printf("Error: exp or log2 of %f is wrong\n", toDouble(x));
+            return false;
+        }
+    }
+
+    // results that do not fit and logarithms of x <= 0 throw
+    try
+    {
+        exp2(fromInt64(10, 5, 0), 8, 8);
+        printf("test 5\n");
+        printf("Error: exp2(10) fits Q(8,8)\n");
+        return false;
+    }
+    catch(std::runtime_error &)
+    {
+    }
+    try
+    {
+        log2(fromInt64(-1, 2, 0), 8, 8);
+        printf("test 6\n");
+        printf("Error: log2(-1) did not throw\n");
+        return false;
+    }
+    catch(std::runtime_error &)
+    {
+    }
+    return true;
+}
+
+bool testPolynomial()
+{
+    // truncated products must equal full products with
+    // the low bits removed, including products of more
+    // than two words.
+    Random rng(17);
+    for(uint32_t i=0; i<5000; i++)
+    {
+        const bool wide = (i % 8) == 0;
+        const int32_t ai = 1 + rng.nextBelow(wide ? 200 : 40);
+        const int32_t af = rng.nextBelow(wide ? 200 : 70);
+        const int32_t bi = 1 + rng.nextBelow(wide ? 200 : 40);
+        const int32_t bf = rng.nextBelow(wide ? 200 : 70);
+        SFix a(ai, af);
+        SFix b(bi, bf);
+        a.randomizeValue(rng);
+        b.randomizeValue(rng);
+        if ((i % 5) == 0)
+        {
+            // a power of two leaves the lowest product words zero
+            b = SFix(bi, bf);
+            b.addPowerOfTwo(-static_cast<int32_t>(rng.nextBelow(bf+1)), (i % 2) == 0);
+        }
+        const int32_t ri = 1 + rng.nextBelow(ai + bi);
+        const int32_t rf = rng.nextBelow(af + bf + 1);
+
+        SFix full(ri, af + bf);
+        full.assignProduct(a, b);
+        SFix truncated(ri, rf);
+        truncated.assignTruncatedProduct(a, b);
+        if (truncated != full.removeLSBs(af + bf - rf))
+        {
+            printf("test 1\n");
+            printf("Error: truncated product of %s and %s is wrong\n",
+                   a.toBinString().c_str(), b.toBinString().c_str());
+            return false;
+        }
+    }
+
+    // Horner evaluation with per-step formats must equal
+    // the same steps using full products.
+    for(uint32_t i=0; i<200; i++)
+    {
+        const uint32_t degree = 5 + rng.nextBelow(16);
+        const int32_t xf = 8 + rng.nextBelow(100);
+        std::vector<SFix> c;
+        for(uint32_t k=0; k<=degree; k++)
+        {
+            SFix v(2, 8 + rng.nextBelow(100));
+            v.randomizeValue(rng);
+            c.push_back(v);
+        }
+        Polynomial p(c, 1, xf, 4, 8 + rng.nextBelow(xf+1));
+        for(uint32_t k=0; k<degree; k++)
+        {
+            if (rng.nextBelow(2) == 0)
+            {
+                // every step keeps at least 8 fractional bits,
+                // so 8 + xf bits are always available.
+                p.setStepFormat(k, 2 + rng.nextBelow(6), 8 + rng.nextBelow(xf+1));
+            }
+        }
+
+        SFix x(1, xf);
+        x.randomizeValue(rng);
+        SFix acc = p.coefficient(degree);
+        for(uint32_t k=degree; k>0; k--)
+        {
+            const SFix &ck = p.coefficient(k-1);
+            SFix product(ck.intBits(), acc.fracBits() + xf);
+            product.assignProduct(acc, x);
+            acc = product.removeLSBs(product.fracBits() - ck.fracBits());
+            acc.accumulate(ck);
+        }
+        if (p.evaluate(x) != acc)
+        {
+            printf("test 2\n");
+            printf("Error: degree %d polynomial differs from the full products\n", degree);
+            return false;
+        }
+    }
+
+    // exp(x) by a degree-12 Taylor polynomial
+    std::vector<SFix> c;
+    double f = 1.0;
+    for(uint32_t k=0; k<=12; k++)
+    {
+        f = (k == 0) ? 1.0 : f/k;
+        c.push_back(fromDouble(f, 2, 40));
+    }
+    Polynomial e(c, 2, 32, 4, 40);
+    std::vector<SFix> xs;
+    std::vector<SFix> ys(65, SFix(4, 40));
+    for(uint32_t i=0; i<=64; i++)
+    {
+        xs.push_back(fromDouble(i/32.0 - 1.0, 2, 32));
+    }
+    resetAllocatorStats();
+    e.evaluate(&xs[0], &ys[0], xs.size());
+    if (getAllocatorStats().allocations != 0)
+    {
+        printf("test 3\n");
+        printf("Error: batch evaluation allocated %d buffers\n", (int)getAllocatorStats().allocations);
+        return false;
+    }
+    for(uint32_t i=0; i<=64; i++)
+    {
+        if (fabs(toDouble(ys[i]) - ::exp(toDouble(xs[i]))) > 1e-9)
+        {
+            printf("test 4\n");
+            printf("Error: exp(%f) = %f\n", toDouble(xs[i]), toDouble(ys[i]));
+            return false;
+        }
+    }
+
+    // a step cannot have more fractional bits than its product
+    try
+    {
+        Polynomial bad(c, 2, 4, 4, 40);
+        bad.setStepFormat(0, 4, 60);
+        bad.evaluate(fromDouble(0.5, 2, 4));
+        printf("test 5\n");
+        printf("Error: impossible step format accepted\n");
+        return false;
+    }
+    catch(std::runtime_error &)
+    {
+    }
+    return true;
+}
+
+bool testAccumulator()
+{
+    // the carry-save accumulator must equal SFix::accumulate,
+    // for operands that are narrower and wider than the sum.
+    Random rng(23);
+    for(uint32_t i=0; i<500; i++)
+    {
+        const int32_t fb = rng.nextBelow(100);
+        const int32_t ib = 1 + rng.nextBelow(100);
+        SFix reference(ib, fb);
+        CarrySaveAccumulator acc(ib, fb);
+        if ((i % 2) == 0)
+        {
+            reference.randomizeValue(rng);
+            acc.assign(reference);
+        }
+
+        const uint32_t terms = 1 + rng.nextBelow(200);
+        for(uint32_t k=0; k<terms; k++)
+        {
+            SFix v(1 + rng.nextBelow(150), fb);
+            v.randomizeValue(rng);
+            const bool subtract = rng.nextBelow(2) == 0;
+            reference.accumulate(v, subtract);
+            acc.add(v, subtract);
+            if (((k % 50) == 0) && (acc.value() != reference))
+            {
+                printf("test 1\n");
+                printf("Error: intermediate sum differs after %d terms\n", k+1);
+                return false;
+            }
+        }
+        if (acc.value() != reference)
+        {
+            printf("test 2\n");
+            printf("Error: Q(%d,%d) sum of %d terms is %s instead of %s\n", ib, fb, terms,
+                   acc.value().toBinString().c_str(), reference.toBinString().c_str());
+            return false;
+        }
+    }
+
+    // a long chain of negative numbers wraps around
+    SFix reference(4, 64);
+    CarrySaveAccumulator acc(4, 64);
+    const SFix v = fromDouble(-0.75, 1, 64);
+    resetAllocatorStats();
+    for(uint32_t k=0; k<100000; k++)
+    {
+        reference.accumulate(v);
+        acc.add(v);
+    }
+    if (acc.value() != reference)
+    {
+        printf("test 3\n");
+        printf("Error: wrapped sum is %f instead of %f\n", toDouble(acc.value()), toDouble(reference));
+        return false;
+    }
+    if (getAllocatorStats().allocations != 0)
+    {
+        printf("test 4\n");
+        printf("Error: accumulation allocated %d buffers\n", (int)getAllocatorStats().allocations);
+        return false;
+    }
+
+    try
+    {
+        acc.add(SFix(4, 60));
+        printf("test 5\n");
+        printf("Error: fractional bits were not checked\n");
+        return false;
+    }
+    catch(std::runtime_error &)
+    {
+    }
+    return true;
+}
+
+bool testComplex()
+{
+    // the four- and three-multiplication products must
+    // equal the product built from SFix operators.
+    Random rng(29);
+    for(uint32_t i=0; i<1000; i++)
+    {
+        const bool wide = (i % 8) == 0;
+        const int32_t aib = 1 + rng.nextBelow(wide ? 300 : 40);
+        const int32_t af = rng.nextBelow(wide ? 300 : 40);
+        const int32_t bi = 1 + rng.nextBelow(wide ? 300 : 40);
+        const int32_t bf = rng.nextBelow(wide ? 300 : 40);
+        SFix ar(aib, af);
+        SFix ai(aib, af);
+        SFix br(bi, bf);
+        SFix bim(bi, bf);
+        ar.randomizeValue(rng);
+        ai.randomizeValue(rng);
+        br.randomizeValue(rng);
+        bim.randomizeValue(rng);
+        const SCFix a(ar, ai);
+        const SCFix b(br, bim);
+
+        // one more integer bit, so the most negative
+        // values can be multiplied.
+        const SFix are = ar.extendMSBs(1);
+        const SFix aie = ai.extendMSBs(1);
+        const SFix re = (are*br) - (aie*bim);
+        const SFix im = (are*bim) + (aie*br);
+        const SCFix p4 = a*b;
+        const SCFix p3 = a.gaussProduct(b);
+        if ((compare(p4.real(), re) != 0) || (compare(p4.imag(), im) != 0))
+        {
+            printf("test 1\n");
+            printf("Error: product of Q(%d,%d) and Q(%d,%d) is wrong\n", aib, af, bi, bf);
+            return false;
+        }
+        if (p3 != p4)
+        {
+            printf("test 2\n");
+            printf("Error: Gauss product of Q(%d,%d) and Q(%d,%d) is wrong\n", aib, af, bi, bf);
+            return false;
+        }
+
+        // in-place products wrap around, like accumulate
+        SCFix w(2, af + bf);
+        w.assignProduct(a, b, (i % 2) == 0);
+        SFix wrapped(2, af + bf);
+        wrapped.accumulate(re);
+        if (w.real() != wrapped)
+        {
+            printf("test 3\n");
+            printf("Error: wrapped product is wrong\n");
+            return false;
+        }
+
+        const SFix m2 = a.magnitudeSquared();
+        if (compare(m2, (are*ar) + (aie*ai)) != 0)
+        {
+            printf("test 4\n");
+            printf("Error: magnitude squared of Q(%d,%d) is wrong\n", a.intBits(), a.fracBits());
+            return false;
+        }
+
+        SCFix c = a.conj();
+        if ((c.real() != ar) || (c.imag() != ai.negate()))
+        {
+            printf("test 5\n");
+            printf("Error: conjugate is wrong\n");
+            return false;
+        }
+        c.conjugate();
+        if (c != a)
+        {
+            printf("test 6\n");
+            printf("Error: in-place conjugate is wrong\n");
+            return false;
+        }
+
+        const SCFix s = a + b;
+        const SCFix d = a - b;
+        if ((s.real() != ar+br) || (s.imag() != ai+bim) ||
+            (d.real() != ar-br) || (d.imag() != ai-bim))
+        {
+            printf("test 7\n");
+            printf("Error: sum or difference is wrong\n");
+            return false;
+        }
+    }
+
+    // batch operations, after the first, do not allocate
+    const size_t n = 64;
+    SCFixBuffer x(n, 1, 31);
+    SCFixBuffer y(n, 1, 31);
+    SCFixBuffer z(n, 3, 62);
+    for(size_t i=0; i<n; i++)
+    {
+        x.real()[i].randomizeValue(rng);
+        x.imag()[i].randomizeValue(rng);
+        y.real()[i].randomizeValue(rng);
+        y.imag()[i].randomizeValue(rng);
+    }
+    const SCFix y3 = y.get(3);
+    std::vector<SFix> m2(n, SFix(3, 62));
+    SCFix c = y3;
+    z.multiply(x, y, true);
+    x.magnitudeSquared(&m2[0]);
+    resetAllocatorStats();
+    z.multiply(x, y, true);
+    z.multiply(x, y3);
+    for(uint32_t i=0; i<3; i++)
+    {
+        c.conjugate();
+        x.magnitudeSquared(&m2[0]);
+    }
+    if ((getAllocatorStats().allocations != 0) || (c.real() != y3.real()) ||
+        (c.imag() != y3.imag().negate()))
+    {
+        printf("test 8\n");
+        printf("Error: batch operations allocated %d buffers\n", (int)getAllocatorStats().allocations);
+        return false;
+    }
+    for(size_t i=0; i<n; i++)
+    {
+        if ((z.get(i) != x.get(i)*y3) || (compare(m2[i], x.get(i).magnitudeSquared()) != 0))
+        {
+            printf("test 9\n");
+            printf("Error: batch element %d is wrong\n", (int)i);
+            return false;
+        }
+    }
+
+    // the most negative parts: (-1-1j)*(-1-1j) = 0+2j
+    const SFix minusOne = fromInt64(-1, 1, 4);
+    const SCFix mn(minusOne, minusOne);
+    const SCFix sq4 = mn*mn;
+    const SCFix sq3 = mn.gaussProduct(mn);
+    if ((toDouble(sq4.real()) != 0.0) || (toDouble(sq4.imag()) != 2.0) || (sq3 != sq4))
+    {
+        printf("test 10\n");
+        printf("Error: product of the most negative values is %f%+fj\n",
+               toDouble(sq4.real()), toDouble(sq4.imag()));
+        return false;
+    }
+    return true;
+}
+
+bool testAllocator()
+{
+    // the pool recycles the buffers of a size class
+    setAllocatorPolicy(AllocatorPolicy::Pool);
+    {
+        SFix warm(64, 64);
+    }
+    resetAllocatorStats();
+    for(uint32_t i=0; i<100; i++)
+    {
+        SFix v(64, 64);
+    }
+    const AllocatorStats poolStats = getAllocatorStats();
+    const bool pool = (getAllocatorPolicy() == AllocatorPolicy::Pool);
+    setAllocatorPolicy(AllocatorPolicy::Heap);
+    releasePoolMemory();
+    if (!pool || (poolStats.allocations != 100) || (poolStats.deallocations != 100) ||
+        (poolStats.heapAllocations != 0))
+    {
+        printf("test 1\n");
+        printf("Error: the pool did not recycle buffers\n");
+        return false;
+    }
+
+    // the innermost arena scope is used, a heap scope
+    // bypasses all of them
+    bool nested = true;
+    {
+        ArenaScope outer;
+        SFix a(32, 32);
+        const size_t outerUsed = outer.bytesUsed();
+        {
+            ArenaScope inner;
+            SFix b(32, 32);
+            nested = nested && (outer.bytesUsed() == outerUsed) && (inner.bytesUsed() > 0);
+            resetAllocatorStats();
+            {
+                HeapScope heap;
+                SFix c(32, 32);
+            }
+            nested = nested && (getAllocatorStats().arenaAllocations == 0) &&
+                     (getAllocatorStats().heapAllocations == 1);
+        }
+        SFix d(32, 32);
+        nested = nested && (outer.bytesUsed() > outerUsed) && (outerUsed > 0);
+    }
+    if (!nested)
+    {
+        printf("test 2\n");
+        printf("Error: nested arena and heap scopes\n");
+        return false;
+    }
+
+    // numbers created outside a scope survive assignments
+    // inside it, also of a different format
+    Random rng(5);
+    SFix x(20, 100);
+    SFix y(20, 100);
+    x.randomizeValue(rng);
+    y.randomizeValue(rng);
+    const SFix expected = x*y;
+    SFix product;
+    SFix copied(1, 15);
+    {
+        ArenaScope scope;
+        product = x*y;
+        const SFix p = x*y;
+        copied = p;
+    }
+    {
+        // reuse the released arena memory
+        ArenaScope scope;
+        std::vector<SFix> garbage;
+        for(uint32_t i=0; i<100; i++)
+        {
+            garbage.push_back(SFix(40, 200));
+            garbage.back().randomizeValue(rng);
+        }
+    }
+    if ((product != expected) || (copied != expected))
+    {
+        printf("test 3\n");
+        printf("Error: assignment inside an arena scope lost the value\n");
+        return false;
+    }
+
+    // buffers freed by another thread migrate to the
+    // pool of that thread
+    std::vector<SFix> values;
+    std::thread producer([&]
+    {
+        setAllocatorPolicy(AllocatorPolicy::Pool);
+        for(uint32_t i=0; i<100; i++)
+        {
+            values.push_back(SFix(64, 64));
+        }
+    });
+    producer.join();
+    setAllocatorPolicy(AllocatorPolicy::Pool);
+    values.clear();
+    resetAllocatorStats();
+    for(uint32_t i=0; i<100; i++)
+    {
+        values.push_back(SFix(64, 64));
+    }
+    const uint64_t migrated = getAllocatorStats().heapAllocations;
+    values.clear();
+    releasePoolMemory();
+    setAllocatorPolicy(AllocatorPolicy::Heap);
+
+    // a thread_local number that is destroyed after the
+    // pool of its thread returns its buffer to the heap
+    std::thread late([]
+    {
+        static thread_local SFix holder;
+        setAllocatorPolicy(AllocatorPolicy::Pool);
+        holder = SFix(64, 64);
+    });
+    late.join();
+    if (migrated != 0)
+    {
+        printf("test 4\n");
+        printf("Error: buffers freed by another thread were not recycled\n");
+        return false;
+    }
+    return true;
+}
+
+
+bool testThreads()
+{
+    // every index is executed once, also when run
+    // is called from within a job.
+    ThreadPool pool(4);
+    std::vector<std::atomic<uint32_t> > counts(1000);
+    pool.run(10, [&](size_t i)
+    {
+        pool.run(100, [&](size_t j) { counts[i*100+j]++; });
+    });
+    for(auto &c : counts)
+    {
+        if (c != 1)
+        {
+            printf("test 1\n");
+            printf("Error: an index was executed %d times\n", (uint32_t)c);
+            return false;
+        }
+    }
+
+    try
+    {
+        pool.run(100, [](size_t i) { if (i == 42) throw std::runtime_error("42"); });
+        printf("test 2\n");
+        printf("Error: exception was not re-thrown\n");
+        return false;
+    }
+    catch(std::runtime_error &)
+    {
+    }
+
+    // multi-threaded products must equal the
+    // single-threaded ones, also when truncated.
+    Random rng(31);
+    std::vector<SFix> a, b, single;
+    for(uint32_t i=0; i<40; i++)
+    {
+        a.push_back(SFix(1 + rng.nextBelow(3000), rng.nextBelow(3000)));
+        b.push_back(SFix(1 + rng.nextBelow(3000), rng.nextBelow(3000)));
+        a.back().randomizeValue(rng);
+        b.back().randomizeValue(rng);
+        SFix p(1 + rng.nextBelow(a.back().intBits() + b.back().intBits()),
+               a.back().fracBits() + b.back().fracBits());
+        p.assignProduct(a.back(), b.back());
+        single.push_back(p);
+        single.push_back(a.back()*b.back());
+    }
+
+    const uint32_t threshold = getParallelMultiplyThreshold();
+    setMultiplyThreads(4);
+    setParallelMultiplyThreshold(8);
+    bool ok = true;
+    for(uint32_t i=0; (i<a.size()) && ok; i++)
+    {
+        SFix p(single[2*i].intBits(), single[2*i].fracBits());
+        p.assignProduct(a[i], b[i]);
+        ok = (p == single[2*i]) && ((a[i]*b[i]) == single[2*i+1]);
+    }
+    setMultiplyThreads(1);
+    setParallelMultiplyThreshold(threshold);
+    if (!ok)
+    {
+        printf("test 3\n");
+        printf("Error: multi-threaded product differs\n");
+        return false;
+    }
+
+    // uneven work makes the threads steal
+    std::vector<std::atomic<uint32_t> > visits(100000);
+    pool.parallelFor(visits.size(), 16, [&](size_t begin, size_t end)
+    {
+        for(size_t i=begin; i<end; i++)
+        {
+            if (i < 1000)
+            {
+                std::this_thread::sleep_for(std::chrono::microseconds(10));
+            }
+            visits[i]++;
+        }
+    });
+    for(auto &v : visits)
+    {
+        if (v != 1)
+        {
+            printf("test 4\n");
+            printf("Error: an index was visited %d times\n", (uint32_t)v);
+            return false;
+        }
+    }
+
+    // batch evaluation equals the serial evaluation
+    std::vector<double> samples;
+    std::vector<SFix> x, y, xy, squares;
+    for(uint32_t i=0; i<5000; i++)
+    {
+        samples.push_back(rng.nextBelow(1u << 30) / 1073741824.0 - 0.5);
+        x.push_back(fromDouble(samples.back(), 1, 40));
+        y.push_back(SFix(1, 40));
+        xy.push_back(SFix(2, 80));
+        squares.push_back(SFix(1, 80));
+    }
+    transform(pool, &samples[0], &y[0], samples.size(), [](double v) { return fromDouble(v, 1, 40); });
+    transform(pool, &x[0], &y[0], &xy[0], x.size(), [](const SFix &a, const SFix &b) { return a + a*b; });
+    transform(&x[0], &squares[0], x.size(), [](const SFix &a) { return a*a; }, 7);
+    std::vector<double> values(x.size());
+    parallel_for(pool, x.size(), [&](size_t i) { values[i] = toDouble(squares[i]); });
+    for(size_t i=0; i<x.size(); i++)
+    {
+        if ((y[i] != x[i]) || (xy[i] != x[i] + x[i]*x[i]) || (values[i] != toDouble(x[i]*x[i])))
+        {
+            printf("test 5\n");
+            printf("Error: batch result %d is wrong\n", (int)i);
+            return false;
+        }
+    }
+
+    try
+    {
+        transform(pool, &x[0], &y[0], x.size(), [](const SFix &a) { return a*a; });
+        printf("test 6\n");
+        printf("Error: output format was not checked\n");
+        return false;
+    }
+    catch(std::runtime_error &)
+    {
+    }
+    return true;
+}
+
+bool testGraph()
+{
+    // FIR filter: y[n] = c0*x[n] + c1*x[n-1] + c2*x[n-2]
+    Random rng(46);
+    const uint32_t N = 500;
+    std::vector<SFix> xs;
+    for(uint32_t i=0; i<N; i++)
+    {
+        xs.push_back(fromDouble(rng.nextBelow(1u << 30) / 1073741824.0 - 0.5, 1, 15));
+    }
+    const SFix c0 = fromDouble(0.25, 1, 15);
+    const SFix c1 = fromDouble(-0.375, 1, 15);
+    const SFix c2 = fromDouble(0.125, 1, 15);
+
+    Graph fir;
+    NodeId x  = fir.input(1, 15);
+    NodeId x1 = fir.delay(x);
+    NodeId x2 = fir.delay(x1);
+    NodeId y  = fir.add(fir.add(fir.mul(fir.constant(c0), x), fir.mul(fir.constant(c1), x1)),
+                        fir.mul(fir.constant(c2), x2));
+    fir.output(y);
+    fir.compile();
+    std::vector<SFix> ys(N, SFix(fir.intBits(y), fir.fracBits(y)));
+    resetAllocatorStats();
+    fir.run({&xs[0]}, {&ys[0]}, N);
+    if (getAllocatorStats().allocations != 0)
+    {
+        printf("test 1\n");
+        printf("Error: running the graph allocated %d buffers\n", (int)getAllocatorStats().allocations);
+        return false;
+    }
+
+    const SFix zero(1, 15);
+    for(uint32_t i=0; i<N; i++)
+    {
+        const SFix &v1 = (i >= 1) ? xs[i-1] : zero;
+        const SFix &v2 = (i >= 2) ? xs[i-2] : zero;
+        if (ys[i] != (c0*xs[i] + c1*v1) + c2*v2)
+        {
+            printf("test 2\n");
+            printf("Error: FIR output %d is wrong\n", i);
+            return false;
+        }
+    }
+
+    // IIR filter: y[n] = x[n] + a*y[n-1], quantized to Q(2,15)
+    const SFix a = fromDouble(0.5, 1, 15);
+    Graph iir;
+    NodeId in = iir.input(1, 15);
+    NodeId yd = iir.feedback(2, 15);
+    NodeId out = iir.quantize(iir.add(in, iir.mul(iir.constant(a), yd)), 2, 15);
+    iir.connect(yd, out);
+    iir.output(out);
+    std::vector<SFix> iirOut(N, SFix(2, 15));
+    iir.run({&xs[0]}, {&iirOut[0]}, N);
+    SFix state(2, 15);
+    for(uint32_t i=0; i<N; i++)
+    {
+        state = (xs[i] + a*state).removeLSBs(15).removeMSBs(1);
+        if (iirOut[i] != state)
+        {
+            printf("test 3\n");
+            printf("Error: IIR output %d is wrong\n", i);
+            return false;
+        }
+    }
+
+    // reset restarts the filter from zero
+    iir.reset();
+    std::vector<SFix> again(N, SFix(2, 15));
+    iir.run({&xs[0]}, {&again[0]}, N);
+    if (again != iirOut)
+    {
+        printf("test 4\n");
+        printf("Error: reset did not clear the delays\n");
+        return false;
+    }
+
+    // quantizers truncate and wrap like removeLSBs/removeMSBs
+    // and extend like extendLSBs/extendMSBs.
+    std::vector<SFix> wide;
+    for(uint32_t i=0; i<N; i++)
+    {
+        wide.push_back(SFix(40, 50));
+        wide.back().randomizeValue(rng);
+    }
+    Graph q;
+    NodeId w = q.input(40, 50);
+    q.output(q.quantize(w, 40, 7));
+    q.output(q.quantize(w, 70, 90));
+    std::vector<SFix> narrow(N, SFix(40, 7)), extended(N, SFix(70, 90));
+    q.run({&wide[0]}, {&narrow[0], &extended[0]}, N);
+    for(uint32_t i=0; i<N; i++)
+    {
+        if ((narrow[i] != wide[i].removeLSBs(43)) ||
+            (extended[i] != wide[i].extendLSBs(40).extendMSBs(30)))
+        {
+            printf("test 5\n");
+            printf("Error: quantizer output %d is wrong\n", i);
+            return false;
+        }
+    }
+
+    // errors
+    Graph bad;
+    NodeId b = bad.input(1, 15);
+    NodeId fb = bad.feedback(3, 15);
+    bad.output(bad.add(b, fb));
+    try
+    {
+        bad.connect(fb, b);
+        printf("test 6\n");
+        printf("Error: format of a feedback source was not checked\n");
+        return false;
+    }
+    catch(std::runtime_error &)
+    {
+    }
+    try
+    {
+        bad.compile();
+        printf("test 7\n");
+        printf("Error: unconnected feedback delay was not detected\n");
+        return false;
+    }
+    catch(std::runtime_error &)
+    {
+    }
+    try
+    {
+        fir.run({}, {&ys[0]}, N);
+        printf("test 8\n");
+        printf("Error: number of inputs was not checked\n");
+        return false;
+    }
+    catch(std::runtime_error &)
+    {
+    }
+    return true;
+}
+
+bool testSimulator()
+{
+    // two-stage pipeline: y = a*b + c
+    Simulator sim;
+    SignalId a  = sim.signal(1, 15);
+    SignalId b  = sim.signal(1, 15);
+    SignalId c  = sim.signal(2, 30);
+    SignalId p  = sim.signal(1, 30);
+    SignalId pq = sim.signal(1, 30);
+    SignalId cq = sim.signal(2, 30);
+    SignalId y  = sim.signal(3, 30);
+    uint32_t productCalls = 0;
+    sim.process([&]
+    {
+        productCalls++;
+        sim.modify(p).assignTruncatedProduct(sim.read(a), sim.read(b));
+    }, {a, b});
+    sim.addRegister(p, pq);
+    sim.addRegister(c, cq);
+    sim.clocked([&] { sim.modify(y).assignSum(sim.read(pq), sim.read(cq)); });
+
+    Random rng(47);
+    const uint32_t N = 300;
+    std::vector<SFix> as, bs, cs;
+    for(uint32_t i=0; i<N; i++)
+    {
+        as.push_back(SFix(1, 15));
+        bs.push_back(SFix(1, 15));
+        cs.push_back(SFix(2, 30));
+        as.back().randomizeValue(rng);
+        bs.back().randomizeValue(rng);
+        cs.back().randomizeValue(rng);
+    }
+    // keep b constant for a while to check that the
+    // product is only evaluated when an input changes.
+    for(uint32_t i=100; i<200; i++)
+    {
+        as[i] = as[100];
+        bs[i] = bs[100];
+    }
+
+    std::vector<SFix> ys(N, SFix(3, 30));
+    for(uint32_t i=0; i<N; i++)
+    {
+        if (i == 10)
+        {
+            resetAllocatorStats();
+        }
+        sim.write(a, as[i]);
+        sim.write(b, bs[i]);
+        sim.write(c, cs[i]);
+        sim.step();
+        ys[i].copyValueFrom(sim.read(y));
+    }
+    if (getAllocatorStats().allocations != 0)
+    {
+        printf("test 1\n");
+        printf("Error: the simulation allocated %d buffers\n", (int)getAllocatorStats().allocations);
+        return false;
+    }
+    for(uint32_t i=1; i<N; i++)
+    {
+        const SFix expected = (as[i-1].extendMSBs(1)*bs[i-1]).removeMSBs(1) + cs[i-1];
+        if (ys[i] != expected)
+        {
+            printf("test 2\n");
+            printf("Error: pipeline output of cycle %d is wrong\n", i);
+            return false;
+        }
+    }
+    if ((productCalls >= N - 90) || (sim.cycle() != N))
+    {
+        printf("test 3\n");
+        printf("Error: the product was evaluated %d times in %d cycles\n", productCalls, (int)sim.cycle());
+        return false;
+    }
+
+    // an 8-bit counter wraps around
+    Simulator counter;
+    const SFix one = fromDouble(1.0, 8, 0);
+    SignalId cnt = counter.signal(8, 0);
+    SignalId nxt = counter.signal(8, 0);
+    counter.process([&]
+    {
+        SFix &v = counter.modify(nxt);
+        v.copyValueFrom(counter.read(cnt));
+        v.accumulate(one);
+    }, {cnt});
+    counter.addRegister(nxt, cnt);
+    counter.run(300);
+    if (counter.read(cnt) != fromDouble(300 - 256, 8, 0))
+    {
+        printf("test 4\n");
+        printf("Error: counter value is %f\n", toDouble(counter.read(cnt)));
+        return false;
+    }
+
+    // a combinational loop that never settles
+    Simulator loop;
+    SignalId s = loop.signal(8, 0);
+    loop.process([&] { loop.modify(s).accumulate(one); }, {s});
+    try
+    {
+        loop.step();
+        printf("test 5\n");
+        printf("Error: combinational loop was not detected\n");
+        return false;
+    }
+    catch(std::runtime_error &)
+    {
+    }
+
+    try
+    {
+        counter.addRegister(cnt, y);
+        printf("test 6\n");
+        printf("Error: register formats were not checked\n");
+        return false;
+    }
+    catch(std::runtime_error &)
+    {
+    }
+
+    // signal ids that do not exist are rejected
+    const SignalId missing = 1000;
+    uint32_t rejected = 0;
+    try
+    {
+        counter.read(missing);
+    }
+    catch(std::runtime_error &)
+    {
+        rejected++;
+    }
+    try
+    {
+        counter.write(missing, counter.read(cnt));
+    }
+    catch(std::runtime_error &)
+    {
+        rejected++;
+    }
+    try
+    {
+        counter.modify(missing);
+    }
+    catch(std::runtime_error &)
+    {
+        rejected++;
+    }
+    if (rejected != 3)
+    {
+        printf("test 7\n");
+        printf("Error: unknown signal ids were not rejected\n");
+        return false;
+    }
+    return true;
+}
+
+std::string readFile(const char *filename)
+{
+    std::string contents;
+    FILE *f = fopen(filename, "rb");
+    if (f != NULL)
+    {
+        char buffer[4096];
+        size_t n;
+        while((n = fread(buffer, 1, sizeof(buffer), f)) > 0)
+        {
+            contents.append(buffer, n);
+        }
+        fclose(f);
+    }
+    return contents;
+}
+
+bool testTrace()
+{
+    Random rng(48);
+    const uint32_t N = 2000;
+    std::vector<SFix> xs, bits, odd;
+    for(uint32_t i=0; i<N; i++)
+    {
+        xs.push_back(SFix(4, 60));
+        bits.push_back(SFix(1, 0));
+        odd.push_back(SFix(1, 2));
+        xs.back().randomizeValue(rng);
+        bits.back().randomizeValue(rng);
+        odd.back().randomizeValue(rng);
+        if ((i % 3) != 0)
+        {
+            // repeated values are not written again
+            xs.back() = xs[i - (i % 3)];
+        }
+    }
+
+    // through the writer thread
+    {
+        VcdWriter vcd("fplib_trace_test.vcd", "1ns", true);
+        uint32_t x = vcd.addSignal("x", 4, 60);
+        uint32_t b = vcd.addSignal("b", 1, 0);
+        for(uint32_t i=0; i<N; i++)
+        {
+            vcd.setTime(10*i);
+            vcd.change(x, xs[i]);
+            vcd.change(b, bits[i]);
+        }
+        vcd.close();
+    }
+
+    std::string expected = "$timescale 1ns $end\n$scope module fplib $end\n"
+                           "$var wire 64 ! x $end\n$var wire 1 \" b $end\n"
+                           "$upscope $end\n$enddefinitions $end\n";
+    for(uint32_t i=0; i<N; i++)
+    {
+        const bool newX = (i % 3) == 0;
+        const bool newB = (i == 0) || (bits[i] != bits[i-1]);
+        if (newX || newB)
+        {
+            expected += "#" + std::to_string(10*i) + "\n";
+        }
+        if (newX)
+        {
+            expected += "b" + xs[i].toBinString() + " !\n";
+        }
+        if (newB)
+        {
+            expected += bits[i].toBinString() + "\"\n";
+        }
+    }
+    if (readFile("fplib_trace_test.vcd") != expected)
+    {
+        printf("test 1\n");
+        printf("Error: VCD file is wrong\n");
+        return false;
+    }
+
+    {
+        HexWriter hex("fplib_trace_test.hex", 4, 60);
+        hex.write(&xs[0], N);
+        hex.close();
+        HexWriter hex3("fplib_trace_test3.hex", 1, 2, true);
+        hex3.write(&odd[0], N);
+        hex3.close();
+    }
+    std::string expectedHex, expectedHex3;
+    for(uint32_t i=0; i<N; i++)
+    {
+        expectedHex  += xs[i].toHexString() + "\n";
+        expectedHex3 += std::string(1, "01234567"[odd[i].getInternalValue(0) & 7]) + "\n";
+    }
+    if ((readFile("fplib_trace_test.hex") != expectedHex) ||
+        (readFile("fplib_trace_test3.hex") != expectedHex3))
+    {
+        printf("test 2\n");
+        printf("Error: hex file is wrong\n");
+        return false;
+    }
+    remove("fplib_trace_test.vcd");
+    remove("fplib_trace_test.hex");
+    remove("fplib_trace_test3.hex");
+
+    try
+    {
+        HexWriter hex("fplib_trace_test.hex", 4, 60);
+        hex.write(odd[0]);
+        printf("test 3\n");
+        printf("Error: value format was not checked\n");
+        return false;
+    }
+    catch(std::runtime_error &)
+    {
+    }
+    remove("fplib_trace_test.hex");
+
+    // tiny buffers make the writer thread swap often;
+    // a reservation larger than the buffer grows it.
+    std::string text;
+    {
+        BufferedWriter out("fplib_trace_test.txt", 64, true);
+        for(uint32_t i=0; i<20000; i++)
+        {
+            const std::string line = std::to_string(i) + "\n";
+            out.write(line);
+            text += line;
+        }
+        char *p = out.reserve(1000);
+        memset(p, 'x', 1000);
+        out.commit(1000);
+        text += std::string(1000, 'x');
+    }
+    if (readFile("fplib_trace_test.txt") != text)
+    {
+        printf("test 4\n");
+        printf("Error: buffered file is wrong\n");
+        return false;
+    }
+    remove("fplib_trace_test.txt");
+    return true;
+}
+
+bool testBinaryTrace()
+{
+    // a slowly changing signal, noise and a wide format
+    Random rng(49);
+    const uint32_t N = 10000;
+    std::vector<SFix> slow, noise, wide, odd;
+    SFix step(-6, 15);
+    for(uint32_t i=0; i<N; i++)
+    {
+        step.randomizeValue(rng);
+        slow.push_back((i == 0) ? SFix(8, 15) : (slow.back() + step).removeMSBs(1));
+        noise.push_back(SFix(3, 20));
+        wide.push_back(SFix(40, 60));
+        odd.push_back(SFix(1, 2));
+        noise.back().randomizeValue(rng);
+        wide.back().randomizeValue(rng);
+        odd.back().randomizeValue(rng);
+    }
+
+    const char *names[] = {"fplib_slow.fpt", "fplib_noise.fpt", "fplib_wide.fpt", "fplib_odd.fpt"};
+    std::vector<SFix>* data[] = {&slow, &noise, &wide, &odd};
+    for(uint32_t k=0; k<4; k++)
+    {
+        BinaryTraceWriter w(names[k], (*data[k])[0].intBits(), (*data[k])[0].fracBits(), 1000, k == 2);
+        w.write(data[k]->data(), N);
+        w.close();
+    }
+
+    // slowly changing values need about two bytes
+    const size_t slowBytes = readFile(names[0]).size();
+    if (slowBytes > 2*N + 1000)
+    {
+        printf("test 1\n");
+        printf("Error: slow trace has %d bytes\n", (int)slowBytes);
+        return false;
+    }
+    // noise is packed to the exact width
+    const size_t noiseBytes = readFile(names[1]).size();
+    if (noiseBytes > (23*N)/8 + 1000)
+    {
+        printf("test 2\n");
+        printf("Error: noise trace has %d bytes\n", (int)noiseBytes);
+        return false;
+    }
+
+    for(uint32_t k=0; k<4; k++)
+    {
+        const std::vector<SFix> &ref = *data[k];
+        BinaryTraceReader r(names[k]);
+        std::vector<SFix> got(N + 10, SFix(r.intBits(), r.fracBits()));
+        if ((r.samples() != N) || (r.read(got.data(), got.size()) != N))
+        {
+            printf("test 3\n");
+            printf("Error: trace %d has the wrong number of samples\n", k);
+            return false;
+        }
+        for(uint32_t i=0; i<N; i++)
+        {
+            if (got[i] != ref[i])
+            {
+                printf("test 4\n");
+                printf("Error: sample %d of trace %d is wrong\n", i, k);
+                return false;
+            }
+        }
+
+        // random access
+        for(uint32_t j=0; j<50; j++)
+        {
+            const uint32_t idx = rng.nextBelow(N);
+            r.seek(idx);
+            if (!r.read(got[0]) || (got[0] != ref[idx]) || (r.position() != idx+1))
+            {
+                printf("test 5\n");
+                printf("Error: sample %d of trace %d is wrong after a seek\n", idx, k);
+                return false;
+            }
+        }
+    }
+
+    // cut the trailer, the index of the 10 chunks and the
+    // end of the last chunk; the index is rebuilt.
+    std::string contents = readFile(names[2]);
+    contents.resize(contents.size() - 32 - 16*10 - 5);
+    FILE *f = fopen(names[2], "wb");
+    fwrite(contents.data(), 1, contents.size(), f);
+    fclose(f);
+    {
+        BinaryTraceReader r(names[2]);
+        SFix v(40, 60);
+        r.seek(8500);
+        if ((r.samples() != 9000) || !r.read(v) || (v != wide[8500]))
+        {
+            printf("test 6\n");
+            printf("Error: truncated trace has %d samples\n", (int)r.samples());
+            return false;
+        }
+    }
+
+    for(uint32_t k=0; k<4; k++)
+    {
+        remove(names[k]);
+    }
+
+    try
+    {
+        BinaryTraceWriter w("fplib_bad.fpt", 1, 15);
+        w.write(SFix(2, 15));
+        printf("test 7\n");
+        printf("Error: value format was not checked\n");
+        return false;
+    }
+    catch(std::runtime_error &)
+    {
+    }
+    remove("fplib_bad.fpt");
+    return true;
+}
+
+bool testVectorCompare()
+{
+    // Q(3,37) values in several blocks, as hex and binary
+    Random rng(50);
+    const uint32_t N = 200000;
+    std::vector<SFix> ref, dut;
+    SFix lsb(3, 37);
+    lsb.setInternalValue(0, 1);
+    for(uint32_t i=0; i<N; i++)
+    {
+        ref.push_back(SFix(3, 37));
+        ref.back().randomizeValue(rng);
+        dut.push_back(ref.back());
+        if ((i % 1000) == 7)
+        {
+            // off by one LSB
+            dut.back() = ((i % 2) ? (dut.back() + lsb) : (dut.back() - lsb)).removeMSBs(1);
+        }
+    }
+    const uint32_t bad[] = {5, 70000, 199999};
+    for(auto i : bad)
+    {
+        dut[i].setInternalValue(0, dut[i].getInternalValue(0) ^ 0x100);
+    }
+
+    {
+        HexWriter hex("fplib_ref.hex", 3, 37);
+        hex.write(&ref[0], N);
+    }
+    FILE *f = fopen("fplib_dut.bin", "wb");
+    for(auto const& v : dut)
+    {
+        uint8_t bytes[5];
+        for(uint32_t k=0; k<5; k++)
+        {
+            bytes[k] = static_cast<uint8_t>(v.getInternalValue(k/4) >> (8*(k%4)));
+        }
+        fwrite(bytes, 1, 5, f);
+    }
+    fclose(f);
+
+    CompareOptions opt(3, 37);
+    opt.threads = 4;
+    CompareResult r = compareVectorFiles("fplib_ref.hex", "fplib_dut.bin", opt);
+    if ((r.countA != N) || (r.countB != N) || (r.mismatches != 200 + 3) ||
+        (r.first.size() != 10) || (r.first[0].index != 5) || (r.first[1].index != 7) ||
+        (r.first[0].a != ref[5]) || (r.first[0].b != dut[5]) || (r.first[1].b != dut[7]))
+    {
+        printf("test 1\n");
+        printf("Error: exact comparison found %d mismatches\n", (int)r.mismatches);
+        return false;
+    }
+
+    opt.tolerance = 1;
+    opt.maxReported = 5;
+    r = compareVectorFiles("fplib_ref.hex", "fplib_dut.bin", opt);
+    if ((r.mismatches != 3) || (r.first.size() != 3) || (r.first[1].index != 70000) ||
+        (r.first[2].b != dut[199999]))
+    {
+        printf("test 2\n");
+        printf("Error: comparison with tolerance found %d mismatches\n", (int)r.mismatches);
+        return false;
+    }
+
+    // comments, underscores and short values in hex files
+    f = fopen("fplib_short.hex", "wb");
+    fprintf(f, "// header\n1\nfff_ffff_ffff // minus one\n\n  8000000000\n");
+    fclose(f);
+    f = fopen("fplib_short.bin", "wb");
+    const uint8_t values[] = {1,0,0,0,0, 0xff,0xff,0xff,0xff,0xff, 0,0,0,0,0x80};
+    fwrite(values, 1, sizeof(values), f);
+    fclose(f);
+    opt.tolerance = 0;
+    r = compareVectorFiles("fplib_short.hex", "fplib_short.bin", opt);
+    if (!r.equal() || (r.countA != 3))
+    {
+        printf("test 3\n");
+        printf("Error: hex parsing failed, %d values\n", (int)r.countA);
+        return false;
+    }
+
+    try
+    {
+        opt.intBits = 4;
+        compareVectorFiles("fplib_short.hex", "fplib_short.bin", opt);
+        printf("test 4\n");
+        printf("Error: binary size was not checked\n");
+        return false;
+    }
+    catch(std::runtime_error &)
+    {
+    }
+
+    remove("fplib_ref.hex");
+    remove("fplib_dut.bin");
+    remove("fplib_short.hex");
+    remove("fplib_short.bin");
+    return true;
+}
+
+bool testReference128()
+{
+#ifdef FPLIB_HAVE_INT128
+    // compare SFix against the 128-bit reference
+    // for random numbers of up to 60 bits.
+    Random rng(42);
+    for(uint32_t i=0; i<1000; i++)
+    {
+        SFix a(1+rng.nextBelow(30), rng.nextBelow(30));
+        SFix b(1+rng.nextBelow(30), rng.nextBelow(30));
+        a.randomizeValue(rng);
+        b.randomizeValue(rng);
+
+        SFixRef128 ra(a.intBits(), a.fracBits());
+        SFixRef128 rb(b.intBits(), b.fracBits());
+        ra.fromBinString(a.toBinString());
+        rb.fromBinString(b.toBinString());
+
+        if (((a+b).toBinString() != (ra+rb).toBinString()) ||
+            ((a-b).toBinString() != (ra-rb).toBinString()) ||
+            ((a*b).toBinString() != (ra*rb).toBinString()))
+        {
+            printf("test 1\n");
+            printf("Error: SFix and SFixRef128 differ for a=%s b=%s\n",
+                   a.toBinString().c_str(), b.toBinString().c_str());
+            return false;
+        }
+    }
+#endif
+    return true;
+}
+
+bool testInstrumentation()
+{
+    if (!instrument::isEnabled())
+    {
+        return true;
+    }
+
+    instrument::reset();
+    SFix a(10,54);
+    SFix b(10,54);
+    a.randomizeValue();
+    b.randomizeValue();
+    for(uint32_t i=0; i<3; i++)
+    {
+        SFix c = a + b;
+    }
+    SFix d = a * b;
+
+    // Q(11,54) is 65 bits -> bucket <= 128 bits.
+    const instrument::Report r = instrument::getReport();
+    const instrument::Counters &add = r.counters[instrument::OP_ADD][instrument::widthBucket(65)];
+    if ((add.calls != 3) || (add.words != 9) || (add.allocations != 3))
+    {
+        printf("test 1\n");
+        printf("Error: got %d calls %d words %d allocations, wanted 3, 9, 3\n",
+               (int)add.calls, (int)add.words, (int)add.allocations);
+        return false;
+    }
+
+    const instrument::Counters &mul = r.counters[instrument::OP_MUL][instrument::widthBucket(127)];
+    if (mul.calls != 1)
+    {
+        printf("test 2\n");
+        printf("Error: got %d multiplications, wanted 1\n", (int)mul.calls);
+        return false;
+    }
+
+    instrument::dump(stdout);
+    return true;
+}
+
+void oneDivXTest()
+{
+    // iterate using:
+    //
+    // x = x*(2-b*x)
+    //
+    // where 1/b is the desired quotient.
+    // Note that the starting x _must_ be
+    // larger than 1 and that b*x
+    // must be smaller than x
+
+    SFix b(8,0);
+    b.setInternalValue(0,14);   // 14.0
+
+    const uint32_t intbits = 8;
+    const uint32_t precision = 256;
+
+    printf("\n");
+    printf("------------------------------------------------\n");
+    printf(" Calculate 1/%d using an iterative method\n", 14);
+    printf("------------------------------------------------\n");
+
+    SFix x(intbits,precision);
+    x.setInternalValue((precision/32)-1,0x000010000);    // ?
+    for(uint32_t i=0; i<30; i++)
+    {
+        //x = x*(two-b*x);
+        x = x.reinterpret(x.intBits()+1, x.fracBits()-1) - x*x*b;
+
+        //std::string s = x.toHexString();
+        //printf("x1 -> %s\n", s.c_str());
+        x = x.removeMSBs(x.intBits()-intbits);
+
+        //s = x.toHexString();
+        //printf("x2 -> %s\n", s.c_str());
+        x = x.removeLSBs(x.fracBits()-precision);
+
+        std::string s = x.toHexString();
+        printf("x -> %s\n", s.c_str());
+    }
+
+    printf("result = 0.");
+    displayNumber(x);
+}
+
+void bisectionSqrt()
+{
+    //
+    // calculate sqrt(rootOf) using the
+    // bisection method.
+    // https://en.wikipedia.org/wiki/Bisection_method
+    //
+
+    const uint32_t fbits = 2048;
+    SFix l(8,fbits);   // left point of the interval
+    SFix r(8,fbits);   // right point of the interval
+    SFix c(8,0);    // root to be found
+
+    uint32_t rootOf = 2;
+    r.setInternalValue(fbits/32,rootOf);
+    c.setInternalValue(0,rootOf);
+
+    for(uint32_t i=0; i<fbits; i++)
+    {
+        // create a new middle point
+        SFix m = r+l;
+        m = m.reinterpret(m.intBits()-1, m.fracBits()+1);   // divide by two
+        m = m.removeLSBs(m.fracBits()-fbits);
+
+        if ((m*m) < c)
+        {
+            // if m is negative, m is below the root
+            // so we can move the left point to m
+            l = m;
+        }
+        else
+        {
+            // if m is negative, m is above the root
+            // so we can move the right point to m
+            r = m;
+        }
+    }
+    std::string s1 = l.toHexString();
+    std::string s2 = r.toHexString();
+
+    printf("\n");
+    printf("------------------------------------------------\n");
+    printf(" Square root calculation using bisection method\n");
+    printf("------------------------------------------------\n\n");
+    //printf("Sqrt(%d):\n", rootOf);
+    //printf("l -> %s / 2^%d\n", s1.c_str(), fbits);
+    //printf("r -> %s / 2^%d\n", s2.c_str(), fbits);
+
+    printf("Sqrt(2) is approximately 1.");
+    displayNumber(l);
+}
+
+int main()
+{
+    printf("------------------------------------------------\n");
+    printf(" Slow reference library tests\n");
+    printf("------------------------------------------------\n\n");
+    if (tests::doTests())
+    {
+        printf("Reference tests passed\n");
+    }
+    else
+    {
+        printf("Reference tests failed\n");
+    }
+
+    printf("\n\n------------------------------------------------\n");
+    printf(" Fast 32-bit library tests\n");
+    printf("------------------------------------------------\n\n");
+
+    if (testAdd())
+    {
+        printf("Add test passed\n");
+    }
+    else
+    {
+        printf("Add test failed\n");
+    }
+
+    if (testSubtract())
+    {
+        printf("Subtract test passed\n");
+    }
+    else
+    {
+        printf("Subtract test failed\n");
+    }
+
+    if (testMul())
+    {
+        printf("Mul test passed\n");
+    }
+    else
+    {
+        printf("Mul test failed\n");
+    }
+
+    if (testExtend())
+    {
+        printf("Extend test passed\n");
+    }
+    else
+    {
+        printf("Extend test failed\n");
+    }
+
+    if (testRemove())
+    {
+        printf("Remove test passed\n");
+    }
+    else
+    {
+        printf("Remove test failed\n");
+    }
+
+    if (powerCheck())
+    {
+        printf("powerCheck test passed\n");
+    }
+    else
+    {
+        printf("powerCheck test failed\n");
+    }
+
+    if (checkMinimumIntegerBits())
+    {
+        printf("checkMinimumIntegerBits test passed\n");
+    }
+    else
+    {
+        printf("checkMinimumIntegerBits test failed\n");
+    }
+
+    if (testExpressions())
+    {
+        printf("Expression test passed\n");
+    }
+    else
+    {
+        printf("Expression test failed\n");
+    }
+
+    if (testRangeAnalysis())
+    {
+        printf("Range analysis test passed\n");
+    }
+    else
+    {
+        printf("Range analysis test failed\n");
+    }
+
+    if (testRandom())
+    {
+        printf("Random test passed\n");
+    }
+    else
+    {
+        printf("Random test failed\n");
+    }
+
+    if (testCompare())
+    {
+        printf("Compare test passed\n");
+    }
+    else
+    {
+        printf("Compare test failed\n");
+    }
+
+    if (testConversion())
+    {
+        printf("Conversion test passed\n");
+    }
+    else
+    {
+        printf("Conversion test failed\n");
+    }
+
+    if (testMemo())
+    {
+        printf("Memo test passed\n");
+    }
+    else
+    {
+        printf("Memo test failed\n");
+    }
+
+    if (testConstants())
+    {
+        printf("Constants test passed\n");
+    }
+    else
+    {
+        printf("Constants test failed\n");
+    }
+
+    if (testCordic())
+    {
+        printf("Cordic test passed\n");
+    }
+    else
+    {
+        printf("Cordic test failed\n");
+    }
+
+    if (testMath())
+    {
+        printf("Math test passed\n");
+    }
+    else
+    {
+        printf("Math test failed\n");
+    }
+
+    if (testPolynomial())
+    {
+        printf("Polynomial test passed\n");
+    }
+    else
+    {
+        printf("Polynomial test failed\n");
+    }
+
+    if (testAccumulator())
+    {
+        printf("Accumulator test passed\n");
+    }
+    else
+    {
+        printf("Accumulator test failed\n");
+    }
+
+    if (testComplex())
+    {
+        printf("Complex test passed\n");
+    }
+    else
+    {
+        printf("Complex test failed\n");
+    }
+
+    if (testAllocator())
+    {
+        printf("Allocator test passed\n");
+    }
+    else
+    {
+        printf("Allocator test failed\n");
+    }
+
+    if (testThreads())
+    {
+        printf("Threads test passed\n");
+    }
+    else
+    {
+        printf("Threads test failed\n");
+    }
+
+    if (testGraph())
+    {
+        printf("Graph test passed\n");
+    }
+    else
+    {
+        printf("Graph test failed\n");
+    }
+
+    if (testSimulator())
+    {
+        printf("Simulator test passed\n");
+    }
+    else
+    {
+        printf("Simulator test failed\n");
+    }
+
+    if (testTrace())
+    {
+        printf("Trace test passed\n");
+    }
+    else
+    {
+        printf("Trace test failed\n");
+    }
+
+    if (testBinaryTrace())
+    {
+        printf("Binary trace test passed\n");
+    }
+    else
+    {
+        printf("Binary trace test failed\n");
+    }
+
+    if (testVectorCompare())
+    {
+        printf("Vector compare test passed\n");
+    }
+    else
+    {
+        printf("Vector compare test failed\n");
+    }
+
+    if (testReference128())
+    {
+        printf("Reference128 test passed\n");
+    }
+    else
+    {
+        printf("Reference128 test failed\n");
+    }
+
+    if (testInstrumentation())
+    {
+        printf("Instrumentation test passed\n");
+    }
+    else
+    {
+        printf("Instrumentation test failed\n");
     }
 
     oneDivXTest();
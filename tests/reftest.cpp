@@ -1,4 +1,5 @@
 
+#include <stdio.h>
 #include "reftest.h"
 #include "../src/fpreference.h"
 
@@ -5,10 +5,52 @@ CONFIG -= qt
 
 
 HEADERS += ../src/fplib.h \
+           ../src/fpaccumulator.h \
+           ../src/fpalloc.h \
+           ../src/fpbintrace.h \
+           ../src/fpcompare.h \
+           ../src/fpcomplex.h \
+           ../src/fpconstants.h \
+           ../src/fpconvert.h \
+           ../src/fpcordic.h \
+           ../src/fpexpr.h \
+           ../src/fpgraph.h \
+           ../src/fpinstrument.h \
+           ../src/fpinternal.h \
+           ../src/fpmath.h \
+           ../src/fpmemo.h \
+           ../src/fppolynomial.h \
+           ../src/fprange.h \
+           ../src/fprandom.h \
            ../src/fpreference.h \
+           ../src/fpreference128.h \
+           ../src/fpsim.h \
+           ../src/fpthreads.h \
+           ../src/fptrace.h \
            reftest.h
 
 SOURCES += main.cpp \
            reftest.cpp \
            ../src/fplib.cpp \
-           ../src/fpreference.cpp
+           ../src/fpaccumulator.cpp \
+           ../src/fpalloc.cpp \
+           ../src/fpbintrace.cpp \
+           ../src/fpcompare.cpp \
+           ../src/fpcomplex.cpp \
+           ../src/fpconstants.cpp \
+           ../src/fpconvert.cpp \
+           ../src/fpcordic.cpp \
+           ../src/fpexpr.cpp \
+           ../src/fpgraph.cpp \
+           ../src/fpinstrument.cpp \
+           ../src/fpinternal.cpp \
+           ../src/fpmath.cpp \
+           ../src/fpmemo.cpp \
+           ../src/fppolynomial.cpp \
+           ../src/fprange.cpp \
+           ../src/fprandom.cpp \
+           ../src/fpreference.cpp \
+           ../src/fpreference128.cpp \
+           ../src/fpsim.cpp \
+           ../src/fpthreads.cpp \
+           ../src/fptrace.cpp
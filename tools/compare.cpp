@@ -0,0 +1,127 @@
+/*
+
+    FPLIB: a library providing a fixed-point datatype.
+
+    fplib_compare: compare two golden-vector files of a
+    declared Q format, see src/fpcompare.h.
+
+    usage: fplib_compare -q intBits,fracBits [-t lsbs] [-n count]
+                         [-j threads] [-f auto|hex|bin] fileA fileB
+
+    The exit code is 0 when the files match, 1 when they
+    differ and 2 on errors.
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#include <stdexcept>
+#include "../src/fplib.h"
+#include "../src/fpcompare.h"
+#include "../src/fpconvert.h"
+
+using namespace fplib;
+
+static void usage(const char *name)
+{
+    printf("usage: %s -q intBits,fracBits [-t lsbs] [-n count] [-j threads] [-f auto|hex|bin] fileA fileB\n", name);
+}
+
+int main(int argc, char *argv[])
+{
+    const char *files[2] = {nullptr, nullptr};
+    uint32_t nfiles = 0;
+    bool haveFormat = false;
+    CompareOptions opt(0, 0);
+
+    for(int i=1; i<argc; i++)
+    {
+        if ((strcmp(argv[i], "-q") == 0) && (i+1 < argc))
+        {
+            haveFormat = (sscanf(argv[++i], "%d,%d", &opt.intBits, &opt.fracBits) == 2);
+        }
+        else if ((strcmp(argv[i], "-t") == 0) && (i+1 < argc))
+        {
+            opt.tolerance = strtoull(argv[++i], nullptr, 10);
+        }
+        else if ((strcmp(argv[i], "-n") == 0) && (i+1 < argc))
+        {
+            opt.maxReported = strtoul(argv[++i], nullptr, 10);
+        }
+        else if ((strcmp(argv[i], "-j") == 0) && (i+1 < argc))
+        {
+            opt.threads = atoi(argv[++i]);
+        }
+        else if ((strcmp(argv[i], "-f") == 0) && (i+1 < argc))
+        {
+            const char *type = argv[++i];
+            if (strcmp(type, "hex") == 0)
+            {
+                opt.typeA = opt.typeB = VectorFileType::Hex;
+            }
+            else if (strcmp(type, "bin") == 0)
+            {
+                opt.typeA = opt.typeB = VectorFileType::Binary;
+            }
+            else if (strcmp(type, "auto") != 0)
+            {
+                usage(argv[0]);
+                return 2;
+            }
+        }
+        else if ((argv[i][0] != '-') && (nfiles < 2))
+        {
+            files[nfiles++] = argv[i];
+        }
+        else
+        {
+            usage(argv[0]);
+            return 2;
+        }
+    }
+
+    if (!haveFormat || (nfiles != 2))
+    {
+        usage(argv[0]);
+        return 2;
+    }
+
+    CompareResult r;
+    try
+    {
+        r = compareVectorFiles(files[0], files[1], opt);
+    }
+    catch(std::runtime_error &e)
+    {
+        printf("Error: %s\n", e.what());
+        return 2;
+    }
+
+    printf("%s: %llu values\n", files[0], (unsigned long long)r.countA);
+    printf("%s: %llu values\n", files[1], (unsigned long long)r.countB);
+    printf("format Q(%d,%d), tolerance %llu LSB\n\n", opt.intBits, opt.fracBits,
+           (unsigned long long)opt.tolerance);
+
+    if (!r.first.empty())
+    {
+        printf("%12s %24s %24s %16s\n", "index", "a", "b", "a-b (LSB)");
+    }
+    for(auto const& m : r.first)
+    {
+        const double diff = ldexp(toDouble(m.a - m.b), opt.fracBits);
+        printf("%12llu %24.12g %24.12g %16.0f\n", (unsigned long long)m.index,
+               toDouble(m.a), toDouble(m.b), diff);
+        printf("%12s %24s %24s\n", "", m.a.toHexString().c_str(), m.b.toHexString().c_str());
+    }
+
+    if (r.countA != r.countB)
+    {
+        printf("the files have a different number of values\n");
+    }
+    printf("%llu mismatches in %llu values\n", (unsigned long long)r.mismatches,
+           (unsigned long long)std::min(r.countA, r.countB));
+    return r.equal() ? 0 : 1;
+}